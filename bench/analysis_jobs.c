@@ -0,0 +1,232 @@
+#include "analysis_jobs.h"
+#include "bench.h"
+
+#include <analysis/analysis.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/*
+ * Feeds CHARTS charts from PRODUCERS threads through the analysis
+ * scheduler with a plugin run with run, one with on_candle and one with
+ * run_batch, the libraries cmake puts in analysis/ next to the binary.
+ * It checks every plugin saw every candle of every chart once and in
+ * order, never on two threads at once, that a batch only held candles
+ * of the same time and interval and that every state was freed. Run it
+ * from its build directory, build with -fsanitize=thread to look for
+ * races as well.
+ *
+ *   bench_analysis_jobs [CHARTS] [ENDS] [PRODUCERS]
+ */
+
+/*
+ * The interval of the odd charts, the even ones are 5 times as long
+ */
+#define ANALYSIS_JOBS_INTERVAL 60000000000ULL
+
+/*
+ * The most producer threads
+ */
+#define ANALYSIS_JOBS_MAX_PRODUCERS 64
+
+/*
+ * What the plugins saw of a chart
+ * @param {atomic_int[]} busy The threads in each plugin with the chart
+ * @param {size_t[]} last The last candle each plugin saw
+ * @param {atomic_size_t[]} runs The candles each plugin saw
+ * @param {size_t} ends The candles the chart finalizes
+ */
+struct analysis_jobs_chart {
+  atomic_int busy[ANALYSIS_JOBS_PLUGINS];
+  size_t last[ANALYSIS_JOBS_PLUGINS];
+  atomic_size_t runs[ANALYSIS_JOBS_PLUGINS];
+  size_t ends;
+};
+
+static struct chart **charts = NULL;
+static char **names = NULL;
+static struct analysis_jobs_chart *seen = NULL;
+static size_t num_charts = 0;
+static size_t num_ends = 0;
+static size_t num_producers = 0;
+
+static atomic_long overlaps = 0;
+static atomic_long out_of_order = 0;
+static atomic_long wrong_state = 0;
+static atomic_long mixed = 0;
+static atomic_long batch_calls = 0;
+static atomic_long batch_max = 0;
+static atomic_long states = 0;
+
+/*
+ * The index of a chart, its name is C followed by it
+ */
+static size_t analysis_jobs_index(struct chart *cht) {
+  char *name = NULL;
+  TRACE_HAULT(chart_get_name(cht, &name));
+  return (size_t)strtoul(name + 1, NULL, 10);
+}
+
+void analysis_jobs_saw(enum ANALYSIS_JOBS_PLUGIN plugin, struct chart *cht,
+                       size_t idx, bool own_state) {
+  struct analysis_jobs_chart *s = &seen[analysis_jobs_index(cht)];
+
+  if (atomic_fetch_add(&s->busy[plugin], 1) != 0)
+    atomic_fetch_add(&overlaps, 1);
+  if (idx <= s->last[plugin])
+    atomic_fetch_add(&out_of_order, 1);
+  if (!own_state)
+    atomic_fetch_add(&wrong_state, 1);
+
+  s->last[plugin] = idx;
+  atomic_fetch_add(&s->runs[plugin], 1);
+  atomic_fetch_sub(&s->busy[plugin], 1);
+}
+
+void analysis_jobs_batch(struct chart **cs, size_t *idx, size_t n) {
+  atomic_fetch_add(&batch_calls, 1);
+  long max = atomic_load(&batch_max);
+  while ((long)n > max &&
+         !atomic_compare_exchange_weak(&batch_max, &max, (long)n))
+    ;
+
+  uint64_t interval = 0;
+  uint64_t start = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t iv = 0;
+    struct chart_span span;
+    TRACE_HAULT(chart_get_interval(cs[i], &iv));
+    TRACE_HAULT(chart_span(cs[i], idx[i] - 1, idx[i] - 1, &span));
+    if (i == 0) {
+      interval = iv;
+      start = span.start;
+    } else if (iv != interval || span.start != start) {
+      atomic_fetch_add(&mixed, 1);
+    }
+    analysis_jobs_saw(ANALYSIS_JOBS_BATCH, cs[i], idx[i], true);
+  }
+}
+
+void analysis_jobs_state(int change) { atomic_fetch_add(&states, change); }
+
+/*
+ * Updates every chart of a producer once a minute, at a different second
+ * for every chart
+ */
+static void *analysis_jobs_produce(void *usr) {
+  size_t p = (size_t)usr;
+  uint64_t begin = 1000 * ANALYSIS_JOBS_INTERVAL;
+
+  for (size_t e = 0; e <= num_ends; ++e) {
+    for (size_t k = p; k < num_charts; k += num_producers) {
+      uint64_t ts =
+          begin + e * ANALYSIS_JOBS_INTERVAL + (k % 7) * 1000000000ULL;
+      int64_t price = 100 + (int64_t)((e * 7 + k) % 13);
+      TRACE_HAULT(chart_update(charts[k], price, price - 1, price + 1, ts));
+    }
+  }
+  return NULL;
+}
+
+/*
+ * True once every plugin saw every candle
+ */
+static bool analysis_jobs_done(void) {
+  for (size_t k = 0; k < num_charts; ++k) {
+    for (size_t p = 0; p < ANALYSIS_JOBS_PLUGINS; ++p) {
+      if (atomic_load(&seen[k].runs[p]) < seen[k].ends)
+        return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  num_charts = bench_arg(argc, argv, 1, 256);
+  num_ends = bench_arg(argc, argv, 2, 400);
+  num_producers = bench_arg(argc, argv, 3, 4);
+  if (num_producers > ANALYSIS_JOBS_MAX_PRODUCERS) {
+    printf("at most %d producers\n", ANALYSIS_JOBS_MAX_PRODUCERS);
+    return 1;
+  }
+
+  TRACE_HAULT(analysis_init());
+
+  // a chart keeps the name it was made with
+  charts = calloc(num_charts, sizeof(struct chart *));
+  names = calloc(num_charts, sizeof(char *));
+  seen = calloc(num_charts, sizeof(struct analysis_jobs_chart));
+  if (!charts || !names || !seen) {
+    printf("%s", "out of memory\n");
+    return 1;
+  }
+
+  size_t total = 0;
+  for (size_t k = 0; k < num_charts; ++k) {
+    names[k] = malloc(32);
+    if (!names[k]) {
+      printf("%s", "out of memory\n");
+      return 1;
+    }
+    snprintf(names[k], 32, "C%zu", k);
+    uint64_t interval = ANALYSIS_JOBS_INTERVAL * (k % 2 ? 1 : 5);
+    TRACE_HAULT(chart_new(interval, names[k], 2, &charts[k]));
+    seen[k].ends = k % 2 ? num_ends : num_ends / 5;
+    total += seen[k].ends;
+  }
+
+  pthread_t producers[ANALYSIS_JOBS_MAX_PRODUCERS];
+  double begin = bench_now();
+  for (size_t p = 0; p < num_producers; ++p)
+    pthread_create(&producers[p], NULL, analysis_jobs_produce, (void *)p);
+  for (size_t p = 0; p < num_producers; ++p)
+    pthread_join(producers[p], NULL);
+
+  // a candle that was dropped never comes, stop waiting after a while
+  size_t depth = 0;
+  size_t dropped = 0;
+  for (size_t w = 0; w < 60000 && !analysis_jobs_done(); ++w)
+    usleep(1000);
+  double elapsed = bench_now() - begin;
+  TRACE_HAULT(analysis_get_stats(&depth, &dropped));
+
+  size_t runs[ANALYSIS_JOBS_PLUGINS] = {0};
+  for (size_t k = 0; k < num_charts; ++k) {
+    for (size_t p = 0; p < ANALYSIS_JOBS_PLUGINS; ++p)
+      runs[p] += atomic_load(&seen[k].runs[p]);
+  }
+
+  TRACE_HAULT(analysis_cleanup());
+  for (size_t k = 0; k < num_charts; ++k) {
+    TRACE_HAULT(chart_free(&charts[k]));
+    free(names[k]);
+  }
+
+  printf("%zu charts, %zu candles from %zu producers in %.3fs => %.0f "
+         "candles/s\n",
+         num_charts, total, num_producers, elapsed, (double)total / elapsed);
+  printf("run %zu, on_candle %zu, run_batch %zu of %zu candles, %zu "
+         "dropped\n",
+         runs[ANALYSIS_JOBS_RUN], runs[ANALYSIS_JOBS_STATE],
+         runs[ANALYSIS_JOBS_BATCH], total, dropped);
+  long calls = atomic_load(&batch_calls);
+  printf("run_batch %ld calls, %.1f charts a call, at most %ld\n", calls,
+         calls ? (double)runs[ANALYSIS_JOBS_BATCH] / (double)calls : 0.0,
+         atomic_load(&batch_max));
+  printf("%ld overlapping, %ld out of order, %ld with the wrong state, %ld "
+         "mixed batches, %ld states not freed\n",
+         atomic_load(&overlaps), atomic_load(&out_of_order),
+         atomic_load(&wrong_state), atomic_load(&mixed),
+         atomic_load(&states));
+
+  bool ok = atomic_load(&overlaps) == 0 && atomic_load(&out_of_order) == 0 &&
+            atomic_load(&wrong_state) == 0 && atomic_load(&mixed) == 0 &&
+            atomic_load(&states) == 0;
+  for (size_t p = 0; p < ANALYSIS_JOBS_PLUGINS; ++p)
+    ok = ok && runs[p] + dropped == total;
+
+  free(charts);
+  free(names);
+  free(seen);
+  return ok ? 0 : 1;
+}
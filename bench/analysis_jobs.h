@@ -0,0 +1,46 @@
+#ifndef ANALYSIS_JOBS_
+#define ANALYSIS_JOBS_
+
+#include <chart/chart.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * The ways the plugins of bench_analysis_jobs are run
+ */
+enum ANALYSIS_JOBS_PLUGIN {
+  ANALYSIS_JOBS_RUN = 0,
+  ANALYSIS_JOBS_STATE = 1,
+  ANALYSIS_JOBS_BATCH = 2,
+  ANALYSIS_JOBS_PLUGINS = 3
+};
+
+/*
+ * Called by a plugin for every candle it is given, checks that no other
+ * thread is in the same plugin with the chart and that idx only grows
+ * @param {enum ANALYSIS_JOBS_PLUGIN} plugin The plugin
+ * @param {struct chart*} cht The chart
+ * @param {size_t} idx The candle
+ * @param {bool} own_state False if the state given was made for another
+ * chart
+ */
+void analysis_jobs_saw(enum ANALYSIS_JOBS_PLUGIN plugin, struct chart *cht,
+                       size_t idx, bool own_state);
+
+/*
+ * Called by the batching plugin for every call, checks the charts of the
+ * call share their candle time and interval and calls analysis_jobs_saw
+ * for each
+ * @param {struct chart**} charts The charts
+ * @param {size_t*} idx The candle of each chart
+ * @param {size_t} n The number of charts
+ */
+void analysis_jobs_batch(struct chart **charts, size_t *idx, size_t n);
+
+/*
+ * Called by the stateful plugin when it makes or frees a state
+ * @param {int} change 1 for a state made, -1 for one freed
+ */
+void analysis_jobs_state(int change);
+
+#endif
@@ -0,0 +1,80 @@
+#include "analysis_jobs.h"
+
+#include <api.h>
+
+/*
+ * The plugin of bench_analysis_jobs, built once with each of
+ * ANALYSIS_JOBS_PLUGIN_RUN, ANALYSIS_JOBS_PLUGIN_STATE and
+ * ANALYSIS_JOBS_PLUGIN_BATCH defined. It does no analysis and hands every
+ * candle back to the benchmark.
+ */
+
+#if defined(ANALYSIS_JOBS_PLUGIN_STATE)
+#define ANALYSIS_JOBS_THIS ANALYSIS_JOBS_STATE
+#define ANALYSIS_JOBS_NAME "bench state"
+#elif defined(ANALYSIS_JOBS_PLUGIN_BATCH)
+#define ANALYSIS_JOBS_THIS ANALYSIS_JOBS_BATCH
+#define ANALYSIS_JOBS_NAME "bench batch"
+#else
+#define ANALYSIS_JOBS_THIS ANALYSIS_JOBS_RUN
+#define ANALYSIS_JOBS_NAME "bench run"
+#endif
+
+const char *get_name(void) { return ANALYSIS_JOBS_NAME; }
+
+const char *get_author(void) { return "bench"; }
+
+// a plugin with incremental_exports is never run, a call is reported as
+// one with the wrong state
+enum RISKI_ERROR_CODE run(struct chart *cht, size_t idx) {
+  analysis_jobs_saw(ANALYSIS_JOBS_THIS, cht, idx,
+                    ANALYSIS_JOBS_THIS == ANALYSIS_JOBS_RUN);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+struct vtable exports = {get_name, get_author, run};
+
+#if defined(ANALYSIS_JOBS_PLUGIN_STATE)
+/*
+ * The state of a chart, only remembers which chart it was made for
+ * @param {struct chart*} cht The chart
+ */
+struct analysis_jobs_plugin_state {
+  struct chart *cht;
+};
+
+static enum RISKI_ERROR_CODE init_state(struct chart *cht, void **state) {
+  struct analysis_jobs_plugin_state *st =
+      malloc(sizeof(struct analysis_jobs_plugin_state));
+  PTR_CHECK(st, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  st->cht = cht;
+  *state = st;
+  analysis_jobs_state(1);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE on_candle(struct chart *cht, void *state,
+                                       size_t idx) {
+  struct analysis_jobs_plugin_state *st =
+      (struct analysis_jobs_plugin_state *)state;
+  analysis_jobs_saw(ANALYSIS_JOBS_STATE, cht, idx, st && st->cht == cht);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static void free_state(void *state) {
+  free(state);
+  analysis_jobs_state(-1);
+}
+
+struct vtable_incremental incremental_exports = {
+    RISKI_PLUGIN_ABI_VERSION, {0}, init_state, on_candle, free_state, NULL};
+#elif defined(ANALYSIS_JOBS_PLUGIN_BATCH)
+static enum RISKI_ERROR_CODE run_batch(struct chart **charts, size_t *idx,
+                                       size_t n) {
+  analysis_jobs_batch(charts, idx, n);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+struct vtable_incremental incremental_exports = {
+    RISKI_PLUGIN_ABI_VERSION, {0}, NULL, NULL, NULL, run_batch};
+#endif
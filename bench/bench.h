@@ -0,0 +1,37 @@
+#ifndef BENCH_
+#define BENCH_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * The seconds on the monotonic clock, for timing a benchmark
+ * @return {double} The seconds since an unspecified point
+ */
+static inline double bench_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec / 1e9;
+}
+
+/*
+ * Reads an optional positive count from the command line
+ * @param {int} argc The number of arguments
+ * @param {char**} argv The arguments
+ * @param {int} i The index of the argument
+ * @param {size_t} def The count when the argument is not given
+ * @return {size_t} The count
+ */
+static inline size_t bench_arg(int argc, char **argv, int i, size_t def) {
+  if (i >= argc)
+    return def;
+  long n = atol(argv[i]);
+  if (n <= 0) {
+    printf("%s is not a positive count\n", argv[i]);
+    exit(1);
+  }
+  return (size_t)n;
+}
+
+#endif
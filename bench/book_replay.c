@@ -0,0 +1,210 @@
+#include "bench.h"
+
+#include <book/book.h>
+#include <iex/iex.h>
+#include <string.h>
+
+/*
+ * Replays the price level updates of a DEEP capture into one order book
+ * per symbol. The updates are read out of the capture first, so only
+ * book_update is timed, then book_update followed by book_best_bid and
+ * book_best_ask the way a security reads its quote after every update.
+ *
+ *   bench_book_replay FILE [RUNS]
+ */
+
+/*
+ * The most symbols a capture can have, a power of two
+ */
+#define BOOK_REPLAY_MAX_SYMBOLS 32768
+
+/*
+ * A price level update read out of the capture
+ * @param {int64_t} price The price of the level
+ * @param {int64_t} size The size of the level, 0 removes it
+ * @param {uint32_t} book The index of the book of the symbol
+ * @param {bool} side BUY_SIDE or SELL_SIDE
+ */
+struct book_replay_update {
+  int64_t price;
+  int64_t size;
+  uint32_t book;
+  bool side;
+
+  // 3 unused bytes in this structure
+  char _p1[3];
+};
+
+/*
+ * The updates of a capture and the symbols they belong to
+ * @param {struct book_replay_update*} updates The updates
+ * @param {size_t} num_updates The number of updates
+ * @param {size_t} cap_updates The number of updates allocated
+ * @param {uint64_t*} keys The 8 byte symbols, 0 for an empty slot
+ * @param {uint32_t*} books The book index of each slot of keys
+ * @param {size_t} num_books The number of symbols seen
+ */
+struct book_replay {
+  struct book_replay_update *updates;
+  size_t num_updates;
+  size_t cap_updates;
+  uint64_t keys[BOOK_REPLAY_MAX_SYMBOLS];
+  uint32_t books[BOOK_REPLAY_MAX_SYMBOLS];
+  size_t num_books;
+};
+
+/*
+ * The book index of a symbol, a new one the first time it is seen
+ */
+static enum RISKI_ERROR_CODE book_replay_book(struct book_replay *r,
+                                              const iex_byte_t *symbol,
+                                              uint32_t *book) {
+  uint64_t key = 0;
+  memcpy(&key, symbol, sizeof(key));
+
+  size_t slot = (size_t)(key * 0x9e3779b97f4a7c15ULL >> 49);
+  while (r->keys[slot] && r->keys[slot] != key)
+    slot = (slot + 1) % BOOK_REPLAY_MAX_SYMBOLS;
+
+  if (!r->keys[slot]) {
+    RANGE_CHECK(r->num_books, 0, BOOK_REPLAY_MAX_SYMBOLS - 1,
+                RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+    r->keys[slot] = key;
+    r->books[slot] = (uint32_t)r->num_books++;
+  }
+  *book = r->books[slot];
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+book_replay_datagram(const struct pcap_mmap_datagram *dg, void *usr) {
+  struct book_replay *r = (struct book_replay *)usr;
+  if (dg->len < sizeof(struct iex_tp_header))
+    return RISKI_ERROR_CODE_NONE;
+
+  const struct iex_tp_header *header =
+      (const struct iex_tp_header *)dg->payload;
+  if (header->message_protocol_id != 0x8004)
+    return RISKI_ERROR_CODE_NONE;
+
+  const unsigned char *data = dg->payload + sizeof(struct iex_tp_header);
+  size_t left = dg->len - sizeof(struct iex_tp_header);
+  if (header->payload_length < left)
+    left = header->payload_length;
+
+  for (iex_short_t i = 0; i < header->message_count; ++i) {
+    if (left < sizeof(struct iex_tp_message_block_header))
+      break;
+    const struct iex_tp_message_block_header *message_header =
+        (const struct iex_tp_message_block_header *)data;
+    size_t block_len =
+        sizeof(message_header->message_length) + message_header->message_length;
+    if (block_len > left)
+      break;
+
+    bool buy = message_header->message_type == PRICE_LEVEL_UPDATE_BUY_MESSAGE;
+    bool sell =
+        message_header->message_type == PRICE_LEVEL_UPDATE_SELL_MESSAGE;
+    if ((buy || sell) &&
+        block_len >= sizeof(struct iex_tp_message_block_header) +
+                         sizeof(struct iex_price_level_update_message)) {
+      const struct iex_price_level_update_message *plu =
+          (const struct iex_price_level_update_message
+               *)(data + sizeof(struct iex_tp_message_block_header));
+
+      if (r->num_updates == r->cap_updates) {
+        size_t cap = r->cap_updates ? r->cap_updates * 2 : 1 << 16;
+        struct book_replay_update *updates =
+            realloc(r->updates, cap * sizeof(struct book_replay_update));
+        PTR_CHECK(updates, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+        r->updates = updates;
+        r->cap_updates = cap;
+      }
+
+      struct book_replay_update *u = &r->updates[r->num_updates++];
+      TRACE(book_replay_book(r, plu->symbol, &u->book));
+      u->price = plu->price;
+      u->size = plu->size;
+      u->side = buy ? BUY_SIDE : SELL_SIDE;
+    }
+
+    data += block_len;
+    left -= block_len;
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Applies every update to fresh books and prints the time taken
+ */
+static void book_replay_run(struct book_replay *r, size_t run, bool quote) {
+  struct book **books = malloc(r->num_books * sizeof(struct book *));
+  if (!books) {
+    printf("%s", "out of memory\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < r->num_books; ++i)
+    books[i] = book_new();
+
+  int64_t sum = 0;
+  double begin = bench_now();
+  for (size_t i = 0; i < r->num_updates; ++i) {
+    const struct book_replay_update *u = &r->updates[i];
+    book_update(u->side, books[u->book], u->price, u->size);
+
+    if (quote) {
+      int64_t price = 0;
+      int64_t quantity = 0;
+      if (book_best_bid(books[u->book], &price, &quantity))
+        sum += price;
+      if (book_best_ask(books[u->book], &price, &quantity))
+        sum += price;
+    }
+  }
+  double elapsed = bench_now() - begin;
+  if (elapsed <= 0)
+    elapsed = 1e-9;
+
+  printf("%-12s run %zu: %zu updates %zu books in %.3fs => %.0f updates/s "
+         "%.1f ns/update (%lld)\n",
+         quote ? "update+quote" : "update", run, r->num_updates,
+         r->num_books, elapsed, (double)r->num_updates / elapsed,
+         elapsed * 1e9 / (double)r->num_updates, (long long)sum);
+
+  for (size_t i = 0; i < r->num_books; ++i)
+    book_free(&books[i]);
+  free(books);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("%s", "usage: bench_book_replay FILE [RUNS]\n");
+    return 1;
+  }
+  size_t runs = bench_arg(argc, argv, 2, 3);
+
+  struct book_replay *r = calloc(1, sizeof(struct book_replay));
+  if (!r) {
+    printf("%s", "out of memory\n");
+    return 1;
+  }
+
+  struct pcap_mmap *pm = NULL;
+  TRACE_HAULT(pcap_mmap_open(argv[1], &pm));
+  TRACE_HAULT(pcap_mmap_for_each_udp(pm, book_replay_datagram, r));
+  TRACE_HAULT(pcap_mmap_close(&pm));
+
+  if (r->num_updates == 0) {
+    printf("no price level updates in %s\n", argv[1]);
+    return 1;
+  }
+
+  for (size_t run = 1; run <= runs; ++run) {
+    book_replay_run(r, run, false);
+    book_replay_run(r, run, true);
+  }
+
+  free(r->updates);
+  free(r);
+  return 0;
+}
@@ -0,0 +1,87 @@
+#include "bench.h"
+
+#include <analysis/analysis.h>
+#include <chart/chart.h>
+#include <string.h>
+
+/*
+ * Times the json of a chart of CANDLES candles, by default 100k, with a
+ * candle pattern on every 10th candle. chart_json and chart_analysis_json
+ * are the mean of RUNS calls, chart_latest_candle of 100k calls.
+ *
+ *   bench_chart_json [CANDLES] [RUNS]
+ */
+
+/*
+ * The interval of the chart, one minute
+ */
+#define CHART_JSON_INTERVAL 60000000000ULL
+
+/*
+ * Times runs calls of fn and prints the mean time and the output size
+ */
+static void chart_json_time(const char *what, struct chart *cht,
+                            enum RISKI_ERROR_CODE (*fn)(struct chart *,
+                                                        char **),
+                            size_t runs) {
+  size_t len = 0;
+  double begin = bench_now();
+  for (size_t i = 0; i < runs; ++i) {
+    char *json = NULL;
+    TRACE_HAULT(fn(cht, &json));
+    len = strlen(json);
+    free(json);
+  }
+  double mean = (bench_now() - begin) / (double)runs;
+
+  if (mean < 1e-3)
+    printf("%-27s %10.0f ns (%zu bytes)\n", what, mean * 1e9, len);
+  else
+    printf("%-27s %10.2f ms (%.1f MB)\n", what, mean * 1e3,
+           (double)len / 1e6);
+}
+
+int main(int argc, char **argv) {
+  size_t num_candles = bench_arg(argc, argv, 1, 100000);
+  size_t runs = bench_arg(argc, argv, 2, 10);
+
+  struct chart *cht = NULL;
+  TRACE_HAULT(chart_new(CHART_JSON_INTERVAL, "BENCH", 4, &cht));
+  TRACE_HAULT(chart_set_analysis(cht, false));
+
+  srand(1);
+  int64_t price = 1000000;
+  uint64_t start = 1000 * CHART_JSON_INTERVAL;
+  for (size_t i = 0; i <= num_candles; ++i) {
+    uint64_t ts = start + i * CHART_JSON_INTERVAL;
+    for (uint64_t k = 0; k < 4; ++k) {
+      price += rand() % 201 - 100;
+      TRACE_HAULT(chart_update(cht, price, price - 1, price + 1, ts + k));
+    }
+  }
+
+  for (size_t i = 0; i < num_candles; i += 10) {
+    struct analysis_result *res = malloc(sizeof(struct analysis_result));
+    struct candle_pattern *data = malloc(sizeof(struct candle_pattern));
+    if (!res || !data) {
+      printf("%s", "out of memory\n");
+      return 1;
+    }
+    data->candles_spanning = 2;
+    data->short_code = strdup("BE");
+    res->type = CANDLE_PATTERN;
+    res->draw_data = data;
+    TRACE_HAULT(chart_put_analysis(cht, i, res));
+  }
+
+  printf("%zu candles, %zu runs\n", num_candles, runs);
+  chart_json_time("chart_json", cht, chart_json, runs);
+  chart_json_time("chart_analysis_json", cht, chart_analysis_json, runs);
+  chart_json_time("chart_latest_candle", cht, chart_latest_candle, 100000);
+  chart_json_time("chart_json_cached", cht, chart_json_cached, runs);
+  chart_json_time("chart_analysis_json_cached", cht,
+                  chart_analysis_json_cached, runs);
+
+  TRACE_HAULT(chart_free(&cht));
+  return 0;
+}
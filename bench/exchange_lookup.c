@@ -0,0 +1,163 @@
+#include "bench.h"
+
+#include <exchange/exchange.h>
+#include <pthread.h>
+#include <string.h>
+
+/*
+ * Times lookups in the open addressed tables of an exchange holding 10k,
+ * 100k and 1M symbols. A security takes tens of KB, so the keys are 8 byte
+ * symbols put by exchange_put_by_key as aliases of one security, the name
+ * table probes the same way. The symbols are put while the readers look
+ * them up, which grows the table under them, then every reader thread
+ * looks up random symbols that are in the table and symbols that are
+ * not. A lookup must find either nothing or the security. The ns/lookup
+ * is the time a reader takes per lookup, it is only the latency of a
+ * lookup when every reader has a core of its own.
+ *
+ *   bench_exchange_lookup [READERS] [LOOKUPS]
+ */
+
+/*
+ * The most reader threads
+ */
+#define EXCHANGE_LOOKUP_MAX_READERS 64
+
+/*
+ * A reader thread
+ * @param {struct exchange*} e The exchange
+ * @param {size_t} num_keys The number of keys in the exchange
+ * @param {size_t} lookups The number of lookups to make
+ * @param {bool} miss True to look up keys that are not in the exchange
+ * @param {uint64_t} seed The seed of the keys looked up
+ * @param {struct security*} want The security every key is put for
+ * @param {size_t} missed The number of lookups that found nothing
+ * @param {size_t} wrong The number of lookups that found another security
+ */
+struct exchange_lookup_reader {
+  struct exchange *e;
+  size_t num_keys;
+  size_t lookups;
+  bool miss;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+
+  uint64_t seed;
+  struct security *want;
+  size_t missed;
+  size_t wrong;
+};
+
+/*
+ * The space padded symbol of the i-th key loaded as an integer. Keys that
+ * are missed start with a digit so they never match a put one.
+ */
+static uint64_t exchange_lookup_key(size_t i, bool miss) {
+  char sym[8];
+  memset(sym, ' ', 8);
+  size_t k = 0;
+  if (miss)
+    sym[k++] = '0';
+  for (; k < 7; ++k) {
+    sym[k] = (char)('A' + i % 26);
+    i /= 26;
+    if (i == 0)
+      break;
+  }
+
+  uint64_t key = 0;
+  memcpy(&key, sym, sizeof(key));
+  return key;
+}
+
+static void *exchange_lookup_read(void *usr) {
+  struct exchange_lookup_reader *r = (struct exchange_lookup_reader *)usr;
+
+  // xorshift, cheap next to a lookup
+  uint64_t x = r->seed;
+  for (size_t i = 0; i < r->lookups; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+
+    struct security *sec = NULL;
+    TRACE_HAULT(exchange_get_by_key(
+        r->e, exchange_lookup_key((size_t)(x % r->num_keys), r->miss), &sec));
+    r->missed += sec == NULL;
+    r->wrong += sec != NULL && sec != r->want;
+  }
+  return NULL;
+}
+
+/*
+ * Runs readers threads of lookups each and prints the result. If put is
+ * true the keys are put as aliases of sec while the readers run.
+ */
+static void exchange_lookup_run(struct exchange *e, struct security *sec,
+                                size_t num_keys, size_t readers,
+                                size_t lookups, bool miss, bool put) {
+  pthread_t threads[EXCHANGE_LOOKUP_MAX_READERS];
+  struct exchange_lookup_reader r[EXCHANGE_LOOKUP_MAX_READERS];
+
+  double begin = bench_now();
+  for (size_t i = 0; i < readers; ++i) {
+    r[i] = (struct exchange_lookup_reader){0};
+    r[i].e = e;
+    r[i].num_keys = num_keys;
+    r[i].lookups = lookups;
+    r[i].miss = miss;
+    r[i].seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+    r[i].want = sec;
+    pthread_create(&threads[i], NULL, exchange_lookup_read, &r[i]);
+  }
+
+  if (put) {
+    for (size_t i = 0; i < num_keys; ++i)
+      TRACE_HAULT(exchange_put_by_key(e, exchange_lookup_key(i, false), sec));
+    printf("%8zu symbols put in %.3fs\n", num_keys, bench_now() - begin);
+  }
+
+  size_t missed = 0;
+  size_t wrong = 0;
+  for (size_t i = 0; i < readers; ++i) {
+    pthread_join(threads[i], NULL);
+    missed += r[i].missed;
+    wrong += r[i].wrong;
+  }
+  double elapsed = bench_now() - begin;
+  if (elapsed <= 0)
+    elapsed = 1e-9;
+
+  size_t total = readers * lookups;
+  printf("%8zu symbols %-4s %zu readers: %.1f ns/lookup %.1f M lookups/s, "
+         "%zu of %zu missed, %zu wrong\n",
+         num_keys, put ? "put" : miss ? "miss" : "hit", readers,
+         elapsed * 1e9 * (double)readers / (double)total,
+         (double)total / elapsed / 1e6, missed, total, wrong);
+}
+
+int main(int argc, char **argv) {
+  size_t readers = bench_arg(argc, argv, 1, 1);
+  size_t lookups = bench_arg(argc, argv, 2, 10000000);
+  if (readers > EXCHANGE_LOOKUP_MAX_READERS) {
+    printf("at most %d readers\n", EXCHANGE_LOOKUP_MAX_READERS);
+    return 1;
+  }
+
+  const size_t sizes[] = {10000, 100000, 1000000};
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+    struct exchange *e = NULL;
+    TRACE_HAULT(exchange_new("BENCH", &e));
+    TRACE_HAULT(exchange_set_analysis(e, false));
+    TRACE_HAULT(exchange_put(e, "BENCH", 60000000000ULL, 4));
+    struct security *sec = NULL;
+    TRACE_HAULT(exchange_get(e, "BENCH", &sec));
+
+    exchange_lookup_run(e, sec, sizes[s], readers, lookups, false, true);
+    exchange_lookup_run(e, sec, sizes[s], readers, lookups, false, false);
+    exchange_lookup_run(e, sec, sizes[s], readers, lookups, true, false);
+    TRACE_HAULT(exchange_free(&e));
+  }
+  return 0;
+}
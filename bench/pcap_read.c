@@ -0,0 +1,131 @@
+#include "bench.h"
+
+#include <iex/iex.h>
+#include <sys/stat.h>
+
+/*
+ * Compares the two ways a capture is read, libpcap and the memory mapped
+ * reader iex_parse_deep uses by default. Both only find the IEX-TP packets
+ * and count their messages, so this times the read path alone. The first
+ * run may read from disk and the rest from the page cache.
+ *
+ *   bench_pcap_read FILE [RUNS]
+ */
+
+/*
+ * The totals of one pass over a capture
+ * @param {size_t} messages The number of IEX messages in the packets
+ * @param {size_t} packets The number of IEX-TP packets
+ */
+struct pcap_read_count {
+  size_t messages;
+  size_t packets;
+};
+
+static void pcap_read_tp(struct pcap_read_count *cnt,
+                         const unsigned char *data, size_t len) {
+  if (len < sizeof(struct iex_tp_header))
+    return;
+
+  const struct iex_tp_header *header = (const struct iex_tp_header *)data;
+  if (header->message_protocol_id != 0x8004)
+    return;
+
+  cnt->messages += header->message_count;
+  cnt->packets += 1;
+}
+
+static void pcap_read_packet(unsigned char *usr,
+                             const struct pcap_pkthdr *pkthdr,
+                             const unsigned char *packet) {
+  struct pcap_read_count *cnt = (struct pcap_read_count *)usr;
+
+  // the same checks packet_handler makes before handing over the payload
+  size_t offset =
+      sizeof(struct ether_header) + sizeof(struct ip) + sizeof(struct udphdr);
+  if (pkthdr->caplen < offset)
+    return;
+
+  const struct ether_header *ethernet_header =
+      (const struct ether_header *)packet;
+  const struct ip *ip_header =
+      (const struct ip *)((const void *)(packet + sizeof(struct ether_header)));
+  if (ntohs(ethernet_header->ether_type) != ETHERTYPE_IP ||
+      ip_header->ip_p != IPPROTO_UDP)
+    return;
+
+  pcap_read_tp(cnt, packet + offset, pkthdr->caplen - offset);
+}
+
+static enum RISKI_ERROR_CODE
+pcap_read_datagram(const struct pcap_mmap_datagram *dg, void *usr) {
+  pcap_read_tp((struct pcap_read_count *)usr, dg->payload, dg->len);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE pcap_read_libpcap(char *file,
+                                               struct pcap_read_count *cnt) {
+  char errbuff[PCAP_ERRBUF_SIZE];
+  pcap_t *desc = pcap_open_offline(file, errbuff);
+  if (!desc) {
+    printf("libpcap: %s\n", errbuff);
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
+
+  int err = pcap_loop(desc, 0, pcap_read_packet, (unsigned char *)cnt);
+  if (err < 0)
+    printf("libpcap: %s\n", pcap_geterr(desc));
+  pcap_close(desc);
+  return err < 0 ? RISKI_ERROR_CODE_UNKNOWN : RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE pcap_read_mmap(char *file,
+                                            struct pcap_read_count *cnt) {
+  struct pcap_mmap *pm = NULL;
+  TRACE(pcap_mmap_open(file, &pm));
+  enum RISKI_ERROR_CODE err =
+      pcap_mmap_for_each_udp(pm, pcap_read_datagram, cnt);
+  TRACE(pcap_mmap_close(&pm));
+  return err;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("%s", "usage: bench_pcap_read FILE [RUNS]\n");
+    return 1;
+  }
+  char *file = argv[1];
+  size_t runs = bench_arg(argc, argv, 2, 3);
+
+  struct stat st;
+  if (stat(file, &st) != 0) {
+    printf("can not stat %s\n", file);
+    return 1;
+  }
+  double gb = (double)st.st_size / 1e9;
+
+  const char *names[] = {"libpcap", "mmap"};
+  enum RISKI_ERROR_CODE (*readers[])(char *, struct pcap_read_count *) = {
+      pcap_read_libpcap, pcap_read_mmap};
+
+  for (size_t run = 1; run <= runs; ++run) {
+    for (size_t i = 0; i < 2; ++i) {
+      struct pcap_read_count cnt = {0};
+      double begin = bench_now();
+      enum RISKI_ERROR_CODE err = readers[i](file, &cnt);
+      double elapsed = bench_now() - begin;
+      if (err != RISKI_ERROR_CODE_NONE) {
+        printf("%-8s run %zu failed\n", names[i], run);
+        continue;
+      }
+      if (elapsed <= 0)
+        elapsed = 1e-9;
+
+      printf("%-8s run %zu: %zu packets %zu messages %.3f GB in %.3fs => "
+             "%.0f msg/s %.3f GB/s\n",
+             names[i], run, cnt.packets, cnt.messages, gb, elapsed,
+             (double)cnt.messages / elapsed, gb / elapsed);
+    }
+  }
+  return 0;
+}
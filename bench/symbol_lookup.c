@@ -0,0 +1,124 @@
+#include "bench.h"
+
+#include <exchange/exchange.h>
+#include <string.h>
+
+/*
+ * Times the security lookup made for every IEX message, by symbol name
+ * the way the parser used to and by the 8 byte symbol key it uses now.
+ * The messages name random symbols out of a universe of SYMBOLS.
+ *
+ *   bench_symbol_lookup [SYMBOLS] [MESSAGES]
+ */
+
+/*
+ * Writes the space padded symbol of the i-th security into sym
+ */
+static void symbol_lookup_symbol(size_t i, char sym[8]) {
+  memset(sym, ' ', 8);
+  for (size_t k = 0; k < 7; ++k) {
+    sym[k] = (char)('A' + i % 26);
+    i /= 26;
+    if (i == 0)
+      break;
+  }
+}
+
+/*
+ * Copies a space padded symbol into a null terminated name
+ */
+static void symbol_lookup_name(const char sym[8], char st[9]) {
+  size_t n = 0;
+  while (n < 8 && sym[n] != ' ') {
+    st[n] = sym[n];
+    ++n;
+  }
+  st[n] = '\x0';
+}
+
+/*
+ * The lookup of a message before the key table, a copy of the name of the
+ * symbol looked up in the name table
+ */
+static enum RISKI_ERROR_CODE symbol_lookup_by_name(struct exchange *e,
+                                                   const char sym[8],
+                                                   struct security **sec) {
+  char st[9];
+  symbol_lookup_name(sym, st);
+
+  char *name = strdup(st);
+  PTR_CHECK(name, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  enum RISKI_ERROR_CODE err = exchange_get(e, name, sec);
+  free(name);
+  return err;
+}
+
+static enum RISKI_ERROR_CODE symbol_lookup_by_key(struct exchange *e,
+                                                  const char sym[8],
+                                                  struct security **sec) {
+  uint64_t key = 0;
+  memcpy(&key, sym, sizeof(key));
+  TRACE(exchange_get_by_key(e, key, sec));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+int main(int argc, char **argv) {
+  size_t num_symbols = bench_arg(argc, argv, 1, 8000);
+  size_t num_messages = bench_arg(argc, argv, 2, 10000000);
+
+  struct exchange *e = NULL;
+  TRACE_HAULT(exchange_new("BENCH", &e));
+  TRACE_HAULT(exchange_set_analysis(e, false));
+
+  for (size_t i = 0; i < num_symbols; ++i) {
+    char sym[8];
+    char name[9];
+    symbol_lookup_symbol(i, sym);
+    symbol_lookup_name(sym, name);
+
+    struct security *sec = NULL;
+    TRACE_HAULT(exchange_put(e, name, 60000000000ULL, 4));
+    TRACE_HAULT(exchange_get(e, name, &sec));
+
+    uint64_t key = 0;
+    memcpy(&key, sym, sizeof(key));
+    TRACE_HAULT(exchange_put_by_key(e, key, sec));
+  }
+
+  char *syms = malloc(num_messages * 8);
+  if (!syms) {
+    printf("%s", "out of memory\n");
+    return 1;
+  }
+  srand(1);
+  for (size_t i = 0; i < num_messages; ++i)
+    symbol_lookup_symbol((size_t)rand() % num_symbols, &syms[i * 8]);
+
+  const char *names[] = {"name", "key"};
+  enum RISKI_ERROR_CODE (*lookups[])(struct exchange *, const char[8],
+                                     struct security **) = {
+      symbol_lookup_by_name, symbol_lookup_by_key};
+
+  for (size_t l = 0; l < 2; ++l) {
+    size_t missed = 0;
+    double begin = bench_now();
+    for (size_t i = 0; i < num_messages; ++i) {
+      struct security *sec = NULL;
+      TRACE_HAULT(lookups[l](e, &syms[i * 8], &sec));
+      missed += sec == NULL;
+    }
+    double elapsed = bench_now() - begin;
+    if (elapsed <= 0)
+      elapsed = 1e-9;
+
+    printf("%-4s %zu symbols %zu messages in %.3fs => %.0f msg/s "
+           "%.1f ns/msg, %zu missed\n",
+           names[l], num_symbols, num_messages, elapsed,
+           (double)num_messages / elapsed, elapsed * 1e9 / (double)num_messages,
+           missed);
+  }
+
+  free(syms);
+  TRACE_HAULT(exchange_free(&e));
+  return 0;
+}
@@ -44,9 +44,9 @@ struct chart;
 struct analysis_info;
 
 /*
- * A cdll used for pushing and popping analysis to the threads
+ * A queue of analysis waiting for a thread to pick it up
  */
-struct analysis_list;
+struct analysis_queue;
 
 /*
  * Initalizes threads to perform analysis on.
@@ -55,9 +55,12 @@ struct analysis_list;
 enum RISKI_ERROR_CODE analysis_init(void);
 
 /*
- * Pushes information to a thread to analyize it
+ * Queues information for the next free thread to analyize it. A chart is
+ * queued once however many ends are pushed for it before it is analysed,
+ * and only one thread analyses a chart at a time, ends in the order they
+ * were pushed.
  * @param sec The chart to perform analysis on
- * @param start The minimum candle to look at
+ * @param start The minimum candle to look at, unused
  * @param end The maximum candle to look at
  * @return The status
  */
@@ -66,13 +69,33 @@ enum RISKI_ERROR_CODE analysis_push(struct chart *sec, size_t start,
 
 /*
  * Pops the very first element to the analysis and puts it inside (*inf).
- * @param bin The thread bin to pop from
- * @param inf A pointer to populate the pop result.
+ * Only one thread may pop from a queue at a time.
+ * @param q The queue to pop from
+ * @param inf A pointer to populate the pop result, NULL if the queue is
+ * empty
  * @return The status
  */
-enum RISKI_ERROR_CODE analysis_pop(struct analysis_list *bin,
+enum RISKI_ERROR_CODE analysis_pop(struct analysis_queue *q,
                                    struct analysis_info **inf);
 
+/*
+ * Reads out how far analysis is behind
+ * @param depth Will set *depth to the number of charts queued for analysis
+ * and not started yet
+ * @param dropped Will set *dropped to the number of analysis dropped because
+ * the queue was full
+ * @return The status
+ */
+enum RISKI_ERROR_CODE analysis_get_stats(size_t *depth, size_t *dropped);
+
+/*
+ * Frees the states the plugins keep for a chart, called when the chart is
+ * freed. Nothing may analyse the chart any more.
+ * @param cht The chart
+ * @return The status
+ */
+enum RISKI_ERROR_CODE analysis_free_state(struct chart *cht);
+
 /*
  * Joins the analysis threads together and cleans up loose memory
  * @return The status
@@ -81,15 +104,13 @@ enum RISKI_ERROR_CODE analysis_cleanup(void);
 
 /*
  * Creates a new analysis info that can be processed by a worker thread.
+ * The candles to analyse are asked for with chart_analysis_request.
  * @param cht The chart to analyize
- * @param start The start of the analysis
- * @param end The end of the analysis
  * @param inf Pointer to the resulting analysis info
  */
-enum RISKI_ERROR_CODE analysis_create_info(struct chart *cht, size_t start,
-                                           size_t end,
+enum RISKI_ERROR_CODE analysis_create_info(struct chart *cht,
                                            struct analysis_info **inf);
 
-extern int ANALYSIS_INTERRUPED;
+extern atomic_int ANALYSIS_INTERRUPED;
 
 #endif
@@ -11,12 +11,56 @@
 #include <error_codes.h>
 #include <tracer.h>
 
+/*
+ * The version of struct vtable_incremental plugins are built against. Later
+ * versions only add members to the end, a plugin built against an older
+ * version keeps working.
+ */
+#define RISKI_PLUGIN_ABI_VERSION 2
+
 struct vtable {
   const char *(*get_name)(void);
   const char *(*get_author)(void);
   enum RISKI_ERROR_CODE (*run)(struct chart *cht, size_t idx);
 };
 
+/*
+ * The optional entry points of a plugin that keeps state for each chart
+ * instead of looking through the chart again for every candle, or that
+ * looks at many charts in one call. A plugin exporting incremental_exports
+ * still exports exports, run is not called for it.
+ * @param {unsigned int} abi_version RISKI_PLUGIN_ABI_VERSION the plugin was
+ * built against
+ * @param {function} init_state Called before the first candle of a chart,
+ * sets *state to the state of the plugin for the chart
+ * @param {function} on_candle Called with the state of the chart in place
+ * of run. Calls for a chart are never made at the same time and idx only
+ * grows, candles between two calls were filled in for a gap in trading.
+ * @param {function} free_state Frees a state, called when the chart is
+ * freed or analysis is shut down
+ * @param {function} run_batch Since version 2, NULL if unused. Called in
+ * place of on_candle and run with n charts, idx[i] being the candle of
+ * charts[i]. The candles before idx[i] of every chart in a call start at
+ * the same time and the charts have the same interval, so they can be read
+ * side by side with chart_span. Charts that close a candle at the same
+ * time on different workers go to different calls. A chart is in one call
+ * at a time and its idx only grows. A plugin with run_batch keeps no
+ * state, its init_state, on_candle and free_state may be NULL.
+ */
+struct vtable_incremental {
+  unsigned int abi_version;
+
+  // 4 unused bytes in this structure
+  char _p1[4];
+
+  enum RISKI_ERROR_CODE (*init_state)(struct chart *cht, void **state);
+  enum RISKI_ERROR_CODE (*on_candle)(struct chart *cht, void *state,
+                                     size_t idx);
+  void (*free_state)(void *state);
+  enum RISKI_ERROR_CODE (*run_batch)(struct chart **charts, size_t *idx,
+                                     size_t n);
+};
+
 const char *get_author(void);
 const char *get_name(void);
 
@@ -8,10 +8,49 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define BUY_SIDE true
 #define SELL_SIDE false
 
+/**
+ * The number of level changes a book remembers for book_changes_since,
+ * must be a power of two
+ */
+#define BOOK_CHANGE_LOG_SIZE 256
+
+/**
+ * A price level as handed out by book_snapshot
+ */
+struct book_level {
+  // The price as a fixed point number
+  int64_t price;
+
+  // Quantity
+  int64_t quantity;
+};
+
+/**
+ * A change to a single level as handed out by book_changes_since.
+ * A quantity of 0 means the level was deleted.
+ */
+struct book_change {
+  // The sequence number of the change, starts at 1 and has no gaps
+  uint64_t seq;
+
+  // The price as a fixed point number
+  int64_t price;
+
+  // The new quantity on the level
+  int64_t quantity;
+
+  // BUY_SIDE or SELL_SIDE
+  bool side;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
 /**
  * Export the private book class
  * to avoid void* in future code
@@ -29,9 +68,51 @@ struct book *book_new(void);
  * quantity of the transaction. A quantity of 0
  * will delete the level, price, from the order book.
  * Side should either be BUY_SIDE or SELL_SIDE
+ * Levels are updated in place, only inserts and deletes
+ * move the levels between price and the top of the book.
  */
 void book_update(bool side, struct book *t, int64_t price, int64_t quantity);
 
+/**
+ * Gets the highest price on the buy side and its quantity in constant
+ * time. Either pointer may be NULL.
+ * Returns false and leaves price and quantity alone if there are no buys
+ */
+bool book_best_bid(struct book *t, int64_t *price, int64_t *quantity);
+
+/**
+ * Gets the lowest price on the sell side and its quantity in constant
+ * time. Either pointer may be NULL.
+ * Returns false and leaves price and quantity alone if there are no sells
+ */
+bool book_best_ask(struct book *t, int64_t *price, int64_t *quantity);
+
+/**
+ * Copies the best depth levels of each side into the caller's buffers
+ * without allocating, best price first. bids and asks must each hold
+ * depth levels. Sets *seq, if not NULL, to the sequence number of the
+ * last change included so book_changes_since can continue from it.
+ */
+void book_snapshot(struct book *t, size_t depth, struct book_level *bids,
+                   size_t *num_bids, struct book_level *asks,
+                   size_t *num_asks, uint64_t *seq);
+
+/**
+ * Gets the sequence number of the last change made to the book
+ */
+uint64_t book_seq(struct book *t);
+
+/**
+ * Copies up to max of the changes made after seq into changes, oldest
+ * first, and sets *num_changes to the number copied. Call again with the
+ * seq of the last change copied to get the rest.
+ * Returns false if the changes right after seq are no longer kept, the
+ * caller then has to start over from book_snapshot
+ */
+bool book_changes_since(struct book *t, uint64_t seq,
+                        struct book_change *changes, size_t max,
+                        size_t *num_changes);
+
 /**
  * Used to correctly free a book
  */
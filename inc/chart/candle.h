@@ -3,23 +3,100 @@
 
 #include <error_codes.h>
 #include <limits.h>
+#include <number_format.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <string_builder.h>
 #include <tracer.h>
 
-#define JSON_CANDLE_MAX_LEN 200
+/*
+ * The longest json of a candle without the terminator, every field at its
+ * widest
+ */
+#define JSON_CANDLE_MAX_LEN 240
+
+/*
+ * The most bytes candle_bin_write writes for one candle, nine varints
+ */
+#define BIN_CANDLE_MAX_LEN (9 * NUMBER_FORMAT_VARINT_MAX_LEN)
+
+/*
+ * The number of candles stored together in a candle_block
+ */
+#define CANDLE_BLOCK_SIZE 64
+
+/*
+ * Candles stored column wise, each field of CANDLE_BLOCK_SIZE consecutive
+ * candles is one contiguous array so scanning a field streams through
+ * memory instead of chasing a pointer per candle.
+ * @param {int64_t[]} open The open prices
+ * @param {int64_t[]} high The high prices
+ * @param {int64_t[]} low The low prices
+ * @param {int64_t[]} close The close prices
+ * @param {int64_t[]} best_bid The best bid prices
+ * @param {int64_t[]} best_ask The best ask prices
+ * @param {uint64_t[]} start_time The start times
+ * @param {uint64_t[]} end_time The end times
+ * @param {uint64_t[]} volume The volumes
+ */
+struct candle_block {
+  int64_t open[CANDLE_BLOCK_SIZE];
+  int64_t high[CANDLE_BLOCK_SIZE];
+  int64_t low[CANDLE_BLOCK_SIZE];
+  int64_t close[CANDLE_BLOCK_SIZE];
+  int64_t best_bid[CANDLE_BLOCK_SIZE];
+  int64_t best_ask[CANDLE_BLOCK_SIZE];
+  uint64_t start_time[CANDLE_BLOCK_SIZE];
+  uint64_t end_time[CANDLE_BLOCK_SIZE];
+  uint64_t volume[CANDLE_BLOCK_SIZE];
+};
 
 /*
- * Private candle struct
+ * What the next binary candle is written against, candle_bin_write
+ * advances it past the candle it wrote
+ * @param {int64_t} close The close of the candle before
+ * @param {uint64_t} start_time The start of the candle before
+ */
+struct candle_bin_prev {
+  int64_t close;
+  uint64_t start_time;
+};
+
+/*
+ * Private candle struct, a candle is a handle to one slot of a
+ * candle_block and is only valid as long as the block is
  */
 struct candle;
 
+/**
+ * Gets the handle of the candle in slot i of a block
+ * @param b The block
+ * @param i The slot, less than CANDLE_BLOCK_SIZE
+ * @return The candle
+ */
+static inline struct candle *candle_at(struct candle_block *b, size_t i) {
+  return (struct candle *)&b->open[i];
+}
+
+/**
+ * Sets every field of a candle as if it was just opened at price
+ * @param c The candle
+ * @param price A fixed point
+ * @param bid The best bid
+ * @param ask The best ask
+ * @param time The timestamp
+ * @return The status
+ */
+enum RISKI_ERROR_CODE candle_reset(struct candle *c, int64_t price,
+                                   int64_t bid, int64_t ask, uint64_t time);
+
 /**
  * Creates a new candle given the start time and opening
- * price.
+ * price. The candle gets a block of its own, charts keep their candles
+ * in shared blocks instead.
  * @param price A fixed point
  * @param time The timestamp
  * @param cnd Sets *cnd to the newly created candle
@@ -38,6 +115,27 @@ enum RISKI_ERROR_CODE candle_new(int64_t price, int64_t bid, int64_t ask,
 enum RISKI_ERROR_CODE candle_update(struct candle *c, int64_t price,
                                     int64_t bid, int64_t ask, uint64_t time);
 
+/**
+ * Updates the best bid and ask of the given candle without touching the
+ * prices, volume or times
+ * @param c The candle to update
+ * @param bid The best bid
+ * @param ask The best ask
+ * @param time The timestamp of the quote
+ * @return The status
+ */
+enum RISKI_ERROR_CODE candle_quote(struct candle *c, int64_t bid, int64_t ask,
+                                   uint64_t time);
+
+/**
+ * Folds a later candle into dst, as if every price of src had been given
+ * to candle_update on dst. The open and start of dst are kept.
+ * @param dst The candle to update
+ * @param src The candle that follows dst
+ * @return The status
+ */
+enum RISKI_ERROR_CODE candle_merge(struct candle *dst, struct candle *src);
+
 /**
  * Frees the given candle
  * @param c Will free *c if *c was created with candle_new
@@ -53,6 +151,36 @@ enum RISKI_ERROR_CODE candle_free(struct candle **c);
  */
 enum RISKI_ERROR_CODE candle_json(struct candle *c, char **json);
 
+/**
+ * Writes the json of candle_json to dst without a terminator
+ * @param c The candle to get a json representation of
+ * @param dst Where to write the json, must have room for
+ * JSON_CANDLE_MAX_LEN characters
+ * @param len Will set *len to the number of characters written
+ * @return The status
+ */
+enum RISKI_ERROR_CODE candle_json_write(struct candle *c, char *dst,
+                                        size_t *len);
+
+/**
+ * Writes the candle as nine varints, each field is the zigzag encoded
+ * difference to a field it is usually close to:
+ * open - close before, high - open, low - open, close - open,
+ * start - (start before + interval), end - start, volume (not zigzag
+ * encoded), best bid - close, best ask - close
+ * @param c The candle
+ * @param prev The candle before, advanced to c
+ * @param interval The interval of the chart of the candle
+ * @param dst Where to write the candle, must have room for
+ * BIN_CANDLE_MAX_LEN bytes
+ * @param len Will set *len to the number of bytes written
+ * @return The status
+ */
+enum RISKI_ERROR_CODE candle_bin_write(struct candle *c,
+                                       struct candle_bin_prev *prev,
+                                       uint64_t interval, unsigned char *dst,
+                                       size_t *len);
+
 /**
  * Gets the volume of the candle, 0 if the candle is a fill in candle
  * @param c The candle to get the volume from
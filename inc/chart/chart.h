@@ -10,8 +10,11 @@
 #endif
 
 #include <chart/candle.h>
+#include <chart/chart_store.h>
 #include <logger.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string_builder.h>
@@ -77,6 +80,53 @@ struct analysis_result {
  */
 struct chart;
 
+/*
+ * A read only view of consecutive candles of a chart, field[k] belongs to
+ * candle first + k. Candles are stored in blocks of CANDLE_BLOCK_SIZE so a
+ * span never crosses a block, walk longer ranges with chart_span in a loop.
+ * The pointers stay valid for as long as the chart does, or until
+ * chart_analysis_leave if the chart spills candles to disk.
+ * Gaps in trading are kept as flat runs. A span over a flat run has flat
+ * set and every field pointer NULL, each of its candles is a doji at price
+ * with price as the bid and ask and no volume. Candle first + k of a flat
+ * span starts and ends at start + k * interval.
+ * @param {const int64_t*} open The open prices
+ * @param {const int64_t*} high The high prices
+ * @param {const int64_t*} low The low prices
+ * @param {const int64_t*} close The close prices
+ * @param {const int64_t*} best_bid The best bid prices
+ * @param {const int64_t*} best_ask The best ask prices
+ * @param {const uint64_t*} start_time The start times
+ * @param {const uint64_t*} end_time The end times
+ * @param {const uint64_t*} volume The volumes
+ * @param {size_t} first The index of the first candle in the span
+ * @param {size_t} len The number of candles in the span
+ * @param {uint64_t} start The start time of the first candle
+ * @param {uint64_t} interval The interval between two candles
+ * @param {int64_t} price The price of every candle of a flat span
+ * @param {bool} flat True if the span is a flat run
+ */
+struct chart_span {
+  const int64_t *open;
+  const int64_t *high;
+  const int64_t *low;
+  const int64_t *close;
+  const int64_t *best_bid;
+  const int64_t *best_ask;
+  const uint64_t *start_time;
+  const uint64_t *end_time;
+  const uint64_t *volume;
+  size_t first;
+  size_t len;
+  uint64_t start;
+  uint64_t interval;
+  int64_t price;
+  bool flat;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
 /*
  * Used to put an analysis result into the chart
  */
@@ -104,7 +154,8 @@ enum RISKI_ERROR_CODE chart_free(struct chart **cht);
 
 /*
  * Updates the chart given the chart, price, and timestamp
- * of the price data.
+ * of the price data. Trades before the current candle, or inside the
+ * candles loaded from a store, are dropped.
  * @param {struct chart*} cht The chart to update
  * @param {int64_t} price The new price
  * @param {uint64_t} ts The time this price happened, must be in the same
@@ -114,6 +165,214 @@ enum RISKI_ERROR_CODE chart_free(struct chart **cht);
 enum RISKI_ERROR_CODE chart_update(struct chart *cht, int64_t price,
                                    int64_t bid, int64_t ask, uint64_t ts);
 
+/*
+ * Folds candle index of src into dst, dst must have an interval that is a
+ * multiple of the interval of src. The candles of src have to be rolled
+ * up in order, a candle that starts a new interval in dst finalizes the
+ * current candle of dst and queues its analysis like chart_update does.
+ * Candles of src that a candle loaded from the store of dst already
+ * covers are skipped.
+ * @param {struct chart*} dst The chart with the larger interval
+ * @param {struct chart*} src The chart with the smaller interval
+ * @param {size_t} index The candle of src, it may be the current one
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_rollup(struct chart *dst, struct chart *src,
+                                   size_t index);
+
+/*
+ * Sets *num_candles to the number of candles in the chart, including the
+ * current one that is not finalized yet
+ * @param {struct chart*} cht A chart
+ * @param {size_t*} num_candles Will set *num_candles to the count
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_num_candles(struct chart *cht,
+                                            size_t *num_candles);
+
+/*
+ * Sets *interval to the length of each candle of the chart
+ * @param {struct chart*} cht A chart
+ * @param {uint64_t*} interval Will set *interval to the interval
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_interval(struct chart *cht,
+                                         uint64_t *interval);
+
+/*
+ * Sets *precision to the precision of the prices of the chart
+ * @param {struct chart*} cht A chart
+ * @param {int*} precision Will set *precision to the precision
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_precision(struct chart *cht,
+                                          int *precision);
+
+/*
+ * Loads the candles and analysis of chart store_chart of store into cht,
+ * which must still be empty, and keeps the chart in the store from then
+ * on. Every candle is written once it is finalized, a flat run as a
+ * single record, and so is every analysis result. The last candle loaded
+ * becomes the current candle again. The store must outlive the chart.
+ * @param {struct chart*} cht An empty chart
+ * @param {struct chart_store*} store An open store
+ * @param {size_t} store_chart The chart of the store that belongs to cht
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_open_store(struct chart *cht,
+                                       struct chart_store *store,
+                                       size_t store_chart);
+
+/*
+ * Sets *until to the end of the last candle loaded from the store of the
+ * chart, see chart_open_store
+ * @param {struct chart*} cht A chart
+ * @param {uint64_t*} until Will set *until to the end, 0 if nothing was
+ * loaded
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_stored_until(struct chart *cht,
+                                             uint64_t *until);
+
+/*
+ * Sets the versions of the chart, numbers that change whenever a candle
+ * of the chart changes or an analysis result is put into it. They can be
+ * read without holding the lock the chart is updated under, a reader that
+ * saw a version change reads the chart after it.
+ * @param {struct chart*} cht A chart
+ * @param {uint64_t*} version Will set *version to the version of the
+ * candles, 0 until the chart is first updated
+ * @param {uint64_t*} analysis_version Will set *analysis_version to the
+ * version of the analysis, 0 until the first result
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_versions(struct chart *cht, uint64_t *version,
+                                         uint64_t *analysis_version);
+
+/*
+ * Keeps only about the newest max_candles candles of the chart in memory.
+ * Older candles are written once to an append-only spill file and read
+ * back in when chart_get_candle, chart_span or chart_json asks for them.
+ * Candle indexes do not change. Analysis threads must wrap their reads in
+ * chart_analysis_enter and chart_analysis_leave.
+ * @param {struct chart*} cht A chart
+ * @param {size_t} max_candles The number of candles to keep in memory
+ * @param {const char*} path The spill file, NULL for an unnamed
+ * temporary file
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_retention(struct chart *cht,
+                                          size_t max_candles,
+                                          const char *path);
+
+/*
+ * Marks the start of a read of the chart by an analysis thread. Candles
+ * spilled to disk during the read are kept in memory until every reader
+ * called chart_analysis_leave, so candle handles and spans stay valid.
+ * @param {struct chart*} cht A chart
+ */
+void chart_analysis_enter(struct chart *cht);
+
+/*
+ * Marks the end of a read started with chart_analysis_enter
+ * @param {struct chart*} cht A chart
+ */
+void chart_analysis_leave(struct chart *cht);
+
+/*
+ * Asks for analysis of the chart up to candle end. Ends that were already
+ * asked for are skipped. A chart is queued for analysis at most once, the
+ * thread that analyses it runs every end asked for in the meantime.
+ * @param {struct chart*} cht A chart
+ * @param {size_t} end The candle after the last finalized candle
+ * @param {bool*} queue Will set *queue to true if the chart is not queued
+ * yet and the caller has to queue it
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_analysis_request(struct chart *cht, size_t end,
+                                             bool *queue);
+
+/*
+ * Takes the oldest ends asked for with chart_analysis_request, only the
+ * thread that dequeued the chart may take them
+ * @param {struct chart*} cht A chart
+ * @param {size_t*} ends The place to copy the ends to, oldest first
+ * @param {size_t} max_ends The most ends to take
+ * @param {size_t*} num_ends Will set *num_ends to the number of ends taken
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_analysis_take(struct chart *cht, size_t *ends,
+                                          size_t max_ends, size_t *num_ends);
+
+/*
+ * Marks the end of the analysis of the ends taken
+ * @param {struct chart*} cht A chart
+ * @param {bool*} queue Will set *queue to true if more ends were asked for
+ * and the caller has to queue the chart again
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_analysis_done(struct chart *cht, bool *queue);
+
+/*
+ * Marks a chart as not queued after the queue had no room for it, the next
+ * chart_analysis_request queues it with every end still waiting
+ * @param {struct chart*} cht A chart
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_analysis_dropped(struct chart *cht);
+
+/*
+ * The state the analysis threads keep for the chart
+ * @param {struct chart*} cht A chart
+ * @param {void**} state Will set *state to the state, NULL if there is none
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_get_analysis_state(struct chart *cht,
+                                               void **state);
+
+/*
+ * Sets the state the analysis threads keep for the chart, chart_free has
+ * analysis_free_state free it
+ * @param {struct chart*} cht A chart
+ * @param {void*} state The state
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_analysis_state(struct chart *cht,
+                                               void *state);
+
+/*
+ * Updates the best bid and ask of the current candle without a trade.
+ * Quotes for an interval that has no candle yet are dropped.
+ * @param {struct chart*} cht The chart to update
+ * @param {int64_t} bid The best bid
+ * @param {int64_t} ask The best ask
+ * @param {uint64_t} ts The time of the quote, in the same time format used
+ * in chart_new interval variable.
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_quote(struct chart *cht, int64_t bid, int64_t ask,
+                                  uint64_t ts);
+
+/*
+ * Turns pushing finalized candles to the analysis threads on or off,
+ * charts are created with analysis turned on
+ * @param {struct chart*} cht The chart
+ * @param {bool} enabled False to stop queuing analysis for this chart
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_analysis(struct chart *cht, bool enabled);
+
+/*
+ * Moves every candle of src onto the end of dst. src must start after the
+ * last candle of dst and have the same interval. The gap between the two
+ * charts is not filled in. Analysis is queued for the appended candles if
+ * it is enabled on dst. src is left empty but must still be freed.
+ * @param {struct chart*} dst The chart to append to
+ * @param {struct chart*} src The chart to take the candles from
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_append(struct chart *dst, struct chart *src);
+
 /*
  * Sets *name to the name of the chart
  * @param {struct chart*} cht A chart
@@ -138,6 +397,56 @@ enum RISKI_ERROR_CODE chart_json(struct chart *cht, char **json);
  */
 enum RISKI_ERROR_CODE chart_latest_candle(struct chart *cht, char **json);
 
+/*
+ * The version of the binary frames of chart_bin and
+ * chart_latest_candle_bin, bumped whenever their layout changes
+ */
+#define CHART_BIN_VERSION 1
+
+/*
+ * The length of the header every binary frame starts with
+ */
+#define CHART_BIN_HEADER_LEN 24
+
+/*
+ * The kind of a binary frame
+ */
+enum CHART_BIN_FRAME {
+  CHART_BIN_FRAME_CHART = 1,
+  CHART_BIN_FRAME_LATEST_CANDLE = 2
+};
+
+/*
+ * Converts the chart to a binary frame, the compact counterpart of
+ * chart_json. Numbers in the header are little endian:
+ * byte 0 CHART_BIN_VERSION
+ * byte 1 enum CHART_BIN_FRAME
+ * bytes 2-3 the precision
+ * bytes 4-7 the number of candles
+ * bytes 8-15 the interval
+ * bytes 16-23 the start of the first candle
+ * The candles follow as written by candle_bin_write, the first one
+ * against a candle with a close of 0 that started one interval before
+ * the start in the header.
+ * @param {struct chart*} cht A chart
+ * @param {char**} bin A place to set the frame ptr, NULL before the first
+ * update of the chart
+ * @param {size_t*} len Will set *len to the length of the frame
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_bin(struct chart *cht, char **bin, size_t *len);
+
+/*
+ * Gets the latest candle as a binary frame of one candle, laid out like
+ * the frame of chart_bin
+ * @param {struct chart*} cht A chart
+ * @param {char**} bin A place to set the frame ptr
+ * @param {size_t*} len Will set *len to the length of the frame
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_latest_candle_bin(struct chart *cht, char **bin,
+                                              size_t *len);
+
 /*
  * Aquires the analysis lock mutex, (blocking)
  * @param {struct chart*} A chart
@@ -205,9 +514,45 @@ enum RISKI_ERROR_CODE chart_invalidate_trends(struct chart *cht);
  */
 enum RISKI_ERROR_CODE chart_analysis_json(struct chart *cht, char **json);
 
+/*
+ * The same json as chart_json, chart_bin and chart_analysis_json, built
+ * without holding the lock the chart is updated under. The json and binary
+ * of finalized candles is kept by the chart and only the candles finalized
+ * since the last call and a copy of the current candle are written. The
+ * analysis json is kept until the number of candles or the analysis
+ * version changes.
+ * @param {struct chart*} cht A chart
+ * @param {char**} json A place to set the json string ptr, NULL before
+ * the first update of the chart
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_json_cached(struct chart *cht, char **json);
+
+/*
+ * See chart_json_cached
+ * @param {struct chart*} cht A chart
+ * @param {char**} bin A place to set the frame ptr, NULL before the first
+ * update of the chart
+ * @param {size_t*} len Will set *len to the length of the frame
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_bin_cached(struct chart *cht, char **bin,
+                                       size_t *len);
+
+/*
+ * See chart_json_cached
+ * @param {struct chart*} cht A chart
+ * @param {char**} json A place to store the json result pointer
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_analysis_json_cached(struct chart *cht,
+                                                 char **json);
+
 /*
  * Returns a candle, this will only return finalized candles. And will cause
  * stack exception if a caller attempts to get an unfinalized candle.
+ * A candle of a flat run is built the first time the run is asked for,
+ * chart_span walks gaps without building them.
  * @param {struct chart*} cht A chart
  * @param {size_t} index The candle index to obtain
  * @param {struct candle**} cnd A place to store the candle pointer
@@ -216,6 +561,32 @@ enum RISKI_ERROR_CODE chart_analysis_json(struct chart *cht, char **json);
 enum RISKI_ERROR_CODE chart_get_candle(struct chart *cht, size_t index,
                                        struct candle **cnd);
 
+/*
+ * Sets *span to the candles from first up to last, or up to the end of
+ * the block or flat run first is in if that comes sooner. Like
+ * chart_get_candle only finalized candles can be viewed. span->len tells
+ * how many candles were covered, the next span starts at first + span->len.
+ *
+ *   struct chart_span span;
+ *   for (size_t i = a; i <= b; i += span.len) {
+ *     TRACE(chart_span(cht, i, b, &span));
+ *     if (span.flat) {
+ *       sum += span.price * span.len;
+ *       continue;
+ *     }
+ *     for (size_t k = 0; k < span.len; ++k)
+ *       sum += span.close[k];
+ *   }
+ *
+ * @param {struct chart*} cht A chart
+ * @param {size_t} first The first candle index
+ * @param {size_t} last The last candle index wanted, inclusive
+ * @param {struct chart_span*} span Will be set to the view
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_span(struct chart *cht, size_t first, size_t last,
+                                 struct chart_span *span);
+
 /*
  * Adds a sloped line pattern to the chart representation.
  * @param {struct chart*} cht The chart
@@ -0,0 +1,126 @@
+#ifndef CHART_SET_
+#define CHART_SET_
+
+#include <chart/chart.h>
+#include <error_codes.h>
+#include <logger.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <tracer.h>
+
+/*
+ * Private definition of a chart set
+ */
+struct chart_set;
+
+/*
+ * Creates a set of charts of the same security at several intervals. The
+ * first interval is the base chart that is updated with every trade, the
+ * rest must be larger multiples of it in ascending order. The candles of
+ * the larger intervals are rolled up from the finalized base candles.
+ * @param {char*} name The name of the charts, not copied
+ * @param {int} precision The precision of the prices
+ * @param {uint64_t*} intervals The intervals, intervals[0] is the base
+ * @param {size_t} num_intervals The number of intervals
+ * @param {struct chart_set**} set Sets *set to the new chart set
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_new(char *name, int precision,
+                                    uint64_t *intervals, size_t num_intervals,
+                                    struct chart_set **set);
+
+/*
+ * Updates every chart of the set with a trade. Only the base chart is
+ * updated directly, a base candle that is finalized by the update is
+ * rolled up into the rest of the charts.
+ * @param {struct chart_set*} set The chart set
+ * @param {int64_t} price The price
+ * @param {int64_t} bid The best bid
+ * @param {int64_t} ask The best ask
+ * @param {uint64_t} ts The timestamp
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_update(struct chart_set *set, int64_t price,
+                                       int64_t bid, int64_t ask, uint64_t ts);
+
+/*
+ * Quotes the current base candle, the larger intervals pick the quote up
+ * when the base candle is rolled up
+ * @param {struct chart_set*} set The chart set
+ * @param {int64_t} bid The best bid
+ * @param {int64_t} ask The best ask
+ * @param {uint64_t} ts The timestamp of the quote
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_quote(struct chart_set *set, int64_t bid,
+                                      int64_t ask, uint64_t ts);
+
+/*
+ * Gets the chart of the set with the given interval
+ * @param {struct chart_set*} set The chart set
+ * @param {uint64_t} interval The interval, 0 for the base chart
+ * @param {struct chart**} cht Sets *cht to the chart, NULL if the set has
+ * no chart with that interval
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_get(struct chart_set *set, uint64_t interval,
+                                    struct chart **cht);
+
+/*
+ * Turns analysis of every chart of the set on or off
+ * @param {struct chart_set*} set The chart set
+ * @param {bool} enabled False to stop queuing analysis
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_set_analysis(struct chart_set *set,
+                                             bool enabled);
+
+/*
+ * Sets the retention of every chart of the set, see chart_set_retention.
+ * Each chart spills to its own unnamed temporary file.
+ * @param {struct chart_set*} set The chart set
+ * @param {size_t} max_candles The number of candles to keep in memory
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_set_retention(struct chart_set *set,
+                                              size_t max_candles);
+
+/*
+ * Keeps every chart of the set in one chart store at path, see
+ * chart_open_store. Whatever the store already holds is loaded first, the
+ * charts must still be empty. Base candles that the larger charts did not
+ * store yet are rolled up again with the next update.
+ * @param {struct chart_set*} set The chart set
+ * @param {const char*} path The file of the store
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_open_store(struct chart_set *set,
+                                           const char *path);
+
+/*
+ * Writes the records the store of the set still buffers, does nothing if
+ * the set is not stored. Safe to call while the set is updated.
+ * @param {struct chart_set*} set The chart set
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_flush_store(struct chart_set *set);
+
+/*
+ * Appends every chart of src to the chart of dst with the same interval,
+ * see chart_append. Both sets must have the same intervals.
+ * @param {struct chart_set*} dst The set to append to
+ * @param {struct chart_set*} src The set of a later time period
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_append(struct chart_set *dst,
+                                       struct chart_set *src);
+
+/*
+ * Frees the chart set and all of its charts
+ * @param {struct chart_set**} set The chart set to free
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_set_free(struct chart_set **set);
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef CHART_STORE_
+#define CHART_STORE_
+
+#include <error_codes.h>
+#include <logger.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <tracer.h>
+
+/*
+ * Bumped whenever the layout of the header or the records changes, a
+ * store with a different version is not loaded
+ */
+#define CHART_STORE_VERSION 1
+
+/*
+ * The most charts a single store can hold
+ */
+#define CHART_STORE_MAX_CHARTS 4
+
+/*
+ * The longest name kept in the header, including the terminator
+ */
+#define CHART_STORE_NAME_LEN 64
+
+/*
+ * The longest short code of a candle pattern record, including the
+ * terminator
+ */
+#define CHART_STORE_SHORT_CODE_LEN 48
+
+/*
+ * Private definition of a chart store
+ */
+struct chart_store;
+
+/*
+ * The kind of a record
+ */
+enum CHART_STORE_RECORD {
+  CHART_STORE_RECORD_CANDLE = 1,
+  CHART_STORE_RECORD_FLAT = 2,
+  CHART_STORE_RECORD_TREND_LINE = 3,
+  CHART_STORE_RECORD_CANDLE_PATTERN = 4
+};
+
+/*
+ * The start of a store file, written once when the file is created
+ * @param {char[8]} magic Always "RISKICHT"
+ * @param {uint32_t} version CHART_STORE_VERSION
+ * @param {int32_t} precision The precision of the prices
+ * @param {uint64_t} num_charts The number of charts in the store
+ * @param {uint64_t[]} intervals The interval of each chart
+ * @param {char[]} name The name of the charts
+ */
+struct chart_store_header {
+  char magic[8];
+  uint32_t version;
+  int32_t precision;
+  uint64_t num_charts;
+  uint64_t intervals[CHART_STORE_MAX_CHARTS];
+  char name[CHART_STORE_NAME_LEN];
+};
+
+/*
+ * A fixed width record, every record after the header is one of these.
+ * Candles are only written once they are finalized so a chart is always
+ * stored as a prefix of its candles. Analysis results may come before or
+ * after the candles they are on.
+ * @param {uint32_t} type The enum CHART_STORE_RECORD of the record
+ * @param {uint32_t} chart The chart of the store the record belongs to
+ *
+ * CHART_STORE_RECORD_CANDLE -> candle, the next candle of the chart
+ * CHART_STORE_RECORD_FLAT -> flat, count fill-in candles at price after
+ * the last candle
+ * CHART_STORE_RECORD_TREND_LINE -> trend_line, a trend line on candle index
+ * CHART_STORE_RECORD_CANDLE_PATTERN -> candle_pattern, a candle pattern on
+ * candle index
+ */
+struct chart_store_record {
+  uint32_t type;
+  uint32_t chart;
+  union {
+    struct {
+      int64_t open;
+      int64_t high;
+      int64_t low;
+      int64_t close;
+      int64_t best_bid;
+      int64_t best_ask;
+      uint64_t start_time;
+      uint64_t end_time;
+      uint64_t volume;
+    } candle;
+    struct {
+      uint64_t start_time;
+      uint64_t count;
+      int64_t price;
+    } flat;
+    struct {
+      uint64_t index;
+      uint64_t start_index;
+      uint64_t end_index;
+      uint32_t direction;
+    } trend_line;
+    struct {
+      uint64_t index;
+      uint64_t candles_spanning;
+      char short_code[CHART_STORE_SHORT_CODE_LEN];
+    } candle_pattern;
+  };
+};
+
+/*
+ * Opens the store at path, creating it if it does not exist. An existing
+ * store must have been created with the same name and intervals, its
+ * records are mapped read only and can be walked with
+ * chart_store_records until chart_store_release. A record cut short by a
+ * crash is dropped.
+ * @param {const char*} path The file of the store
+ * @param {const char*} name The name of the charts
+ * @param {int} precision The precision of the prices
+ * @param {uint64_t*} intervals The interval of each chart
+ * @param {size_t} num_charts The number of charts, at most
+ * CHART_STORE_MAX_CHARTS
+ * @param {struct chart_store**} store Sets *store to the opened store
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_open(const char *path, const char *name,
+                                       int precision, uint64_t *intervals,
+                                       size_t num_charts,
+                                       struct chart_store **store);
+
+/*
+ * Reads the header of the store at path without opening it
+ * @param {const char*} path The file of the store
+ * @param {struct chart_store_header*} header Will be set to the header
+ * @param {bool*} valid Set to false if path is not a store of this version
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_peek(const char *path,
+                                       struct chart_store_header *header,
+                                       bool *valid);
+
+/*
+ * Sets *records to the records that were in the store when it was opened
+ * @param {struct chart_store*} store The store
+ * @param {const struct chart_store_record**} records Will be set to the
+ * first record, NULL once the store was released
+ * @param {size_t*} num_records Will be set to the number of records
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE
+chart_store_records(struct chart_store *store,
+                    const struct chart_store_record **records,
+                    size_t *num_records);
+
+/*
+ * Unmaps the records read at open, call it once every chart was loaded
+ * @param {struct chart_store*} store The store
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_release(struct chart_store *store);
+
+/*
+ * Appends a record to the store. Records are buffered and written once
+ * the buffer is full or the oldest record has waited a second, or by
+ * chart_store_flush. Any thread may put and flush.
+ * @param {struct chart_store*} store The store
+ * @param {const struct chart_store_record*} record The record
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_put(struct chart_store *store,
+                                      const struct chart_store_record *record);
+
+/*
+ * Writes the buffered records to the file
+ * @param {struct chart_store*} store The store
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_flush(struct chart_store *store);
+
+/*
+ * Flushes and closes the store, sets *store to NULL
+ * @param {struct chart_store**} store The store
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE chart_store_free(struct chart_store **store);
+
+#endif
@@ -1,13 +1,30 @@
 #ifndef EXCHANGE_
 #define EXCHANGE_
 
+// std
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <security/security.h>
 
 /*
  * Private struct describing an exchange
+ *
+ * An exchange is safe for one writer and any number of readers. Gets and
+ * foreach never lock or block the writer, puts are serialized between
+ * themselves. Securities are never removed until exchange_free, so a
+ * pointer handed out stays valid until then.
  */
 struct exchange;
 
+/*
+ * The directory the exchange of a live feed keeps its charts in, see
+ * exchange_open_store. NULL keeps nothing.
+ */
+extern char *EXCHANGE_STORE_DIR;
+
 /*
  * Creates a new exchange with a given name
  * This will create a copy of the name
@@ -37,7 +54,83 @@ enum RISKI_ERROR_CODE exchange_get(struct exchange *e, char *name,
                                    struct security **sec);
 
 /*
- * Frees the exchange and all the securities that were added to it
+ * Gets a security given a fixed width key, such as the 8 byte symbol of a
+ * feed loaded as an integer. No allocation or string compare is done.
+ * Sets *sec to NULL if the key was never put.
+ * @param {struct exchange*} e The exchange to get a security from
+ * @param {uint64_t} key The key, must not be 0
+ * @param {struct security**} sec Will set *sec to the security
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_get_by_key(struct exchange *e, uint64_t key,
+                                          struct security **sec);
+
+/*
+ * Makes key an alias of a security that is already in the exchange,
+ * replacing what key pointed to before
+ * @param {struct exchange*} e The exchange
+ * @param {uint64_t} key The key, must not be 0
+ * @param {struct security*} sec The security
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_put_by_key(struct exchange *e, uint64_t key,
+                                          struct security *sec);
+
+/*
+ * Called once for every security in the exchange
+ * @param {struct security*} sec The security
+ * @param {void*} usr The user pointer given to exchange_foreach
+ * @return {enum RISKI_ERROR_CODE} The status, anything other than
+ * RISKI_ERROR_CODE_NONE stops the iteration
+ */
+typedef enum RISKI_ERROR_CODE (*exchange_foreach_fn)(struct security *sec,
+                                                     void *usr);
+
+/*
+ * Calls fn on every security in the exchange. Securities put while
+ * iterating may or may not be visited, fn must not put into e itself.
+ * @param {struct exchange*} e The exchange
+ * @param {exchange_foreach_fn} fn The function to call
+ * @param {void*} usr Passed through to fn
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_foreach(struct exchange *e,
+                                       exchange_foreach_fn fn, void *usr);
+
+/*
+ * Turns analysis on or off for every security in the exchange, including
+ * the ones that are added later. Exchanges are created with analysis on.
+ * @param {struct exchange*} e The exchange
+ * @param {bool} enabled False to stop queuing analysis
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_set_analysis(struct exchange *e,
+                                            bool enabled);
+
+/*
+ * Keeps the charts of every security of the exchange in a store in dir,
+ * including the ones that are added later. The securities already stored
+ * in dir are put into the exchange with their charts loaded. dir is not
+ * copied.
+ * @param {struct exchange*} e The exchange
+ * @param {const char*} dir The directory of the stores
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_open_store(struct exchange *e,
+                                          const char *dir);
+
+/*
+ * Writes what the stores of the securities still buffer, a live feed
+ * calls this now and then so a crash loses little. Stores are also
+ * written when the exchange is freed.
+ * @param {struct exchange*} e The exchange
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE exchange_flush_store(struct exchange *e);
+
+/*
+ * Frees the exchange and all the securities that were added to it, no
+ * other thread may be using the exchange
  * @param {struct exchange**} e Will free *e and set *e to NULL
  * @return {enum RISKI_ERROR_CODE} The status
  */
@@ -28,15 +28,25 @@
 // on interup
 #include <signal.h>
 
+// batch replay
+#include <glob.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 // std
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 // iex packet and type data
 #include <exchange/exchange.h>
 #include <iex/packet.h>
+#include <iex/pcap_mmap.h>
+#include <iex/pipeline.h>
 #include <iex/types.h>
 #include <security/security.h>
 
@@ -46,11 +56,26 @@
 #include <tracer.h>
 
 /**
- * Processes the IEX Deep data feed
- * @param file file A location to a pcap file provded by IEX
+ * Processes the IEX Deep data feed. The file is memory mapped and walked
+ * in place unless IEX_USE_LIBPCAP is set. Throughput is logged at the end.
+ * @param file file A location to a pcap or pcapng file provded by IEX
  */
 enum RISKI_ERROR_CODE iex_parse_deep(char *file);
 
+/**
+ * Processes many IEX Deep files, one per day, on a pool of IEX_BATCH_JOBS
+ * threads. Each day is parsed into its own exchange and the finished days
+ * are appended in file name order onto the charts of iex_exchange.
+ * @param location A directory of pcap/pcapng files or a glob pattern
+ */
+enum RISKI_ERROR_CODE iex_parse_deep_batch(char *location);
+
+/**
+ * Frees iex_exchange. The exchange outlives parsing so the server can keep
+ * reading it, only call this once nothing else is using it.
+ */
+enum RISKI_ERROR_CODE iex_cleanup(void);
+
 /**
  * Represents the IEX exchange
  */
@@ -67,4 +92,23 @@ enum RISKI_ERROR_CODE iex_stop_parse(void);
  */
 extern int IEX_SIGNAL_INTER;
 
+/**
+ * Set to true to replay through libpcap instead of the memory
+ * mapped reader, used to compare the two
+ */
+extern bool IEX_USE_LIBPCAP;
+
+/**
+ * The number of days iex_parse_deep_batch parses at once,
+ * 0 uses one thread per processor
+ */
+extern long IEX_BATCH_JOBS;
+
+/**
+ * The number of threads iex_parse_deep applies book and chart updates on,
+ * securities are split between them by hash. 0 applies them on the thread
+ * reading the file.
+ */
+extern long IEX_PARSE_WORKERS;
+
 #endif
@@ -0,0 +1,91 @@
+#ifndef PCAP_MMAP_
+#define PCAP_MMAP_
+
+// std
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// the error codes and stack tracer
+#include <error_codes.h>
+#include <logger.h>
+#include <tracer.h>
+
+/*
+ * A UDP datagram found inside a memory mapped capture file. The payload
+ * points straight into the mapping and is only valid until the reader is
+ * closed.
+ * @param {const unsigned char*} payload The UDP payload
+ * @param {size_t} len The number of captured payload bytes
+ * @param {uint32_t} ip_src The IPv4 source address (network byte order)
+ * @param {uint32_t} ip_dst The IPv4 destination address (network byte order)
+ */
+struct pcap_mmap_datagram {
+  const unsigned char *payload;
+  size_t len;
+  uint32_t ip_src;
+  uint32_t ip_dst;
+};
+
+/*
+ * Called once for every IPv4 UDP datagram in the capture file
+ * @param {const struct pcap_mmap_datagram*} dg The datagram
+ * @param {void*} usr The user pointer given to pcap_mmap_for_each_udp
+ * @return {enum RISKI_ERROR_CODE} The status, anything other than
+ * RISKI_ERROR_CODE_NONE stops the walk
+ */
+typedef enum RISKI_ERROR_CODE (*pcap_mmap_handler)(
+    const struct pcap_mmap_datagram *dg, void *usr);
+
+/*
+ * Private struct describing a memory mapped pcap or pcapng file
+ */
+struct pcap_mmap;
+
+/*
+ * Maps a pcap or pcapng file read only into memory and validates its
+ * header. The mapping is advised for sequential read-ahead.
+ * @param {char*} file The location of the capture file
+ * @param {struct pcap_mmap**} pm Will set *pm to the new reader
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE pcap_mmap_open(char *file, struct pcap_mmap **pm);
+
+/*
+ * Walks every packet in the file in place and hands each IPv4 UDP
+ * datagram carried over ethernet to the handler. No packet data is copied.
+ * @param {struct pcap_mmap*} pm The reader
+ * @param {pcap_mmap_handler} handler The function to call per datagram
+ * @param {void*} usr Passed through to the handler
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE pcap_mmap_for_each_udp(struct pcap_mmap *pm,
+                                             pcap_mmap_handler handler,
+                                             void *usr);
+
+/*
+ * Asks a running pcap_mmap_for_each_udp to return after the current
+ * packet, safe to call from a signal handler or another thread
+ * @param {struct pcap_mmap*} pm The reader
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE pcap_mmap_stop(struct pcap_mmap *pm);
+
+/*
+ * Gets the size of the mapped file and the number of packets walked so far
+ * @param {struct pcap_mmap*} pm The reader
+ * @param {size_t*} bytes Will set *bytes to the file size
+ * @param {size_t*} packets Will set *packets to the packets walked
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE pcap_mmap_stats(struct pcap_mmap *pm, size_t *bytes,
+                                      size_t *packets);
+
+/*
+ * Unmaps the file and frees the reader
+ * @param {struct pcap_mmap**} pm Will free *pm and set *pm to NULL
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE pcap_mmap_close(struct pcap_mmap **pm);
+
+#endif
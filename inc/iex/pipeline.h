@@ -0,0 +1,98 @@
+#ifndef IEX_PIPELINE_
+#define IEX_PIPELINE_
+
+// std
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// iex packet and type data
+#include <iex/packet.h>
+#include <iex/types.h>
+#include <security/security.h>
+
+// the error codes and stack tracer
+#include <error_codes.h>
+#include <logger.h>
+#include <tracer.h>
+
+/*
+ * The number of messages each worker ring can hold, must be a power of two
+ */
+#define IEX_PIPELINE_RING_SIZE 4096
+
+/*
+ * The number of times a worker with an empty ring or the decoder with a
+ * full one yields before it parks until the other side moves
+ */
+#define IEX_PIPELINE_SPINS 64
+
+/*
+ * A decoded message that has been routed to the worker owning its
+ * security. The body is copied out of the packet so the packet buffer can
+ * be reused as soon as the message is pushed.
+ * @param {struct security*} sec The security the message is for
+ * @param {union} body A copy of the message body
+ * @param {iex_byte_t} type The iex message type of body
+ */
+struct iex_pipeline_message {
+  struct security *sec;
+  union {
+    struct iex_price_level_update_message price_level_update;
+    struct iex_trade_report_message trade_report;
+  } body;
+  iex_byte_t type;
+
+  // 2 unused bytes in this structure
+  char _p1[2];
+};
+
+/*
+ * Called on a worker thread for every message routed to it. A security is
+ * only ever handled by one worker so messages for it arrive in order.
+ * @param {const struct iex_pipeline_message*} msg The message
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+typedef enum RISKI_ERROR_CODE (*iex_pipeline_handler)(
+    const struct iex_pipeline_message *msg);
+
+/*
+ * Private struct describing the pipeline
+ */
+struct iex_pipeline;
+
+/*
+ * Starts num_workers threads each reading from their own single producer
+ * single consumer ring
+ * @param {size_t} num_workers The number of worker threads
+ * @param {iex_pipeline_handler} handler The function applying a message
+ * @param {struct iex_pipeline**} p Will set *p to the new pipeline
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE iex_pipeline_new(size_t num_workers,
+                                       iex_pipeline_handler handler,
+                                       struct iex_pipeline **p);
+
+/*
+ * Routes a message to the worker owning msg->sec, waiting while that
+ * workers ring is full. Must only be called from a single thread.
+ * @param {struct iex_pipeline*} p The pipeline
+ * @param {const struct iex_pipeline_message*} msg The message to copy in
+ * @return {enum RISKI_ERROR_CODE} The status, the first error a worker hit
+ */
+enum RISKI_ERROR_CODE iex_pipeline_push(struct iex_pipeline *p,
+                                        const struct iex_pipeline_message *msg);
+
+/*
+ * Waits for the workers to drain their rings, joins them and frees the
+ * pipeline
+ * @param {struct iex_pipeline**} p Will free *p and set *p to NULL
+ * @return {enum RISKI_ERROR_CODE} The status, the first error a worker hit
+ */
+enum RISKI_ERROR_CODE iex_pipeline_free(struct iex_pipeline **p);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef NUMBER_FORMAT_
+#define NUMBER_FORMAT_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The most characters number_format_u64 or number_format_i64 write,
+ * 18446744073709551615 and -9223372036854775808 are both 20 long
+ */
+#define NUMBER_FORMAT_MAX_LEN 20
+
+/*
+ * Writes v in decimal to dst without a terminator, the same digits
+ * sprintf "%lu" gives. dst must have room for NUMBER_FORMAT_MAX_LEN
+ * characters.
+ * @param {uint64_t} v The number
+ * @param {char*} dst Where to write the digits
+ * @return {size_t} The number of characters written
+ */
+size_t number_format_u64(uint64_t v, char *dst);
+
+/*
+ * Writes v in decimal to dst without a terminator, the same characters
+ * sprintf "%ld" gives. dst must have room for NUMBER_FORMAT_MAX_LEN
+ * characters.
+ * @param {int64_t} v The number
+ * @param {char*} dst Where to write the digits
+ * @return {size_t} The number of characters written
+ */
+size_t number_format_i64(int64_t v, char *dst);
+
+/*
+ * The most bytes number_format_varint writes, 7 bits of a uint64_t go
+ * into each byte
+ */
+#define NUMBER_FORMAT_VARINT_MAX_LEN 10
+
+/*
+ * Writes v as a little endian base 128 varint, the low 7 bits of each
+ * byte hold the next 7 bits of v and the high bit is set on every byte
+ * but the last. dst must have room for NUMBER_FORMAT_VARINT_MAX_LEN bytes.
+ * @param {uint64_t} v The number
+ * @param {unsigned char*} dst Where to write the bytes
+ * @return {size_t} The number of bytes written
+ */
+size_t number_format_varint(uint64_t v, unsigned char *dst);
+
+/*
+ * Maps a signed number onto an unsigned one so numbers close to 0 stay
+ * small, 0, -1, 1, -2, 2 become 0, 1, 2, 3, 4. Used to write signed
+ * numbers as a varint.
+ * @param {int64_t} v The number
+ * @return {uint64_t} The zigzag encoded number
+ */
+static inline uint64_t number_format_zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (0 - ((uint64_t)v >> 63));
+}
+
+#endif
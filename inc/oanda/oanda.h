@@ -14,6 +14,12 @@
 #include <sys/socket.h>
 #include <tracer.h>
 
+/*
+ * The number of the newest candles of each chart kept in memory during a
+ * live session, older candles are spilled to disk
+ */
+#define OANDA_RESIDENT_CANDLES 4320
+
 /*
  * Represents the oanda exchange
  */
@@ -3,6 +3,8 @@
 
 #include <book/book.h>
 #include <chart/chart.h>
+#include <chart/chart_set.h>
+#include <chart/chart_store.h>
 #include <error_codes.h>
 #include <logger.h>
 #include <pthread.h>
@@ -14,12 +16,22 @@
 #define SECURITY_INTERVAL_MINUTE_NANOSECONDS 6e+10
 #define SECURITY_INTERVAL_5SECOND_NANOSECONDS 5000000000
 #define SECURITY_INTERVAL_5MINUTE_NANOSECONDS 300000000000
+#define SECURITY_INTERVAL_HOUR_NANOSECONDS 3600000000000
 
-#ifdef RUN_TESTS
-#define SECURITY_HASH_MODULE_VAL 2
-#else
-#define SECURITY_HASH_MODULE_VAL 12000
-#endif
+/*
+ * The file name suffix of the chart store of a security
+ */
+#define SECURITY_STORE_SUFFIX ".chart"
+
+/*
+ * The most levels per side security_get_depth will send
+ */
+#define SECURITY_DEPTH_MAX_LEVELS 50
+
+/*
+ * The number of levels per side the server sends in a depth snapshot
+ */
+#define SECURITY_DEPTH_LEVELS 20
 
 /*
  * Private definition of a security
@@ -27,10 +39,32 @@
 struct security;
 
 /*
- * Creates a new security given a name.
+ * The intervals of the charts new securities keep, in nanoseconds and
+ * ascending. When set the first is the base chart the feed updates and
+ * replaces the interval given to security_new. Empty keeps the defaults,
+ * see security_new.
+ */
+extern uint64_t SECURITY_INTERVALS[CHART_STORE_MAX_CHARTS];
+extern size_t SECURITY_NUM_INTERVALS;
+
+/*
+ * Sets SECURITY_INTERVALS from a comma separated list of lengths with a
+ * unit of s, m or h, such as 5s,1m,5m,1h. Every interval must be a larger
+ * multiple of the first. Must be called before any security is created.
+ * @param {const char*} list The list of intervals
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the list is not
+ * valid
+ */
+enum RISKI_ERROR_CODE security_set_intervals(const char *list);
+
+/*
+ * Creates a new security given a name. Besides the chart at interval the
+ * security keeps a chart for every SECURITY_INTERVAL that is a larger
+ * multiple of it, these are rolled up from the finalized candles. If
+ * SECURITY_INTERVALS is set its charts are kept instead.
  * @param {char*} name The name of the security
  * @param {uint64_t} interval The interval between candles in a consistent
- * time format
+ * time format, ignored when SECURITY_INTERVALS is set
  * @param {struct security**} sec Sets *sec to the newly created security
  * @return {enum RISKI_ERROR_CODE} The status
  */
@@ -45,41 +79,133 @@ enum RISKI_ERROR_CODE security_new(char *name, uint64_t interval, int precision,
  * You can not mix a fixed 4 decimal number with a fixed 5 decimal number,
  * if done this will result in undefined behavior. The quantity is the number
  * of shares.
+ * If the update moves the best bid or ask the current candle is quoted
+ * with the new top of the book.
  * @param {struct security*} sec The security to update
  * @param {bool} side True for buy False for sell
  * @param {int64_t} price The price level
  * @param {int64_t} quantity The quantity on the price level
+ * @param {uint64_t} ts The timestamp of the update
  */
 enum RISKI_ERROR_CODE security_book_update(struct security *sec, bool side,
-                                           int64_t price, int64_t quantity);
+                                           int64_t price, int64_t quantity,
+                                           uint64_t ts);
 
 /*
- * Returns a json representation of the chart, the user of this function
- * must free the resulting data
+ * Returns a json representation of the order book. If seq is 0 or the
+ * changes after seq are no longer kept, the best depth levels of each
+ * side are sent as a snapshot. Otherwise only the levels that changed
+ * after seq are sent, a quantity of 0 deletes the level. Either way the
+ * json carries the seq to ask for next time.
+ * The user of this function must free the resulting data
  * @param {struct security*} sec The security to serialize
+ * @param {size_t} depth The number of levels per side in a snapshot, at
+ * most SECURITY_DEPTH_MAX_LEVELS
+ * @param {uint64_t} seq The seq of the last json the caller applied
  * @param {char**} json Sets *json to the resulting json
+ * @param {uint64_t*} next_seq Sets *next_seq, if not NULL, to the seq the
+ * json carries
  * @return {enum RISKI_ERROR_CODE} The status
  */
-enum RISKI_ERROR_CODE security_get_chart(struct security *sec, char **json);
+enum RISKI_ERROR_CODE security_get_depth(struct security *sec, size_t depth,
+                                         uint64_t seq, char **json,
+                                         uint64_t *next_seq);
+
+/*
+ * Gets the seq of the last change made to the order book, a depth request
+ * with this seq would send no changes
+ * @param {struct security*} sec The security
+ * @param {uint64_t*} seq Sets *seq to the seq
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_get_depth_seq(struct security *sec,
+                                             uint64_t *seq);
+
+/*
+ * Returns a json representation of the chart, the user of this function
+ * must free the resulting data. Does not wait for updates to the chart,
+ * see chart_json_cached.
+ * @param {struct security*} sec The security to serialize
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
+ * @param {char**} json Sets *json to the resulting json
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
+ */
+enum RISKI_ERROR_CODE security_get_chart(struct security *sec,
+                                         uint64_t interval, char **json);
 
 /*
  * Returns a json representation of the analysis
  * done on this securities chart
  * @param {struct security*} sec The security to serialize
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
  * @param {char**} json Sets *json to the resulting json
- * @return {enum RISKI_ERROR_CODE} The status
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
  */
-enum RISKI_ERROR_CODE security_get_analysis(struct security *sec, char **json);
+enum RISKI_ERROR_CODE security_get_analysis(struct security *sec,
+                                            uint64_t interval, char **json);
+
+/*
+ * Gets the versions of a chart of the security, see chart_get_versions
+ * @param {struct security*} sec The security
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
+ * @param {uint64_t*} version Sets *version to the version of the candles
+ * @param {uint64_t*} analysis_version Sets *analysis_version to the
+ * version of the analysis
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
+ */
+enum RISKI_ERROR_CODE security_get_versions(struct security *sec,
+                                            uint64_t interval,
+                                            uint64_t *version,
+                                            uint64_t *analysis_version);
 
 /*
  * Returns the latest candle of a given security
  * @param {struct security*} sec The security to serialize
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
  * @param {char**} json Sets *json to the resulting json
- * @return {enum RISKI_ERROR_CODE} The status
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
  */
 enum RISKI_ERROR_CODE security_get_latest_candle(struct security *sec,
+                                                 uint64_t interval,
                                                  char **json);
 
+/*
+ * Returns the chart as a binary frame, see chart_bin. The user of this
+ * function must free the resulting data.
+ * @param {struct security*} sec The security to serialize
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
+ * @param {char**} bin Sets *bin to the resulting frame
+ * @param {size_t*} len Sets *len to the length of the frame
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
+ */
+enum RISKI_ERROR_CODE security_get_chart_bin(struct security *sec,
+                                             uint64_t interval, char **bin,
+                                             size_t *len);
+
+/*
+ * Returns the latest candle as a binary frame, see chart_latest_candle_bin
+ * @param {struct security*} sec The security to serialize
+ * @param {uint64_t} interval The interval of the chart, 0 for the interval
+ * the security was created with
+ * @param {char**} bin Sets *bin to the resulting frame
+ * @param {size_t*} len Sets *len to the length of the frame
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval
+ */
+enum RISKI_ERROR_CODE security_get_latest_candle_bin(struct security *sec,
+                                                     uint64_t interval,
+                                                     char **bin, size_t *len);
+
 /*
  * Updates the chart given a fixed point number, which must be of the same
  * type given to the order book, and a timestamp in a time unit that is the
@@ -94,6 +220,77 @@ enum RISKI_ERROR_CODE security_chart_update(struct security *sec, int64_t price,
                                             int64_t bid, int64_t ask,
                                             uint64_t ts);
 
+/*
+ * Updates the chart with a trade, the bid and ask are taken from the top
+ * of the order book kept by security_book_update. A side with no levels
+ * keeps its last quote, a side that has never been quoted takes the trade
+ * price. Must be called from the thread updating the book.
+ * @param {struct security*} sec The security
+ * @param {int64_t} price The price
+ * @param {uint64_t} ts The timestamp
+ * @return {enum RISKI_ERROR_CODE}
+ */
+enum RISKI_ERROR_CODE security_trade_update(struct security *sec,
+                                            int64_t price, uint64_t ts);
+
+/*
+ * Sets *name to the name of the security, the name is owned by the
+ * security and must not be freed
+ * @param {struct security*} sec The security
+ * @param {char**} name Will set *name to the name
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_get_name(struct security *sec, char **name);
+
+/*
+ * Turns analysis of the securities charts on or off
+ * @param {struct security*} sec The security
+ * @param {bool} enabled False to stop queuing analysis
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_set_analysis(struct security *sec,
+                                            bool enabled);
+
+/*
+ * Keeps only about the newest max_candles candles of each chart of the
+ * security in memory, older candles are spilled to disk
+ * @param {struct security*} sec The security
+ * @param {size_t} max_candles The number of candles to keep in memory
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_set_retention(struct security *sec,
+                                             size_t max_candles);
+
+/*
+ * Keeps the charts of the security in the file named after it with
+ * SECURITY_STORE_SUFFIX in dir. Charts already in the file are loaded
+ * first so this has to be called before the first update.
+ * @param {struct security*} sec The security
+ * @param {const char*} dir The directory of the stores
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_open_store(struct security *sec,
+                                          const char *dir);
+
+/*
+ * Writes the candles and analysis the store of the security still
+ * buffers, see chart_store_put
+ * @param {struct security*} sec The security
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_flush_store(struct security *sec);
+
+/*
+ * Appends the charts of src, which must be of a later time period, to the
+ * end of the charts of dst and hands the order book of src over to dst.
+ * src is left with empty charts and must still be freed.
+ * @param {struct security*} dst The security to merge into
+ * @param {struct security*} src The security to merge from
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE security_merge(struct security *dst,
+                                     struct security *src);
+
 /*
  * Frees the security struct
  * @param {struct security**} sec The security to free
@@ -102,10 +299,10 @@ enum RISKI_ERROR_CODE security_chart_update(struct security *sec, int64_t price,
 enum RISKI_ERROR_CODE security_free(struct security **sec);
 
 /*
- * Gets the hashed index of the security
- * hash is of module 1000
+ * Gets the hash of a security name, the full width of the hash is used
+ * so callers must reduce it to their own table size
  * @param {char*} n1 The name of the security
- * @param {size_t*} index *index will be set to the bin
+ * @param {size_t*} index *index will be set to the hash
  * @return {enum RISKI_ERROR_CODE} The status
  */
 enum RISKI_ERROR_CODE security_hash(char *n1, size_t *index);
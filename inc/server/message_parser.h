@@ -6,6 +6,8 @@
 #include <logger.h>
 #include <oanda/oanda.h>
 #include <security/search.h>
+#include <server/subscription.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -13,9 +15,30 @@
  * Takes in a message
  * @param msg The message to parse
  * @param len The length of the message
+ * @param subs The subscriptions of the session the message is from
+ * @param resp Will set *resp to the message to send back, NULL if there
+ * is none
+ * @return The status
+ */
+enum RISKI_ERROR_CODE parse_message(char *msg, size_t len,
+                                    struct subscription_set *subs,
+                                    char **resp);
+
+/**
+ * Takes in a message of a client of the binary protocol. Charts and
+ * candles are answered with the frames of chart_bin and
+ * chart_latest_candle_bin, everything else like parse_message.
+ * @param msg The message to parse
+ * @param len The length of the message
+ * @param subs The subscriptions of the session the message is from
  * @param resp Will set *resp to the message to send back
+ * @param resp_len Will set *resp_len to the length of *resp
+ * @param binary Will set *binary to true if *resp is a binary frame
  * @return The status
  */
-enum RISKI_ERROR_CODE parse_message(char *msg, size_t len, char **resp);
+enum RISKI_ERROR_CODE parse_message_bin(char *msg, size_t len,
+                                        struct subscription_set *subs,
+                                        char **resp, size_t *resp_len,
+                                        bool *binary);
 
 #endif
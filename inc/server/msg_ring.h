@@ -0,0 +1,140 @@
+#ifndef MSG_RING_
+#define MSG_RING_
+
+#include <error_codes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tracer.h>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdocumentation"
+#pragma clang diagnostic ignored "-Wreserved-id-macro"
+#pragma clang diagnostic ignored "-Wpadded"
+#pragma clang diagnostic ignored "-Wdocumentation-unknown-command"
+#pragma clang diagnostic ignored "-Wduplicate-enum"
+#include <libwebsockets.h>
+#pragma clang diagnostic pop
+
+/*
+ * The most messages waiting to be sent to a session
+ */
+#define MSG_RING_LEN 16
+
+/*
+ * A message waiting to be sent, shared by every session it is queued on.
+ * The payload is preceded by the LWS_PRE bytes lws_write needs in front
+ * of it. Messages are only touched from the thread servicing lws, so the
+ * reference count is not atomic.
+ * @param {unsigned char*} payload The payload, LWS_PRE bytes into the
+ * same allocation as the message
+ * @param {size_t} len The length of the payload
+ * @param {size_t} refs The number of holders of the message
+ * @param {bool} binary True to send it as a binary frame instead of text
+ */
+struct msg {
+  unsigned char *payload;
+  size_t len;
+  size_t refs;
+  bool binary;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
+/*
+ * What a ring does with a message that does not fit
+ */
+enum MSG_RING_POLICY {
+  // the message is refused, the caller has to wait for the ring to drain
+  MSG_RING_BACKPRESSURE = 0,
+
+  // the oldest waiting message is dropped to make room
+  MSG_RING_DROP_OLDEST = 1
+};
+
+/*
+ * The messages waiting to be sent to a session, oldest first
+ * @param {struct msg*[]} msgs The messages
+ * @param {size_t} head The index of the oldest message
+ * @param {size_t} count The number of messages
+ * @param {size_t} dropped The number of messages dropped to make room
+ */
+struct msg_ring {
+  struct msg *msgs[MSG_RING_LEN];
+  size_t head;
+  size_t count;
+  size_t dropped;
+};
+
+/*
+ * Creates a message holding a copy of data, the caller holds the only
+ * reference
+ * @param {const char*} data The payload
+ * @param {size_t} len The length of the payload
+ * @param {bool} binary True to send it as a binary frame
+ * @param {struct msg**} msg Will set *msg to the message
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_new(const char *data, size_t len, bool binary,
+                              struct msg **msg);
+
+/*
+ * Takes another reference to a message
+ * @param {struct msg*} msg The message
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_ref(struct msg *msg);
+
+/*
+ * Drops a reference to a message, freeing it with the last one
+ * @param {struct msg**} msg The message, *msg is set to NULL
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_unref(struct msg **msg);
+
+/*
+ * Queues a message, the ring takes its own reference
+ * @param {struct msg_ring*} ring The ring
+ * @param {struct msg*} msg The message
+ * @param {enum MSG_RING_POLICY} policy What to do if the ring is full,
+ * with MSG_RING_BACKPRESSURE the push fails with
+ * RISKI_ERROR_CODE_INSUFFITIENT_SPACE
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_ring_push(struct msg_ring *ring, struct msg *msg,
+                                    enum MSG_RING_POLICY policy);
+
+/*
+ * The oldest message of a ring, without taking it off the ring
+ * @param {struct msg_ring*} ring The ring
+ * @param {struct msg**} msg Will set *msg to the message, NULL if the ring
+ * is empty
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_ring_peek(struct msg_ring *ring, struct msg **msg);
+
+/*
+ * Takes the oldest message off a ring and drops the ring's reference
+ * @param {struct msg_ring*} ring The ring, must not be empty
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_ring_pop(struct msg_ring *ring);
+
+/*
+ * Drops every message of a ring
+ * @param {struct msg_ring*} ring The ring
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE msg_ring_clear(struct msg_ring *ring);
+
+/*
+ * True if the next push with MSG_RING_BACKPRESSURE would be refused
+ * @param {struct msg_ring*} ring The ring
+ */
+static inline bool msg_ring_full(const struct msg_ring *ring) {
+  return ring->count == MSG_RING_LEN;
+}
+
+#endif
@@ -18,6 +18,12 @@
 
 extern int SERVER_INTERRUPTED;
 
+/*
+ * How often a client is pushed the changes to the charts it is subscribed
+ * to, a chart that changes faster is only pushed once per interval
+ */
+#define SERVER_PUSH_INTERVAL_US (LWS_USEC_PER_SEC / 4)
+
 void *server_start(void *);
 
 #endif
@@ -0,0 +1,167 @@
+#ifndef SUBSCRIPTION_
+#define SUBSCRIPTION_
+
+#include <error_codes.h>
+#include <security/security.h>
+#include <server/msg_ring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <tracer.h>
+
+/*
+ * The most charts and order books a session can be subscribed to
+ */
+#define SUBSCRIPTION_MAX 32
+
+/*
+ * A chart or order book a session is subscribed to
+ * @param {struct security*} sec The security of the chart
+ * @param {uint64_t} interval The interval of the chart, 0 for the default
+ * chart of the security
+ * @param {uint64_t} version The version of the candles last pushed
+ * @param {uint64_t} analysis_version The version of the analysis last
+ * pushed
+ * @param {uint64_t} depth_seq The seq of the depth last pushed, 0 until
+ * the first snapshot
+ * @param {bool} depth True if the subscription is to the order book of
+ * the security instead of a chart
+ */
+struct subscription {
+  struct security *sec;
+  uint64_t interval;
+  uint64_t version;
+  uint64_t analysis_version;
+  uint64_t depth_seq;
+  bool depth;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
+/*
+ * The charts a session is subscribed to. Changes are pushed in rounds, a
+ * round looks at every subscription once so a busy chart is pushed at
+ * most once per round and can not hold back the others.
+ * @param {struct subscription[]} subs The subscriptions
+ * @param {size_t} num_subs The number of subscriptions
+ * @param {size_t} next The subscription the round looks at next
+ * @param {size_t} left The number of subscriptions the round has not
+ * looked at yet
+ * @param {bool} candle_sent True if the candle of next was pushed and
+ * only its analysis is left
+ */
+struct subscription_set {
+  struct subscription subs[SUBSCRIPTION_MAX];
+  size_t num_subs;
+  size_t next;
+  size_t left;
+  bool candle_sent;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
+/*
+ * The number of pushes a subscription_cache keeps
+ */
+#define SUBSCRIPTION_CACHE_LEN 64
+
+/*
+ * A push kept so that every session subscribed to the same chart sends
+ * the same message
+ * @param {struct security*} sec The security of the chart
+ * @param {uint64_t} interval The interval of the chart
+ * @param {uint64_t} version The version of the candles, or of the
+ * analysis, the message was built from
+ * @param {struct msg*} msg The message, NULL for an empty entry
+ * @param {bool} analysis True if the message is the analysis of the chart
+ * instead of its latest candle
+ */
+struct subscription_cached {
+  struct security *sec;
+  uint64_t interval;
+  uint64_t version;
+  struct msg *msg;
+  bool analysis;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
+/*
+ * The pushes last built for the charts sessions are subscribed to, an
+ * entry is replaced by the next push of another chart that hashes to it.
+ * A cache is only used by sessions of one protocol, so its candles are
+ * either all binary or all json.
+ * @param {struct subscription_cached[]} entries The pushes
+ */
+struct subscription_cache {
+  struct subscription_cached entries[SUBSCRIPTION_CACHE_LEN];
+};
+
+/*
+ * Drops every push kept by a cache
+ * @param {struct subscription_cache*} cache The cache
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE
+subscription_cache_clear(struct subscription_cache *cache);
+
+/*
+ * Subscribes to a chart or to the order book of a security, subscribing
+ * twice to the same one does nothing. The current candle and analysis, or
+ * a snapshot of the book, are pushed in the next round.
+ * @param {struct subscription_set*} set The subscriptions of a session
+ * @param {struct security*} sec The security
+ * @param {uint64_t} interval The interval of the chart, 0 for the default
+ * @param {bool} depth True to subscribe to the order book, interval is
+ * ignored
+ * @return {enum RISKI_ERROR_CODE} The status, an error if the security has
+ * no chart with that interval or the set is full
+ */
+enum RISKI_ERROR_CODE subscription_add(struct subscription_set *set,
+                                       struct security *sec,
+                                       uint64_t interval, bool depth);
+
+/*
+ * Unsubscribes from a chart or an order book
+ * @param {struct subscription_set*} set The subscriptions of a session
+ * @param {struct security*} sec The security
+ * @param {uint64_t} interval The interval of the chart, 0 for the default
+ * @param {bool} depth True to unsubscribe from the order book, interval is
+ * ignored
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE subscription_remove(struct subscription_set *set,
+                                          struct security *sec,
+                                          uint64_t interval, bool depth);
+
+/*
+ * Starts a new round of pushes
+ * @param {struct subscription_set*} set The subscriptions of a session
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE subscription_round(struct subscription_set *set);
+
+/*
+ * Finds the next push of the round. A chart whose candles changed since
+ * the last push is sent as its latest candle, one whose analysis changed
+ * as its full analysis, the same messages latest and analysis answer
+ * with. A push already built for another session is shared with it. An
+ * order book that changed is sent as the depth json of the changes since
+ * the last push, each session has its own seq so these are not shared.
+ * @param {struct subscription_set*} set The subscriptions of a session
+ * @param {struct subscription_cache*} cache The pushes shared between
+ * the sessions
+ * @param {bool} binary True to send candles as the frames of
+ * chart_latest_candle_bin instead of json
+ * @param {struct msg**} msg Will set *msg to the message, the caller holds
+ * a reference to it, NULL once the round is over
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE subscription_next(struct subscription_set *set,
+                                        struct subscription_cache *cache,
+                                        bool binary, struct msg **msg);
+
+#endif
@@ -2,6 +2,8 @@
 #define STRING_BUILDER_
 
 #include <error_codes.h>
+#include <number_format.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,11 +25,57 @@ enum RISKI_ERROR_CODE string_builder_new(struct string_builder **sb);
  * of a string builder.
  * @param {struct string_builder*} sb The string builder
  * @param {char*} c The text to append
- * @param {size_t} n The length of c
  * @return {enum RISKI_ERROR_CODE} The status
  */
 enum RISKI_ERROR_CODE string_builder_append(struct string_builder *sb, char *c);
 
+/*
+ * Appends the first n characters of c, c does not need to be NULL
+ * terminated
+ * @param {struct string_builder*} sb The string builder
+ * @param {const char*} c The text to append
+ * @param {size_t} n The length of c
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_append_n(struct string_builder *sb,
+                                              const char *c, size_t n);
+
+/*
+ * Appends a single character
+ * @param {struct string_builder*} sb The string builder
+ * @param {char} c The character to append
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_append_char(struct string_builder *sb,
+                                                 char c);
+
+/*
+ * Appends the decimal text of a signed integer
+ * @param {struct string_builder*} sb The string builder
+ * @param {int64_t} v The number to append
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_append_i64(struct string_builder *sb,
+                                                int64_t v);
+
+/*
+ * Appends the decimal text of an unsigned integer
+ * @param {struct string_builder*} sb The string builder
+ * @param {uint64_t} v The number to append
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_append_u64(struct string_builder *sb,
+                                                uint64_t v);
+
+/*
+ * Gets the length of the string built so far
+ * @param {struct string_builder*} sb The string builder
+ * @param {size_t*} len Will be set to the length
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_len(struct string_builder *sb,
+                                         size_t *len);
+
 /*
  * Gets the string built by the string builder. The *c pointer is
  * set to the value of the string.
@@ -37,6 +85,17 @@ enum RISKI_ERROR_CODE string_builder_append(struct string_builder *sb, char *c);
  */
 enum RISKI_ERROR_CODE string_builder_str(struct string_builder *sb, char **c);
 
+/*
+ * Hands the string built by the string builder over to the caller
+ * without copying it, the caller frees *c. The string builder is left
+ * empty and can be reused or freed.
+ * @param {struct string_builder*} sb The string builder
+ * @param {char**} c A pointer to a char* array
+ * @return {enum RISKI_ERROR_CODE} The status
+ */
+enum RISKI_ERROR_CODE string_builder_take(struct string_builder *sb,
+                                          char **c);
+
 /*
  * Frees a string builder object including the string it represents
  * @param {struct string_builder*} sb The string builder to free
@@ -11,26 +11,57 @@ const char* get_author() {
   return author;
 }
 
-enum RISKI_ERROR_CODE
-run (struct chart *cht, size_t idx)
+/*
+ * The last finalised candle seen for a chart, so the next call only has to
+ * read its own candle
+ * @param {size_t} idx The index of the candle
+ * @param {bool} valid false until a candle has been read
+ */
+struct engulfing_state
+{
+  size_t idx;
+  int64_t o, h, l, c;
+  bool valid;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
+
+static enum RISKI_ERROR_CODE
+read_candle (struct chart *cht, size_t idx, struct engulfing_state *st)
+{
+  struct candle *cnd = NULL;
+  TRACE (chart_get_candle (cht, idx, &cnd));
+  TRACE (candle_open (cnd, &st->o));
+  TRACE (candle_high (cnd, &st->h));
+  TRACE (candle_low (cnd, &st->l));
+  TRACE (candle_close (cnd, &st->c));
+  st->idx = idx;
+  st->valid = true;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+find_engulfing (struct chart *cht, size_t idx, struct engulfing_state *prev)
 {
   PTR_CHECK (cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK (prev, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   if (idx < 2)
     {
       return RISKI_ERROR_CODE_NONE;
     }
-  struct candle *cnd1 = NULL;
-  TRACE (chart_get_candle (cht, idx - 1, &cnd1));
 
-  struct candle *cnd2 = NULL;
-  TRACE (chart_get_candle (cht, idx - 2, &cnd2));
+  // the previous call did not read idx - 2 after a gap in trading
+  struct engulfing_state cnd2 = *prev;
+  if (!cnd2.valid || cnd2.idx != idx - 2)
+    TRACE (read_candle (cht, idx - 2, &cnd2));
 
-  int64_t cnd1_o, cnd1_h, cnd1_l, cnd1_c = 0;
-  TRACE (candle_open (cnd1, &cnd1_o));
-  TRACE (candle_high (cnd1, &cnd1_h));
-  TRACE (candle_low (cnd1, &cnd1_l));
-  TRACE (candle_close (cnd1, &cnd1_c));
+  struct engulfing_state cnd1;
+  TRACE (read_candle (cht, idx - 1, &cnd1));
+  *prev = cnd1;
+
+  int64_t cnd1_o = cnd1.o, cnd1_h = cnd1.h, cnd1_l = cnd1.l, cnd1_c = cnd1.c;
 
   // make sure this candle is going up
   if (cnd1_c <= cnd1_o)
@@ -38,11 +69,7 @@ run (struct chart *cht, size_t idx)
       return RISKI_ERROR_CODE_NONE;
     }
 
-  int64_t cnd2_o, cnd2_h, cnd2_l, cnd2_c = 0;
-  TRACE (candle_open (cnd2, &cnd2_o));
-  TRACE (candle_high (cnd2, &cnd2_h));
-  TRACE (candle_low (cnd2, &cnd2_l));
-  TRACE (candle_close (cnd2, &cnd2_c));
+  int64_t cnd2_o = cnd2.o, cnd2_h = cnd2.h, cnd2_l = cnd2.l, cnd2_c = cnd2.c;
 
   // make sure this candle is going down
   if (cnd2_c >= cnd2_o)
@@ -86,8 +113,49 @@ run (struct chart *cht, size_t idx)
   return RISKI_ERROR_CODE_NONE;
 }
 
+enum RISKI_ERROR_CODE
+run (struct chart *cht, size_t idx)
+{
+  struct engulfing_state prev = { 0 };
+  TRACE (find_engulfing (cht, idx, &prev));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+init_state (struct chart *cht, void **state)
+{
+  PTR_CHECK (cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK (state, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *state = calloc (1, sizeof (struct engulfing_state));
+  PTR_CHECK (*state, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+on_candle (struct chart *cht, void *state, size_t idx)
+{
+  TRACE (find_engulfing (cht, idx, (struct engulfing_state*) state));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static void
+free_state (void *state)
+{
+  free (state);
+}
+
 struct vtable exports = {
   get_name,
   get_author,
   run
 };
+
+struct vtable_incremental incremental_exports = {
+  RISKI_PLUGIN_ABI_VERSION,
+  { 0 },
+  init_state,
+  on_candle,
+  free_state,
+  NULL
+};
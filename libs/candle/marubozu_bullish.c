@@ -12,6 +12,44 @@ const char* get_author()
   return author;
 }
 
+/*
+ * Checks the open, high, low and close of a candle for a marubozu
+ */
+static bool
+is_marubozu (int64_t o, int64_t h, int64_t l, int64_t c)
+{
+  // we check l != h to make sure we don't have a doji
+  return o == l && c == h && l != h;
+}
+
+/*
+ * Puts a marubozu on the candle before idx
+ */
+static enum RISKI_ERROR_CODE
+put_marubozu (struct chart *cht, size_t idx)
+{
+  struct analysis_result *res =
+    (struct analysis_result*) malloc(sizeof(struct analysis_result) * 1);
+  PTR_CHECK(res, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  res->type = CANDLE_PATTERN;
+  
+  struct candle_pattern *data = malloc(sizeof(struct candle_pattern) * 1);
+  data->candles_spanning = 1;
+  data->short_code = strdup("M");
+
+  res->draw_data = (void*) data;
+
+  char* sec_name = NULL;
+  TRACE(chart_get_name(cht, &sec_name));
+
+  logger_analysis(sec_name, name, __func__,
+      FILENAME_SHORT, __LINE__, "%s" , " ");
+  TRACE(chart_put_analysis(cht, idx-1,res));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE
 run(struct chart* cht, size_t idx)
 {
@@ -30,28 +68,36 @@ run(struct chart* cht, size_t idx)
   int64_t c = 0;
   TRACE (candle_close (cnd, &c));
 
-  // we check l != h to make sure we don't have a doji
-  if (o == l && c == h && l != h)
+  if (is_marubozu (o, h, l, c))
     {
-      // we have a marubozu here
-      struct analysis_result *res =
-        (struct analysis_result*) malloc(sizeof(struct analysis_result) * 1);
-      PTR_CHECK(res, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+      TRACE (put_marubozu (cht, idx));
+    }
 
-      res->type = CANDLE_PATTERN;
-      
-      struct candle_pattern *data = malloc(sizeof(struct candle_pattern) * 1);
-      data->candles_spanning = 1;
-      data->short_code = strdup("M");
+  return RISKI_ERROR_CODE_NONE;
+}
 
-      res->draw_data = (void*) data;
+/*
+ * The charts all finalized a candle of the same interval at the same time,
+ * their candles are read straight out of the columns of the charts
+ */
+static enum RISKI_ERROR_CODE
+run_batch (struct chart **charts, size_t *idx, size_t n)
+{
+  PTR_CHECK (charts, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK (idx, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-      char* sec_name = NULL;
-      TRACE(chart_get_name(cht, &sec_name));
+  for (size_t i = 0; i < n; ++i)
+    {
+      struct chart_span span;
+      TRACE (chart_span (charts[i], idx[i] - 1, idx[i] - 1, &span));
 
-      logger_analysis(sec_name, name, __func__,
-          FILENAME_SHORT, __LINE__, "%s" , " ");
-      TRACE(chart_put_analysis(cht, idx-1,res));
+      // a candle of a flat run is a doji
+      if (!span.flat
+          && is_marubozu (span.open[0], span.high[0], span.low[0],
+                          span.close[0]))
+        {
+          TRACE (put_marubozu (charts[i], idx[i]));
+        }
     }
 
   return RISKI_ERROR_CODE_NONE;
@@ -62,3 +108,12 @@ struct vtable exports = {
   get_author,
   run
 };
+
+struct vtable_incremental incremental_exports = {
+  RISKI_PLUGIN_ABI_VERSION,
+  { 0 },
+  NULL,
+  NULL,
+  NULL,
+  run_batch
+};
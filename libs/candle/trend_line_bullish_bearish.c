@@ -5,8 +5,6 @@
 static const char* name = "Orbitally Trends";
 static const char* author = "washcloth";
 
-enum RISKI_ERROR_CODE get_working_value (struct candle *cnd, int64_t *res, enum DIRECTION type);
-
 const char* get_name() {
   return name;
 }
@@ -15,65 +13,121 @@ const char* get_author() {
   return author;
 }
 
-enum RISKI_ERROR_CODE
-get_working_value (struct candle *cnd, int64_t *res, enum DIRECTION type)
+/*
+ * The lows, highs and closes of the finalised candles of a chart. Every
+ * call searches back to the first candle, so they are read from the chart
+ * once and kept here, 24 bytes a candle.
+ * @param {int64_t*} low The low of each candle
+ * @param {int64_t*} high The high of each candle
+ * @param {int64_t*} close The close of each candle
+ * @param {size_t} len The number of candles read
+ * @param {size_t} cap The number of candles the arrays hold
+ */
+struct trend_line_state
 {
-  switch (type)
+  int64_t *low;
+  int64_t *high;
+  int64_t *close;
+  size_t len;
+  size_t cap;
+};
+
+/*
+ * Reads the candles from st->len up to idx into the state
+ */
+static enum RISKI_ERROR_CODE
+read_candles (struct chart *cht, struct trend_line_state *st, size_t idx)
+{
+  if (idx <= st->len)
+    return RISKI_ERROR_CODE_NONE;
+
+  if (idx > st->cap)
     {
-    case DIRECTION_SUPPORT:
-      TRACE (candle_low (cnd, res));
-      break;
-    case DIRECTION_RESISTANCE:
-      TRACE (candle_high (cnd, res));
-      break;
-    case DIRECTION_INVALIDATED_RESISTANCE:
-    case DIRECTION_INVALIDATED_SUPPORT:
-      TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
-            __LINE__, "%s", "INVALIDED is not a valid trend type"));
-      break;
+      size_t cap = st->cap ? st->cap : 1024;
+      while (cap < idx)
+        cap *= 2;
+
+      int64_t *low = realloc (st->low, cap * sizeof (int64_t));
+      PTR_CHECK (low, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+      st->low = low;
+      int64_t *high = realloc (st->high, cap * sizeof (int64_t));
+      PTR_CHECK (high, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+      st->high = high;
+      int64_t *close = realloc (st->close, cap * sizeof (int64_t));
+      PTR_CHECK (close, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+      st->close = close;
+      st->cap = cap;
+    }
+
+  // a flat run has the same price all the way through
+  struct chart_span span;
+  for (size_t s = st->len; s < idx; s += span.len)
+    {
+      TRACE (chart_span (cht, s, idx - 1, &span));
+      for (size_t k = 0; k < span.len; ++k)
+        {
+          st->low[s + k] = span.flat ? span.price : span.low[k];
+          st->high[s + k] = span.flat ? span.price : span.high[k];
+          st->close[s + k] = span.flat ? span.price : span.close[k];
+        }
     }
+  st->len = idx;
   return RISKI_ERROR_CODE_NONE;
 }
 
 static enum RISKI_ERROR_CODE
-find_trend_line (struct chart *cht, size_t num_candles, enum DIRECTION type)
+find_trend_line (struct chart *cht, struct trend_line_state *st,
+                 size_t num_candles, enum DIRECTION type)
 {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR,
       RISKI_ERROR_TEXT);
+  PTR_CHECK(st, RISKI_ERROR_CODE_NULL_PTR,
+      RISKI_ERROR_TEXT);
 
   if (num_candles < 3)
     return RISKI_ERROR_CODE_NONE;
 
-  size_t slope_first_point = num_candles - 1;
+  const int64_t *working = NULL;
+  switch (type)
+    {
+    case DIRECTION_SUPPORT:
+      working = st->low;
+      break;
+    case DIRECTION_RESISTANCE:
+      working = st->high;
+      break;
+    case DIRECTION_INVALIDATED_RESISTANCE:
+    case DIRECTION_INVALIDATED_SUPPORT:
+      TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+            __LINE__, "%s", "INVALIDED is not a valid trend type"));
+      return RISKI_ERROR_CODE_UNKNOWN;
+    }
 
-  struct candle *candle_first = NULL;
-  TRACE (chart_get_candle (cht, slope_first_point, &candle_first));
-  int64_t candle_first_working_value = 0;
-  TRACE (get_working_value (candle_first, &candle_first_working_value, type));
+  size_t slope_first_point = num_candles - 1;
+  int64_t candle_first_working_value = working[slope_first_point];
 
   size_t max_confirmation_width = num_candles / 3;
   for (size_t w = max_confirmation_width; w >= 1; --w)
     {
-      int64_t confirmation_working_value = 0;
-      struct candle *confirmation_candle = NULL;
-      TRACE (
-          chart_get_candle (cht, num_candles - w - 1, &confirmation_candle));
-      TRACE (get_working_value (confirmation_candle,
-                                &confirmation_working_value, type));
+      int64_t confirmation_working_value = working[num_candles - w - 1];
 
       // Create a line between the last candle and last candle - width
       struct linear_equation *eq = linear_equation_new (
           (int64_t) slope_first_point, candle_first_working_value,
           (int64_t) (slope_first_point - w - 1), confirmation_working_value);
 
-      bool trend_broken = false;
-
       size_t num_indirect_confirmations = 0;
       size_t num_confirmations = 0;
       size_t last_valid_confirmation = 0;
 
+      // the candles from checked_from to the last one are on the right
+      // side of the line, checked_equal of them are on it. Confirmation
+      // points only move back so each pass checks the candles it added.
+      size_t checked_from = num_candles;
+      size_t checked_equal = 0;
+
       for (int64_t c = (int64_t) (slope_first_point - w - 1);
-          c >= 0 && !trend_broken;
+          c >= 0;
            c -= w)
         {
           // Check if the expected confirmation point is true
@@ -87,14 +141,7 @@ find_trend_line (struct chart *cht, size_t num_candles, enum DIRECTION type)
           for (size_t r = ((size_t)c - w / 2);
                r <= (size_t)c + w / 2 && (size_t)r < num_candles; ++r)
             {
-              struct candle *possible_confirmation = NULL;
-              TRACE (chart_get_candle (cht, r, &possible_confirmation));
-              int64_t possible_confirmation_val = 0;
-              TRACE (get_working_value (possible_confirmation,
-                                        &possible_confirmation_val, type));
-
-              if (linear_equation_direction (eq, (int64_t)r,
-                    possible_confirmation_val)
+              if (linear_equation_direction (eq, (int64_t)r, working[r])
                   == LINEAR_EQUATION_DIRECTION_EQUAL)
                 {
                   at_least_one_confirmation = true;
@@ -104,56 +151,41 @@ find_trend_line (struct chart *cht, size_t num_candles, enum DIRECTION type)
             }
 
           if (!at_least_one_confirmation)
-            {
-              trend_broken = true;
-              break;
-            }
+            break;
 
           // Check the data inbetween the last two confirmation points
-          for (size_t i = confirmation_point;
-               i < num_candles && !trend_broken; ++i)
+          size_t pass_equal = 0;
+          for (size_t i = confirmation_point; i < checked_from; ++i)
             {
-              struct candle *cnd = NULL;
-              TRACE (chart_get_candle (cht, i, &cnd));
-              int64_t working_value = 0;
-              TRACE (candle_close (cnd, &working_value));
               enum LINEAR_EQUATION_DIRECTION dir
-                  = linear_equation_direction (eq, (int64_t) i, working_value);
+                  = linear_equation_direction (eq, (int64_t) i,
+                                               st->close[i]);
 
               switch (dir)
                 {
                 case LINEAR_EQUATION_DIRECTION_ABOVE:
-                  switch (type)
+                  if (type == DIRECTION_RESISTANCE)
                     {
-                    case DIRECTION_SUPPORT:
-                      break;
-                    case DIRECTION_RESISTANCE:
-                      trend_broken = true;
+                      num_indirect_confirmations += pass_equal;
                       goto dont_confirm;
-                    case DIRECTION_INVALIDATED_RESISTANCE:
-                    case DIRECTION_INVALIDATED_SUPPORT:
-                      return RISKI_ERROR_CODE_UNKNOWN;
                     }
                   break;
                 case LINEAR_EQUATION_DIRECTION_BELOW:
-                  switch (type)
+                  if (type == DIRECTION_SUPPORT)
                     {
-                    case DIRECTION_SUPPORT:
-                      trend_broken = true;
+                      num_indirect_confirmations += pass_equal;
                       goto dont_confirm;
-                    case DIRECTION_RESISTANCE:
-                      continue;
-                    case DIRECTION_INVALIDATED_RESISTANCE:
-                    case DIRECTION_INVALIDATED_SUPPORT:
-                      return RISKI_ERROR_CODE_UNKNOWN;
                     }
                   break;
                 case LINEAR_EQUATION_DIRECTION_EQUAL:
-                  num_indirect_confirmations += 1;
+                  pass_equal += 1;
                   break;
                 }
             }
 
+          checked_from = confirmation_point;
+          checked_equal += pass_equal;
+          num_indirect_confirmations += checked_equal;
           num_confirmations += 1;
           last_valid_confirmation = confirmation_point;
         }
@@ -197,14 +229,57 @@ find_trend_line (struct chart *cht, size_t num_candles, enum DIRECTION type)
   return RISKI_ERROR_CODE_NONE;
 }
 
+static enum RISKI_ERROR_CODE
+find_trend_lines (struct chart *cht, struct trend_line_state *st, size_t idx)
+{
+  TRACE (read_candles (cht, st, idx));
+  TRACE (find_trend_line (cht, st, idx, DIRECTION_SUPPORT));
+  TRACE (find_trend_line (cht, st, idx, DIRECTION_RESISTANCE));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static void
+free_state (void *state)
+{
+  struct trend_line_state *st = state;
+  if (!st)
+    return;
+  free (st->low);
+  free (st->high);
+  free (st->close);
+  free (st);
+}
+
 enum RISKI_ERROR_CODE
 run(struct chart* cht, size_t idx)
 {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR,
       RISKI_ERROR_TEXT);
 
-  TRACE(find_trend_line(cht, idx, DIRECTION_SUPPORT));
-  TRACE(find_trend_line(cht, idx, DIRECTION_RESISTANCE));
+  struct trend_line_state st = { 0 };
+  enum RISKI_ERROR_CODE status = find_trend_lines (cht, &st, idx);
+  free (st.low);
+  free (st.high);
+  free (st.close);
+  TRACE (status);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+init_state (struct chart *cht, void **state)
+{
+  PTR_CHECK (cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK (state, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *state = calloc (1, sizeof (struct trend_line_state));
+  PTR_CHECK (*state, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+on_candle (struct chart *cht, void *state, size_t idx)
+{
+  TRACE (find_trend_lines (cht, (struct trend_line_state*) state, idx));
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -213,3 +288,12 @@ struct vtable exports = {
   get_author,
   run
 };
+
+struct vtable_incremental incremental_exports = {
+  RISKI_PLUGIN_ABI_VERSION,
+  { 0 },
+  init_state,
+  on_candle,
+  free_state,
+  NULL
+};
@@ -3,61 +3,208 @@
 #include <stdatomic.h>
 
 /*
- * The analysis info struct is the value of the linked list
- * created by analysis_list.
+ * The most jobs a worker keeps in its deque
+ */
+#define ANALYSIS_DEQUE_LEN 256
+
+/*
+ * The most charts waiting for a worker to move them into its deque, a
+ * power of two. Charts pushed while it is full are dropped.
+ */
+#define ANALYSIS_QUEUE_LEN 32768
+
+/*
+ * The most candles of one chart a worker analyses before the chart goes
+ * to the back of the queue
+ */
+#define ANALYSIS_BATCH_LEN 64
+
+/*
+ * The most charts a worker analyses together when a plugin has run_batch
+ */
+#define ANALYSIS_GATHER_LEN 64
+
+/*
+ * The most analysis infos a thread keeps around for reuse
+ */
+#define ANALYSIS_FREE_LEN (2 * ANALYSIS_DEQUE_LEN)
+
+/*
+ * A job in the deque of a worker, the candles to analyse are kept by the
+ * chart. Once run it goes on the free list of the thread that ran it, so
+ * a worker seldom has to allocate one.
  *
  * @param {struct chart*} cht A candle stick chart
- * @param {size_t} start_candle The start analysis candle
- * @param {size_t} end_candle The end analysis candle
- * @param {struct analysis_info* | NULL} next The next element in the list
- * @param {struct analysis_info* | NULL} prev The prev element in the list
+ * @param {struct analysis_info* | NULL} next The next element in the free
+ * list
  */
 struct analysis_info {
   struct chart *cht;
-  size_t start_candle;
-  size_t end_candle;
   struct analysis_info *next;
-  struct analysis_info *prev;
 };
 
 /*
- * An overarching structure containing meta data for the linked list
- * @param {struct analysis_info*} head The head of the linked list
- * @param {struct analysis_info*} tail The tail of the linked list
- * @param {pthread_mutex_t} can_remove A mutex locking head and tail
- *  from being written and read at the same time.
- * @param {size_t} num_elements The number of elements in the list
+ * A chart in the queue, held by value so pushing does not allocate
+ * @param {atomic_size_t} seq Whose turn the slot is. A producer may fill
+ * the slot at position pos while seq is pos, the consumer may empty it once
+ * seq is pos + 1 and hands it back for pos + ANALYSIS_QUEUE_LEN.
+ * @param {struct chart*} cht A candle stick chart
+ */
+struct analysis_slot {
+  atomic_size_t seq;
+  struct chart *cht;
+};
+
+/*
+ * A bounded lock-free queue of jobs with many producers and one consumer
+ * at a time. Producers claim a position with a compare and swap on tail,
+ * a worker that wins draining pops from head.
+ * @param {atomic_size_t} tail The position of the next push
+ * @param {size_t} head The position of the next pop, only touched while
+ * holding draining
+ * @param {atomic_size_t} dropped The number of jobs dropped because the queue
+ * was full
+ * @param {atomic_flag} draining Held by the worker popping
+ * @param {struct analysis_slot[]} slots The jobs
+ */
+struct analysis_queue {
+  atomic_size_t tail;
+
+  // tail is written by every producer, head by the consumer
+  char _p1[56];
+
+  size_t head;
+  atomic_size_t dropped;
+  atomic_flag draining;
+
+  // 7 unused bytes in this structure
+  char _p2[7];
+
+  struct analysis_slot slots[ANALYSIS_QUEUE_LEN];
+};
+
+/*
+ * The jobs of one worker. Only the worker pushes and takes at the bottom,
+ * any worker may steal from the top (a Chase-Lev deque). top and bottom
+ * only grow, the slot of a job is its index modulo ANALYSIS_DEQUE_LEN.
+ * @param {atomic_long} top The index of the oldest job
+ * @param {atomic_long} bottom One past the index of the newest job
+ * @param {struct analysis_info*[]} jobs The jobs
  */
-struct analysis_list {
-  struct analysis_info *head;
-  struct analysis_info *tail;
-  pthread_mutex_t can_remove;
-  int _Atomic num_elements;
+struct analysis_deque {
+  atomic_long top;
+
+  // top and bottom are written by different threads
+  char _p1[56];
 
-  // 4 extra usable bytes in this structure
-  char _p1[4];
+  atomic_long bottom;
+
+  char _p2[56];
+
+  _Atomic(struct analysis_info *) jobs[ANALYSIS_DEQUE_LEN];
 };
 
 /*
- * A list of loaded vtables
+ * A list of loaded vtables. incs[i] is the incremental vtable of funs[i] if
+ * it has on_candle, batches[i] if it has run_batch, otherwise both are NULL
+ * and the plugin only has run.
  */
 struct analysis_functions {
   size_t num_functions;
+  size_t num_batched;
   void **handles;
   struct vtable **funs;
+  struct vtable_incremental **incs;
+  struct vtable_incremental **batches;
 };
 
 /*
  * Loaded functions
  */
-static struct analysis_functions loaded_funs = {0, NULL, NULL};
+static struct analysis_functions loaded_funs = {0, 0, NULL, NULL, NULL, NULL};
+
+/*
+ * The states the incremental plugins keep for a chart, in a list of every
+ * chart that has them so they can be freed before the plugins are closed
+ * @param {struct chart*} cht The chart
+ * @param {void**} states The state of each loaded function, NULL for
+ * plugins without one
+ * @param {struct analysis_state*} next The next chart in the list
+ * @param {struct analysis_state*} prev The previous chart in the list
+ */
+struct analysis_state {
+  struct chart *cht;
+  void **states;
+  struct analysis_state *next;
+  struct analysis_state *prev;
+};
+
+/*
+ * Every chart with plugin states, changed under states_lock
+ */
+static struct analysis_state *chart_states = NULL;
+static pthread_mutex_t states_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
- * Keeps track of which bin the next request will go into.
- * This is incremented everytime analysis_push is called and
- * modded (%) by num_analysis_threads
+ * An end of a gathered chart, sorted by the candle it finalized
+ * @param {uint64_t} start The start of the candle before idx, 0 if the
+ * ends are not grouped
+ * @param {uint64_t} interval The interval of the chart, 0 if the ends are
+ * not grouped
+ * @param {size_t} chart The index of the chart in the gather
+ * @param {size_t} idx The end
  */
-static long current_analysis_index = 0;
+struct analysis_end {
+  uint64_t start;
+  uint64_t interval;
+  size_t chart;
+  size_t idx;
+};
+
+/*
+ * The charts a worker analyses together. The ends of every chart are
+ * sorted by the start and interval of the candle they finalized, ends of
+ * the same candle time make a group. A chart's ends start later one after
+ * the other, so it is in a group once and its ends are run in order.
+ * @param {size_t} num_charts The number of charts
+ * @param {struct analysis_info*[]} infs The jobs of the charts
+ * @param {struct analysis_state*[]} states The plugin states of the charts
+ * @param {size_t} num_ends The number of ends of all charts
+ * @param {struct analysis_end[]} ends The ends of all charts
+ * @param {size_t[]} taken Room for the ends of one chart
+ * @param {struct chart*[]} charts The charts in the current group
+ * @param {size_t[]} idx The end of each chart in the current group
+ * @param {struct analysis_state*[]} group_states The plugin states of each
+ * chart in the current group
+ */
+struct analysis_gather {
+  size_t num_charts;
+  struct analysis_info *infs[ANALYSIS_GATHER_LEN];
+  struct analysis_state *states[ANALYSIS_GATHER_LEN];
+  size_t num_ends;
+  struct analysis_end ends[ANALYSIS_GATHER_LEN * ANALYSIS_BATCH_LEN];
+  size_t taken[ANALYSIS_BATCH_LEN];
+  struct chart *charts[ANALYSIS_GATHER_LEN];
+  size_t idx[ANALYSIS_GATHER_LEN];
+  struct analysis_state *group_states[ANALYSIS_GATHER_LEN];
+};
+
+/*
+ * Orders ends by candle time and interval, then by chart and end
+ */
+static int analysis_end_cmp(const void *a, const void *b) {
+  const struct analysis_end *x = (const struct analysis_end *)a;
+  const struct analysis_end *y = (const struct analysis_end *)b;
+  if (x->start != y->start)
+    return x->start < y->start ? -1 : 1;
+  if (x->interval != y->interval)
+    return x->interval < y->interval ? -1 : 1;
+  if (x->chart != y->chart)
+    return x->chart < y->chart ? -1 : 1;
+  if (x->idx != y->idx)
+    return x->idx < y->idx ? -1 : 1;
+  return 0;
+}
 
 /*
  * The number of availibale threads that can work. If the number of
@@ -71,16 +218,48 @@ static long current_analysis_index = 0;
 static long num_analysis_threads = 0;
 
 /*
- * A list of struct analysis_list* of length num_analysis_threads.
- * Each thread has its own bin that it pops. This ensures equal
- * working amung all the threads.
+ * Requests from analysis_push wait here until a worker moves them into
+ * its deque. Charts are updated from several parser threads and workers
+ * never push work of their own, so the deques can not be fed directly.
+ */
+static struct analysis_queue queue;
+
+/*
+ * The analysis infos the calling thread can reuse
  */
-static struct analysis_list **thread_operations;
+static _Thread_local struct analysis_info *free_infos = NULL;
+static _Thread_local size_t num_free_infos = 0;
+
+/*
+ * A list of struct analysis_deque of length num_analysis_threads, one for
+ * each worker. A worker runs the jobs of its own deque and steals from
+ * the others once it runs out, so one slow job does not hold up the jobs
+ * queued behind it.
+ */
+static struct analysis_deque *deques;
+
+/*
+ * The number of jobs pushed that no worker has started yet, wherever they
+ * are queued. Workers park while it is 0.
+ */
+static atomic_long num_pending = 0;
+
+/*
+ * The number of workers waiting on can_work
+ */
+static atomic_long num_parked = 0;
+
+/*
+ * Parked workers wait on can_work until a job is pushed or the threads
+ * are joined
+ */
+static pthread_mutex_t park_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t can_work = PTHREAD_COND_INITIALIZER;
 
 /*
  * A wait check must be set before starting the analysis workflow.
  * Analysis is haulted until init_completed is set to true in
- * which case pushing and popping to the analysis_list can occure
+ * which case pushing and popping to the queue can occure
  */
 static bool init_completed = false;
 
@@ -90,7 +269,286 @@ static bool init_completed = false;
 static pthread_t *threads;
 
 // Set to 1 if the threads need to be joined
-int ANALYSIS_INTERRUPED = 0;
+atomic_int ANALYSIS_INTERRUPED = 0;
+
+/*
+ * Pushes a job to the bottom of the deque of the calling worker, false if
+ * the deque is full
+ */
+static bool analysis_deque_push(struct analysis_deque *dq,
+                                struct analysis_info *inf) {
+  long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+  long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  if (b - t >= ANALYSIS_DEQUE_LEN)
+    return false;
+
+  atomic_store_explicit(&dq->jobs[b % ANALYSIS_DEQUE_LEN], inf,
+                        memory_order_relaxed);
+  // the job is written before thieves can see it
+  atomic_store_explicit(&dq->bottom, b + 1, memory_order_release);
+  return true;
+}
+
+/*
+ * Takes the newest job of the deque of the calling worker, NULL if it is
+ * empty or a thief got the last job first
+ */
+static struct analysis_info *analysis_deque_take(struct analysis_deque *dq) {
+  long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+
+  struct analysis_info *inf = NULL;
+  if (t <= b) {
+    inf = atomic_load_explicit(&dq->jobs[b % ANALYSIS_DEQUE_LEN],
+                               memory_order_relaxed);
+    if (t == b) {
+      // the last job, thieves race for it on top
+      if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                   memory_order_seq_cst,
+                                                   memory_order_relaxed))
+        inf = NULL;
+      atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+  }
+  return inf;
+}
+
+/*
+ * Takes the oldest job of another worker's deque, NULL if it is empty or
+ * another thread took the job first
+ */
+static struct analysis_info *analysis_deque_steal(struct analysis_deque *dq) {
+  long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+  if (t >= b)
+    return NULL;
+
+  struct analysis_info *inf = atomic_load_explicit(
+      &dq->jobs[t % ANALYSIS_DEQUE_LEN], memory_order_relaxed);
+  if (!atomic_compare_exchange_strong_explicit(
+          &dq->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+    return NULL;
+  return inf;
+}
+
+/*
+ * Puts an analysis info that was run on the free list of the calling
+ * thread
+ */
+static void analysis_recycle(struct analysis_info *inf) {
+  if (num_free_infos == ANALYSIS_FREE_LEN) {
+    free(inf);
+    return;
+  }
+  inf->next = free_infos;
+  free_infos = inf;
+  ++num_free_infos;
+}
+
+/*
+ * Frees the free list of the calling thread
+ */
+static void analysis_free_recycled(void) {
+  while (free_infos) {
+    struct analysis_info *inf = free_infos;
+    free_infos = inf->next;
+    free(inf);
+  }
+  num_free_infos = 0;
+}
+
+/*
+ * Moves a share of the queued jobs into the deque of a worker and returns
+ * the oldest of them to run. NULL if nothing was queued or another worker
+ * is already moving jobs, their deque can be stolen from soon after.
+ */
+static struct analysis_info *analysis_fetch(struct analysis_deque *dq) {
+  struct analysis_info *batch[ANALYSIS_DEQUE_LEN];
+  size_t n = 0;
+
+  if (atomic_flag_test_and_set_explicit(&queue.draining,
+                                        memory_order_acquire))
+    return NULL;
+
+  // a fair share so the other workers find some too, the deque is empty
+  // when this is called
+  size_t depth =
+      atomic_load_explicit(&queue.tail, memory_order_relaxed) - queue.head;
+  size_t want = depth / (size_t)num_analysis_threads + 1;
+  if (want > ANALYSIS_DEQUE_LEN)
+    want = ANALYSIS_DEQUE_LEN;
+  while (n < want) {
+    struct analysis_info *inf = NULL;
+    if (analysis_pop(&queue, &inf) != RISKI_ERROR_CODE_NONE || !inf)
+      break;
+    batch[n++] = inf;
+  }
+  atomic_flag_clear_explicit(&queue.draining, memory_order_release);
+
+  if (n == 0)
+    return NULL;
+
+  // newest first, so the worker takes them oldest first and thieves take
+  // the newest
+  for (size_t i = n - 1; i > 0; --i)
+    analysis_deque_push(dq, batch[i]);
+  return batch[0];
+}
+
+/*
+ * Finds the next job for worker self, NULL if there is none anywhere
+ */
+static struct analysis_info *analysis_next(long self) {
+  struct analysis_info *inf = analysis_deque_take(&deques[self]);
+  if (inf)
+    return inf;
+
+  inf = analysis_fetch(&deques[self]);
+  if (inf)
+    return inf;
+
+  for (long i = 1; i < num_analysis_threads; ++i) {
+    inf = analysis_deque_steal(&deques[(self + i) % num_analysis_threads]);
+    if (inf)
+      return inf;
+  }
+  return NULL;
+}
+
+/*
+ * Sets *st to the plugin states of a chart, they are made on first use.
+ * Only the thread analysing the chart may call this.
+ */
+static enum RISKI_ERROR_CODE analysis_get_state(struct chart *cht,
+                                                struct analysis_state **st) {
+  void *cur = NULL;
+  TRACE(chart_get_analysis_state(cht, &cur));
+  if (cur) {
+    *st = (struct analysis_state *)cur;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct analysis_state *s =
+      (struct analysis_state *)malloc(sizeof(struct analysis_state));
+  PTR_CHECK(s, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  s->cht = cht;
+  s->states = (void **)calloc(loaded_funs.num_functions, sizeof(void *));
+  if (!s->states && loaded_funs.num_functions > 0) {
+    free(s);
+    PTR_CHECK(NULL, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  }
+
+  for (size_t i = 0; i < loaded_funs.num_functions; ++i) {
+    if (loaded_funs.incs[i])
+      TRACE(loaded_funs.incs[i]->init_state(cht, &s->states[i]));
+  }
+
+  pthread_mutex_lock(&states_lock);
+  s->prev = NULL;
+  s->next = chart_states;
+  if (chart_states)
+    chart_states->prev = s;
+  chart_states = s;
+  pthread_mutex_unlock(&states_lock);
+
+  TRACE(chart_set_analysis_state(cht, s));
+  *st = s;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Frees the plugin states of a chart, states_lock must be held
+ */
+static enum RISKI_ERROR_CODE analysis_drop_state(struct analysis_state *s) {
+  for (size_t i = 0; i < loaded_funs.num_functions; ++i) {
+    if (loaded_funs.incs[i] && s->states[i])
+      loaded_funs.incs[i]->free_state(s->states[i]);
+  }
+
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    chart_states = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+
+  TRACE(chart_set_analysis_state(s->cht, NULL));
+  free(s->states);
+  free(s);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Waits until a job is pushed or the threads are joined
+ */
+static void analysis_park(void) {
+  pthread_mutex_lock(&park_lock);
+  // analysis_push counts the job before it looks for parked workers, so
+  // either it sees this worker parked or this worker sees the job
+  atomic_fetch_add(&num_parked, 1);
+  while (atomic_load(&num_pending) == 0 &&
+         atomic_load(&ANALYSIS_INTERRUPED) == 0)
+    pthread_cond_wait(&can_work, &park_lock);
+  atomic_fetch_sub(&num_parked, 1);
+  pthread_mutex_unlock(&park_lock);
+}
+
+/*
+ * Queues a chart for the workers, a chart that does not fit is marked as
+ * not queued again
+ */
+static enum RISKI_ERROR_CODE analysis_enqueue(struct chart *cht) {
+  // claim the next position, a slot that is still waiting to be popped
+  // means the queue is full
+  struct analysis_slot *slot = NULL;
+  size_t pos = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+  for (;;) {
+    slot = &queue.slots[pos & (ANALYSIS_QUEUE_LEN - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&queue.tail, &pos, pos + 1,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+        break;
+    } else if (dif < 0) {
+      size_t dropped = atomic_fetch_add(&queue.dropped, 1) + 1;
+      TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
+                           "analysis queue is full, dropped %lu charts",
+                           dropped));
+      TRACE(chart_analysis_dropped(cht));
+      return RISKI_ERROR_CODE_NONE;
+    } else {
+      // another producer took the position
+      pos = atomic_load_explicit(&queue.tail, memory_order_relaxed);
+    }
+  }
+
+  slot->cht = cht;
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+
+  long ne = atomic_fetch_add(&num_pending, 1) + 1;
+
+  // wake a worker, the lock makes sure it is either waiting already or
+  // will see the job before it waits
+  if (atomic_load(&num_parked) > 0) {
+    pthread_mutex_lock(&park_lock);
+    pthread_cond_signal(&can_work);
+    pthread_mutex_unlock(&park_lock);
+  }
+
+  if (ne > 5 * num_analysis_threads) {
+    TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
+                         "analysis has fallen behind by %lu charts", ne));
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
 
 static void *analysis_thread_func(void *index) {
   // wait for the sync
@@ -99,57 +557,142 @@ static void *analysis_thread_func(void *index) {
   long assigned_bin = *((long *)index);
   free(index);
 
-  // this thread will only monitor this bin of analysis requests
-  struct analysis_list *bin = thread_operations[assigned_bin];
-  // logger_info("thread was assigned bin id %lu %p", assigned_bin, bin);
   logger_info(__func__, FILENAME_SHORT, __LINE__, "assigned thread bin #%d",
               assigned_bin);
 
-  while (ANALYSIS_INTERRUPED == 0) {
-    int ne = atomic_load_explicit(&bin->num_elements, memory_order_seq_cst);
-    if (ne == 0) {
-      sched_yield();
+  // too large for the stack of a worker once every chart has a batch of
+  // ends
+  struct analysis_gather *gather =
+      (struct analysis_gather *)malloc(sizeof(struct analysis_gather));
+  if (!gather)
+    TRACE_HAULT(RISKI_ERROR_CODE_MALLOC_ERROR);
+
+  while (atomic_load(&ANALYSIS_INTERRUPED) == 0) {
+    // get the next analysis in the queue
+    struct analysis_info *inf = analysis_next(assigned_bin);
+    if (!inf) {
+      // a job may be on its way from the queue into a deque, that only
+      // takes a moment
+      if (atomic_load(&num_pending) > 0)
+        sched_yield();
+      else
+        analysis_park();
       continue;
     }
+    atomic_fetch_sub(&num_pending, 1);
+
+    // with a plugin taking many charts in one call, the charts waiting in
+    // this worker's deque are gathered and grouped by the candle each end
+    // finalized, charts that closed a candle of the same interval at the
+    // same time go to run_batch together. Thieves still take from the
+    // other end of the deque.
+    bool grouped = loaded_funs.num_batched > 0;
+    gather->num_charts = 0;
+    gather->infs[gather->num_charts++] = inf;
+    while (grouped && gather->num_charts < ANALYSIS_GATHER_LEN) {
+      inf = analysis_deque_take(&deques[assigned_bin]);
+      if (!inf)
+        break;
+      atomic_fetch_sub(&num_pending, 1);
+      gather->infs[gather->num_charts++] = inf;
+    }
 
-    // get the next analysis in the queue
-    struct analysis_info *inf = NULL;
-    pthread_mutex_lock(&(bin->can_remove));
-    analysis_pop(bin, &inf);
-    pthread_mutex_unlock(&(bin->can_remove));
+    gather->num_ends = 0;
+    for (size_t j = 0; j < gather->num_charts; ++j) {
+      struct chart *cht = gather->infs[j]->cht;
+
+      // the ends asked for since the chart was queued, the chart is not
+      // queued again until this thread is done with it
+      size_t num_taken = 0;
+      TRACE_HAULT(chart_analysis_take(cht, gather->taken, ANALYSIS_BATCH_LEN,
+                                      &num_taken));
+
+      // keep spilled candles around while the plugins read them
+      chart_analysis_enter(cht);
 
-    // analysis_pop returns NULL if there is nothing to do
-    // if (!inf) {
-    // wait a few seconds for data to populate
-    //  continue;
-    //}
-    struct chart *cht = inf->cht;
+      TRACE_HAULT(analysis_get_state(cht, &gather->states[j]));
 
-    size_t start_index = inf->start_candle;
-    (void)start_index;
+      uint64_t interval = 0;
+      if (grouped)
+        TRACE_HAULT(chart_get_interval(cht, &interval));
 
-    size_t end_candle = inf->end_candle;
+      for (size_t k = 0; k < num_taken; ++k) {
+        struct analysis_end *end = &gather->ends[gather->num_ends++];
+        end->start = 0;
+        end->interval = interval;
+        end->chart = j;
+        end->idx = gather->taken[k];
 
-    // aquire the analysis struct first
-    // chart_analysis_lock(cht);
+        if (grouped) {
+          struct chart_span span;
+          TRACE_HAULT(chart_span(cht, end->idx - 1, end->idx - 1, &span));
+          end->start = span.start;
+        }
+      }
+    }
+
+    if (grouped)
+      qsort(gather->ends, gather->num_ends, sizeof(struct analysis_end),
+            analysis_end_cmp);
 
     // group the analysis into sections from simplest to hardest
 
-    // loop through each function
-    for (size_t i = 0; i < loaded_funs.num_functions; ++i) {
-      clock_t begin = clock();
-      TRACE_HAULT(loaded_funs.funs[i]->run(cht, end_candle));
-      clock_t end = clock();
-      long ts = end - begin;
-      TRACE_HAULT(logger_info(
-          __func__, FILENAME_SHORT, __LINE__, "[TIMIT] %s@%d => %d/cycles",
-          loaded_funs.funs[i]->get_name(), assigned_bin, ts));
+    // loop through each group of candles and function
+    for (size_t first = 0; first < gather->num_ends;) {
+      const struct analysis_end *group = &gather->ends[first];
+      size_t n = 0;
+      while (first + n < gather->num_ends && n < ANALYSIS_GATHER_LEN &&
+             group[n].start == group[0].start &&
+             group[n].interval == group[0].interval) {
+        const struct analysis_end *end = &group[n];
+        gather->charts[n] = gather->infs[end->chart]->cht;
+        gather->idx[n] = end->idx;
+        gather->group_states[n] = gather->states[end->chart];
+        ++n;
+      }
+      first += n;
+
+      for (size_t i = 0; i < loaded_funs.num_functions; ++i) {
+        clock_t begin = clock();
+        if (loaded_funs.batches[i]) {
+          TRACE_HAULT(loaded_funs.batches[i]->run_batch(gather->charts,
+                                                        gather->idx, n));
+        } else {
+          for (size_t r = 0; r < n; ++r) {
+            if (loaded_funs.incs[i]) {
+              TRACE_HAULT(loaded_funs.incs[i]->on_candle(
+                  gather->charts[r], gather->group_states[r]->states[i],
+                  gather->idx[r]));
+            } else {
+              TRACE_HAULT(
+                  loaded_funs.funs[i]->run(gather->charts[r], gather->idx[r]));
+            }
+          }
+        }
+        clock_t end = clock();
+        long ts = end - begin;
+        TRACE_HAULT(logger_info(
+            __func__, FILENAME_SHORT, __LINE__, "[TIMIT] %s@%d => %d/cycles",
+            loaded_funs.funs[i]->get_name(), assigned_bin, ts));
+      }
     }
 
-    // release the analysis struct lock
-    // chart_analysis_unlock(cht);
-    free(inf);
+    for (size_t j = 0; j < gather->num_charts; ++j) {
+      struct chart *cht = gather->infs[j]->cht;
+      chart_analysis_leave(cht);
+
+      // more ends were asked for while this ran, or more than a batch was
+      // waiting
+      bool again = false;
+      TRACE_HAULT(chart_analysis_done(cht, &again));
+      if (again)
+        TRACE_HAULT(analysis_enqueue(cht));
+
+      analysis_recycle(gather->infs[j]);
+    }
   }
+  free(gather);
+  analysis_free_recycled();
   return NULL;
 }
 
@@ -190,6 +733,31 @@ static enum RISKI_ERROR_CODE analysis_load() {
                               __LINE__, "Loaded %s by %s", dyn->get_name(),
                               dyn->get_author()));
 
+        // plugins that keep state for each chart or take many charts at
+        // once export a second vtable
+        struct vtable_incremental *inc = NULL;
+        struct vtable_incremental *batch = NULL;
+        inc = (struct vtable_incremental *)dlsym(handle, "incremental_exports");
+        if (inc && inc->abi_version == 0) {
+          TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
+                               "%s has no plugin abi version, using run",
+                               dyn->get_name()));
+          inc = NULL;
+        }
+
+        // run_batch is only there since version 2
+        if (inc && inc->abi_version >= 2 && inc->run_batch) {
+          batch = inc;
+          inc = NULL;
+          loaded_funs.num_batched += 1;
+        } else if (inc &&
+                   (!inc->init_state || !inc->on_candle || !inc->free_state)) {
+          TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
+                               "%s is missing incremental functions, using run",
+                               dyn->get_name()));
+          inc = NULL;
+        }
+
         loaded_funs.num_functions += 1;
         printf("%lu", loaded_funs.num_functions);
         loaded_funs.funs = (struct vtable **)realloc(
@@ -197,6 +765,16 @@ static enum RISKI_ERROR_CODE analysis_load() {
             sizeof(struct vtable **) * loaded_funs.num_functions);
         loaded_funs.funs[loaded_funs.num_functions - 1] = dyn;
 
+        loaded_funs.incs = (struct vtable_incremental **)realloc(
+            loaded_funs.incs,
+            sizeof(struct vtable_incremental *) * loaded_funs.num_functions);
+        loaded_funs.incs[loaded_funs.num_functions - 1] = inc;
+
+        loaded_funs.batches = (struct vtable_incremental **)realloc(
+            loaded_funs.batches,
+            sizeof(struct vtable_incremental *) * loaded_funs.num_functions);
+        loaded_funs.batches[loaded_funs.num_functions - 1] = batch;
+
         loaded_funs.handles = (void **)realloc(
             loaded_funs.handles, sizeof(void *) * loaded_funs.num_functions);
 
@@ -217,6 +795,7 @@ static enum RISKI_ERROR_CODE analysis_load() {
   return RISKI_ERROR_CODE_NONE;
 }
 
+
 enum RISKI_ERROR_CODE analysis_init() {
 
   TRACE(analysis_load());
@@ -240,30 +819,21 @@ enum RISKI_ERROR_CODE analysis_init() {
   TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
                     "creating %d analysis threads", numCPU));
 
-  // create the list container
-  thread_operations = (struct analysis_list **)malloc(
-      (uint64_t)num_analysis_threads * sizeof(struct analysis_list *));
-
-  // make sure malloc was correct
-  PTR_CHECK(thread_operations, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
-
-  // create the lists
-  for (long i = 0; i < num_analysis_threads; ++i) {
-    thread_operations[i] =
-        (struct analysis_list *)malloc(1 * sizeof(struct analysis_list));
-
-    // make sure malloc was correct
-    PTR_CHECK(thread_operations, RISKI_ERROR_CODE_MALLOC_ERROR,
-              RISKI_ERROR_TEXT);
-
-    pthread_mutex_init(&(thread_operations[i]->can_remove), NULL);
+  // every slot starts out free for the first push to its position
+  for (size_t i = 0; i < ANALYSIS_QUEUE_LEN; ++i) {
+    atomic_init(&queue.slots[i].seq, i);
+  }
+  atomic_init(&queue.tail, 0);
+  queue.head = 0;
+  atomic_init(&queue.dropped, 0);
+  atomic_flag_clear(&queue.draining);
 
-    thread_operations[i]->head = NULL;
-    thread_operations[i]->tail = NULL;
+  // create the deques
+  deques = (struct analysis_deque *)calloc((uint64_t)num_analysis_threads,
+                                           sizeof(struct analysis_deque));
 
-    atomic_store_explicit(&thread_operations[i]->num_elements, 0,
-                          memory_order_seq_cst);
-  }
+  // make sure malloc was correct
+  PTR_CHECK(deques, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
 
   threads =
       (pthread_t *)calloc((uint64_t)num_analysis_threads, sizeof(pthread_t));
@@ -283,8 +853,7 @@ enum RISKI_ERROR_CODE analysis_init() {
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE analysis_create_info(struct chart *cht, size_t start,
-                                           size_t end,
+enum RISKI_ERROR_CODE analysis_create_info(struct chart *cht,
                                            struct analysis_info **inf) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(inf, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -295,11 +864,7 @@ enum RISKI_ERROR_CODE analysis_create_info(struct chart *cht, size_t start,
   PTR_CHECK(element, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
 
   element->cht = cht;
-  element->start_candle = start;
-  element->end_candle = end;
-
   element->next = NULL;
-  element->prev = NULL;
 
   *inf = element;
 
@@ -312,102 +877,121 @@ enum RISKI_ERROR_CODE analysis_push(struct chart *cht, size_t start,
     ;
 
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(thread_operations, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(deques, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  // what bin the analysis will go into
-  long thread_bin = current_analysis_index % num_analysis_threads;
-  // get the list
+  // every plugin looks at the candles before end
+  (void)start;
 
-  struct analysis_list *bin = thread_operations[thread_bin];
+  // a chart that is already queued or analysed picks the end up from the
+  // chart, so one busy chart takes up one slot in the queue
+  bool queue_chart = false;
+  TRACE(chart_analysis_request(cht, end, &queue_chart));
+  if (queue_chart)
+    TRACE(analysis_enqueue(cht));
 
-  // create the new element
-  struct analysis_info *element = NULL;
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  // Create a new info struct
-  TRACE(analysis_create_info(cht, start, end, &element));
+enum RISKI_ERROR_CODE analysis_pop(struct analysis_queue *q,
+                                   struct analysis_info **inf) {
+  PTR_CHECK(q, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(inf, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  // Make sure the info object was set correctly
-  PTR_CHECK(element, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  *inf = NULL;
 
-  // The number of elements
-  int ne = 0;
+  struct analysis_slot *slot = &q->slots[q->head & (ANALYSIS_QUEUE_LEN - 1)];
+  size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
 
-  // aquire lock to make sure no removing occurs
-  pthread_mutex_lock(&(bin->can_remove));
+  // empty, or the producer of the next job has not finished writing it
+  if (seq != q->head + 1)
+    return RISKI_ERROR_CODE_NONE;
 
-  // we will always push to the end of the bin
-  if (bin->tail == NULL && bin->head == NULL) {
-    // no elements in the list (easy case)
-    bin->head = element;
-    bin->tail = element;
-    // bin->num_elements = 1;
-    atomic_store_explicit(&bin->num_elements, 1, memory_order_seq_cst);
-    ne = 1;
-    pthread_mutex_unlock(&(bin->can_remove));
+  struct analysis_info *element = free_infos;
+  if (element) {
+    free_infos = element->next;
+    --num_free_infos;
+    element->cht = slot->cht;
+    element->next = NULL;
   } else {
-    // insert into the end of the dll
-    // get tail
-    struct analysis_info *tail = bin->tail;
-
-    // add to the list
-    bin->tail->next = element;
-    bin->tail->prev = tail;
-    bin->tail = element;
-    // bin->num_elements += 1;
-    atomic_fetch_add_explicit(&bin->num_elements, 1, memory_order_seq_cst);
-    ne = atomic_load_explicit(&bin->num_elements, memory_order_seq_cst);
-    pthread_mutex_unlock(&(bin->can_remove));
+    TRACE(analysis_create_info(slot->cht, &element));
   }
 
-  if (ne > 5) {
-    TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
-                         "thread id #%lu has fallen behind by %lu charts",
-                         thread_bin, ne));
-  }
+  // hand the slot back to the producers
+  atomic_store_explicit(&slot->seq, q->head + ANALYSIS_QUEUE_LEN,
+                        memory_order_release);
+  q->head += 1;
+
+  *inf = element;
 
-  current_analysis_index += 1;
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE analysis_pop(struct analysis_list *bin,
-                                   struct analysis_info **inf) {
-  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+enum RISKI_ERROR_CODE analysis_get_stats(size_t *depth, size_t *dropped) {
+  PTR_CHECK(depth, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(dropped, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  struct analysis_info *element = bin->head;
+  long pending = atomic_load(&num_pending);
+  *depth = pending > 0 ? (size_t)pending : 0;
+  *dropped = atomic_load(&queue.dropped);
 
-  // remove the head
-  if (bin->head) {
-    bin->head = bin->head->next;
-    // bin->num_elements -= 1;
-    atomic_fetch_sub_explicit(&bin->num_elements, 1, memory_order_seq_cst);
-  }
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  // if the next element was not null
-  // set the previous element to NULL
-  if (bin->head) {
-    bin->head->prev = NULL;
-  } else {
-    bin->head = NULL;
-    bin->tail = NULL;
-  }
+enum RISKI_ERROR_CODE analysis_free_state(struct chart *cht) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  PTR_CHECK(inf, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  *inf = element;
+  void *st = NULL;
+  pthread_mutex_lock(&states_lock);
+  enum RISKI_ERROR_CODE err = chart_get_analysis_state(cht, &st);
+  if (err == RISKI_ERROR_CODE_NONE && st)
+    err = analysis_drop_state((struct analysis_state *)st);
+  pthread_mutex_unlock(&states_lock);
 
+  TRACE(err);
   return RISKI_ERROR_CODE_NONE;
 }
 
 enum RISKI_ERROR_CODE analysis_cleanup() {
-  ANALYSIS_INTERRUPED = 1;
+  atomic_store(&ANALYSIS_INTERRUPED, 1);
+
+  // parked workers only wake up for a job
+  pthread_mutex_lock(&park_lock);
+  pthread_cond_broadcast(&can_work);
+  pthread_mutex_unlock(&park_lock);
+
   for (long i = 0; i < num_analysis_threads; ++i) {
     pthread_join(threads[i], NULL);
   }
+
+  // drop the jobs nobody got to
+  struct analysis_info *inf = NULL;
   for (long i = 0; i < num_analysis_threads; ++i) {
-    free(thread_operations[i]);
+    while ((inf = analysis_deque_take(&deques[i])))
+      free(inf);
   }
-  free(thread_operations);
+  do {
+    analysis_pop(&queue, &inf);
+    free(inf);
+  } while (inf);
+  analysis_free_recycled();
+
+  if (atomic_load(&queue.dropped) > 0) {
+    TRACE(logger_warning(__func__, FILENAME_SHORT, __LINE__,
+                         "%lu charts were dropped from analysis",
+                         atomic_load(&queue.dropped)));
+  }
+
+  // the states are freed by the plugins, so before they are closed
+  pthread_mutex_lock(&states_lock);
+  while (chart_states)
+    TRACE(analysis_drop_state(chart_states));
+  pthread_mutex_unlock(&states_lock);
+
+  free(deques);
   free(threads);
   free(loaded_funs.funs);
+  free(loaded_funs.incs);
+  free(loaded_funs.batches);
 
   for (size_t i = 0; i < loaded_funs.num_functions; ++i) {
     dlclose(loaded_funs.handles[i]);
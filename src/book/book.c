@@ -1,167 +1,243 @@
 #include <book/book.h>
 
 /**
- * Defines a level inside the book
+ * The number of levels a side can hold before it first grows
  */
-struct level {
-  // The price as a fixed point number
-  int64_t price;
+#define BOOK_INITIAL_LEVELS 64
 
-  // Quantity
-  int64_t quantity;
+/**
+ * One side of the book. Levels are kept sorted so the best price is
+ * always the last level, updates happen close to the top of the book
+ * so inserting or removing a level only moves the few levels above it.
+ */
+struct side {
+  // Hold the levels, worst price first
+  struct book_level *lvls;
+
+  // The number of levels in use
+  int64_t len;
+
+  // The number of levels allocated
+  int64_t cap;
 };
 
 /**
  * The meta class of a book
  */
 struct book {
-  // The number of buys on the buy side
-  int64_t buys_len;
+  // Hold the buys side, sorted from lowest to highest price
+  struct side buys;
 
-  // The number of sells on the sell side
-  int64_t sells_len;
+  // Hold the sells side, sorted from highest to lowest price
+  struct side sells;
 
-  // Hold the buys side
-  struct level *buys;
+  // The sequence number of the last change, 0 before the first one
+  uint64_t seq;
 
-  // Hold the sells side
-  struct level *sells;
+  // The last BOOK_CHANGE_LOG_SIZE changes, change seq is at seq % size.
+  // Allocated on the first change since most books are never read.
+  struct book_change *changes;
 };
 
 struct book *book_new() {
-  // Allocate a new book
-  struct book *t = (struct book *)(malloc(1 * sizeof(struct book)));
-
-  // set number of buys and sells to 0
-  t->buys_len = 0;
-  t->sells_len = 0;
-
-  // set both arrays to NULL since their are 0 elements
-  t->buys = NULL;
-  t->sells = NULL;
+  // Allocate a new book, both sides start empty and allocate on first use
+  struct book *t = (struct book *)(calloc(1, sizeof(struct book)));
   return t;
 }
 
-// removes a price lvl from the lvl array
-static void remove_lvl(struct level **lvls, int64_t index, int64_t count) {
-  // delete the price lvl
-  // tmp array
-  struct level *lvl_tmp =
-      (struct level *)(malloc((uint64_t)(count - 1) * sizeof(struct level)));
-  // copy the left side
-  for (int64_t i = 0; i < index; ++i) {
-    lvl_tmp[i] = (*lvls)[i];
+/**
+ * Returns true if price a sits below price b in the ordering of the side,
+ * i.e. a is a worse price than b
+ */
+static inline bool worse(bool side, int64_t a, int64_t b) {
+  return (side) ? a < b : a > b;
+}
+
+/**
+ * Finds the index of price in the side, or the index it would have to be
+ * inserted at. Most updates are close to the top so the search starts
+ * from the best price and gallops down before narrowing it down.
+ */
+static int64_t find_lvl(bool side, struct side *s, int64_t price) {
+  int64_t hi = s->len;
+  int64_t step = 1;
+
+  // gallop from the top until a level that is not worse than price
+  while (hi - step >= 0 && worse(side, price, s->lvls[hi - step].price)) {
+    hi -= step;
+    step *= 2;
   }
-  // copy the right side
-  for (int64_t i = index + 1; i < count; ++i) {
-    lvl_tmp[i - 1] = (*lvls)[i];
+  int64_t lo = (hi - step < 0) ? 0 : hi - step;
+
+  // binary search [lo, hi) for the first level not worse than price
+  while (lo < hi) {
+    int64_t mid = lo + (hi - lo) / 2;
+    if (worse(side, s->lvls[mid].price, price))
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  return lo;
+}
 
-  // 0,1,2,3
+static bool reserve_lvl(struct side *s) {
+  if (s->len < s->cap)
+    return true;
 
-  // free old lvls
-  free(*lvls);
-  *lvls = lvl_tmp;
+  int64_t cap = (s->cap == 0) ? BOOK_INITIAL_LEVELS : s->cap * 2;
+  struct book_level *lvls = (struct book_level *)(realloc(
+      s->lvls, (uint64_t)cap * sizeof(struct book_level)));
+  if (!lvls)
+    return false;
 
-  // special case if count is not 0
-  if (count - 1 == 0) {
-    free(lvl_tmp);
-    *lvls = NULL;
-  }
+  s->lvls = lvls;
+  s->cap = cap;
+  return true;
 }
 
-static void insert_at(struct level **lvls, int64_t len, int64_t at,
-                      struct level lvl) {
-  len += 1;
-
-  // create a new array
-  struct level *new_lvl =
-      (struct level *)(malloc((uint64_t)len * sizeof(struct level)));
+/**
+ * Records a change to a level in the change log, overwriting the oldest
+ */
+static void log_change(bool side, struct book *t, int64_t price,
+                       int64_t quantity) {
+  // bumped even if the change can not be kept so readers see the gap
+  t->seq += 1;
+
+  if (!t->changes) {
+    t->changes = (struct book_change *)(calloc(BOOK_CHANGE_LOG_SIZE,
+                                               sizeof(struct book_change)));
+    if (!t->changes) {
+      logger_error(RISKI_ERROR_CODE_MALLOC_ERROR, __func__, FILENAME_SHORT,
+                   __LINE__, "unable to allocate the book change log");
+      return;
+    }
+  }
 
-  // put the new data inside
-  new_lvl[at] = lvl;
+  struct book_change *c = &t->changes[t->seq % BOOK_CHANGE_LOG_SIZE];
+  c->seq = t->seq;
+  c->price = price;
+  c->quantity = quantity;
+  c->side = side;
+}
 
-  // copy the right side data
-  for (int64_t i = 0; i <= (at - 1); ++i) {
-    new_lvl[i] = (*lvls)[i];
+void book_update(bool side, struct book *t, int64_t price, int64_t quantity) {
+  struct side *s = (side) ? &t->buys : &t->sells;
+
+  int64_t at = find_lvl(side, s, price);
+  bool found = at < s->len && s->lvls[at].price == price;
+
+  if (found) {
+    if (quantity != 0) {
+      // don't delete just update the quantity
+      s->lvls[at].quantity = quantity;
+      log_change(side, t, price, quantity);
+    } else {
+      // delete the lvl by shifting the better levels down by one
+      memmove(&s->lvls[at], &s->lvls[at + 1],
+              (uint64_t)(s->len - at - 1) * sizeof(struct book_level));
+      s->len -= 1;
+      log_change(side, t, price, 0);
+    }
+    return;
   }
 
-  // copy the left side data
-  for (int64_t i = (at); i < (len - 1); ++i) {
-    new_lvl[i + 1] = (*lvls)[i];
+  // deleting a level that is not in the book
+  if (quantity == 0)
+    return;
+
+  if (!reserve_lvl(s)) {
+    logger_error(RISKI_ERROR_CODE_MALLOC_ERROR, __func__, FILENAME_SHORT,
+                 __LINE__, "unable to grow the book to %ld levels",
+                 s->len + 1);
+    return;
   }
 
-  free(*lvls);
-  *lvls = new_lvl;
+  // make room by shifting the better levels up by one
+  memmove(&s->lvls[at + 1], &s->lvls[at],
+          (uint64_t)(s->len - at) * sizeof(struct book_level));
+  s->lvls[at].price = price;
+  s->lvls[at].quantity = quantity;
+  s->len += 1;
+  log_change(side, t, price, quantity);
 }
 
-void book_update(bool side, struct book *t, int64_t price, int64_t quantity) {
-  /*
-   * note that order books will always be ordered from least to greatest
-   * [100,101,102,103,104,105,106]
-   */
-
-  struct level **lvls = (side) ? &t->buys : &t->sells;
-  int64_t *count = (side) ? &t->buys_len : &t->sells_len;
-
-  // there are no elements in this list
-  if (*count == 0) {
-    // no prices in lvls so just make a new one
-    *lvls = realloc(*lvls, (uint64_t)((*count) + 1) * sizeof(struct level));
-    (*lvls)[0].price = price;
-    (*lvls[0]).quantity = quantity;
-    *count = (*count) + 1;
-    return;
-  }
+static bool best(struct side *s, int64_t *price, int64_t *quantity) {
+  if (s->len == 0)
+    return false;
 
-  // Binary search of lvls to find the price element
-  // to update it or to create a new level
-  int64_t start = 0;
-  int64_t end = *count;
-  while (start <= end) {
-    int64_t cur = (start + end) / 2;
-
-    if (cur >= *count)
-      break;
-
-    // because of fixed point math, we can compare these
-    // floating point numbers
-    if (((*lvls)[cur]).price == price) {
-      if (quantity != 0) {
-        // don't delete just update the quantity
-        ((*lvls)[cur]).quantity = quantity;
-        return;
-      } else {
-        // delete the lvl
-        remove_lvl(lvls, cur, *count);
-        *count = (*count) - 1;
-        return;
-      }
-    } else if (((*lvls)[cur]).price < price) {
-      start = cur + 1;
-      continue;
-    } else if (((*lvls)[cur]).price > price) {
-      end = cur - 1;
-      continue;
-    }
+  if (price)
+    *price = s->lvls[s->len - 1].price;
+  if (quantity)
+    *quantity = s->lvls[s->len - 1].quantity;
+  return true;
+}
+
+bool book_best_bid(struct book *t, int64_t *price, int64_t *quantity) {
+  return best(&t->buys, price, quantity);
+}
+
+bool book_best_ask(struct book *t, int64_t *price, int64_t *quantity) {
+  return best(&t->sells, price, quantity);
+}
+
+/**
+ * Copies up to depth levels of a side starting at the best price
+ */
+static size_t copy_top(struct side *s, size_t depth, struct book_level *out) {
+  size_t n = ((uint64_t)s->len < depth) ? (size_t)s->len : depth;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = s->lvls[s->len - 1 - (int64_t)i];
   }
+  return n;
+}
+
+void book_snapshot(struct book *t, size_t depth, struct book_level *bids,
+                   size_t *num_bids, struct book_level *asks,
+                   size_t *num_asks, uint64_t *seq) {
+  *num_bids = copy_top(&t->buys, depth, bids);
+  *num_asks = copy_top(&t->sells, depth, asks);
+  if (seq)
+    *seq = t->seq;
+}
+
+uint64_t book_seq(struct book *t) { return t->seq; }
 
-  struct level tmp;
-  tmp.price = price;
-  tmp.quantity = quantity;
+bool book_changes_since(struct book *t, uint64_t seq,
+                        struct book_change *changes, size_t max,
+                        size_t *num_changes) {
+  *num_changes = 0;
 
-  insert_at(lvls, (start == end) ? (*count) : (*count), start, tmp);
-  *count += 1;
+  // the caller is ahead of the book, e.g. it belongs to a book that
+  // was replaced
+  if (seq > t->seq)
+    return false;
+
+  // the change right after seq has already been overwritten
+  if (t->seq - seq > BOOK_CHANGE_LOG_SIZE || (!t->changes && t->seq != seq))
+    return false;
+
+  size_t n = 0;
+  for (uint64_t s = seq + 1; s <= t->seq && n < max; ++s) {
+    struct book_change *c = &t->changes[s % BOOK_CHANGE_LOG_SIZE];
+
+    // a change that could not be logged
+    if (c->seq != s)
+      return false;
+    changes[n++] = *c;
+  }
+  *num_changes = n;
+  return true;
 }
 
 void book_free(struct book **t) {
-  if ((*t)->buys_len != 0)
-    free((*t)->buys);
-  (*t)->buys = NULL;
+  free((*t)->buys.lvls);
+  (*t)->buys.lvls = NULL;
+
+  free((*t)->sells.lvls);
+  (*t)->sells.lvls = NULL;
 
-  if ((*t)->sells_len != 0)
-    free((*t)->sells);
-  (*t)->sells = NULL;
+  free((*t)->changes);
+  (*t)->changes = NULL;
 
   free(*t);
   *t = NULL;
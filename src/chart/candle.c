@@ -1,45 +1,40 @@
 #include <chart/candle.h>
 
-#define MAX_INT_STR_LEN ((CHAR_BIT * sizeof(uint64_t) - 1) / 3 + 2)
-
 /*
- * Represents a candle
- * @param {int64_t} open The open price
- * @param {int64_t} high The high price
- * @param {int64_t} low The low price
- * @param {int64_t} close The close price
- * @param {int64_t} best_bid The best bid price
- * @param {int64_t} best_ask The best ask price
- * @param {uint64_t} start_time The start_time price
- * @param {uint64_t} end_time The end_time price
- * @param {uint64_t} volume The volume of the candle
+ * A candle points at its slot of the open array of a candle_block, the
+ * same slot of any other field is a fixed distance away
  */
-struct candle {
-  int64_t open;
-  int64_t high;
-  int64_t low;
-  int64_t close;
-  int64_t best_bid;
-  int64_t best_ask;
-  uint64_t start_time;
-  uint64_t end_time;
-  uint64_t volume;
-};
+#define CANDLE_FIELD(C, TYPE, FIELD)                                           \
+  (*(TYPE *)((char *)(C) + offsetof(struct candle_block, FIELD)))
+
+_Static_assert(offsetof(struct candle_block, open) == 0,
+               "a candle handle must point into the first field");
+
+enum RISKI_ERROR_CODE candle_reset(struct candle *c, int64_t price,
+                                   int64_t bid, int64_t ask, uint64_t time) {
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  CANDLE_FIELD(c, int64_t, open) = price;
+  CANDLE_FIELD(c, int64_t, high) = price;
+  CANDLE_FIELD(c, int64_t, low) = price;
+  CANDLE_FIELD(c, int64_t, close) = price;
+  CANDLE_FIELD(c, uint64_t, start_time) = time;
+  CANDLE_FIELD(c, uint64_t, end_time) = time;
+  CANDLE_FIELD(c, int64_t, best_bid) = bid;
+  CANDLE_FIELD(c, int64_t, best_ask) = ask;
+  CANDLE_FIELD(c, uint64_t, volume) = 0;
+
+  return RISKI_ERROR_CODE_NONE;
+}
 
 enum RISKI_ERROR_CODE candle_new(int64_t price, int64_t bid, int64_t ask,
                                  uint64_t time, struct candle **cnd) {
-  struct candle *c = (struct candle *)malloc(1 * sizeof(struct candle));
-  PTR_CHECK(c, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
-
-  c->open = price;
-  c->high = price;
-  c->low = price;
-  c->close = price;
-  c->start_time = time;
-  c->end_time = time;
-  c->best_ask = bid;
-  c->best_bid = ask;
-  c->volume = 0;
+  struct candle_block *b =
+      (struct candle_block *)malloc(1 * sizeof(struct candle_block));
+  PTR_CHECK(b, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  struct candle *c = candle_at(b, 0);
+  TRACE(candle_reset(c, price, bid, ask, time));
   *cnd = c;
 
   return RISKI_ERROR_CODE_NONE;
@@ -48,7 +43,7 @@ enum RISKI_ERROR_CODE candle_new(int64_t price, int64_t bid, int64_t ask,
 #define CREATE_CANDLE_GET_FUNCTION(NAME, TYPE, ELEMENT)                        \
   enum RISKI_ERROR_CODE NAME(struct candle *c, TYPE *t) {                      \
     PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);                 \
-    *t = c->ELEMENT;                                                           \
+    *t = CANDLE_FIELD(c, TYPE, ELEMENT);                                       \
     return RISKI_ERROR_CODE_NONE;                                              \
   }
 
@@ -69,24 +64,57 @@ enum RISKI_ERROR_CODE candle_update(struct candle *c, int64_t price,
   // set the close time only if the last price time
   // is greater than the most recent price also the same applies for best
   // bid and ask
-  if (time >= c->end_time) {
-    c->end_time = time;
-    c->close = price;
-    c->best_bid = bid;
-    c->best_ask = ask;
+  if (time >= CANDLE_FIELD(c, uint64_t, end_time)) {
+    CANDLE_FIELD(c, uint64_t, end_time) = time;
+    CANDLE_FIELD(c, int64_t, close) = price;
+    CANDLE_FIELD(c, int64_t, best_bid) = bid;
+    CANDLE_FIELD(c, int64_t, best_ask) = ask;
   }
 
   // only update volume if the lastest time is greater than the previous
-  if (time > c->end_time) {
-    c->volume += 1;
+  if (time > CANDLE_FIELD(c, uint64_t, end_time)) {
+    CANDLE_FIELD(c, uint64_t, volume) += 1;
   }
 
   // update the high and low
   // the time doesn't matter in this case
-  if (price > c->high)
-    c->high = price;
-  if (price < c->low)
-    c->low = price;
+  if (price > CANDLE_FIELD(c, int64_t, high))
+    CANDLE_FIELD(c, int64_t, high) = price;
+  if (price < CANDLE_FIELD(c, int64_t, low))
+    CANDLE_FIELD(c, int64_t, low) = price;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE candle_quote(struct candle *c, int64_t bid, int64_t ask,
+                                   uint64_t time) {
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // a quote older than the last trade would overwrite a newer bid and ask
+  if (time >= CANDLE_FIELD(c, uint64_t, end_time)) {
+    CANDLE_FIELD(c, int64_t, best_bid) = bid;
+    CANDLE_FIELD(c, int64_t, best_ask) = ask;
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE candle_merge(struct candle *dst, struct candle *src) {
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(src, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (CANDLE_FIELD(src, int64_t, high) > CANDLE_FIELD(dst, int64_t, high))
+    CANDLE_FIELD(dst, int64_t, high) = CANDLE_FIELD(src, int64_t, high);
+  if (CANDLE_FIELD(src, int64_t, low) < CANDLE_FIELD(dst, int64_t, low))
+    CANDLE_FIELD(dst, int64_t, low) = CANDLE_FIELD(src, int64_t, low);
+
+  CANDLE_FIELD(dst, uint64_t, volume) += CANDLE_FIELD(src, uint64_t, volume);
+
+  // src is the later candle so it closes dst
+  CANDLE_FIELD(dst, int64_t, close) = CANDLE_FIELD(src, int64_t, close);
+  CANDLE_FIELD(dst, uint64_t, end_time) = CANDLE_FIELD(src, uint64_t, end_time);
+  CANDLE_FIELD(dst, int64_t, best_bid) = CANDLE_FIELD(src, int64_t, best_bid);
+  CANDLE_FIELD(dst, int64_t, best_ask) = CANDLE_FIELD(src, int64_t, best_ask);
 
   return RISKI_ERROR_CODE_NONE;
 }
@@ -94,13 +122,28 @@ enum RISKI_ERROR_CODE candle_update(struct candle *c, int64_t price,
 enum RISKI_ERROR_CODE candle_free(struct candle **c) {
   PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(*c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // a candle from candle_new is slot 0 so it points at its block
   free(*c);
   *c = NULL;
   return RISKI_ERROR_CODE_NONE;
 }
 
-// convert a candle struct to json
-enum RISKI_ERROR_CODE candle_json(struct candle *c, char **json) {
+/*
+ * Copies the string literal S to P and moves P past it
+ */
+#define CANDLE_JSON_LITERAL(P, S)                                              \
+  do {                                                                         \
+    memcpy((P), (S), sizeof(S) - 1);                                           \
+    (P) += sizeof(S) - 1;                                                      \
+  } while (0)
+
+enum RISKI_ERROR_CODE candle_json_write(struct candle *c, char *dst,
+                                        size_t *len) {
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
   /**
    * {
    *  "candle" : {
@@ -117,59 +160,103 @@ enum RISKI_ERROR_CODE candle_json(struct candle *c, char **json) {
    * }
    */
 
-  char type_str[MAX_INT_STR_LEN];
-
-  // max 170 characters (no white space or new lines)
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
-
-  TRACE(string_builder_append(sb, "{\"candle\":{"));
-
-  TRACE(string_builder_append(sb, "\"o\":"));
-  sprintf(type_str, "%ld", c->open);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"h\":"));
-  sprintf(type_str, "%ld", c->high);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"l\":"));
-  sprintf(type_str, "%ld", c->low);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"c\":"));
-  sprintf(type_str, "%ld", c->close);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"s\":"));
-  sprintf(type_str, "%lu", c->start_time);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"e\":"));
-  sprintf(type_str, "%lu", c->end_time);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"v\":"));
-  sprintf(type_str, "%lu", c->volume);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"b\":"));
-  sprintf(type_str, "%ld", c->best_bid);
-  TRACE(string_builder_append(sb, type_str));
+  char *p = dst;
+  CANDLE_JSON_LITERAL(p, "{\"candle\":{\"o\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, open), p);
+  CANDLE_JSON_LITERAL(p, ",\"h\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, high), p);
+  CANDLE_JSON_LITERAL(p, ",\"l\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, low), p);
+  CANDLE_JSON_LITERAL(p, ",\"c\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, close), p);
+  CANDLE_JSON_LITERAL(p, ",\"s\":");
+  p += number_format_u64(CANDLE_FIELD(c, uint64_t, start_time), p);
+  CANDLE_JSON_LITERAL(p, ",\"e\":");
+  p += number_format_u64(CANDLE_FIELD(c, uint64_t, end_time), p);
+  CANDLE_JSON_LITERAL(p, ",\"v\":");
+  p += number_format_u64(CANDLE_FIELD(c, uint64_t, volume), p);
+  CANDLE_JSON_LITERAL(p, ",\"b\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, best_bid), p);
+  CANDLE_JSON_LITERAL(p, ",\"a\":");
+  p += number_format_i64(CANDLE_FIELD(c, int64_t, best_ask), p);
+  CANDLE_JSON_LITERAL(p, "}}");
+
+  *len = (size_t)(p - dst);
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  TRACE(string_builder_append(sb, ",\"a\":"));
-  sprintf(type_str, "%ld", c->best_ask);
-  TRACE(string_builder_append(sb, type_str));
+#undef CANDLE_JSON_LITERAL
 
-  TRACE(string_builder_append(sb, "}}"));
+// convert a candle struct to json
+enum RISKI_ERROR_CODE candle_json(struct candle *c, char **json) {
+  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  char *ret = NULL;
-  TRACE(string_builder_str(sb, &ret));
+  char *ret = (char *)malloc(JSON_CANDLE_MAX_LEN + 1);
+  PTR_CHECK(ret, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
 
-  TRACE(string_builder_free(&sb));
+  size_t len = 0;
+  enum RISKI_ERROR_CODE err = candle_json_write(c, ret, &len);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(ret);
+  TRACE(err);
+  ret[len] = '\0';
 
   *json = ret;
   return RISKI_ERROR_CODE_NONE;
 }
 
-#undef MAX_INT_STR_LEN
+enum RISKI_ERROR_CODE candle_bin_write(struct candle *c,
+                                       struct candle_bin_prev *prev,
+                                       uint64_t interval, unsigned char *dst,
+                                       size_t *len) {
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(prev, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  int64_t open = CANDLE_FIELD(c, int64_t, open);
+  int64_t close = CANDLE_FIELD(c, int64_t, close);
+  uint64_t start = CANDLE_FIELD(c, uint64_t, start_time);
+
+  // the differences are taken unsigned so they wrap instead of overflow,
+  // the reader adds them back the same way
+  unsigned char *p = dst;
+  p += number_format_varint(
+      number_format_zigzag((int64_t)((uint64_t)open - (uint64_t)prev->close)),
+      p);
+  p += number_format_varint(
+      number_format_zigzag((int64_t)(
+          (uint64_t)CANDLE_FIELD(c, int64_t, high) - (uint64_t)open)),
+      p);
+  p += number_format_varint(
+      number_format_zigzag((int64_t)(
+          (uint64_t)CANDLE_FIELD(c, int64_t, low) - (uint64_t)open)),
+      p);
+  p += number_format_varint(
+      number_format_zigzag((int64_t)((uint64_t)close - (uint64_t)open)), p);
+  p += number_format_varint(
+      number_format_zigzag(
+          (int64_t)(start - (prev->start_time + interval))),
+      p);
+  p += number_format_varint(
+      number_format_zigzag(
+          (int64_t)(CANDLE_FIELD(c, uint64_t, end_time) - start)),
+      p);
+  p += number_format_varint(CANDLE_FIELD(c, uint64_t, volume), p);
+  p += number_format_varint(
+      number_format_zigzag((int64_t)(
+          (uint64_t)CANDLE_FIELD(c, int64_t, best_bid) - (uint64_t)close)),
+      p);
+  p += number_format_varint(
+      number_format_zigzag((int64_t)(
+          (uint64_t)CANDLE_FIELD(c, int64_t, best_ask) - (uint64_t)close)),
+      p);
+
+  prev->close = close;
+  prev->start_time = start;
+
+  *len = (size_t)(p - dst);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+#undef CANDLE_FIELD
@@ -1,16 +1,207 @@
 #include <chart/chart.h>
 
-#define MAX_INT_STR_LEN ((CHAR_BIT * sizeof(int) - 1) / 3 + 2)
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+
+/*
+ * A block or flat run directory that was replaced by a bigger one.
+ * Analysis threads may still be reading through it so it is kept until the
+ * chart is freed.
+ * @param {void*} dir The old directory
+ * @param {struct chart_retired*} next The next retired directory
+ */
+struct chart_retired {
+  void *dir;
+  struct chart_retired *next;
+};
+
+/*
+ * Consecutive fill-in candles of a gap in trading. Every candle of the run
+ * is a doji at price with price as the bid and ask, no volume and an end
+ * time equal to its start time. The run takes no candle slots, the
+ * candles are only built a block at a time if chart_get_candle asks for
+ * one of them.
+ * @param {size_t} first The index of the first candle of the run
+ * @param {size_t} count The number of candles in the run
+ * @param {size_t} flat_before The number of candles in earlier runs
+ * @param {size_t} index The position of the run in the runs of its chart
+ * @param {uint64_t} start_time The start of the first candle
+ * @param {int64_t} price The price of every candle
+ * @param {struct candle_block**} expanded Block k holds the candles from
+ * k * CANDLE_BLOCK_SIZE on once chart_get_candle built them, NULL until
+ * then or after chart_trim dropped it
+ */
+struct chart_flat_run {
+  size_t first;
+  size_t count;
+  size_t flat_before;
+  size_t index;
+  uint64_t start_time;
+  int64_t price;
+  _Atomic(struct candle_block *) *expanded;
+};
+
+/*
+ * A growable buffer the json or binary frames of a chart are written
+ * into directly, there are no intermediate strings
+ * @param {char*} c The characters written so far, not terminated until
+ * chart_out_take
+ * @param {size_t} len The number of characters written
+ * @param {size_t} allocated The size of c
+ */
+struct chart_out {
+  char *c;
+  size_t len;
+  size_t allocated;
+};
+
+/*
+ * A copy of the current candle the thread updating the chart publishes
+ * after every change, so it can be read without the lock of the security.
+ * seq is odd while the copy is being written, a reader retries until it
+ * read the same even seq before and after copying.
+ * @param {_Atomic uint64_t} seq Bumped before and after every write
+ * @param {_Atomic size_t} cur_candle The index of the current candle
+ * @param {_Atomic uint64_t} last_update The start of the current candle,
+ * 0 if there is none yet
+ * @param {_Atomic int64_t} open, high, low, close, best_bid, best_ask,
+ * start_time, end_time, volume The fields of the current candle
+ */
+struct chart_tail {
+  _Atomic(uint64_t) seq;
+  _Atomic(size_t) cur_candle;
+  _Atomic(uint64_t) last_update;
+  _Atomic(int64_t) open;
+  _Atomic(int64_t) high;
+  _Atomic(int64_t) low;
+  _Atomic(int64_t) close;
+  _Atomic(int64_t) best_bid;
+  _Atomic(int64_t) best_ask;
+  _Atomic(uint64_t) start_time;
+  _Atomic(uint64_t) end_time;
+  _Atomic(uint64_t) volume;
+};
+
+/*
+ * The json and binary frames of a chart built by earlier requests.
+ * Finalized candles do not change, so their json and binary are kept and
+ * a request only writes the candles finalized since the last one and
+ * the current candle.
+ * With retention only about the resident candles are kept, the older ones
+ * are written again by every request.
+ * @param {pthread_mutex_t} lock Held while the cache is read or extended
+ * @param {struct chart_out} json The json of the cached candles, each
+ * followed by a comma
+ * @param {size_t} json_first The first candle in json
+ * @param {size_t} json_candles The candles before this one are in json
+ * @param {struct chart_out} bin The binary of the cached candles
+ * @param {size_t} bin_first The first candle in bin
+ * @param {size_t} bin_candles The candles before this one are in bin
+ * @param {struct candle_bin_prev} bin_prev What the candle after the last
+ * one in bin is written against
+ * @param {uint64_t} bin_start The start of the first candle
+ * @param {char*} analysis The json of chart_analysis_json, NULL if it
+ * was not built yet
+ * @param {size_t} analysis_len The length of analysis
+ * @param {size_t} analysis_bins The number of bins analysis was built
+ * from
+ * @param {uint64_t} analysis_version The analysis version it was built
+ * from
+ */
+struct chart_cache {
+  pthread_mutex_t lock;
+  struct chart_out json;
+  size_t json_first;
+  size_t json_candles;
+  struct chart_out bin;
+  size_t bin_first;
+  size_t bin_candles;
+  struct candle_bin_prev bin_prev;
+  uint64_t bin_start;
+  char *analysis;
+  size_t analysis_len;
+  size_t analysis_bins;
+  uint64_t analysis_version;
+};
+
+/*
+ * The analysis asked for and not run yet. A chart waits in the analysis
+ * queue at most once and is analysed by one thread at a time, the thread
+ * runs every end asked for since, oldest first.
+ * @param {pthread_mutex_t} lock Held to read or change the jobs
+ * @param {size_t*} ends The end candles to analyse, oldest first
+ * @param {size_t} num_ends The number of ends
+ * @param {size_t} num_ends_allocated The number of slots in ends
+ * @param {size_t} last_end The newest end ever asked for, older ones are
+ * already queued or run
+ * @param {bool} queued True while the chart is queued or analysed
+ */
+struct chart_jobs {
+  pthread_mutex_t lock;
+  size_t *ends;
+  size_t num_ends;
+  size_t num_ends_allocated;
+  size_t last_end;
+  bool queued;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
+};
 
 /*
  * A struct representing the chart
  * @param {uint64_t} interval The interval between two candles
- * @param {size_t} num_candles_allocated The number of allocated candles
+ * @param {size_t} num_candles_allocated The number of analysis bins
  * @param {size_t} cur_candle The current number of allocated candles
  * @param {uint64_t} last_update The start of the last candle
- * @param {struct candle**} candles The list of candles
+ * @param {struct candle_block**} blocks The candles that are not part of
+ * a flat run, slot p is slot p % CANDLE_BLOCK_SIZE of block
+ * p / CANDLE_BLOCK_SIZE. Blocks never move once allocated so candle
+ * handles stay valid, unless the block is spilled. A spilled block is NULL
+ * until it is read back in.
+ * @param {size_t} num_blocks The number of blocks allocated
+ * @param {size_t} num_blocks_allocated The number of slots in blocks
+ * @param {struct chart_flat_run**} runs The flat runs by ascending index
+ * @param {size_t} num_runs The number of flat runs
+ * @param {size_t} num_runs_allocated The number of slots in runs
+ * @param {size_t} num_flat The number of candles in all the flat runs
+ * @param {struct chart_retired*} retired Directories blocks and runs
+ * outgrew
+ * @param {size_t} max_resident The most blocks kept in memory, 0 keeps
+ * every block
+ * @param {atomic_size_t} num_resident The number of blocks in memory
+ * @param {size_t} num_spilled The blocks before this one are in the spill
+ * file
+ * @param {size_t} evict_from The oldest block that may be in memory
+ * @param {atomic_size_t} num_expanded The number of flat run blocks built
+ * @param {size_t} expand_from The oldest flat run that may have built
+ * blocks
+ * @param {struct chart_retired*} evicted Spilled and dropped flat run
+ * blocks that analysis threads may still be reading
+ * @param {atomic_uint} readers The number of analysis threads reading
+ * @param {pthread_mutex_t} spill_lock Held to read a block back in and to
+ * spill blocks
+ * @param {int} spill_fd The spill file, -1 if there is none
+ * @param {struct chart_store*} store The store finalized candles and
+ * analysis are written to, NULL if there is none
+ * @param {size_t} store_chart The chart of the store this chart is
+ * @param {size_t} num_stored The candles before this one are in the store
+ * @param {uint64_t} stored_until The end of the last candle loaded from
+ * the store, candles rolled up before it are already in the chart
+ * @param {_Atomic uint64_t} version Counts the changes to the candles, read
+ * without the lock of the security by the server
+ * @param {_Atomic uint64_t} analysis_version Counts the analysis results
+ * put into the chart
+ * @param {struct chart_tail} tail The current candle as last published
+ * @param {struct chart_cache} cache The frames built by earlier requests
+ * @param {struct chart_jobs} jobs The analysis waiting to be run
+ * @param {void*} analysis_state The state the analysis plugins keep for
+ * the chart, owned by the analysis threads
  * @param {struct chart_analysis*} analysis The analysis coorisponding to the
  * chart.
+ * @param {bool} analysis_enabled True if finalized candles are pushed to
+ * the analysis threads
  * @param {char*} name The name of the chart
  */
 struct chart {
@@ -18,17 +209,201 @@ struct chart {
   size_t num_candles_allocated;
   size_t cur_candle;
   uint64_t last_update;
-  struct candle **candles;
+  _Atomic(struct candle_block *) *blocks;
+  size_t num_blocks;
+  size_t num_blocks_allocated;
+  struct chart_flat_run **runs;
+  size_t num_runs;
+  size_t num_runs_allocated;
+  size_t num_flat;
+  struct chart_retired *retired;
+  size_t max_resident;
+  atomic_size_t num_resident;
+  size_t num_spilled;
+  size_t evict_from;
+  atomic_size_t num_expanded;
+  size_t expand_from;
+  struct chart_retired *evicted;
+  atomic_uint readers;
+  int spill_fd;
+  pthread_mutex_t spill_lock;
+  struct chart_store *store;
+  size_t store_chart;
+  size_t num_stored;
+  uint64_t stored_until;
+  _Atomic(uint64_t) version;
+  _Atomic(uint64_t) analysis_version;
+  struct chart_tail tail;
+  struct chart_cache cache;
+  struct chart_jobs jobs;
+  void *analysis_state;
   pthread_mutex_t analysis_lock;
   struct analysis_result **analysis;
   int precision;
+  bool analysis_enabled;
 
-  // 4 unused bytes in this structure
-  char _p1[4];
+  // 3 unused bytes in this structure
+  char _p1[3];
 
   char *name;
 };
 
+/*
+ * The number of flat runs that start at or before index
+ */
+static size_t chart_find_run(struct chart *cht, size_t index) {
+  size_t lo = 0;
+  size_t hi = cht->num_runs;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (cht->runs[mid]->first <= index)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/*
+ * Sets *run to the flat run holding candle index, or to NULL and *slot to
+ * the slot of the candle in the blocks
+ */
+static inline void chart_locate(struct chart *cht, size_t index,
+                                struct chart_flat_run **run, size_t *slot) {
+  *run = NULL;
+
+  // candles after the last run are the common case, the current candle
+  // is always one of them
+  if (cht->num_runs == 0) {
+    *slot = index;
+    return;
+  }
+  // num_flat is taken from the last run instead of the chart, a reader
+  // outside the lock of the security may see a run pushed after it
+  struct chart_flat_run *last = cht->runs[cht->num_runs - 1];
+  if (index >= last->first + last->count) {
+    *slot = index - last->flat_before - last->count;
+    return;
+  }
+
+  size_t i = chart_find_run(cht, index);
+  struct chart_flat_run *r = i == 0 ? NULL : cht->runs[i - 1];
+  if (!r) {
+    *slot = index;
+  } else if (index < r->first + r->count) {
+    *run = r;
+  } else {
+    *slot = index - r->flat_before - r->count;
+  }
+}
+
+/*
+ * The number of blocks the candles of a flat run take once built
+ */
+static inline size_t chart_run_blocks(const struct chart_flat_run *run) {
+  return (run->count + CANDLE_BLOCK_SIZE - 1) / CANDLE_BLOCK_SIZE;
+}
+
+/*
+ * Builds block k of a flat run, NULL if it can not be allocated
+ */
+static struct candle_block *chart_expand_run(struct chart *cht,
+                                             struct chart_flat_run *run,
+                                             size_t k) {
+  pthread_mutex_lock(&cht->spill_lock);
+
+  // another thread may have built it while this one waited
+  struct candle_block *b = atomic_load(&run->expanded[k]);
+  if (!b) {
+    b = (struct candle_block *)malloc(sizeof(struct candle_block));
+    if (b) {
+      size_t first = k * CANDLE_BLOCK_SIZE;
+      size_t len = run->count - first;
+      if (len > CANDLE_BLOCK_SIZE)
+        len = CANDLE_BLOCK_SIZE;
+
+      for (size_t i = 0; i < len; ++i) {
+        candle_reset(candle_at(b, i), run->price, run->price, run->price,
+                     run->start_time + (first + i) * cht->interval);
+      }
+
+      atomic_store(&run->expanded[k], b);
+      atomic_fetch_add(&cht->num_expanded, 1);
+      if (run->index < cht->expand_from)
+        cht->expand_from = run->index;
+    }
+  }
+
+  pthread_mutex_unlock(&cht->spill_lock);
+  return b;
+}
+
+/*
+ * Reads spilled block k back in, NULL if it can not be read
+ */
+static struct candle_block *chart_page_in(struct chart *cht, size_t k) {
+  pthread_mutex_lock(&cht->spill_lock);
+
+  // another thread may have read it in while this one waited
+  struct candle_block *b = cht->blocks[k];
+  if (!b) {
+    b = (struct candle_block *)malloc(sizeof(struct candle_block));
+    if (b && pread(cht->spill_fd, b, sizeof(struct candle_block),
+                   (off_t)(k * sizeof(struct candle_block))) !=
+                 (ssize_t)sizeof(struct candle_block)) {
+      free(b);
+      b = NULL;
+    }
+    if (b) {
+      cht->blocks[k] = b;
+      atomic_fetch_add(&cht->num_resident, 1);
+      if (k < cht->evict_from)
+        cht->evict_from = k;
+    }
+  }
+
+  pthread_mutex_unlock(&cht->spill_lock);
+  return b;
+}
+
+/*
+ * Block k, read back in if it was spilled. NULL if that fails.
+ */
+static inline struct candle_block *chart_block(struct chart *cht,
+                                               size_t k) {
+  struct candle_block *b = cht->blocks[k];
+  if (b)
+    return b;
+  return chart_page_in(cht, k);
+}
+
+/*
+ * The handle of candle index, the block must already be allocated. A
+ * candle in a flat run is built on first use, a spilled candle is read
+ * back in. NULL if either fails.
+ */
+static inline struct candle *chart_candle(struct chart *cht, size_t index) {
+  struct chart_flat_run *run = NULL;
+  size_t slot = 0;
+  chart_locate(cht, index, &run, &slot);
+
+  if (run) {
+    size_t i = index - run->first;
+    size_t k = i / CANDLE_BLOCK_SIZE;
+    struct candle_block *b = atomic_load(&run->expanded[k]);
+    if (!b)
+      b = chart_expand_run(cht, run, k);
+    if (!b)
+      return NULL;
+    return candle_at(b, i % CANDLE_BLOCK_SIZE);
+  }
+
+  struct candle_block *b = chart_block(cht, slot / CANDLE_BLOCK_SIZE);
+  if (!b)
+    return NULL;
+  return candle_at(b, slot % CANDLE_BLOCK_SIZE);
+}
+
 enum RISKI_ERROR_CODE chart_get_name(struct chart *cht, char **name) {
   PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -37,11 +412,97 @@ enum RISKI_ERROR_CODE chart_get_name(struct chart *cht, char **name) {
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE chart_put_analysis(struct chart *cht, size_t idx,
-                                         struct analysis_result *res) {
-  RANGE_CHECK(idx, 0, cht->cur_candle, RISKI_ERROR_CODE_INVALID_RANGE,
-              RISKI_ERROR_TEXT);
+/*
+ * Bumps a version of the chart. The version only tells readers that
+ * something changed, what changed is read under the lock of the security
+ * so the counter needs no ordering of its own.
+ */
+static inline void chart_changed(_Atomic(uint64_t) *version) {
+  atomic_fetch_add_explicit(version, 1, memory_order_relaxed);
+}
+
+/*
+ * Publishes the current candle to the readers of the tail and bumps the
+ * version of the candles. Called after every change to the candles, the
+ * current candle is never in a flat run or spilled.
+ */
+static void chart_publish(struct chart *cht) {
+  struct chart_tail *t = &cht->tail;
+  uint64_t seq = atomic_load_explicit(&t->seq, memory_order_relaxed);
+  atomic_store_explicit(&t->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&t->cur_candle, cht->cur_candle,
+                        memory_order_relaxed);
+  atomic_store_explicit(&t->last_update, cht->last_update,
+                        memory_order_relaxed);
+  if (cht->last_update != 0) {
+    struct chart_flat_run *run = NULL;
+    size_t slot = 0;
+    chart_locate(cht, cht->cur_candle, &run, &slot);
+    struct candle_block *b = cht->blocks[slot / CANDLE_BLOCK_SIZE];
+    size_t off = slot % CANDLE_BLOCK_SIZE;
+
+#define CHART_PUBLISH_FIELD(FIELD)                                             \
+  atomic_store_explicit(&t->FIELD, b->FIELD[off], memory_order_relaxed)
+    CHART_PUBLISH_FIELD(open);
+    CHART_PUBLISH_FIELD(high);
+    CHART_PUBLISH_FIELD(low);
+    CHART_PUBLISH_FIELD(close);
+    CHART_PUBLISH_FIELD(best_bid);
+    CHART_PUBLISH_FIELD(best_ask);
+    CHART_PUBLISH_FIELD(start_time);
+    CHART_PUBLISH_FIELD(end_time);
+    CHART_PUBLISH_FIELD(volume);
+#undef CHART_PUBLISH_FIELD
+  }
 
+  atomic_store_explicit(&t->seq, seq + 2, memory_order_release);
+  chart_changed(&cht->version);
+}
+
+/*
+ * Reads the tail into slot 0 of copy, retrying while it is being written
+ */
+static void chart_read_tail(struct chart *cht, size_t *cur_candle,
+                            uint64_t *last_update,
+                            struct candle_block *copy) {
+  struct chart_tail *t = &cht->tail;
+  for (;;) {
+    uint64_t seq = atomic_load_explicit(&t->seq, memory_order_acquire);
+    if (seq & 1) {
+      sched_yield();
+      continue;
+    }
+
+    *cur_candle = atomic_load_explicit(&t->cur_candle, memory_order_relaxed);
+    *last_update =
+        atomic_load_explicit(&t->last_update, memory_order_relaxed);
+
+#define CHART_READ_FIELD(FIELD)                                                \
+  copy->FIELD[0] = atomic_load_explicit(&t->FIELD, memory_order_relaxed)
+    CHART_READ_FIELD(open);
+    CHART_READ_FIELD(high);
+    CHART_READ_FIELD(low);
+    CHART_READ_FIELD(close);
+    CHART_READ_FIELD(best_bid);
+    CHART_READ_FIELD(best_ask);
+    CHART_READ_FIELD(start_time);
+    CHART_READ_FIELD(end_time);
+    CHART_READ_FIELD(volume);
+#undef CHART_READ_FIELD
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&t->seq, memory_order_relaxed) == seq)
+      return;
+  }
+}
+
+/*
+ * Adds res to the analysis of candle idx
+ */
+static void chart_attach_analysis(struct chart *cht, size_t idx,
+                                  struct analysis_result *res) {
   res->next = NULL;
 
   pthread_mutex_lock(&cht->analysis_lock);
@@ -60,83 +521,134 @@ enum RISKI_ERROR_CODE chart_put_analysis(struct chart *cht, size_t idx,
     cht->analysis[idx] = res;
   }
   pthread_mutex_unlock(&cht->analysis_lock);
-  return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE
-chart_analysis_trend_line_json(struct trend_line *tl, char **json) {
-  PTR_CHECK(tl, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
-
-  TRACE(string_builder_append(sb, "{"));
-  TRACE(string_builder_append(sb, "\"endIndex\":"));
-
-  char type_str[MAX_INT_STR_LEN];
-  sprintf(type_str, "%d", (int)tl->end_index);
-
-  TRACE(string_builder_append(sb, type_str));
-  TRACE(string_builder_append(sb, ",\"startIndex\":"));
-
-  sprintf(type_str, "%d", (int)tl->start_index);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, ",\"direction\":"));
-
-  sprintf(type_str, "%d", (int)tl->direction);
-  TRACE(string_builder_append(sb, type_str));
-
-  TRACE(string_builder_append(sb, "}"));
+/*
+ * Writes the analysis result res on candle idx to the store
+ */
+static enum RISKI_ERROR_CODE chart_store_analysis(struct chart *cht,
+                                                  size_t idx,
+                                                  struct analysis_result *res) {
+  struct chart_store_record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.chart = (uint32_t)cht->store_chart;
+
+  switch (res->type) {
+  case TREND_LINE: {
+    struct trend_line *tl = (struct trend_line *)res->draw_data;
+    rec.type = CHART_STORE_RECORD_TREND_LINE;
+    rec.trend_line.index = idx;
+    rec.trend_line.start_index = tl->start_index;
+    rec.trend_line.end_index = tl->end_index;
+    rec.trend_line.direction = (uint32_t)tl->direction;
+    break;
+  }
+  case CANDLE_PATTERN: {
+    struct candle_pattern *cp = (struct candle_pattern *)res->draw_data;
+    rec.type = CHART_STORE_RECORD_CANDLE_PATTERN;
+    rec.candle_pattern.index = idx;
+    rec.candle_pattern.candles_spanning = cp->candles_spanning;
+    strncpy(rec.candle_pattern.short_code, cp->short_code,
+            CHART_STORE_SHORT_CODE_LEN - 1);
+    break;
+  }
+  }
 
-  char *sb_str = NULL;
-  TRACE(string_builder_str(sb, &sb_str));
+  TRACE(chart_store_put(cht->store, &rec));
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  *json = sb_str;
+enum RISKI_ERROR_CODE chart_put_analysis(struct chart *cht, size_t idx,
+                                         struct analysis_result *res) {
+  RANGE_CHECK(idx, 0, cht->cur_candle, RISKI_ERROR_CODE_INVALID_RANGE,
+              RISKI_ERROR_TEXT);
 
-  TRACE(string_builder_free(&sb));
+  chart_attach_analysis(cht, idx, res);
+  chart_changed(&cht->analysis_version);
 
+  if (cht->store)
+    TRACE(chart_store_analysis(cht, idx, res));
   return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE
-chart_analysis_candle_pattern_json(struct candle_pattern *cp, char **json) {
-  PTR_CHECK(cp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
+/*
+ * Makes room for n more characters and a terminator
+ */
+static enum RISKI_ERROR_CODE chart_out_reserve(struct chart_out *out,
+                                                    size_t n) {
+  if (out->len + n + 1 <= out->allocated)
+    return RISKI_ERROR_CODE_NONE;
 
-  TRACE(string_builder_append(sb, "{"));
-  TRACE(string_builder_append(sb, "\"candlesSpanning\":"));
+  size_t allocated = out->allocated == 0 ? 256 : out->allocated;
+  while (allocated < out->len + n + 1)
+    allocated *= 2;
 
-  char type_str[MAX_INT_STR_LEN];
-  sprintf(type_str, "%d", (int)cp->candles_spanning);
+  char *c = (char *)realloc(out->c, allocated);
+  PTR_CHECK(c, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  out->c = c;
+  out->allocated = allocated;
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  TRACE(string_builder_append(sb, type_str));
-  TRACE(string_builder_append(sb, ",\"shortCode\":\""));
-  TRACE(string_builder_append(sb, cp->short_code));
-  TRACE(string_builder_append(sb, "\""));
-  TRACE(string_builder_append(sb, "}"));
+/*
+ * Terminates the json and hands it over to the caller
+ */
+static char *chart_out_take(struct chart_out *out) {
+  out->c[out->len] = '\0';
+  char *c = out->c;
+  out->c = NULL;
+  out->len = 0;
+  out->allocated = 0;
+  return c;
+}
 
-  char *sb_str = NULL;
-  TRACE(string_builder_str(sb, &sb_str));
+/*
+ * Appends the string literal S, the room must already be reserved
+ */
+#define CHART_JSON_LITERAL(OUT, S)                                             \
+  do {                                                                         \
+    memcpy((OUT)->c + (OUT)->len, (S), sizeof(S) - 1);                         \
+    (OUT)->len += sizeof(S) - 1;                                               \
+  } while (0)
 
-  *json = sb_str;
+/*
+ * Appends an integer, the room must already be reserved
+ */
+#define CHART_JSON_INT(OUT, V)                                                 \
+  ((OUT)->len += number_format_i64((int64_t)(V), (OUT)->c + (OUT)->len))
 
-  TRACE(string_builder_free(&sb));
+/*
+ * The most characters a trend line or candle pattern adds besides the
+ * short code
+ */
+#define CHART_JSON_ANALYSIS_MAX_LEN 128
+
+static void chart_analysis_trend_line_json(struct trend_line *tl,
+                                           struct chart_out *out) {
+  CHART_JSON_LITERAL(out, "{\"endIndex\":");
+  CHART_JSON_INT(out, (int)tl->end_index);
+  CHART_JSON_LITERAL(out, ",\"startIndex\":");
+  CHART_JSON_INT(out, (int)tl->start_index);
+  CHART_JSON_LITERAL(out, ",\"direction\":");
+  CHART_JSON_INT(out, (int)tl->direction);
+  CHART_JSON_LITERAL(out, "}");
+}
 
-  return RISKI_ERROR_CODE_NONE;
+static void chart_analysis_candle_pattern_json(struct candle_pattern *cp,
+                                               size_t short_code_len,
+                                               struct chart_out *out) {
+  CHART_JSON_LITERAL(out, "{\"candlesSpanning\":");
+  CHART_JSON_INT(out, (int)cp->candles_spanning);
+  CHART_JSON_LITERAL(out, ",\"shortCode\":\"");
+  memcpy(out->c + out->len, cp->short_code, short_code_len);
+  out->len += short_code_len;
+  CHART_JSON_LITERAL(out, "\"}");
 }
 
 static enum RISKI_ERROR_CODE
-chart_analysis_result_json(struct analysis_result *analysis, char **json) {
+chart_analysis_result_json(struct analysis_result *analysis,
+                           struct chart_out *out) {
   PTR_CHECK(analysis, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
 
   /*
    * [
@@ -152,49 +664,71 @@ chart_analysis_result_json(struct analysis_result *analysis, char **json) {
    * ]
    */
 
-  TRACE(string_builder_append(sb, "["));
+  TRACE(chart_out_reserve(out, 1));
+  CHART_JSON_LITERAL(out, "[");
 
   while (analysis) {
+    size_t short_code_len = 0;
+    if (analysis->type == CANDLE_PATTERN) {
+      short_code_len =
+          strlen(((struct candle_pattern *)analysis->draw_data)->short_code);
+    }
+    TRACE(chart_out_reserve(out, CHART_JSON_ANALYSIS_MAX_LEN +
+                                          short_code_len));
 
-    TRACE(string_builder_append(sb, "{\"type\":"));
-
-    // convert type integer to string
-    char type_str[MAX_INT_STR_LEN];
-    sprintf(type_str, "%d", analysis->type);
-
-    TRACE(string_builder_append(sb, type_str));
-    TRACE(string_builder_append(sb, ",\"data\":"));
+    CHART_JSON_LITERAL(out, "{\"type\":");
+    CHART_JSON_INT(out, analysis->type);
+    CHART_JSON_LITERAL(out, ",\"data\":");
 
-    char *data_json = NULL;
     switch (analysis->type) {
     case CANDLE_PATTERN:
-      TRACE(
-          chart_analysis_candle_pattern_json(analysis->draw_data, &data_json));
+      chart_analysis_candle_pattern_json(analysis->draw_data, short_code_len,
+                                         out);
       break;
     case TREND_LINE:
-      TRACE(chart_analysis_trend_line_json(analysis->draw_data, &data_json));
+      chart_analysis_trend_line_json(analysis->draw_data, out);
       break;
     }
-    TRACE(string_builder_append(sb, data_json));
-    TRACE(string_builder_append(sb, "}"));
-
-    free(data_json);
+    CHART_JSON_LITERAL(out, "}");
 
     if (analysis->next) {
-      TRACE(string_builder_append(sb, ","));
+      CHART_JSON_LITERAL(out, ",");
     }
     analysis = analysis->next;
   }
 
-  TRACE(string_builder_append(sb, "]"));
+  TRACE(chart_out_reserve(out, 1));
+  CHART_JSON_LITERAL(out, "]");
 
-  char *jsn = NULL;
-  TRACE(string_builder_str(sb, &jsn));
-
-  *json = jsn;
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  TRACE(string_builder_free(&sb));
+/*
+ * Writes the analysis json of the first num_bins candles, the analysis
+ * lock must be held or the chart not shared yet
+ */
+static enum RISKI_ERROR_CODE chart_analysis_json_write(struct chart *cht,
+                                                       size_t num_bins,
+                                                       struct chart_out *out) {
+  // most bins are empty
+  TRACE(chart_out_reserve(out, 32 + num_bins * 5));
+  CHART_JSON_LITERAL(out, "{\"analysisFull\": [");
+
+  for (size_t i = 0; i < num_bins; ++i) {
+    if (cht->analysis[i] == NULL) {
+      TRACE(chart_out_reserve(out, 5));
+      CHART_JSON_LITERAL(out, "null");
+    } else {
+      TRACE(chart_analysis_result_json(cht->analysis[i], out));
+    }
+    if (i != num_bins - 1) {
+      TRACE(chart_out_reserve(out, 1));
+      CHART_JSON_LITERAL(out, ",");
+    }
+  }
 
+  TRACE(chart_out_reserve(out, 2));
+  CHART_JSON_LITERAL(out, "]}");
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -202,35 +736,76 @@ enum RISKI_ERROR_CODE chart_analysis_json(struct chart *cht, char **json) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
+  // the analysis of the current candle and the one before it is not sent
+  size_t num_bins = cht->cur_candle < 1 ? 0 : cht->cur_candle - 1;
 
-  TRACE(string_builder_append(sb, "{\"analysisFull\": ["));
+  struct chart_out out = {NULL, 0, 0};
+  enum RISKI_ERROR_CODE err = chart_analysis_json_write(cht, num_bins, &out);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
 
-  for (size_t i = 0; i < cht->cur_candle - 1; ++i) {
-    char *candle_analysis = NULL;
-    if (cht->analysis[i] == NULL) {
-      TRACE(string_builder_append(sb, "null"));
-    } else {
-      TRACE(chart_analysis_result_json(cht->analysis[i], &candle_analysis));
-      TRACE(string_builder_append(sb, candle_analysis));
-
-      free(candle_analysis);
-    }
-    if (i != cht->cur_candle - 2) {
-      TRACE(string_builder_append(sb, ","));
-    }
-  }
+  *json = chart_out_take(&out);
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  TRACE(string_builder_append(sb, "]}"));
+/*
+ * Sets up the tail of a chart that was never updated
+ */
+static void chart_tail_init(struct chart_tail *t) {
+  atomic_init(&t->seq, 0);
+  atomic_init(&t->cur_candle, 0);
+  atomic_init(&t->last_update, 0);
+  atomic_init(&t->open, 0);
+  atomic_init(&t->high, 0);
+  atomic_init(&t->low, 0);
+  atomic_init(&t->close, 0);
+  atomic_init(&t->best_bid, 0);
+  atomic_init(&t->best_ask, 0);
+  atomic_init(&t->start_time, 0);
+  atomic_init(&t->end_time, 0);
+  atomic_init(&t->volume, 0);
+}
 
-  char *jsn = NULL;
-  TRACE(string_builder_str(sb, &jsn));
-  TRACE(string_builder_free(&sb));
+/*
+ * Sets up an empty cache
+ */
+static void chart_cache_init(struct chart_cache *cache) {
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->json = (struct chart_out){NULL, 0, 0};
+  cache->json_first = 0;
+  cache->json_candles = 0;
+  cache->bin = (struct chart_out){NULL, 0, 0};
+  cache->bin_first = 0;
+  cache->bin_candles = 0;
+  cache->bin_prev = (struct candle_bin_prev){0, 0};
+  cache->bin_start = 0;
+  cache->analysis = NULL;
+  cache->analysis_len = 0;
+  cache->analysis_bins = 0;
+  cache->analysis_version = 0;
+}
 
-  *json = jsn;
+/*
+ * Frees the frames kept by a cache
+ */
+static void chart_cache_free(struct chart_cache *cache) {
+  free(cache->json.c);
+  free(cache->bin.c);
+  free(cache->analysis);
+  pthread_mutex_destroy(&cache->lock);
+}
 
-  return RISKI_ERROR_CODE_NONE;
+/*
+ * Sets up a chart nobody asked to analyse yet
+ */
+static void chart_jobs_init(struct chart_jobs *jobs) {
+  pthread_mutex_init(&jobs->lock, NULL);
+  jobs->ends = NULL;
+  jobs->num_ends = 0;
+  jobs->num_ends_allocated = 0;
+  jobs->last_end = 0;
+  jobs->queued = false;
 }
 
 enum RISKI_ERROR_CODE chart_new(uint64_t interval, char *name, int precision,
@@ -246,10 +821,42 @@ enum RISKI_ERROR_CODE chart_new(uint64_t interval, char *name, int precision,
   cht->cur_candle = 0;
   cht->last_update = 0;
   cht->precision = precision;
-
-  // Create a list of candles pre allocated for 1 days worth
-  cht->candles = (struct candle **)malloc((cht->num_candles_allocated) *
-                                          sizeof(struct chart *));
+  cht->analysis_enabled = true;
+
+  // Create a block directory for 1 days worth, the blocks themselves are
+  // allocated as candles are added
+  cht->num_blocks = 0;
+  cht->num_blocks_allocated =
+      (cht->num_candles_allocated + CANDLE_BLOCK_SIZE - 1) / CANDLE_BLOCK_SIZE;
+  cht->blocks = malloc(cht->num_blocks_allocated * sizeof(cht->blocks[0]));
+  cht->runs = NULL;
+  cht->num_runs = 0;
+  cht->num_runs_allocated = 0;
+  cht->num_flat = 0;
+  cht->retired = NULL;
+
+  // every candle stays in memory until chart_set_retention is called
+  cht->max_resident = 0;
+  atomic_init(&cht->num_resident, 0);
+  cht->num_spilled = 0;
+  cht->evict_from = 0;
+  atomic_init(&cht->num_expanded, 0);
+  cht->expand_from = 0;
+  cht->evicted = NULL;
+  atomic_init(&cht->readers, 0);
+  atomic_init(&cht->version, 0);
+  atomic_init(&cht->analysis_version, 0);
+  chart_tail_init(&cht->tail);
+  chart_cache_init(&cht->cache);
+  chart_jobs_init(&cht->jobs);
+  cht->analysis_state = NULL;
+  cht->spill_fd = -1;
+  pthread_mutex_init(&(cht->spill_lock), NULL);
+
+  cht->store = NULL;
+  cht->store_chart = 0;
+  cht->num_stored = 0;
+  cht->stored_until = 0;
 
   // Create the bins for the analysis results at each candle
   cht->analysis = (struct analysis_result **)malloc(
@@ -262,24 +869,96 @@ enum RISKI_ERROR_CODE chart_new(uint64_t interval, char *name, int precision,
     cht->analysis[i] = NULL;
   }
 
-  PTR_CHECK(cht->candles, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(cht->blocks, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   *cht_ = cht;
   return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE chart_new_candle(struct chart *cht, int64_t lst,
-                                              int64_t bid, int64_t ask) {
+/*
+ * Keeps dir around until the chart is freed
+ */
+static enum RISKI_ERROR_CODE chart_retire(struct chart *cht, void *dir) {
+  struct chart_retired *retired =
+      (struct chart_retired *)malloc(sizeof(struct chart_retired));
+  PTR_CHECK(retired, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  retired->dir = dir;
+  retired->next = cht->retired;
+  cht->retired = retired;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Makes sure the blocks for the first num_slots slots are allocated
+ */
+static enum RISKI_ERROR_CODE chart_reserve_blocks(struct chart *cht,
+                                                  size_t num_slots) {
+  size_t num_blocks = (num_slots + CANDLE_BLOCK_SIZE - 1) / CANDLE_BLOCK_SIZE;
+
+  if (num_blocks > cht->num_blocks_allocated) {
+    size_t num_blocks_allocated = cht->num_blocks_allocated * 2;
+    while (num_blocks_allocated < num_blocks)
+      num_blocks_allocated *= 2;
+
+    _Atomic(struct candle_block *) *blocks =
+        malloc(num_blocks_allocated * sizeof(blocks[0]));
+    PTR_CHECK(blocks, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+    // the old directory is retired instead of freed since analysis may
+    // still be walking it
+    enum RISKI_ERROR_CODE err = chart_retire(cht, cht->blocks);
+    if (err != RISKI_ERROR_CODE_NONE)
+      free(blocks);
+    TRACE(err);
+
+    // blocks read back in while copying would be lost
+    pthread_mutex_lock(&cht->spill_lock);
+    for (size_t i = 0; i < cht->num_blocks; ++i) {
+      atomic_init(&blocks[i], cht->blocks[i]);
+    }
+    cht->blocks = blocks;
+    pthread_mutex_unlock(&cht->spill_lock);
+    cht->num_blocks_allocated = num_blocks_allocated;
+  }
+
+  while (cht->num_blocks < num_blocks) {
+    struct candle_block *b =
+        (struct candle_block *)malloc(sizeof(struct candle_block));
+    PTR_CHECK(b, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+    cht->blocks[cht->num_blocks] = b;
+    cht->num_blocks += 1;
+    atomic_fetch_add(&cht->num_resident, 1);
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Makes sure there is room for at least num_candles candles and their
+ * analysis bins, the candles in flat runs must already be added
+ */
+static enum RISKI_ERROR_CODE chart_reserve(struct chart *cht,
+                                           size_t num_candles) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  if (cht->cur_candle >= cht->num_candles_allocated) {
-    size_t prev_candles_allocated = cht->num_candles_allocated;
+  TRACE(chart_reserve_blocks(cht, num_candles - cht->num_flat));
+
+  if (num_candles <= cht->num_candles_allocated)
+    return RISKI_ERROR_CODE_NONE;
+
+  size_t prev_candles_allocated = cht->num_candles_allocated;
+  while (cht->num_candles_allocated < num_candles) {
     cht->num_candles_allocated =
         (size_t)((double)cht->num_candles_allocated * (double)1.5);
-    cht->candles = realloc(cht->candles, sizeof(struct candle **) *
-                                             cht->num_candles_allocated);
-    cht->analysis = realloc(cht->candles, sizeof(struct analysis_result) *
-                                              cht->num_candles_allocated);
+  }
+
+  pthread_mutex_lock(&cht->analysis_lock);
+  struct analysis_result **analysis = (struct analysis_result **)realloc(
+      cht->analysis,
+      sizeof(struct analysis_result *) * cht->num_candles_allocated);
+  if (analysis) {
+    cht->analysis = analysis;
 
     // set the newly allocated memory to their default state.
     for (size_t i = prev_candles_allocated; i < cht->num_candles_allocated;
@@ -287,112 +966,1053 @@ static enum RISKI_ERROR_CODE chart_new_candle(struct chart *cht, int64_t lst,
       cht->analysis[i] = NULL;
     }
   }
+  pthread_mutex_unlock(&cht->analysis_lock);
+  PTR_CHECK(analysis, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
 
-  TRACE(candle_new(lst, bid, ask, cht->last_update,
-                   &cht->candles[cht->cur_candle]));
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE chart_get_candle(struct chart *cht, size_t index,
-                                       struct candle **cnd) {
-  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  RANGE_CHECK(index, 0, cht->cur_candle, RISKI_ERROR_CODE_INVALID_RANGE,
-              RISKI_ERROR_TEXT);
-  *cnd = cht->candles[index];
+/*
+ * Frees the spilled blocks that were kept for analysis threads, spill_lock
+ * must be held and no analysis thread may be reading
+ */
+static void chart_free_evicted(struct chart *cht) {
+  while (cht->evicted) {
+    struct chart_retired *next = cht->evicted->next;
+    free(cht->evicted->dir);
+    free(cht->evicted);
+    cht->evicted = next;
+  }
+}
+
+/*
+ * Puts a block that was taken out of the chart on the evicted list,
+ * spill_lock must be held
+ */
+static enum RISKI_ERROR_CODE chart_evict(struct chart *cht,
+                                         struct candle_block *b) {
+  struct chart_retired *evicted =
+      (struct chart_retired *)malloc(sizeof(struct chart_retired));
+  PTR_CHECK(evicted, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  evicted->dir = b;
+  evicted->next = cht->evicted;
+  cht->evicted = evicted;
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE chart_update(struct chart *cht, int64_t price,
-                                   int64_t bid, int64_t ask, uint64_t ts) {
-  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+/*
+ * Drops the oldest built flat run blocks until no more than max_resident
+ * are left, they are built again if they are asked for. spill_lock must be
+ * held.
+ */
+static enum RISKI_ERROR_CODE chart_trim_runs(struct chart *cht) {
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  size_t r = cht->expand_from;
+  for (; r < cht->num_runs &&
+         atomic_load(&cht->num_expanded) > cht->max_resident;
+       ++r) {
+    struct chart_flat_run *run = cht->runs[r];
+    size_t num_blocks = chart_run_blocks(run);
+    for (size_t k = 0; k < num_blocks &&
+                       atomic_load(&cht->num_expanded) > cht->max_resident;
+         ++k) {
+      struct candle_block *b = atomic_load(&run->expanded[k]);
+      if (!b)
+        continue;
+
+      err = chart_evict(cht, b);
+      if (err != RISKI_ERROR_CODE_NONE)
+        break;
+      atomic_store(&run->expanded[k], NULL);
+      atomic_fetch_sub(&cht->num_expanded, 1);
+    }
 
-  // convert ts into the start time of its coorisponding candle
-  // this will sync all the candles to the beginning minute no matter
-  // when the server is started
-  size_t offset = ts % cht->interval;
-  ts = ts - offset;
-  // special case where this is the first chart update
-  if (cht->last_update == 0) {
-    // sync the first candle to the closest minute
-    cht->last_update = ts;
-    TRACE(chart_new_candle(cht, price, bid, ask));
-    return RISKI_ERROR_CODE_NONE;
+    // the run may still have blocks when the limit was reached in it
+    if (err != RISKI_ERROR_CODE_NONE ||
+        atomic_load(&cht->num_expanded) <= cht->max_resident)
+      break;
   }
+  cht->expand_from = r;
 
-  // check if the interval requires us to make a new candle
-  if (ts != cht->last_update) {
-    // create a new candle
-    // check if fill-ins are required
-    size_t fill_in_candles = ((ts - cht->last_update) / cht->interval);
-    if (fill_in_candles != 1) {
-      for (size_t i = 0; i < fill_in_candles - 1; ++i) {
-        // fill in the candles in between with dojies of the
-        // current candle before creating the new candle
-        cht->cur_candle += 1;
-        cht->last_update += cht->interval;
-
-        int64_t close = 0;
-        TRACE(candle_close(cht->candles[cht->cur_candle - 1], &close));
-        TRACE(chart_new_candle(cht, close, close, close));
+  return err;
+}
+
+/*
+ * Spills the oldest blocks until no more than max_resident blocks are in
+ * memory and drops the oldest built flat run blocks over the same limit.
+ * The block holding the current candle is never spilled and a block is
+ * only written the first time it is spilled, finalized candles do not
+ * change.
+ */
+static enum RISKI_ERROR_CODE chart_trim(struct chart *cht) {
+  if (cht->max_resident == 0 ||
+      (atomic_load(&cht->num_resident) <= cht->max_resident &&
+       atomic_load(&cht->num_expanded) <= cht->max_resident))
+    return RISKI_ERROR_CODE_NONE;
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  pthread_mutex_lock(&cht->spill_lock);
+
+  size_t k = cht->evict_from;
+  for (; k + 1 < cht->num_blocks &&
+         atomic_load(&cht->num_resident) > cht->max_resident;
+       ++k) {
+    struct candle_block *b = cht->blocks[k];
+    if (!b)
+      continue;
+
+    if (k >= cht->num_spilled) {
+      if (pwrite(cht->spill_fd, b, sizeof(struct candle_block),
+                 (off_t)(k * sizeof(struct candle_block))) !=
+          (ssize_t)sizeof(struct candle_block)) {
+        err = RISKI_ERROR_CODE_UNKNOWN;
+        break;
       }
+      cht->num_spilled = k + 1;
     }
 
-    cht->last_update = ts;
-    cht->cur_candle += 1;
-    chart_new_candle(cht, price, bid, ask);
+    err = chart_evict(cht, b);
+    if (err != RISKI_ERROR_CODE_NONE)
+      break;
 
-    // queue up analysis on the newly finalized chart
-    TRACE(analysis_push(cht, 0, cht->cur_candle));
-  } else {
-    // update the current candle
-    TRACE(candle_update(cht->candles[cht->cur_candle], price, bid, ask, ts));
+    cht->blocks[k] = NULL;
+    atomic_fetch_sub(&cht->num_resident, 1);
   }
+  cht->evict_from = k;
+
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_trim_runs(cht);
 
+  // a reader that arrives after the blocks were cleared reads them back
+  // in, so once there are no readers nobody holds the old ones
+  if (atomic_load(&cht->readers) == 0)
+    chart_free_evicted(cht);
+
+  pthread_mutex_unlock(&cht->spill_lock);
+
+  if (err != RISKI_ERROR_CODE_NONE) {
+    TRACE(logger_error(err, __func__, FILENAME_SHORT, __LINE__,
+                       "%s could not spill block %lu", cht->name, k));
+    return err;
+  }
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE chart_json(struct chart *cht, char **json) {
+enum RISKI_ERROR_CODE chart_set_retention(struct chart *cht,
+                                          size_t max_candles,
+                                          const char *path) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(max_candles, 0, >, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
 
-  // if the last update is 0 then there is no chart
-  // information so we can't construct a valid json
-  if (cht->last_update == 0) {
-    *json = NULL;
-    return RISKI_ERROR_CODE_NONE;
-  }
+  if (cht->spill_fd == -1) {
+    int fd = -1;
+    if (path) {
+      fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    } else {
+      // nobody else needs the file so it is removed right away, it lives
+      // on until the chart closes it
+      char tmp_path[] = "/tmp/riski-chart-XXXXXX";
+      fd = mkstemp(tmp_path);
+      if (fd != -1)
+        unlink(tmp_path);
+    }
 
-  struct string_builder *sb = NULL;
-  TRACE(string_builder_new(&sb));
+    if (fd == -1) {
+      TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                         __LINE__, "%s could not open a spill file",
+                         cht->name));
+      return RISKI_ERROR_CODE_UNKNOWN;
+    }
+    cht->spill_fd = fd;
+  }
 
-  size_t num_candles = cht->cur_candle + 1;
+  // one more block for the partly filled block of the current candle
+  cht->max_resident =
+      (max_candles + CANDLE_BLOCK_SIZE - 1) / CANDLE_BLOCK_SIZE + 1;
+  TRACE(chart_trim(cht));
 
-  TRACE(string_builder_append(sb, "{\"chart\": {\"precision\":"));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+void chart_analysis_enter(struct chart *cht) {
+  atomic_fetch_add(&cht->readers, 1);
+}
+
+void chart_analysis_leave(struct chart *cht) {
+  atomic_fetch_sub(&cht->readers, 1);
+}
+
+enum RISKI_ERROR_CODE chart_analysis_request(struct chart *cht, size_t end,
+                                             bool *queue) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(queue, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart_jobs *jobs = &cht->jobs;
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  pthread_mutex_lock(&jobs->lock);
+  // an end that was already asked for is queued or run
+  if (end > jobs->last_end) {
+    if (jobs->num_ends == jobs->num_ends_allocated) {
+      size_t num_ends_allocated =
+          jobs->num_ends_allocated == 0 ? 16 : jobs->num_ends_allocated * 2;
+      size_t *ends =
+          (size_t *)realloc(jobs->ends, num_ends_allocated * sizeof(size_t));
+      if (ends) {
+        jobs->ends = ends;
+        jobs->num_ends_allocated = num_ends_allocated;
+      } else {
+        err = RISKI_ERROR_CODE_MALLOC_ERROR;
+      }
+    }
+    if (err == RISKI_ERROR_CODE_NONE) {
+      jobs->ends[jobs->num_ends++] = end;
+      jobs->last_end = end;
+    }
+  }
+
+  *queue = !jobs->queued && jobs->num_ends > 0;
+  if (*queue)
+    jobs->queued = true;
+  pthread_mutex_unlock(&jobs->lock);
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_analysis_take(struct chart *cht, size_t *ends,
+                                          size_t max_ends, size_t *num_ends) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(ends, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(num_ends, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart_jobs *jobs = &cht->jobs;
+
+  pthread_mutex_lock(&jobs->lock);
+  size_t n = jobs->num_ends < max_ends ? jobs->num_ends : max_ends;
+  if (n > 0) {
+    memcpy(ends, jobs->ends, n * sizeof(size_t));
+    memmove(jobs->ends, jobs->ends + n,
+            (jobs->num_ends - n) * sizeof(size_t));
+    jobs->num_ends -= n;
+  }
+  pthread_mutex_unlock(&jobs->lock);
+
+  *num_ends = n;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_analysis_done(struct chart *cht, bool *queue) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(queue, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart_jobs *jobs = &cht->jobs;
+
+  pthread_mutex_lock(&jobs->lock);
+  // ends asked for while this analysis ran did not queue the chart
+  *queue = jobs->num_ends > 0;
+  jobs->queued = *queue;
+  pthread_mutex_unlock(&jobs->lock);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_analysis_state(struct chart *cht,
+                                               void **state) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(state, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *state = cht->analysis_state;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_analysis_state(struct chart *cht,
+                                               void *state) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  cht->analysis_state = state;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_analysis_dropped(struct chart *cht) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  pthread_mutex_lock(&cht->jobs.lock);
+  cht->jobs.queued = false;
+  pthread_mutex_unlock(&cht->jobs.lock);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Frees a flat run and its candles
+ */
+static void chart_free_run(struct chart_flat_run *run) {
+  size_t num_blocks = chart_run_blocks(run);
+  for (size_t k = 0; k < num_blocks; ++k) {
+    free(atomic_load(&run->expanded[k]));
+  }
+  free(run->expanded);
+  free(run);
+}
+
+/*
+ * Adds run to the end of the flat runs, run->first must come after every
+ * candle of the chart
+ */
+static enum RISKI_ERROR_CODE chart_push_run(struct chart *cht,
+                                            struct chart_flat_run *run) {
+  if (cht->num_runs == cht->num_runs_allocated) {
+    size_t num_runs_allocated =
+        cht->num_runs_allocated == 0 ? 16 : cht->num_runs_allocated * 2;
+
+    struct chart_flat_run **runs = (struct chart_flat_run **)malloc(
+        num_runs_allocated * sizeof(struct chart_flat_run *));
+    PTR_CHECK(runs, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+    if (cht->runs) {
+      enum RISKI_ERROR_CODE err = chart_retire(cht, cht->runs);
+      if (err != RISKI_ERROR_CODE_NONE)
+        free(runs);
+      TRACE(err);
+
+      memcpy(runs, cht->runs, cht->num_runs * sizeof(struct chart_flat_run *));
+    }
+    cht->runs = runs;
+    cht->num_runs_allocated = num_runs_allocated;
+  }
+
+  run->flat_before = cht->num_flat;
+  run->index = cht->num_runs;
+  cht->runs[cht->num_runs] = run;
+  cht->num_runs += 1;
+  cht->num_flat += run->count;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds count fill-in candles at price after the current candle
+ */
+static enum RISKI_ERROR_CODE chart_fill_in(struct chart *cht, size_t count,
+                                           int64_t price) {
+  struct chart_flat_run *run =
+      (struct chart_flat_run *)malloc(sizeof(struct chart_flat_run));
+  PTR_CHECK(run, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  run->first = cht->cur_candle + 1;
+  run->count = count;
+  run->start_time = cht->last_update + cht->interval;
+  run->price = price;
+
+  // calloc leaves every block unbuilt
+  _Atomic(struct candle_block *) *expanded =
+      (_Atomic(struct candle_block *) *)calloc(chart_run_blocks(run),
+                                               sizeof(expanded[0]));
+  if (!expanded)
+    free(run);
+  PTR_CHECK(expanded, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  run->expanded = expanded;
+
+  enum RISKI_ERROR_CODE err = chart_push_run(cht, run);
+  if (err != RISKI_ERROR_CODE_NONE)
+    chart_free_run(run);
+  TRACE(err);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE chart_new_candle(struct chart *cht, int64_t lst,
+                                              int64_t bid, int64_t ask) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(chart_reserve(cht, cht->cur_candle + 1));
+
+  TRACE(candle_reset(chart_candle(cht, cht->cur_candle), lst, bid, ask,
+                     cht->last_update));
+  TRACE(chart_trim(cht));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Copies n candle slots starting at slot s of src to slot d of dst, both
+ * ranges must already be allocated
+ */
+static enum RISKI_ERROR_CODE chart_copy_candles(struct chart *dst, size_t d,
+                                                struct chart *src, size_t s,
+                                                size_t n) {
+  while (n != 0) {
+    size_t d_off = d % CANDLE_BLOCK_SIZE;
+    size_t s_off = s % CANDLE_BLOCK_SIZE;
+
+    // the longest run that stays inside one block of each chart
+    size_t run = CANDLE_BLOCK_SIZE - (d_off > s_off ? d_off : s_off);
+    if (run > n)
+      run = n;
+
+    struct candle_block *db = chart_block(dst, d / CANDLE_BLOCK_SIZE);
+    struct candle_block *sb = chart_block(src, s / CANDLE_BLOCK_SIZE);
+    PTR_CHECK(db, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+    PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+#define COPY_FIELD(FIELD)                                                      \
+  memcpy(&db->FIELD[d_off], &sb->FIELD[s_off], run * sizeof(db->FIELD[0]))
+    COPY_FIELD(open);
+    COPY_FIELD(high);
+    COPY_FIELD(low);
+    COPY_FIELD(close);
+    COPY_FIELD(best_bid);
+    COPY_FIELD(best_ask);
+    COPY_FIELD(start_time);
+    COPY_FIELD(end_time);
+    COPY_FIELD(volume);
+#undef COPY_FIELD
+
+    d += run;
+    s += run;
+    n -= run;
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Writes every finalized candle that is not in the store yet, a flat run
+ * is written as one record
+ */
+static enum RISKI_ERROR_CODE chart_persist(struct chart *cht) {
+  if (!cht->store)
+    return RISKI_ERROR_CODE_NONE;
+
+  struct chart_store_record rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.chart = (uint32_t)cht->store_chart;
+
+  // every candle before the current one is finalized
+  size_t i = cht->num_stored;
+  while (i < cht->cur_candle) {
+    struct chart_flat_run *run = NULL;
+    size_t slot = 0;
+    chart_locate(cht, i, &run, &slot);
+
+    if (run) {
+      size_t k = i - run->first;
+      rec.type = CHART_STORE_RECORD_FLAT;
+      rec.flat.start_time = run->start_time + k * cht->interval;
+      rec.flat.count = run->count - k;
+      rec.flat.price = run->price;
+      i += run->count - k;
+    } else {
+      struct candle_block *b = chart_block(cht, slot / CANDLE_BLOCK_SIZE);
+      PTR_CHECK(b, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+      size_t off = slot % CANDLE_BLOCK_SIZE;
+      rec.type = CHART_STORE_RECORD_CANDLE;
+      rec.candle.open = b->open[off];
+      rec.candle.high = b->high[off];
+      rec.candle.low = b->low[off];
+      rec.candle.close = b->close[off];
+      rec.candle.best_bid = b->best_bid[off];
+      rec.candle.best_ask = b->best_ask[off];
+      rec.candle.start_time = b->start_time[off];
+      rec.candle.end_time = b->end_time[off];
+      rec.candle.volume = b->volume[off];
+      i += 1;
+    }
+
+    TRACE(chart_store_put(cht->store, &rec));
+  }
+
+  cht->num_stored = i;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds a candle record from the store after the last candle
+ */
+static enum RISKI_ERROR_CODE
+chart_load_candle(struct chart *cht, const struct chart_store_record *rec) {
+  if (cht->last_update != 0) {
+    // the gap left by chart_append is not filled in, anything else has
+    // to come after the last candle
+    COMPARISON_CHECK(rec->candle.start_time, cht->last_update, >,
+                     RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+    cht->cur_candle += 1;
+  }
+  cht->last_update = rec->candle.start_time;
+
+  TRACE(chart_reserve(cht, cht->cur_candle + 1));
+
+  size_t slot = cht->cur_candle - cht->num_flat;
+  struct candle_block *b = chart_block(cht, slot / CANDLE_BLOCK_SIZE);
+  PTR_CHECK(b, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  size_t off = slot % CANDLE_BLOCK_SIZE;
+  b->open[off] = rec->candle.open;
+  b->high[off] = rec->candle.high;
+  b->low[off] = rec->candle.low;
+  b->close[off] = rec->candle.close;
+  b->best_bid[off] = rec->candle.best_bid;
+  b->best_ask[off] = rec->candle.best_ask;
+  b->start_time[off] = rec->candle.start_time;
+  b->end_time[off] = rec->candle.end_time;
+  b->volume[off] = rec->candle.volume;
+
+  TRACE(chart_trim(cht));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds a flat run record from the store after the last candle
+ */
+static enum RISKI_ERROR_CODE
+chart_load_flat(struct chart *cht, const struct chart_store_record *rec) {
+  // a flat run always follows the candle it repeats
+  if (cht->last_update == 0 || rec->flat.count == 0 ||
+      rec->flat.start_time != cht->last_update + cht->interval) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s stored flat run at %lu does not follow %lu",
+                       cht->name, rec->flat.start_time, cht->last_update));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+
+  TRACE(chart_fill_in(cht, rec->flat.count, rec->flat.price));
+  cht->cur_candle += rec->flat.count;
+  cht->last_update += rec->flat.count * cht->interval;
+
+  // the run takes no slots, only analysis bins
+  TRACE(chart_reserve(cht, cht->cur_candle + 1));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds an analysis record from the store, results on candles that were
+ * not stored are dropped
+ */
+static enum RISKI_ERROR_CODE
+chart_load_analysis(struct chart *cht, const struct chart_store_record *rec) {
+  struct analysis_result *res =
+      (struct analysis_result *)malloc(sizeof(struct analysis_result));
+  PTR_CHECK(res, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  size_t idx = 0;
+  if (rec->type == CHART_STORE_RECORD_TREND_LINE) {
+    struct trend_line *tl =
+        (struct trend_line *)malloc(sizeof(struct trend_line));
+    if (!tl)
+      free(res);
+    PTR_CHECK(tl, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+    tl->start_index = rec->trend_line.start_index;
+    tl->end_index = rec->trend_line.end_index;
+    tl->direction = (enum DIRECTION)rec->trend_line.direction;
+    res->type = TREND_LINE;
+    res->draw_data = tl;
+    idx = rec->trend_line.index;
+  } else {
+    struct candle_pattern *cp =
+        (struct candle_pattern *)malloc(sizeof(struct candle_pattern));
+    if (!cp)
+      free(res);
+    PTR_CHECK(cp, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+    cp->candles_spanning = rec->candle_pattern.candles_spanning;
+    cp->short_code = strndup(rec->candle_pattern.short_code,
+                             CHART_STORE_SHORT_CODE_LEN - 1);
+    res->type = CANDLE_PATTERN;
+    res->draw_data = cp;
+    idx = rec->candle_pattern.index;
+  }
+
+  if (idx > cht->cur_candle) {
+    if (res->type == CANDLE_PATTERN)
+      free(((struct candle_pattern *)res->draw_data)->short_code);
+    free(res->draw_data);
+    free(res);
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  chart_attach_analysis(cht, idx, res);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_open_store(struct chart *cht,
+                                       struct chart_store *store,
+                                       size_t store_chart) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (cht->last_update != 0 || cht->store) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s can only open a store while it is empty",
+                       cht->name));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+
+  const struct chart_store_record *records = NULL;
+  size_t num_records = 0;
+  TRACE(chart_store_records(store, &records, &num_records));
+
+  // candles first so every analysis result has its candle to go on
+  for (size_t i = 0; i < num_records; ++i) {
+    if (records[i].chart != store_chart)
+      continue;
+    if (records[i].type == CHART_STORE_RECORD_CANDLE)
+      TRACE(chart_load_candle(cht, &records[i]));
+    else if (records[i].type == CHART_STORE_RECORD_FLAT)
+      TRACE(chart_load_flat(cht, &records[i]));
+  }
+
+  // the last candle loaded becomes the current candle again, it is in the
+  // store already so it is not written a second time when it is finalized
+  if (cht->last_update != 0) {
+    cht->num_stored = cht->cur_candle + 1;
+    cht->stored_until = cht->last_update + cht->interval;
+
+    for (size_t i = 0; i < num_records; ++i) {
+      if (records[i].chart != store_chart)
+        continue;
+      if (records[i].type == CHART_STORE_RECORD_TREND_LINE ||
+          records[i].type == CHART_STORE_RECORD_CANDLE_PATTERN)
+        TRACE(chart_load_analysis(cht, &records[i]));
+    }
+
+    chart_publish(cht);
+    chart_changed(&cht->analysis_version);
+  }
+
+  cht->store = store;
+  cht->store_chart = store_chart;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_analysis(struct chart *cht, bool enabled) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  cht->analysis_enabled = enabled;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_append(struct chart *dst, struct chart *src) {
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(src, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // nothing was traded in src so there is nothing to move
+  if (src->last_update == 0)
+    return RISKI_ERROR_CODE_NONE;
+
+  if (dst->interval != src->interval) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s can not append a chart with a different interval",
+                       dst->name));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+
+  struct candle_block *src_first = chart_block(src, 0);
+  PTR_CHECK(src_first, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  uint64_t src_start = src_first->start_time[0];
+
+  if (dst->last_update != 0 && src_start <= dst->last_update) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s appended chart must start after %lu", dst->name,
+                       dst->last_update));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+
+  // the current candle of dst becomes finalized, no fill-ins are created
+  // for the gap between the two charts
+  size_t first = dst->last_update == 0 ? 0 : dst->cur_candle + 1;
+  size_t first_slot = first - dst->num_flat;
+  size_t num_src_candles = src->cur_candle + 1;
+  size_t num_src_slots = num_src_candles - src->num_flat;
+
+  // the flat runs of src are handed over to dst, src keeps none of them
+  // even if dst can not take them all
+  size_t num_src_runs = src->num_runs;
+  src->num_runs = 0;
+  src->num_flat = 0;
+
+  // the blocks src built for its runs go with them
+  if (atomic_load(&src->num_expanded) > 0 &&
+      dst->num_runs < dst->expand_from)
+    dst->expand_from = dst->num_runs;
+  atomic_fetch_add(&dst->num_expanded, atomic_exchange(&src->num_expanded, 0));
+  src->expand_from = 0;
+
+  for (size_t i = 0; i < num_src_runs; ++i) {
+    src->runs[i]->first += first;
+    enum RISKI_ERROR_CODE err = chart_push_run(dst, src->runs[i]);
+    if (err != RISKI_ERROR_CODE_NONE) {
+      for (size_t k = i; k < num_src_runs; ++k)
+        chart_free_run(src->runs[k]);
+    }
+    TRACE(err);
+  }
+
+  TRACE(chart_reserve(dst, first + num_src_candles));
+
+  TRACE(chart_copy_candles(dst, first_slot, src, 0, num_src_slots));
+  dst->cur_candle = first + num_src_candles - 1;
+  dst->last_update = src->last_update;
+
+  src->cur_candle = 0;
+  src->last_update = 0;
+
+  chart_publish(src);
+  chart_publish(dst);
+  TRACE(chart_trim(dst));
+  TRACE(chart_persist(dst));
+
+  // queue up analysis for every candle that is now finalized in the same
+  // way chart_update does one candle at a time
+  if (dst->analysis_enabled) {
+    for (size_t i = first == 0 ? 1 : first; i <= dst->cur_candle; ++i) {
+      TRACE(analysis_push(dst, 0, i));
+    }
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_candle(struct chart *cht, size_t index,
+                                       struct candle **cnd) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  RANGE_CHECK(index, 0, cht->cur_candle, RISKI_ERROR_CODE_INVALID_RANGE,
+              RISKI_ERROR_TEXT);
+
+  struct candle *c = chart_candle(cht, index);
+  PTR_CHECK(c, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  *cnd = c;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_span(struct chart *cht, size_t first, size_t last,
+                                 struct chart_span *span) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(span, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  RANGE_CHECK(last, 0, cht->cur_candle, RISKI_ERROR_CODE_INVALID_RANGE,
+              RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(first, last, <=, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
+
+  struct chart_flat_run *run = NULL;
+  size_t slot = 0;
+  chart_locate(cht, first, &run, &slot);
+
+  span->first = first;
+  span->interval = cht->interval;
+
+  if (run) {
+    size_t k = first - run->first;
+
+    span->open = NULL;
+    span->high = NULL;
+    span->low = NULL;
+    span->close = NULL;
+    span->best_bid = NULL;
+    span->best_ask = NULL;
+    span->start_time = NULL;
+    span->end_time = NULL;
+    span->volume = NULL;
+    span->flat = true;
+    span->price = run->price;
+    span->start = run->start_time + k * cht->interval;
+    span->len = run->count - k;
+    if (span->len > last - first + 1)
+      span->len = last - first + 1;
+
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct candle_block *b = chart_block(cht, slot / CANDLE_BLOCK_SIZE);
+  PTR_CHECK(b, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  size_t off = slot % CANDLE_BLOCK_SIZE;
+
+  // stop at the end of the block, at the next flat run or at last,
+  // whichever comes first
+  size_t len = CANDLE_BLOCK_SIZE - off;
+  if (len > last - first + 1)
+    len = last - first + 1;
+
+  size_t next = chart_find_run(cht, first);
+  if (next < cht->num_runs && len > cht->runs[next]->first - first)
+    len = cht->runs[next]->first - first;
+
+  span->open = &b->open[off];
+  span->high = &b->high[off];
+  span->low = &b->low[off];
+  span->close = &b->close[off];
+  span->best_bid = &b->best_bid[off];
+  span->best_ask = &b->best_ask[off];
+  span->start_time = &b->start_time[off];
+  span->end_time = &b->end_time[off];
+  span->volume = &b->volume[off];
+  span->flat = false;
+  span->price = 0;
+  span->start = b->start_time[off];
+  span->len = len;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Makes the candle starting at ts the current candle, ts must already be
+ * aligned to the interval. Candles skipped over are filled in and the
+ * candle that was current is finalized.
+ */
+static enum RISKI_ERROR_CODE chart_advance(struct chart *cht, uint64_t ts,
+                                           int64_t price, int64_t bid,
+                                           int64_t ask) {
+  // special case where this is the first chart update
+  if (cht->last_update == 0) {
+    // sync the first candle to the closest minute
+    cht->last_update = ts;
+    TRACE(chart_new_candle(cht, price, bid, ask));
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  // create a new candle
+  // check if fill-ins are required
+  size_t fill_in_candles = ((ts - cht->last_update) / cht->interval);
+  if (fill_in_candles != 1) {
+    // the candles in between are dojies of the current candle, they are
+    // kept as one flat run instead of a candle each
+    int64_t close = 0;
+    TRACE(candle_close(chart_candle(cht, cht->cur_candle), &close));
+    TRACE(chart_fill_in(cht, fill_in_candles - 1, close));
+
+    cht->cur_candle += fill_in_candles - 1;
+    cht->last_update += (fill_in_candles - 1) * cht->interval;
+  }
+
+  cht->last_update = ts;
+  cht->cur_candle += 1;
+  TRACE(chart_new_candle(cht, price, bid, ask));
+  TRACE(chart_persist(cht));
+
+  // queue up analysis on the newly finalized chart
+  if (cht->analysis_enabled)
+    TRACE(analysis_push(cht, 0, cht->cur_candle));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_update(struct chart *cht, int64_t price,
+                                   int64_t bid, int64_t ask, uint64_t ts) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // convert ts into the start time of its coorisponding candle
+  // this will sync all the candles to the beginning minute no matter
+  // when the server is started
+  size_t offset = ts % cht->interval;
+  ts = ts - offset;
+
+  // trades before the current candle can not be placed and the candles
+  // loaded from a store are complete, both happen when a feed is replayed
+  // over a store
+  if (ts < cht->last_update || ts < cht->stored_until)
+    return RISKI_ERROR_CODE_NONE;
+
+  // check if the interval requires us to make a new candle
+  if (cht->last_update == 0 || ts != cht->last_update) {
+    TRACE(chart_advance(cht, ts, price, bid, ask));
+  } else {
+    // update the current candle
+    TRACE(candle_update(chart_candle(cht, cht->cur_candle), price, bid, ask,
+                        ts));
+  }
+  chart_publish(cht);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_rollup(struct chart *dst, struct chart *src,
+                                   size_t index) {
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(src, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(index, src->cur_candle, <=, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
+
+  struct chart_flat_run *run = NULL;
+  size_t slot = 0;
+  chart_locate(src, index, &run, &slot);
+
+  // fill-ins are left out so dst fills in its own gaps like chart_update
+  if (run)
+    return RISKI_ERROR_CODE_NONE;
+
+  struct candle_block *b = chart_block(src, slot / CANDLE_BLOCK_SIZE);
+  PTR_CHECK(b, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  size_t off = slot % CANDLE_BLOCK_SIZE;
+  struct candle *c = candle_at(b, off);
+
+  uint64_t ts = b->start_time[off] - (b->start_time[off] % dst->interval);
+
+  // candles of dst loaded from its store already hold this one
+  if (ts < dst->stored_until)
+    return RISKI_ERROR_CODE_NONE;
+
+  // the first lower candle of an interval opens the candle, the rest are
+  // folded into it
+  if (dst->last_update == 0 || ts != dst->last_update)
+    TRACE(chart_advance(dst, ts, b->open[off], b->best_bid[off],
+                        b->best_ask[off]));
+
+  TRACE(candle_merge(chart_candle(dst, dst->cur_candle), c));
+  chart_publish(dst);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_num_candles(struct chart *cht,
+                                            size_t *num_candles) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(num_candles, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *num_candles = cht->last_update == 0 ? 0 : cht->cur_candle + 1;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_interval(struct chart *cht,
+                                         uint64_t *interval) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(interval, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *interval = cht->interval;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_precision(struct chart *cht,
+                                          int *precision) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(precision, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *precision = cht->precision;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_stored_until(struct chart *cht,
+                                             uint64_t *until) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(until, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *until = cht->stored_until;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_get_versions(struct chart *cht, uint64_t *version,
+                                         uint64_t *analysis_version) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(version, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(analysis_version, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *version = atomic_load_explicit(&cht->version, memory_order_relaxed);
+  *analysis_version =
+      atomic_load_explicit(&cht->analysis_version, memory_order_relaxed);
+  return RISKI_ERROR_CODE_NONE;
+}
 
-#define MAX_INT_STR_LEN ((CHAR_BIT * sizeof(int) - 1) / 3 + 2)
-  char type_str[MAX_INT_STR_LEN];
-  sprintf(type_str, "%d", cht->precision);
-#undef MAX_INT_STR_LEN
-  TRACE(string_builder_append(sb, type_str));
-  TRACE(string_builder_append(sb, ", \"candles\": ["));
+enum RISKI_ERROR_CODE chart_quote(struct chart *cht, int64_t bid, int64_t ask,
+                                  uint64_t ts) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // quotes only move the current candle, a candle is only ever opened by
+  // a trade and takes the current quote with it then
+  if (cht->last_update == 0 || ts - (ts % cht->interval) != cht->last_update ||
+      ts < cht->stored_until)
+    return RISKI_ERROR_CODE_NONE;
+
+  TRACE(candle_quote(chart_candle(cht, cht->cur_candle), bid, ask, ts));
+  chart_publish(cht);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Sets *c to candle i without expanding a flat run, the candles of a flat
+ * run are built one at a time in flat instead
+ */
+static enum RISKI_ERROR_CODE chart_candle_view(struct chart *cht, size_t i,
+                                               struct candle *flat,
+                                               struct candle **c) {
+  struct chart_flat_run *run = NULL;
+  size_t slot = 0;
+  chart_locate(cht, i, &run, &slot);
+
+  if (run) {
+    TRACE(candle_reset(flat, run->price, run->price, run->price,
+                       run->start_time + (i - run->first) * cht->interval));
+    *c = flat;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct candle_block *b = chart_block(cht, slot / CANDLE_BLOCK_SIZE);
+  PTR_CHECK(b, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  *c = candle_at(b, slot % CANDLE_BLOCK_SIZE);
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  char *tmp_candle_json = NULL;
+/*
+ * Writes the candles of the chart after the header chart_json started
+ */
+static enum RISKI_ERROR_CODE chart_json_candles(struct chart *cht,
+                                                struct chart_out *out) {
+  size_t num_candles = cht->cur_candle + 1;
+
+  struct candle_block flat;
   for (size_t i = 0; i < num_candles; ++i) {
-    TRACE(candle_json(cht->candles[i], &tmp_candle_json));
-    TRACE(string_builder_append(sb, tmp_candle_json));
+    struct candle *c = NULL;
+    TRACE(chart_candle_view(cht, i, candle_at(&flat, 0), &c));
+
+    TRACE(chart_out_reserve(out, JSON_CANDLE_MAX_LEN + 1));
+    size_t len = 0;
+    TRACE(candle_json_write(c, out->c + out->len, &len));
+    out->len += len;
     if (i != num_candles - 1) {
-      TRACE(string_builder_append(sb, ","));
+      CHART_JSON_LITERAL(out, ",");
     }
-    free(tmp_candle_json);
-    tmp_candle_json = NULL;
   }
-  TRACE(string_builder_append(sb, "]}}"));
 
-  char *buf = NULL;
-  TRACE(string_builder_str(sb, &buf));
-  *json = buf;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * About the length of the json of a candle, used to size the buffer of
+ * chart_json up front so it rarely has to grow
+ */
+#define CHART_JSON_CANDLE_LEN 128
+
+enum RISKI_ERROR_CODE chart_json(struct chart *cht, char **json) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // if the last update is 0 then there is no chart
+  // information so we can't construct a valid json
+  if (cht->last_update == 0) {
+    *json = NULL;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct chart_out out = {NULL, 0, 0};
+  TRACE(chart_out_reserve(
+      &out, 64 + (cht->cur_candle + 1) * CHART_JSON_CANDLE_LEN));
+
+  CHART_JSON_LITERAL(&out, "{\"chart\": {\"precision\":");
+  CHART_JSON_INT(&out, cht->precision);
+  CHART_JSON_LITERAL(&out, ", \"candles\": [");
+
+  enum RISKI_ERROR_CODE err = chart_json_candles(cht, &out);
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_out_reserve(&out, 3);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+
+  CHART_JSON_LITERAL(&out, "]}}");
+  *json = chart_out_take(&out);
 
-  TRACE(string_builder_free(&sb));
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -402,33 +2022,476 @@ enum RISKI_ERROR_CODE chart_latest_candle(struct chart *cht, char **json) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  size_t total_json_size = 18 + JSON_CANDLE_MAX_LEN;
+  struct chart_out out = {NULL, 0, 0};
+  TRACE(chart_out_reserve(&out, 17 + JSON_CANDLE_MAX_LEN + 1));
+
+  CHART_JSON_LITERAL(&out, "{\"latestCandle\":");
+  size_t len = 0;
+  enum RISKI_ERROR_CODE err =
+      candle_json_write(chart_candle(cht, cht->cur_candle),
+                        out.c + out.len, &len);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+  out.len += len;
+  CHART_JSON_LITERAL(&out, "}");
+
+  *json = chart_out_take(&out);
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  char *buf = (char *)calloc(total_json_size, sizeof(char));
-  PTR_CHECK(buf, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
-  strcat(buf, "{\"latestCandle\":\x0");
+/*
+ * Writes the n low bytes of v to dst, lowest byte first
+ */
+static void chart_bin_le(unsigned char *dst, uint64_t v, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = (unsigned char)(v >> (8 * i));
+}
 
-  char *tmp_candle_json = NULL;
-  TRACE(candle_json(cht->candles[cht->cur_candle], &tmp_candle_json));
-  strcat(buf, tmp_candle_json);
-  strcat(buf, "}\x0");
+/*
+ * Starts a binary frame of num_candles candles, the first candle starts
+ * at start. The room must already be reserved.
+ */
+static void chart_bin_header(struct chart *cht, struct chart_out *out,
+                             enum CHART_BIN_FRAME type, size_t num_candles,
+                             uint64_t start) {
+  unsigned char *h = (unsigned char *)out->c + out->len;
+  h[0] = CHART_BIN_VERSION;
+  h[1] = (unsigned char)type;
+  chart_bin_le(h + 2, (uint64_t)cht->precision, 2);
+  chart_bin_le(h + 4, num_candles, 4);
+  chart_bin_le(h + 8, cht->interval, 8);
+  chart_bin_le(h + 16, start, 8);
+  out->len += CHART_BIN_HEADER_LEN;
+}
 
-  free(tmp_candle_json);
+/*
+ * Writes candle c of a binary frame
+ */
+static enum RISKI_ERROR_CODE chart_bin_candle(struct chart *cht,
+                                              struct chart_out *out,
+                                              struct candle *c,
+                                              struct candle_bin_prev *prev) {
+  TRACE(chart_out_reserve(out, BIN_CANDLE_MAX_LEN));
+  size_t len = 0;
+  TRACE(candle_bin_write(c, prev, cht->interval,
+                         (unsigned char *)out->c + out->len, &len));
+  out->len += len;
+  return RISKI_ERROR_CODE_NONE;
+}
 
-  *json = buf;
+/*
+ * About the length of a binary candle, used to size the buffer of
+ * chart_bin up front
+ */
+#define CHART_BIN_CANDLE_LEN 16
+
+enum RISKI_ERROR_CODE chart_bin(struct chart *cht, char **bin, size_t *len) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // same as chart_json, there is nothing to send before the first update
+  if (cht->last_update == 0) {
+    *bin = NULL;
+    *len = 0;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  size_t num_candles = cht->cur_candle + 1;
+
+  struct candle_block flat;
+  struct candle *c = NULL;
+  TRACE(chart_candle_view(cht, 0, candle_at(&flat, 0), &c));
+  uint64_t start = 0;
+  TRACE(candle_start(c, &start));
+
+  struct chart_out out = {NULL, 0, 0};
+  TRACE(chart_out_reserve(&out, CHART_BIN_HEADER_LEN +
+                                    num_candles * CHART_BIN_CANDLE_LEN));
+  chart_bin_header(cht, &out, CHART_BIN_FRAME_CHART, num_candles, start);
+
+  // the first start is in the header, so the first candle is written
+  // against the candle that would have come before it
+  struct candle_bin_prev prev = {0, start - cht->interval};
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  for (size_t i = 0; i < num_candles && err == RISKI_ERROR_CODE_NONE; ++i) {
+    err = chart_candle_view(cht, i, candle_at(&flat, 0), &c);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = chart_bin_candle(cht, &out, c, &prev);
+  }
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+
+  *len = out.len;
+  *bin = chart_out_take(&out);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_latest_candle_bin(struct chart *cht, char **bin,
+                                              size_t *len) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct candle *c = chart_candle(cht, cht->cur_candle);
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  uint64_t start = 0;
+  TRACE(candle_start(c, &start));
+
+  struct chart_out out = {NULL, 0, 0};
+  TRACE(chart_out_reserve(&out, CHART_BIN_HEADER_LEN + BIN_CANDLE_MAX_LEN));
+  chart_bin_header(cht, &out, CHART_BIN_FRAME_LATEST_CANDLE, 1, start);
+
+  struct candle_bin_prev prev = {0, start - cht->interval};
+  enum RISKI_ERROR_CODE err = chart_bin_candle(cht, &out, c, &prev);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+
+  *len = out.len;
+  *bin = chart_out_take(&out);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * The number of finalized candles the cache keeps, about the candles that
+ * are resident. 0 keeps every candle.
+ */
+static size_t chart_cache_limit(struct chart *cht) {
+  return cht->max_resident * CANDLE_BLOCK_SIZE;
+}
+
+/*
+ * Writes the json of candles from up to but not including to, each
+ * followed by a comma. Finalized candles are read the same way analysis
+ * threads read them, without the lock of the security.
+ */
+static enum RISKI_ERROR_CODE chart_json_finalized(struct chart *cht,
+                                                  struct chart_out *out,
+                                                  size_t from, size_t to) {
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  struct candle_block flat;
+  chart_analysis_enter(cht);
+  for (size_t i = from; i < to && err == RISKI_ERROR_CODE_NONE; ++i) {
+    struct candle *c = NULL;
+    err = chart_candle_view(cht, i, candle_at(&flat, 0), &c);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = chart_out_reserve(out, JSON_CANDLE_MAX_LEN + 1);
+    size_t len = 0;
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = candle_json_write(c, out->c + out->len, &len);
+    if (err == RISKI_ERROR_CODE_NONE) {
+      out->len += len;
+      CHART_JSON_LITERAL(out, ",");
+    }
+  }
+  chart_analysis_leave(cht);
+  TRACE(err);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds the json of the candles finalized since the last call to the
+ * cache, the cache lock must be held. With retention the cache starts
+ * over from the newest candles once it holds twice as many as are kept.
+ */
+static enum RISKI_ERROR_CODE chart_cache_json(struct chart *cht,
+                                              size_t num_finalized) {
+  struct chart_cache *cache = &cht->cache;
+
+  size_t limit = chart_cache_limit(cht);
+  if (limit > 0 && num_finalized - cache->json_first > 2 * limit) {
+    cache->json.len = 0;
+    cache->json_first = num_finalized - limit;
+    cache->json_candles = cache->json_first;
+  }
+
+  if (cache->json.len == 0)
+    TRACE(chart_out_reserve(&cache->json, (num_finalized - cache->json_first) *
+                                              CHART_JSON_CANDLE_LEN));
+
+  TRACE(chart_json_finalized(cht, &cache->json, cache->json_candles,
+                             num_finalized));
+  cache->json_candles = num_finalized;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_json_cached(struct chart *cht, char **json) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t cur_candle = 0;
+  uint64_t last_update = 0;
+  struct candle_block tail;
+  chart_read_tail(cht, &cur_candle, &last_update, &tail);
+
+  // same as chart_json, there is nothing to send before the first update
+  if (last_update == 0) {
+    *json = NULL;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct chart_cache *cache = &cht->cache;
+  pthread_mutex_lock(&cache->lock);
+  enum RISKI_ERROR_CODE err = chart_cache_json(cht, cur_candle);
+  struct chart_out out = {NULL, 0, 0};
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_out_reserve(
+        &out, 64 + cache->json_first * CHART_JSON_CANDLE_LEN +
+                  cache->json.len + JSON_CANDLE_MAX_LEN + 3);
+  if (err == RISKI_ERROR_CODE_NONE) {
+    CHART_JSON_LITERAL(&out, "{\"chart\": {\"precision\":");
+    CHART_JSON_INT(&out, cht->precision);
+    CHART_JSON_LITERAL(&out, ", \"candles\": [");
+
+    // the candles before the cache are written again every time
+    err = chart_json_finalized(cht, &out, 0, cache->json_first);
+  }
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_out_reserve(&out, cache->json.len + JSON_CANDLE_MAX_LEN + 3);
+  if (err == RISKI_ERROR_CODE_NONE && cache->json.len > 0) {
+    memcpy(out.c + out.len, cache->json.c, cache->json.len);
+    out.len += cache->json.len;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  size_t len = 0;
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = candle_json_write(candle_at(&tail, 0), out.c + out.len, &len);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+
+  out.len += len;
+  CHART_JSON_LITERAL(&out, "]}}");
+  *json = chart_out_take(&out);
   return RISKI_ERROR_CODE_NONE;
 }
 
+/*
+ * Writes the binary candles from up to but not including to, prev is the
+ * candle before from and is moved along
+ */
+static enum RISKI_ERROR_CODE chart_bin_finalized(struct chart *cht,
+                                                 struct chart_out *out,
+                                                 size_t from, size_t to,
+                                                 struct candle_bin_prev *prev) {
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  struct candle_block flat;
+  chart_analysis_enter(cht);
+  for (size_t i = from; i < to && err == RISKI_ERROR_CODE_NONE; ++i) {
+    struct candle *c = NULL;
+    err = chart_candle_view(cht, i, candle_at(&flat, 0), &c);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = chart_bin_candle(cht, out, c, prev);
+  }
+  chart_analysis_leave(cht);
+  TRACE(err);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Adds the binary candles finalized since the last call to the cache, the
+ * cache lock must be held. first is the first candle of the chart, used
+ * while the cache is empty. With retention the cache starts over like the
+ * json one, from the candle after the one it is written against.
+ */
+static enum RISKI_ERROR_CODE chart_cache_bin(struct chart *cht,
+                                             size_t num_finalized,
+                                             struct candle *first) {
+  struct chart_cache *cache = &cht->cache;
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  struct candle_block flat;
+  chart_analysis_enter(cht);
+  if (cache->bin_candles == 0) {
+    // the first start is in the header, so the first candle is written
+    // against the candle that would have come before it
+    if (num_finalized > 0)
+      err = chart_candle_view(cht, 0, candle_at(&flat, 0), &first);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = candle_start(first, &cache->bin_start);
+    cache->bin_prev =
+        (struct candle_bin_prev){0, cache->bin_start - cht->interval};
+  }
+
+  size_t limit = chart_cache_limit(cht);
+  if (err == RISKI_ERROR_CODE_NONE && limit > 0 &&
+      num_finalized - cache->bin_first > 2 * limit) {
+    size_t bin_first = num_finalized - limit;
+    struct candle *c = NULL;
+    err = chart_candle_view(cht, bin_first - 1, candle_at(&flat, 0), &c);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = candle_close(c, &cache->bin_prev.close);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = candle_start(c, &cache->bin_prev.start_time);
+    if (err == RISKI_ERROR_CODE_NONE) {
+      cache->bin.len = 0;
+      cache->bin_first = bin_first;
+      cache->bin_candles = bin_first;
+    }
+  }
+  chart_analysis_leave(cht);
+  TRACE(err);
+
+  TRACE(chart_bin_finalized(cht, &cache->bin, cache->bin_candles,
+                            num_finalized, &cache->bin_prev));
+  cache->bin_candles = num_finalized;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_bin_cached(struct chart *cht, char **bin,
+                                       size_t *len) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t cur_candle = 0;
+  uint64_t last_update = 0;
+  struct candle_block tail;
+  chart_read_tail(cht, &cur_candle, &last_update, &tail);
+
+  if (last_update == 0) {
+    *bin = NULL;
+    *len = 0;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  struct chart_cache *cache = &cht->cache;
+  pthread_mutex_lock(&cache->lock);
+  enum RISKI_ERROR_CODE err =
+      chart_cache_bin(cht, cur_candle, candle_at(&tail, 0));
+  struct chart_out out = {NULL, 0, 0};
+  struct candle_bin_prev prev = cache->bin_prev;
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_out_reserve(&out, CHART_BIN_HEADER_LEN +
+                                      cache->bin_first * CHART_BIN_CANDLE_LEN +
+                                      cache->bin.len + BIN_CANDLE_MAX_LEN);
+  if (err == RISKI_ERROR_CODE_NONE) {
+    chart_bin_header(cht, &out, CHART_BIN_FRAME_CHART, cur_candle + 1,
+                     cache->bin_start);
+
+    // the candles before the cache are written again every time, ending
+    // on the candle the cache is written against
+    struct candle_bin_prev first = {0, cache->bin_start - cht->interval};
+    err = chart_bin_finalized(cht, &out, 0, cache->bin_first, &first);
+  }
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_out_reserve(&out, cache->bin.len + BIN_CANDLE_MAX_LEN);
+  // nothing is cached while the first candle is the current one
+  if (err == RISKI_ERROR_CODE_NONE && cache->bin.len > 0) {
+    memcpy(out.c + out.len, cache->bin.c, cache->bin.len);
+    out.len += cache->bin.len;
+  }
+  pthread_mutex_unlock(&cache->lock);
+
+  if (err == RISKI_ERROR_CODE_NONE)
+    err = chart_bin_candle(cht, &out, candle_at(&tail, 0), &prev);
+  if (err != RISKI_ERROR_CODE_NONE)
+    free(out.c);
+  TRACE(err);
+
+  *len = out.len;
+  *bin = chart_out_take(&out);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_analysis_json_cached(struct chart *cht,
+                                                 char **json) {
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t cur_candle = 0;
+  uint64_t last_update = 0;
+  struct candle_block tail;
+  chart_read_tail(cht, &cur_candle, &last_update, &tail);
+  size_t num_bins = cur_candle < 1 ? 0 : cur_candle - 1;
+
+  // results are attached before the version is bumped, so json built
+  // after reading the version holds at least that version
+  uint64_t version =
+      atomic_load_explicit(&cht->analysis_version, memory_order_acquire);
+
+  struct chart_cache *cache = &cht->cache;
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  pthread_mutex_lock(&cache->lock);
+  if (!cache->analysis || cache->analysis_bins != num_bins ||
+      cache->analysis_version != version) {
+    struct chart_out out = {NULL, 0, 0};
+    pthread_mutex_lock(&cht->analysis_lock);
+    err = chart_analysis_json_write(cht, num_bins, &out);
+    pthread_mutex_unlock(&cht->analysis_lock);
+
+    if (err == RISKI_ERROR_CODE_NONE) {
+      free(cache->analysis);
+      cache->analysis_len = out.len;
+      cache->analysis = chart_out_take(&out);
+      cache->analysis_bins = num_bins;
+      cache->analysis_version = version;
+    } else {
+      free(out.c);
+    }
+  }
+
+  char *copy = NULL;
+  if (err == RISKI_ERROR_CODE_NONE) {
+    copy = (char *)malloc(cache->analysis_len + 1);
+    if (copy)
+      memcpy(copy, cache->analysis, cache->analysis_len + 1);
+    else
+      err = RISKI_ERROR_CODE_MALLOC_ERROR;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  TRACE(err);
+
+  *json = copy;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+#undef CHART_BIN_CANDLE_LEN
+#undef CHART_JSON_CANDLE_LEN
+#undef CHART_JSON_ANALYSIS_MAX_LEN
+#undef CHART_JSON_INT
+#undef CHART_JSON_LITERAL
+
 enum RISKI_ERROR_CODE chart_free(struct chart **cht) {
   PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(*cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  if ((*cht)->last_update != 0) {
-    for (size_t i = 0; i < ((*cht)->cur_candle + 1); ++i) {
-      TRACE(candle_free(&((*cht)->candles[i])));
-    }
+  if ((*cht)->analysis_state)
+    TRACE(analysis_free_state(*cht));
+
+  for (size_t i = 0; i < (*cht)->num_blocks; ++i) {
+    free((*cht)->blocks[i]);
+  }
+  free((*cht)->blocks);
+
+  chart_free_evicted(*cht);
+  if ((*cht)->spill_fd != -1)
+    close((*cht)->spill_fd);
+  pthread_mutex_destroy(&(*cht)->spill_lock);
+  chart_cache_free(&(*cht)->cache);
+  free((*cht)->jobs.ends);
+  pthread_mutex_destroy(&(*cht)->jobs.lock);
+
+  for (size_t i = 0; i < (*cht)->num_runs; ++i) {
+    chart_free_run((*cht)->runs[i]);
+  }
+  free((*cht)->runs);
+
+  while ((*cht)->retired) {
+    struct chart_retired *next = (*cht)->retired->next;
+    free((*cht)->retired->dir);
+    free((*cht)->retired);
+    (*cht)->retired = next;
   }
-  free((*cht)->candles);
   // TODO free the analysis lists
 
   for (size_t i = 0; i < (*cht)->num_candles_allocated; ++i) {
@@ -458,5 +2521,3 @@ enum RISKI_ERROR_CODE chart_free(struct chart **cht) {
 
   return RISKI_ERROR_CODE_NONE;
 }
-
-#undef MAX_INT_STR_LEN
@@ -0,0 +1,262 @@
+#include <chart/chart_set.h>
+
+/*
+ * A chart for each interval of a security
+ * @param {struct chart**} charts The charts by ascending interval, the
+ * first one is the base chart
+ * @param {size_t} num_charts The number of charts
+ * @param {size_t} rolled The number of base candles already rolled up into
+ * the larger intervals
+ * @param {struct chart_store*} store The store of the charts, NULL if
+ * they are not stored
+ */
+struct chart_set {
+  struct chart **charts;
+  size_t num_charts;
+  size_t rolled;
+  struct chart_store *store;
+};
+
+enum RISKI_ERROR_CODE chart_set_new(char *name, int precision,
+                                    uint64_t *intervals, size_t num_intervals,
+                                    struct chart_set **set) {
+  PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(intervals, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(num_intervals, 0, >, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(intervals[0], 0, >, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
+
+  // every candle of a larger interval has to be made of whole base candles
+  for (size_t i = 1; i < num_intervals; ++i) {
+    if (intervals[i] <= intervals[i - 1] || intervals[i] % intervals[0] != 0) {
+      TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                         FILENAME_SHORT, __LINE__,
+                         "%s interval %lu is not a larger multiple of %lu",
+                         name, intervals[i], intervals[0]));
+      return RISKI_ERROR_CODE_INVALID_RANGE;
+    }
+  }
+
+  struct chart_set *s = (struct chart_set *)malloc(sizeof(struct chart_set));
+  PTR_CHECK(s, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  s->charts = (struct chart **)malloc(num_intervals * sizeof(struct chart *));
+  PTR_CHECK(s->charts, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < num_intervals; ++i) {
+    TRACE(chart_new(intervals[i], name, precision, &(s->charts[i])));
+  }
+  s->num_charts = num_intervals;
+  s->rolled = 0;
+  s->store = NULL;
+
+  *set = s;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Rolls the base candles from set->rolled up to but not including end
+ * into the larger intervals
+ */
+static enum RISKI_ERROR_CODE chart_set_roll(struct chart_set *set,
+                                            size_t end) {
+  for (; set->rolled < end; ++set->rolled) {
+    for (size_t i = 1; i < set->num_charts; ++i) {
+      TRACE(chart_rollup(set->charts[i], set->charts[0], set->rolled));
+    }
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_update(struct chart_set *set, int64_t price,
+                                       int64_t bid, int64_t ask, uint64_t ts) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(chart_update(set->charts[0], price, bid, ask, ts));
+
+  if (set->num_charts == 1)
+    return RISKI_ERROR_CODE_NONE;
+
+  // every base candle but the current one is finalized
+  size_t num_candles = 0;
+  TRACE(chart_get_num_candles(set->charts[0], &num_candles));
+  TRACE(chart_set_roll(set, num_candles - 1));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_quote(struct chart_set *set, int64_t bid,
+                                      int64_t ask, uint64_t ts) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(chart_quote(set->charts[0], bid, ask, ts));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_get(struct chart_set *set, uint64_t interval,
+                                    struct chart **cht) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(cht, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *cht = NULL;
+  if (interval == 0) {
+    *cht = set->charts[0];
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  for (size_t i = 0; i < set->num_charts; ++i) {
+    uint64_t cht_interval = 0;
+    TRACE(chart_get_interval(set->charts[i], &cht_interval));
+    if (cht_interval == interval) {
+      *cht = set->charts[i];
+      break;
+    }
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_set_analysis(struct chart_set *set,
+                                             bool enabled) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < set->num_charts; ++i) {
+    TRACE(chart_set_analysis(set->charts[i], enabled));
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_set_retention(struct chart_set *set,
+                                              size_t max_candles) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < set->num_charts; ++i) {
+    TRACE(chart_set_retention(set->charts[i], max_candles, NULL));
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Sets *covered to the number of finalized base candles that start before
+ * until
+ */
+static enum RISKI_ERROR_CODE chart_set_covered(struct chart_set *set,
+                                               uint64_t until,
+                                               size_t *covered) {
+  size_t num_candles = 0;
+  TRACE(chart_get_num_candles(set->charts[0], &num_candles));
+
+  size_t i = 0;
+  struct chart_span span;
+  while (i + 1 < num_candles) {
+    TRACE(chart_span(set->charts[0], i, num_candles - 2, &span));
+    size_t k = 0;
+    while (k < span.len &&
+           (span.flat ? span.start + k * span.interval
+                      : span.start_time[k]) < until)
+      ++k;
+    i += k;
+    if (k != span.len)
+      break;
+  }
+
+  *covered = i;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_open_store(struct chart_set *set,
+                                           const char *path) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(path, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(set->num_charts, CHART_STORE_MAX_CHARTS, <=,
+                   RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+
+  char *name = NULL;
+  int precision = 0;
+  TRACE(chart_get_name(set->charts[0], &name));
+  TRACE(chart_get_precision(set->charts[0], &precision));
+
+  uint64_t intervals[CHART_STORE_MAX_CHARTS];
+  for (size_t i = 0; i < set->num_charts; ++i) {
+    TRACE(chart_get_interval(set->charts[i], &intervals[i]));
+  }
+
+  struct chart_store *store = NULL;
+  TRACE(chart_store_open(path, name, precision, intervals, set->num_charts,
+                         &store));
+
+  // the set owns the store even if a chart fails to load from it, the
+  // charts before that one already point to it
+  set->store = store;
+  for (size_t i = 0; i < set->num_charts; ++i) {
+    TRACE(chart_open_store(set->charts[i], store, i));
+  }
+  TRACE(chart_store_release(store));
+
+  // every larger chart stored the base candles before the end of its last
+  // candle, the ones after that still have to be rolled up. Where a
+  // larger chart is further along chart_rollup skips them.
+  uint64_t until = UINT64_MAX;
+  for (size_t i = 1; i < set->num_charts; ++i) {
+    uint64_t stored_until = 0;
+    TRACE(chart_get_stored_until(set->charts[i], &stored_until));
+    if (stored_until < until)
+      until = stored_until;
+  }
+  if (set->num_charts > 1)
+    TRACE(chart_set_covered(set, until, &set->rolled));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_append(struct chart_set *dst,
+                                       struct chart_set *src) {
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(src, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(dst->num_charts, src->num_charts, ==,
+                   RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+
+  // the current base candles are finalized by the append so they have to
+  // be in the larger intervals before those are appended
+  size_t num_candles = 0;
+  TRACE(chart_get_num_candles(dst->charts[0], &num_candles));
+  TRACE(chart_set_roll(dst, num_candles));
+  TRACE(chart_get_num_candles(src->charts[0], &num_candles));
+  TRACE(chart_set_roll(src, num_candles));
+
+  for (size_t i = 0; i < dst->num_charts; ++i) {
+    TRACE(chart_append(dst->charts[i], src->charts[i]));
+  }
+
+  TRACE(chart_get_num_candles(dst->charts[0], &num_candles));
+  dst->rolled = num_candles;
+  src->rolled = 0;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_flush_store(struct chart_set *set) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (set->store)
+    TRACE(chart_store_flush(set->store));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_set_free(struct chart_set **set) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(*set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < (*set)->num_charts; ++i) {
+    TRACE(chart_free(&((*set)->charts[i])));
+  }
+  if ((*set)->store)
+    TRACE(chart_store_free(&(*set)->store));
+  free((*set)->charts);
+  free(*set);
+  *set = NULL;
+
+  return RISKI_ERROR_CODE_NONE;
+}
@@ -0,0 +1,351 @@
+#include <chart/chart_store.h>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * The number of records buffered before they are written
+ */
+#define CHART_STORE_BUFFER_RECORDS 64
+
+/*
+ * The longest a record is buffered for before it is written, as long as
+ * more records are put
+ */
+#define CHART_STORE_BUFFER_NANOSECONDS 1000000000ULL
+
+static const char chart_store_magic[8] = {'R', 'I', 'S', 'K',
+                                          'I', 'C', 'H', 'T'};
+
+/*
+ * A file of fixed width records after a header
+ * @param {int} fd The file, opened for appending
+ * @param {pthread_mutex_t} lock Held to buffer and write records
+ * @param {void*} map The file as it was when it was opened, NULL once
+ * released
+ * @param {size_t} map_len The length of map
+ * @param {size_t} num_records The number of records in map
+ * @param {struct chart_store_record*} buffer Records not written yet
+ * @param {size_t} num_buffered The number of records in buffer
+ * @param {uint64_t} first_buffered The monotonic time in nanoseconds the
+ * oldest record in buffer was put
+ * @param {char*} path The file name, used for errors
+ */
+struct chart_store {
+  int fd;
+
+  // 4 unused bytes in this structure
+  char _p1[4];
+
+  pthread_mutex_t lock;
+  void *map;
+  size_t map_len;
+  size_t num_records;
+  struct chart_store_record buffer[CHART_STORE_BUFFER_RECORDS];
+  size_t num_buffered;
+  uint64_t first_buffered;
+  char *path;
+};
+
+/*
+ * The monotonic time in nanoseconds
+ */
+static uint64_t chart_store_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Reads exactly len bytes at offset, false on a short read
+ */
+static bool chart_store_read_at(int fd, void *buf, size_t len, off_t offset) {
+  return pread(fd, buf, len, offset) == (ssize_t)len;
+}
+
+/*
+ * True if header is a store of this version
+ */
+static bool chart_store_header_valid(const struct chart_store_header *header) {
+  return memcmp(header->magic, chart_store_magic, sizeof(header->magic)) ==
+             0 &&
+         header->version == CHART_STORE_VERSION &&
+         header->num_charts <= CHART_STORE_MAX_CHARTS &&
+         memchr(header->name, '\0', CHART_STORE_NAME_LEN) != NULL;
+}
+
+enum RISKI_ERROR_CODE chart_store_peek(const char *path,
+                                       struct chart_store_header *header,
+                                       bool *valid) {
+  PTR_CHECK(path, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(header, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(valid, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *valid = false;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return RISKI_ERROR_CODE_NONE;
+
+  if (chart_store_read_at(fd, header, sizeof(struct chart_store_header), 0))
+    *valid = chart_store_header_valid(header);
+  close(fd);
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Writes a new header to an empty store
+ */
+static enum RISKI_ERROR_CODE
+chart_store_create(struct chart_store *s, const char *name, int precision,
+                   uint64_t *intervals, size_t num_charts) {
+  struct chart_store_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, chart_store_magic, sizeof(header.magic));
+  header.version = CHART_STORE_VERSION;
+  header.precision = precision;
+  header.num_charts = num_charts;
+  memcpy(header.intervals, intervals, num_charts * sizeof(uint64_t));
+  strncpy(header.name, name, CHART_STORE_NAME_LEN - 1);
+
+  if (write(s->fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+    TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                       __LINE__, "could not write the header of %s",
+                       s->path));
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Checks the header of an existing store against the charts it is opened
+ * for and maps its records
+ */
+static enum RISKI_ERROR_CODE chart_store_map(struct chart_store *s,
+                                             const char *name,
+                                             uint64_t *intervals,
+                                             size_t num_charts,
+                                             size_t file_len) {
+  struct chart_store_header header;
+  if (!chart_store_read_at(s->fd, &header, sizeof(header), 0) ||
+      !chart_store_header_valid(&header) ||
+      strncmp(header.name, name, CHART_STORE_NAME_LEN - 1) != 0 ||
+      header.num_charts != num_charts ||
+      memcmp(header.intervals, intervals, num_charts * sizeof(uint64_t)) !=
+          0) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s is not a store of the %s charts", s->path, name));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+
+  // a record that was cut short is dropped so new records line up again
+  size_t num_records = (file_len - sizeof(header)) /
+                       sizeof(struct chart_store_record);
+  size_t len =
+      sizeof(header) + num_records * sizeof(struct chart_store_record);
+  if (len != file_len && ftruncate(s->fd, (off_t)len) != 0) {
+    TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                       __LINE__, "could not truncate %s", s->path));
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
+
+  s->num_records = num_records;
+  if (num_records == 0)
+    return RISKI_ERROR_CODE_NONE;
+
+  void *map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, s->fd, 0);
+  if (map == MAP_FAILED) {
+    TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                       __LINE__, "could not map %s", s->path));
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
+
+  // the records are read front to back once
+  madvise(map, len, MADV_SEQUENTIAL);
+
+  s->map = map;
+  s->map_len = len;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_store_open(const char *path, const char *name,
+                                       int precision, uint64_t *intervals,
+                                       size_t num_charts,
+                                       struct chart_store **store) {
+  PTR_CHECK(path, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(intervals, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  RANGE_CHECK(num_charts, 1, CHART_STORE_MAX_CHARTS + 1,
+              RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+
+  struct chart_store *s =
+      (struct chart_store *)malloc(sizeof(struct chart_store));
+  PTR_CHECK(s, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  s->path = strdup(path);
+  if (!s->path) {
+    free(s);
+    PTR_CHECK(NULL, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  }
+  s->map = NULL;
+  s->map_len = 0;
+  s->num_records = 0;
+  s->num_buffered = 0;
+  s->first_buffered = 0;
+  s->fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+
+  struct stat st;
+  if (s->fd == -1 || fstat(s->fd, &st) != 0) {
+    TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                       __LINE__, "could not open %s", path));
+    if (s->fd != -1)
+      close(s->fd);
+    free(s->path);
+    free(s);
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  if ((size_t)st.st_size < sizeof(struct chart_store_header)) {
+    // a header that was cut short means nothing was ever stored
+    if (ftruncate(s->fd, 0) == 0)
+      err = chart_store_create(s, name, precision, intervals, num_charts);
+    else
+      err = RISKI_ERROR_CODE_UNKNOWN;
+  } else {
+    err = chart_store_map(s, name, intervals, num_charts,
+                          (size_t)st.st_size);
+  }
+
+  if (err != RISKI_ERROR_CODE_NONE) {
+    close(s->fd);
+    free(s->path);
+    free(s);
+  }
+  TRACE(err);
+
+  pthread_mutex_init(&s->lock, NULL);
+
+  *store = s;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE
+chart_store_records(struct chart_store *store,
+                    const struct chart_store_record **records,
+                    size_t *num_records) {
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(records, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(num_records, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (!store->map) {
+    *records = NULL;
+    *num_records = 0;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  *records = (const struct chart_store_record
+                  *)((const char *)store->map +
+                     sizeof(struct chart_store_header));
+  *num_records = store->num_records;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_store_release(struct chart_store *store) {
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (store->map) {
+    munmap(store->map, store->map_len);
+    store->map = NULL;
+    store->map_len = 0;
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Writes the buffer out, lock must be held
+ */
+static enum RISKI_ERROR_CODE chart_store_write(struct chart_store *s) {
+  size_t len = s->num_buffered * sizeof(struct chart_store_record);
+  const char *buf = (const char *)s->buffer;
+
+  while (len != 0) {
+    ssize_t n = write(s->fd, buf, len);
+    if (n <= 0) {
+      TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                         __LINE__, "could not write to %s", s->path));
+      return RISKI_ERROR_CODE_UNKNOWN;
+    }
+    buf += n;
+    len -= (size_t)n;
+  }
+
+  s->num_buffered = 0;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE
+chart_store_put(struct chart_store *store,
+                const struct chart_store_record *record) {
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(record, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  // the buffer is written once it is full or its oldest record has waited
+  // long enough, one write covers many candles and their analysis
+  pthread_mutex_lock(&store->lock);
+  if (store->num_buffered == CHART_STORE_BUFFER_RECORDS)
+    err = chart_store_write(store);
+  if (err == RISKI_ERROR_CODE_NONE) {
+    uint64_t now = chart_store_now();
+    if (store->num_buffered == 0)
+      store->first_buffered = now;
+    store->buffer[store->num_buffered] = *record;
+    store->num_buffered += 1;
+    if (now - store->first_buffered >= CHART_STORE_BUFFER_NANOSECONDS)
+      err = chart_store_write(store);
+  }
+  pthread_mutex_unlock(&store->lock);
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_store_flush(struct chart_store *store) {
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  pthread_mutex_lock(&store->lock);
+  enum RISKI_ERROR_CODE err = chart_store_write(store);
+  pthread_mutex_unlock(&store->lock);
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE chart_store_free(struct chart_store **store) {
+  PTR_CHECK(store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(*store, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  enum RISKI_ERROR_CODE err = chart_store_flush(*store);
+
+  TRACE(chart_store_release(*store));
+  close((*store)->fd);
+  pthread_mutex_destroy(&(*store)->lock);
+  free((*store)->path);
+  free(*store);
+  *store = NULL;
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+#undef CHART_STORE_BUFFER_NANOSECONDS
+#undef CHART_STORE_BUFFER_RECORDS
@@ -1,30 +1,271 @@
 #include <exchange/exchange.h>
 
+#include <dirent.h>
+
+char *EXCHANGE_STORE_DIR = NULL;
+
+/*
+ * The number of slots in a group, the control bytes of a group are packed
+ * into one atomic 64 bit word
+ */
+#define EXCHANGE_GROUP_WIDTH 8
+
 /*
- * The number of securities that have been added to the exchange
+ * The number of slots a table starts with, must be a power of two and a
+ * multiple of EXCHANGE_GROUP_WIDTH
  */
-static size_t num_securities = 0;
+#define EXCHANGE_INITIAL_CAPACITY 1024
+
+/*
+ * Control byte of a slot that has never been used, a used slot holds the
+ * top 7 bits of its hash so the high bit is always clear
+ */
+#define EXCHANGE_CTRL_EMPTY 0x80
+
+#define EXCHANGE_LSB 0x0101010101010101ULL
+#define EXCHANGE_MSB 0x8080808080808080ULL
 
 /*
- * Linked list for the hash bins
- * @param {struct security*} val The value of the bin
- * @param {struct ll*} next The next element in the list
+ * A slot in a table. key never changes once the slot is published, val
+ * can be replaced by exchange_put_by_key so it is atomic.
+ * @param {uint64_t} key The name hash or the fixed width key
+ * @param {struct security*} val The security
  */
-struct ll {
-  struct security *val;
-  struct ll *next;
+struct exchange_slot {
+  uint64_t key;
+  _Atomic(struct security *) val;
+};
+
+/*
+ * An insert only open addressed table in the style of a swiss table.
+ * Slots are probed a group at a time, the control bytes of a group are
+ * compared against the 7 bit tag of the hash in one go so most misses
+ * never touch the slots. A slot is published by storing its control word
+ * with release order after the slot was written, so readers never need
+ * a lock.
+ * @param {_Atomic uint64_t*} ctrl One control word per group of slots
+ * @param {struct exchange_slot*} slots The slots
+ * @param {size_t} capacity The number of slots, a power of two
+ * @param {size_t} size The number of used slots, only used by the writer
+ * @param {struct exchange_table*} retired The table this one replaced when
+ * it grew, kept until the exchange is freed
+ */
+struct exchange_table {
+  _Atomic uint64_t *ctrl;
+  struct exchange_slot *slots;
+  size_t capacity;
+  size_t size;
+  struct exchange_table *retired;
 };
 
 /*
  * Holds the exchange information
+ *
+ * Lookups never lock and never write shared memory, they load the table
+ * pointer and probe. Puts are serialized by write_lock, insert into the
+ * live tables in place and only replace a table when it has to grow. The
+ * grown table is published with a single pointer store. A reader may still
+ * be probing the old one, so it is kept on the retired list of the new
+ * table until the exchange is freed. Tables only double, so the retired
+ * tables together are smaller than the live one.
+ *
  * @param {char*} name The name of the exchange
- * @param {struct ll} A fixed number of bins for the hashmap
+ * @param {size_t} num_securities The number of securities added
+ * @param {_Atomic(struct exchange_table*)} by_name Owns the securities,
+ * keyed by the hash of their name
+ * @param {_Atomic(struct exchange_table*)} by_key Aliases from fixed width
+ * keys
+ * @param {pthread_mutex_t} write_lock Serializes writers
+ * @param {const char*} store The directory new securities keep their
+ * charts in, NULL if they are not stored
+ * @param {bool} analysis False if new securities should not be analyized
  */
 struct exchange {
   char *name;
-  struct ll entries[SECURITY_HASH_MODULE_VAL];
+  size_t num_securities;
+  _Atomic(struct exchange_table *) by_name;
+  _Atomic(struct exchange_table *) by_key;
+  pthread_mutex_t write_lock;
+  const char *store;
+  bool analysis;
+
+  // 7 unused bytes in this structure
+  char _p1[7];
 };
 
+/*
+ * splitmix64 finalizer, spreads the key over the whole word so both the
+ * low bits (group) and high bits (tag) are usable
+ */
+static inline uint64_t exchange_mix(uint64_t key) {
+  key ^= key >> 30;
+  key *= 0xbf58476d1ce4e5b9ULL;
+  key ^= key >> 27;
+  key *= 0x94d049bb133111ebULL;
+  key ^= key >> 31;
+  return key;
+}
+
+/*
+ * Returns a word with the high bit set in every byte of group equal to tag.
+ * May report a false positive next to a real match, callers compare the
+ * key of every match anyway.
+ */
+static inline uint64_t group_match(uint64_t group, uint8_t tag) {
+  uint64_t x = group ^ (EXCHANGE_LSB * tag);
+  return (x - EXCHANGE_LSB) & ~x & EXCHANGE_MSB;
+}
+
+/*
+ * The slot in the group of the lowest set high bit
+ */
+static inline size_t group_first(uint64_t match) {
+  return (size_t)__builtin_ctzll(match) >> 3;
+}
+
+static enum RISKI_ERROR_CODE table_new(size_t capacity,
+                                       struct exchange_table **table) {
+  struct exchange_table *t =
+      (struct exchange_table *)malloc(sizeof(struct exchange_table));
+  PTR_CHECK(t, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  size_t num_groups = capacity / EXCHANGE_GROUP_WIDTH;
+  t->ctrl = (_Atomic uint64_t *)malloc(num_groups * sizeof(_Atomic uint64_t));
+  PTR_CHECK(t->ctrl, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  for (size_t g = 0; g < num_groups; ++g) {
+    atomic_init(&t->ctrl[g], EXCHANGE_MSB);
+  }
+
+  t->slots = (struct exchange_slot *)malloc(capacity *
+                                            sizeof(struct exchange_slot));
+  PTR_CHECK(t->slots, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  t->capacity = capacity;
+  t->size = 0;
+  t->retired = NULL;
+
+  *table = t;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Frees a table and the tables it replaced
+ */
+static void table_free(struct exchange_table *t) {
+  while (t) {
+    struct exchange_table *retired = t->retired;
+    free(t->ctrl);
+    free(t->slots);
+    free(t);
+    t = retired;
+  }
+}
+
+/*
+ * Finds the slot of key, if name is given the security of the slot must
+ * also have that name. Returns NULL if there is no such slot. Only reads
+ * the table so it is safe alongside the writer.
+ */
+static struct exchange_slot *table_find(struct exchange_table *t,
+                                        uint64_t key, char *name) {
+  uint64_t h = exchange_mix(key);
+  uint8_t tag = (uint8_t)(h >> 57);
+  size_t group_mask = t->capacity / EXCHANGE_GROUP_WIDTH - 1;
+  size_t g = (size_t)h & group_mask;
+
+  // triangular probing visits every group once for power of two sizes
+  for (size_t step = 1;; ++step) {
+    uint64_t group = atomic_load_explicit(&t->ctrl[g], memory_order_acquire);
+
+    for (uint64_t m = group_match(group, tag); m; m &= m - 1) {
+      struct exchange_slot *slot =
+          &t->slots[g * EXCHANGE_GROUP_WIDTH + group_first(m)];
+      if (slot->key != key)
+        continue;
+
+      bool isequal = true;
+      if (name && security_cmp(name, atomic_load_explicit(
+                                         &slot->val, memory_order_acquire),
+                               &isequal) != RISKI_ERROR_CODE_NONE)
+        isequal = false;
+      if (isequal)
+        return slot;
+    }
+
+    // an empty slot in the group means key was never inserted
+    if (group & EXCHANGE_MSB)
+      return NULL;
+
+    if (step > group_mask)
+      return NULL;
+    g = (g + step) & group_mask;
+  }
+}
+
+/*
+ * Puts key into the first empty slot of its probe sequence and publishes
+ * it, the table must have room. Only called by the writer.
+ */
+static void table_insert_unchecked(struct exchange_table *t, uint64_t key,
+                                   struct security *val) {
+  uint64_t h = exchange_mix(key);
+  size_t group_mask = t->capacity / EXCHANGE_GROUP_WIDTH - 1;
+  size_t g = (size_t)h & group_mask;
+
+  for (size_t step = 1;; ++step) {
+    uint64_t group = atomic_load_explicit(&t->ctrl[g], memory_order_relaxed);
+    uint64_t empty = group & EXCHANGE_MSB;
+    if (empty) {
+      size_t at = group_first(empty);
+      struct exchange_slot *slot = &t->slots[g * EXCHANGE_GROUP_WIDTH + at];
+      slot->key = key;
+      atomic_store_explicit(&slot->val, val, memory_order_relaxed);
+
+      group &= ~(0xffULL << (at * 8));
+      group |= (uint64_t)(h >> 57) << (at * 8);
+      atomic_store_explicit(&t->ctrl[g], group, memory_order_release);
+
+      t->size += 1;
+      return;
+    }
+    g = (g + step) & group_mask;
+  }
+}
+
+/*
+ * Inserts key into *table, doubling the table into a new one when it
+ * would be more than 7/8 full. Only called by the writer.
+ */
+static enum RISKI_ERROR_CODE table_insert(_Atomic(struct exchange_table *) *
+                                              table,
+                                          uint64_t key, struct security *val) {
+  struct exchange_table *t = atomic_load(table);
+
+  if ((t->size + 1) * 8 > t->capacity * 7) {
+    struct exchange_table *grown = NULL;
+    TRACE(table_new(t->capacity * 2, &grown));
+
+    for (size_t i = 0; i < t->capacity; ++i) {
+      uint64_t group = atomic_load_explicit(
+          &t->ctrl[i / EXCHANGE_GROUP_WIDTH], memory_order_relaxed);
+      if (group & (0x80ULL << ((i % EXCHANGE_GROUP_WIDTH) * 8)))
+        continue;
+      table_insert_unchecked(
+          grown, t->slots[i].key,
+          atomic_load_explicit(&t->slots[i].val, memory_order_relaxed));
+    }
+    table_insert_unchecked(grown, key, val);
+
+    // readers may still be probing t
+    grown->retired = t;
+    atomic_store_explicit(table, grown, memory_order_release);
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  table_insert_unchecked(t, key, val);
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE exchange_new(char *name, struct exchange **exchange) {
   PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(exchange, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -36,6 +277,15 @@ enum RISKI_ERROR_CODE exchange_new(char *name, struct exchange **exchange) {
   struct exchange *e = (struct exchange *)calloc(1, sizeof(struct exchange));
   PTR_CHECK(e, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
   e->name = n;
+  e->analysis = true;
+
+  struct exchange_table *t = NULL;
+  TRACE(table_new(EXCHANGE_INITIAL_CAPACITY, &t));
+  atomic_init(&e->by_name, t);
+  TRACE(table_new(EXCHANGE_INITIAL_CAPACITY, &t));
+  atomic_init(&e->by_key, t);
+
+  pthread_mutex_init(&e->write_lock, NULL);
 
   *exchange = e;
   return RISKI_ERROR_CODE_NONE;
@@ -43,32 +293,37 @@ enum RISKI_ERROR_CODE exchange_new(char *name, struct exchange **exchange) {
 
 enum RISKI_ERROR_CODE exchange_put(struct exchange *e, char *name,
                                    uint64_t interval, int precision) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
   struct security *s = NULL;
   TRACE(security_new(name, interval, precision, &s));
+  if (!e->analysis)
+    TRACE(security_set_analysis(s, false));
+  if (e->store) {
+    enum RISKI_ERROR_CODE err = security_open_store(s, e->store);
+    if (err != RISKI_ERROR_CODE_NONE)
+      TRACE(security_free(&s));
+    TRACE(err);
+  }
 
-  size_t index = 0;
-  TRACE(security_get_hash(s, &index));
-
-  struct ll *val = &e->entries[index];
-  if (val->val == NULL) {
-    val->val = s;
-  } else {
-    while (val->next != NULL) {
-      val = val->next;
-    }
+  size_t hash = 0;
+  TRACE(security_get_hash(s, &hash));
 
-    struct ll *next_entry = (struct ll *)malloc(1 * sizeof(struct ll));
-    PTR_CHECK(next_entry, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
-    next_entry->next = NULL;
-    next_entry->val = s;
+  pthread_mutex_lock(&e->write_lock);
+  enum RISKI_ERROR_CODE err = table_insert(&e->by_name, hash, s);
+  if (err == RISKI_ERROR_CODE_NONE)
+    e->num_securities += 1;
+  size_t num_securities = e->num_securities;
+  pthread_mutex_unlock(&e->write_lock);
 
-    val->next = next_entry;
-  }
+  if (err != RISKI_ERROR_CODE_NONE)
+    TRACE(security_free(&s));
+  TRACE(err);
 
-  num_securities += 1;
   if (num_securities % 200 == 0)
     TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
-                      "~%lu securities monitored", num_securities));
+                      "~%lu securities monitored on %s", num_securities,
+                      e->name));
 
   return RISKI_ERROR_CODE_NONE;
 }
@@ -81,24 +336,154 @@ enum RISKI_ERROR_CODE exchange_get(struct exchange *e, char *name,
   size_t hash = 0;
   TRACE(security_hash(name, &hash));
 
-  struct ll *bin_list = &e->entries[hash];
+  struct exchange_slot *slot = table_find(
+      atomic_load_explicit(&e->by_name, memory_order_acquire), hash, name);
+  *sec = slot ? atomic_load_explicit(&slot->val, memory_order_acquire) : NULL;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_get_by_key(struct exchange *e, uint64_t key,
+                                          struct security **sec) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct exchange_slot *slot = table_find(
+      atomic_load_explicit(&e->by_key, memory_order_acquire), key, NULL);
+  *sec = slot ? atomic_load_explicit(&slot->val, memory_order_acquire) : NULL;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_put_by_key(struct exchange *e, uint64_t key,
+                                          struct security *sec) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  // tables are only freed by exchange_free, a grown table keeps the one it
+  // replaced on its retired list, so the table read here stays valid
+  pthread_mutex_lock(&e->write_lock);
+  struct exchange_slot *slot = table_find(atomic_load(&e->by_key), key, NULL);
+  if (slot)
+    atomic_store_explicit(&slot->val, sec, memory_order_release);
+  else
+    err = table_insert(&e->by_key, key, sec);
+  pthread_mutex_unlock(&e->write_lock);
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE set_analysis(struct security *sec, void *usr) {
+  TRACE(security_set_analysis(sec, *(bool *)usr));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_set_analysis(struct exchange *e,
+                                            bool enabled) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  e->analysis = enabled;
+  TRACE(exchange_foreach(e, set_analysis, &enabled));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_open_store(struct exchange *e,
+                                          const char *dir) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(dir, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  DIR *d = opendir(dir);
+  if (!d) {
+    TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
+                       __LINE__, "can not open store directory %s", dir));
+    return RISKI_ERROR_CODE_UNKNOWN;
+  }
 
-  while (bin_list != NULL) {
-    if (bin_list->val == NULL) {
-      *sec = NULL;
-      return RISKI_ERROR_CODE_NONE;
+  e->store = dir;
+
+  size_t suffix_len = strlen(SECURITY_STORE_SUFFIX);
+  size_t num_loaded = 0;
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  struct dirent *entry = NULL;
+  while (err == RISKI_ERROR_CODE_NONE && (entry = readdir(d)) != NULL) {
+    size_t len = strlen(entry->d_name);
+    if (len <= suffix_len ||
+        strcmp(entry->d_name + len - suffix_len, SECURITY_STORE_SUFFIX) != 0)
+      continue;
+
+    size_t n = strlen(dir) + len + 2;
+    char *path = (char *)malloc(n * sizeof(char));
+    if (!path) {
+      err = RISKI_ERROR_CODE_MALLOC_ERROR;
+      break;
     }
-    bool isequal = false;
-    TRACE(security_cmp(name, bin_list->val, &isequal));
+    snprintf(path, n, "%s/%s", dir, entry->d_name);
+
+    struct chart_store_header header;
+    bool valid = false;
+    err = chart_store_peek(path, &header, &valid);
+    free(path);
+    if (err != RISKI_ERROR_CODE_NONE || !valid || header.num_charts == 0)
+      continue;
 
-    if (isequal) {
-      *sec = bin_list->val;
-      return RISKI_ERROR_CODE_NONE;
+    // exchange_put opens the store again and loads the charts
+    struct security *sec = NULL;
+    err = exchange_get(e, header.name, &sec);
+    if (err == RISKI_ERROR_CODE_NONE && sec == NULL) {
+      err = exchange_put(e, header.name, header.intervals[0],
+                         header.precision);
+      num_loaded += 1;
     }
-    bin_list = bin_list->next;
   }
+  closedir(d);
+  TRACE(err);
 
-  *sec = NULL;
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
+                    "%lu securities loaded from %s on %s", num_loaded, dir,
+                    e->name));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE flush_store(struct security *sec, void *usr) {
+  (void)usr;
+  TRACE(security_flush_store(sec));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_flush_store(struct exchange *e) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (e->store)
+    TRACE(exchange_foreach(e, flush_store, NULL));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE exchange_foreach(struct exchange *e,
+                                       exchange_foreach_fn fn, void *usr) {
+  PTR_CHECK(e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(fn, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+
+  struct exchange_table *t =
+      atomic_load_explicit(&e->by_name, memory_order_acquire);
+  for (size_t g = 0; g < t->capacity / EXCHANGE_GROUP_WIDTH; ++g) {
+    uint64_t group = atomic_load_explicit(&t->ctrl[g], memory_order_acquire);
+    for (uint64_t m = ~group & EXCHANGE_MSB; m; m &= m - 1) {
+      struct exchange_slot *slot =
+          &t->slots[g * EXCHANGE_GROUP_WIDTH + group_first(m)];
+      err = fn(atomic_load_explicit(&slot->val, memory_order_acquire), usr);
+      if (err != RISKI_ERROR_CODE_NONE)
+        goto done;
+    }
+  }
+done:
+
+  TRACE(err);
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -107,21 +492,20 @@ enum RISKI_ERROR_CODE exchange_free(struct exchange **e) {
   PTR_CHECK(*e, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   free((*e)->name);
-  for (size_t i = 0; i < SECURITY_HASH_MODULE_VAL; ++i) {
-    // free the ll entries
-    if ((*e)->entries[i].val != NULL) {
-      TRACE(security_free(&((*e)->entries[i].val)));
-      if ((*e)->entries[i].next != NULL) {
-        struct ll *cur = (*e)->entries[i].next;
-        while (cur != NULL) {
-          struct ll *tmp = cur;
-          cur = cur->next;
-          TRACE(security_free(&tmp->val));
-          free(tmp);
-        }
-      }
-    }
+
+  // the key table only aliases securities, by_name owns them
+  struct exchange_table *t = atomic_load(&(*e)->by_name);
+  for (size_t i = 0; i < t->capacity; ++i) {
+    uint64_t group = atomic_load(&t->ctrl[i / EXCHANGE_GROUP_WIDTH]);
+    if (group & (0x80ULL << ((i % EXCHANGE_GROUP_WIDTH) * 8)))
+      continue;
+    struct security *s = atomic_load(&t->slots[i].val);
+    TRACE(security_free(&s));
   }
+  table_free(t);
+  table_free(atomic_load(&(*e)->by_key));
+  pthread_mutex_destroy(&(*e)->write_lock);
+
   free(*e);
   *e = NULL;
   return RISKI_ERROR_CODE_NONE;
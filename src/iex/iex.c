@@ -3,10 +3,50 @@
 struct exchange *iex_exchange = NULL;
 
 int IEX_SIGNAL_INTER = 0;
-static pcap_t *desc;
+bool IEX_USE_LIBPCAP = false;
+long IEX_BATCH_JOBS = 0;
+long IEX_PARSE_WORKERS = 0;
+
+/*
+ * Set by iex_stop_parse, every running replay checks this once per packet
+ */
+static atomic_bool stop_requested = false;
+
+/*
+ * The IEX multicast groups in network byte order, filled in once by
+ * iex_parse_deep so the per packet filter is three integer compares
+ */
+static uint32_t iex_groups[3];
+
+/*
+ * The state of a single file being replayed. Every parse function works
+ * on the exchange of the replay so several files can be parsed at once.
+ * @param {struct exchange*} exchange The exchange securities are put into
+ * @param {pcap_t*} desc The libpcap handle when IEX_USE_LIBPCAP is set
+ * @param {struct pcap_mmap*} pm The memory mapped reader otherwise
+ * @param {struct iex_pipeline*} pipeline The workers book and chart updates
+ * are routed to, NULL to apply them on the reading thread
+ * @param {size_t} messages The number of iex messages parsed
+ * @param {size_t} bytes The number of bytes read from the file
+ * @param {enum RISKI_ERROR_CODE} status The result of the replay
+ * @param {bool} done True once the replay has finished
+ */
+struct iex_replay {
+  struct exchange *exchange;
+  pcap_t *desc;
+  struct pcap_mmap *pm;
+  struct iex_pipeline *pipeline;
+  size_t messages;
+  size_t bytes;
+  enum RISKI_ERROR_CODE status;
+  bool done;
+
+  // 3 unused bytes in this structure
+  char _p1[3];
+};
 
 enum RISKI_ERROR_CODE iex_stop_parse() {
-  pcap_breakloop(desc);
+  atomic_store(&stop_requested, true);
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -43,7 +83,15 @@ void packet_handler(unsigned char *userData, const struct pcap_pkthdr *pkthdr,
 /**
  * Processes the data inside the udp packet
  */
-static enum RISKI_ERROR_CODE iex_tp_handler(const unsigned char *data);
+static enum RISKI_ERROR_CODE iex_tp_handler(struct iex_replay *r,
+                                            const unsigned char *data,
+                                            size_t len);
+
+/**
+ * Applies a book or chart update on a pipeline worker
+ */
+static enum RISKI_ERROR_CODE
+iex_pipeline_apply(const struct iex_pipeline_message *msg);
 
 /**
  * Prints the packet header for debug information
@@ -79,60 +127,413 @@ print_iex_tp_header(const struct iex_tp_header *header) {
   return RISKI_ERROR_CODE_NONE;
 }
 
-static bool is_iex_traffic(char *ip_src, char *ip_dst) {
-  return strcmp(ip_src, IEX_PRIMARY) == 0 ||
-         strcmp(ip_src, IEX_SECONDARY) == 0 ||
-         strcmp(ip_src, IEX_TERTIARY) == 0 ||
-         strcmp(ip_dst, IEX_PRIMARY) == 0 ||
-         strcmp(ip_dst, IEX_SECONDARY) == 0 ||
-         strcmp(ip_dst, IEX_TERTIARY) == 0;
+static bool is_iex_traffic(uint32_t ip_src, uint32_t ip_dst) {
+  return ip_src == iex_groups[0] || ip_src == iex_groups[1] ||
+         ip_src == iex_groups[2] || ip_dst == iex_groups[0] ||
+         ip_dst == iex_groups[1] || ip_dst == iex_groups[2];
 }
 
-/**
- * Entry point to parsing an iex historical deep pcap file
+/*
+ * Handles a udp datagram straight out of the memory mapped capture
  */
-enum RISKI_ERROR_CODE iex_parse_deep(char *file) {
-  PTR_CHECK(file, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+static enum RISKI_ERROR_CODE
+mmap_datagram_handler(const struct pcap_mmap_datagram *dg, void *usr) {
+  struct iex_replay *r = (struct iex_replay *)usr;
 
-  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__, "parsing pcap file: %s",
-                    file));
+  if (atomic_load_explicit(&stop_requested, memory_order_relaxed)) {
+    TRACE(pcap_mmap_stop(r->pm));
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  if (!is_iex_traffic(dg->ip_src, dg->ip_dst) ||
+      dg->len < sizeof(struct iex_tp_header))
+    return RISKI_ERROR_CODE_NONE;
+
+  TRACE(iex_tp_handler(r, dg->payload, dg->len));
+  return RISKI_ERROR_CODE_NONE;
+}
 
+/*
+ * Replays the file through libpcap, one callback per packet
+ */
+static enum RISKI_ERROR_CODE iex_replay_libpcap(struct iex_replay *r,
+                                                char *file) {
   // create a file descriptor for the pcap file
   char errbuff[PCAP_ERRBUF_SIZE];
-  desc = pcap_open_offline(file, errbuff);
+  r->desc = pcap_open_offline(file, errbuff);
 
   // exit with error if troubles happened during
   // opening
-  if (!desc) {
+  if (!r->desc) {
     TRACE(logger_error(RISKI_ERROR_CODE_UNKNOWN, __func__, FILENAME_SHORT,
                        __LINE__, "%s", errbuff));
     exit(1);
   }
 
+  if (pcap_loop(r->desc, 0, packet_handler, (unsigned char *)r) < 0) {
+    if (IEX_SIGNAL_INTER != 1) {
+      TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__, "%s",
+                        pcap_geterr(r->desc)));
+      exit(1);
+    }
+  }
+
+  pcap_close(r->desc);
+  r->desc = NULL;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Replays the file by walking a read only mapping of it in place
+ */
+static enum RISKI_ERROR_CODE iex_replay_mmap(struct iex_replay *r,
+                                             char *file) {
+  TRACE(pcap_mmap_open(file, &r->pm));
+
+  // a broken packet stops the walk, the mapping still has to go
+  enum RISKI_ERROR_CODE err =
+      pcap_mmap_for_each_udp(r->pm, mmap_datagram_handler, r);
+  if (err != RISKI_ERROR_CODE_NONE) {
+    TRACE(pcap_mmap_close(&r->pm));
+    return err;
+  }
+
+  size_t packets = 0;
+  TRACE(pcap_mmap_stats(r->pm, &r->bytes, &packets));
+  TRACE(pcap_mmap_close(&r->pm));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Replays a single file into r->exchange with the configured reader
+ */
+static enum RISKI_ERROR_CODE iex_replay_file(struct iex_replay *r,
+                                             char *file) {
+  PTR_CHECK(r, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(file, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (IEX_USE_LIBPCAP) {
+    TRACE(iex_replay_libpcap(r, file));
+  } else {
+    TRACE(iex_replay_mmap(r, file));
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Logs the parse throughput since begin
+ */
+static enum RISKI_ERROR_CODE iex_log_throughput(const char *what,
+                                                size_t messages, size_t bytes,
+                                                const struct timespec *begin) {
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double elapsed = (double)(end.tv_sec - begin->tv_sec) +
+                   (double)(end.tv_nsec - begin->tv_nsec) / 1e9;
+  if (elapsed <= 0)
+    elapsed = 1e-9;
+
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
+                    "[%s][%s] %lu messages %.3f GB in %.2fs => %.0f msg/s "
+                    "%.3f GB/s",
+                    IEX_USE_LIBPCAP ? "libpcap" : "mmap", what, messages,
+                    (double)bytes / 1e9, elapsed, (double)messages / elapsed,
+                    (double)bytes / 1e9 / elapsed));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static void iex_groups_init() {
+  inet_pton(AF_INET, IEX_PRIMARY, &iex_groups[0]);
+  inet_pton(AF_INET, IEX_SECONDARY, &iex_groups[1]);
+  inet_pton(AF_INET, IEX_TERTIARY, &iex_groups[2]);
+}
+
+/**
+ * Entry point to parsing an iex historical deep pcap file
+ */
+enum RISKI_ERROR_CODE iex_parse_deep(char *file) {
+  PTR_CHECK(file, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__, "parsing pcap file: %s",
+                    file));
+
+  iex_groups_init();
+  atomic_store(&stop_requested, false);
+
   TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
                     "creating exchange with name IEX"));
   TRACE(exchange_new("IEX", &iex_exchange));
+  if (EXCHANGE_STORE_DIR)
+    TRACE(exchange_open_store(iex_exchange, EXCHANGE_STORE_DIR));
+
+  struct iex_replay r = {0};
+  r.exchange = iex_exchange;
+
+  // this thread becomes the decoder and owns the exchange, the workers
+  // each own the securities that hash to them
+  if (IEX_PARSE_WORKERS > 0)
+    TRACE(iex_pipeline_new((size_t)IEX_PARSE_WORKERS, iex_pipeline_apply,
+                           &r.pipeline));
+
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+
+  enum RISKI_ERROR_CODE err = iex_replay_file(&r, file);
+  if (r.pipeline) {
+    enum RISKI_ERROR_CODE pipeline_err = iex_pipeline_free(&r.pipeline);
+    if (err == RISKI_ERROR_CODE_NONE)
+      err = pipeline_err;
+  }
+  TRACE(err);
+  TRACE(iex_log_throughput(file, r.messages, r.bytes, &begin));
 
-  if (pcap_loop(desc, 0, packet_handler, NULL) < 0) {
-    if (IEX_SIGNAL_INTER != 1) {
-      TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__, "%s",
-                        pcap_geterr(desc)));
-      exit(1);
+  // TODO do some sort of finalization to the data here?
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Shared state of a batch replay. Workers take files in order and replay
+ * each into its own exchange, the caller merges finished days in order.
+ * @param {char**} files The sorted list of files, one per day
+ * @param {size_t} num_files The number of files
+ * @param {struct iex_replay*} days The replay of each file
+ * @param {size_t} next_file The next file a worker will take
+ * @param {size_t} next_merge The next day that will be merged
+ * @param {size_t} window How far workers may run ahead of the merge
+ * @param {pthread_mutex_t} lock Guards the indexes and done flags
+ * @param {pthread_cond_t} changed Signaled when a day finishes or merges
+ */
+struct iex_batch {
+  char **files;
+  size_t num_files;
+  struct iex_replay *days;
+  size_t next_file;
+  size_t next_merge;
+  size_t window;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+};
+
+static void *iex_batch_worker(void *usr) {
+  struct iex_batch *b = (struct iex_batch *)usr;
+
+  pthread_mutex_lock(&b->lock);
+  while (true) {
+    // do not run too far ahead of the merge so memory stays bounded
+    while (!atomic_load(&stop_requested) && b->next_file < b->num_files &&
+           b->next_file >= b->next_merge + b->window)
+      pthread_cond_wait(&b->changed, &b->lock);
+
+    if (atomic_load(&stop_requested) || b->next_file >= b->num_files)
+      break;
+
+    size_t i = b->next_file++;
+    pthread_mutex_unlock(&b->lock);
+
+    struct iex_replay *r = &b->days[i];
+    struct timespec begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    r->status = exchange_new("IEX", &r->exchange);
+    if (r->status == RISKI_ERROR_CODE_NONE)
+      r->status = exchange_set_analysis(r->exchange, false);
+    if (r->status == RISKI_ERROR_CODE_NONE)
+      r->status = iex_replay_file(r, b->files[i]);
+    if (r->status == RISKI_ERROR_CODE_NONE)
+      r->status =
+          iex_log_throughput(b->files[i], r->messages, r->bytes, &begin);
+
+    pthread_mutex_lock(&b->lock);
+    r->done = true;
+    pthread_cond_broadcast(&b->changed);
+  }
+  pthread_cond_broadcast(&b->changed);
+  pthread_mutex_unlock(&b->lock);
+  return NULL;
+}
+
+/*
+ * Appends the chart of a single day security onto its history in
+ * iex_exchange
+ */
+static enum RISKI_ERROR_CODE iex_batch_merge_security(struct security *sec,
+                                                      void *usr) {
+  struct exchange *history = (struct exchange *)usr;
+
+  char *name = NULL;
+  TRACE(security_get_name(sec, &name));
+
+  struct security *dst = NULL;
+  TRACE(exchange_get(history, name, &dst));
+  if (dst == NULL) {
+    TRACE(exchange_put(history, name, SECURITY_INTERVAL_MINUTE_NANOSECONDS, 4));
+    TRACE(exchange_get(history, name, &dst));
+  }
+
+  TRACE(security_merge(dst, sec));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static int iex_batch_file_cmp(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+ * Expands a directory or glob into a sorted list of capture files
+ */
+static enum RISKI_ERROR_CODE iex_batch_glob(char *location, glob_t *g) {
+  struct stat st;
+  int err = 0;
+  if (stat(location, &st) == 0 && S_ISDIR(st.st_mode)) {
+    size_t n = strlen(location) + 16;
+    char *pattern = (char *)malloc(n * sizeof(char));
+    PTR_CHECK(pattern, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+    snprintf(pattern, n, "%s/*.pcap", location);
+    err = glob(pattern, 0, NULL, g);
+    snprintf(pattern, n, "%s/*.pcapng", location);
+    int err_ng = glob(pattern, err == 0 ? GLOB_APPEND : 0, NULL, g);
+    if (err == GLOB_NOMATCH)
+      err = err_ng;
+    free(pattern);
+  } else {
+    err = glob(location, 0, NULL, g);
+  }
+
+  if (err != 0 || g->gl_pathc == 0) {
+    if (err != GLOB_NOMATCH)
+      globfree(g);
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__, FILENAME_SHORT,
+                       __LINE__, "no pcap files found in %s", location));
+    return RISKI_ERROR_CODE_INVALID_FILE;
+  }
+
+  // days are merged in name order, IEX names files by date
+  qsort(g->gl_pathv, g->gl_pathc, sizeof(char *), iex_batch_file_cmp);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE iex_parse_deep_batch(char *location) {
+  PTR_CHECK(location, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  glob_t g;
+  TRACE(iex_batch_glob(location, &g));
+
+  long jobs = IEX_BATCH_JOBS;
+  if (jobs <= 0)
+    jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  if (jobs <= 0)
+    jobs = 1;
+  if ((size_t)jobs > g.gl_pathc)
+    jobs = (long)g.gl_pathc;
+
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
+                    "replaying %lu pcap files from %s on %ld threads",
+                    g.gl_pathc, location, jobs));
+
+  iex_groups_init();
+  atomic_store(&stop_requested, false);
+
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
+                    "creating exchange with name IEX"));
+  TRACE(exchange_new("IEX", &iex_exchange));
+
+  struct iex_batch b;
+  b.files = g.gl_pathv;
+  b.num_files = g.gl_pathc;
+  b.next_file = 0;
+  b.next_merge = 0;
+  b.window = 2 * (size_t)jobs;
+  b.days = (struct iex_replay *)calloc(b.num_files, sizeof(struct iex_replay));
+  PTR_CHECK(b.days, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  pthread_mutex_init(&b.lock, NULL);
+  pthread_cond_init(&b.changed, NULL);
+
+  pthread_t *workers = (pthread_t *)calloc((size_t)jobs, sizeof(pthread_t));
+  PTR_CHECK(workers, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  for (long i = 0; i < jobs; ++i) {
+    pthread_create(&workers[i], NULL, iex_batch_worker, &b);
+  }
+
+  struct timespec begin;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+
+  size_t messages = 0;
+  size_t bytes = 0;
+  enum RISKI_ERROR_CODE status = RISKI_ERROR_CODE_NONE;
+
+  // merge the days in date order as soon as each one is finished
+  for (size_t i = 0; i < b.num_files; ++i) {
+    struct iex_replay *r = &b.days[i];
+
+    pthread_mutex_lock(&b.lock);
+    while (!r->done && !(atomic_load(&stop_requested) && i >= b.next_file))
+      pthread_cond_wait(&b.changed, &b.lock);
+    bool done = r->done;
+    pthread_mutex_unlock(&b.lock);
+
+    if (!done)
+      break;
+
+    if (r->status == RISKI_ERROR_CODE_NONE && status == RISKI_ERROR_CODE_NONE) {
+      status = exchange_foreach(r->exchange, iex_batch_merge_security,
+                                iex_exchange);
+      messages += r->messages;
+      bytes += r->bytes;
+    } else if (r->status != RISKI_ERROR_CODE_NONE) {
+      TRACE(logger_error(r->status, __func__, FILENAME_SHORT, __LINE__,
+                         "skipping %s", b.files[i]));
     }
+
+    if (r->exchange)
+      TRACE(exchange_free(&r->exchange));
+
+    pthread_mutex_lock(&b.lock);
+    b.next_merge = i + 1;
+    pthread_cond_broadcast(&b.changed);
+    pthread_mutex_unlock(&b.lock);
+  }
+
+  for (long i = 0; i < jobs; ++i) {
+    pthread_join(workers[i], NULL);
   }
 
+  // days that finished after an interrupt were never merged
+  for (size_t i = 0; i < b.num_files; ++i) {
+    if (b.days[i].exchange)
+      TRACE(exchange_free(&b.days[i].exchange));
+  }
+
+  TRACE(iex_log_throughput(location, messages, bytes, &begin));
+
+  free(workers);
+  free(b.days);
+  pthread_mutex_destroy(&b.lock);
+  pthread_cond_destroy(&b.changed);
+  globfree(&g);
+
   // TODO do some sort of finalization to the data here?
-  TRACE(exchange_free(&iex_exchange));
-  pcap_close(desc);
 
+  return status;
+}
+
+enum RISKI_ERROR_CODE iex_cleanup(void) {
+  if (iex_exchange)
+    TRACE(exchange_free(&iex_exchange));
   return RISKI_ERROR_CODE_NONE;
 }
 
 void packet_handler(unsigned char *userData, const struct pcap_pkthdr *pkthdr,
                     const unsigned char *packet) {
-  // we won't be passing any user defined information
-  (void)userData;
-  (void)pkthdr;
+  struct iex_replay *r = (struct iex_replay *)userData;
+
+  if (atomic_load_explicit(&stop_requested, memory_order_relaxed)) {
+    pcap_breakloop(r->desc);
+    return;
+  }
+
+  r->bytes += pkthdr->caplen + sizeof(struct pcap_pkthdr);
 
   // we only care about ethernet traffic so validate this packet
   // is an ethernet packet
@@ -148,21 +549,18 @@ void packet_handler(unsigned char *userData, const struct pcap_pkthdr *pkthdr,
     ip_header = (const struct ip *)((
         const void *)(packet + sizeof(struct ether_header)));
 
-    // convert src and dst ip addresses into text form
-    char ip_src[INET_ADDRSTRLEN];
-    char ip_dst[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &(ip_header->ip_src), ip_src, INET_ADDRSTRLEN);
-    inet_ntop(AF_INET, &(ip_header->ip_dst), ip_dst, INET_ADDRSTRLEN);
-
     // verify udp packet and verify src
-    if (ip_header->ip_p == IPPROTO_UDP && is_iex_traffic(ip_src, ip_dst)) {
+    size_t offset =
+        sizeof(struct ether_header) + sizeof(struct ip) + sizeof(struct udphdr);
+    if (ip_header->ip_p == IPPROTO_UDP &&
+        is_iex_traffic(ip_header->ip_src.s_addr, ip_header->ip_dst.s_addr) &&
+        pkthdr->caplen >= offset + sizeof(struct iex_tp_header)) {
       // extract the packet data
-      const unsigned char *data = (const unsigned char *)((
-          const void *)(packet + sizeof(struct ether_header) +
-                        sizeof(struct ip) + sizeof(struct udphdr)));
+      const unsigned char *data =
+          (const unsigned char *)((const void *)(packet + offset));
 
       // offload the udp data processing out of this function
-      TRACE_HAULT(iex_tp_handler(data));
+      TRACE_HAULT(iex_tp_handler(r, data, pkthdr->caplen - offset));
     }
   }
 }
@@ -306,36 +704,108 @@ static enum RISKI_ERROR_CODE parse_security_event_message(const void *payload) {
   return RISKI_ERROR_CODE_NONE;
 }
 
+/**
+ * Finds the security for an iex symbol, creating it the first
+ * time the symbol is seen. The space padded symbol is used as an
+ * 8 byte key so only the first message of a symbol touches strings.
+ */
+static enum RISKI_ERROR_CODE iex_get_security(struct exchange *ex,
+                                              const iex_byte_t *symbol,
+                                              struct security **sec) {
+  PTR_CHECK(ex, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  uint64_t key = 0;
+  memcpy(&key, symbol, sizeof(key));
+
+  struct security *cur_sec = NULL;
+  TRACE(exchange_get_by_key(ex, key, &cur_sec));
+  if (cur_sec != NULL) {
+    *sec = cur_sec;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  char *st = NULL;
+  TRACE(symbol_sanitize(symbol, 8, &st));
+
+reget_security:
+  TRACE(exchange_get(ex, st, &cur_sec));
+
+  if (cur_sec == NULL) {
+    TRACE(exchange_put(ex, st, SECURITY_INTERVAL_MINUTE_NANOSECONDS, 4));
+    goto reget_security;
+  }
+
+  free(st);
+  TRACE(exchange_put_by_key(ex, key, cur_sec));
+
+  *sec = cur_sec;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE apply_price_level_update_message(
+    struct security *sec, iex_byte_t side,
+    const struct iex_price_level_update_message *payload_data) {
+  TRACE(security_book_update(sec, side == PRICE_LEVEL_UPDATE_BUY_MESSAGE,
+                             payload_data->price, payload_data->size,
+                             payload_data->timestamp));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE
+apply_trade_report_message(struct security *sec,
+                           const struct iex_trade_report_message *payload_data) {
+  TRACE(security_trade_update(sec, payload_data->price,
+                              payload_data->timestamp));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/**
+ * Applies a message that was routed to a pipeline worker
+ */
+static enum RISKI_ERROR_CODE
+iex_pipeline_apply(const struct iex_pipeline_message *msg) {
+  switch (msg->type) {
+  case PRICE_LEVEL_UPDATE_BUY_MESSAGE:
+  case PRICE_LEVEL_UPDATE_SELL_MESSAGE:
+    TRACE(apply_price_level_update_message(msg->sec, msg->type,
+                                           &msg->body.price_level_update));
+    break;
+  case TRADE_REPORT_MESSAGE:
+    TRACE(apply_trade_report_message(msg->sec, &msg->body.trade_report));
+    break;
+  default:
+    return RISKI_ERROR_CODE_INVALID_MESSAGE;
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
 /**
  * Tells us that a price update has happened to the order book.
  * The side was given in the message block and needs to be passed
  * though to this function.
  */
 static enum RISKI_ERROR_CODE
-parse_price_level_update_message(iex_byte_t side, const void *payload) {
+parse_price_level_update_message(struct iex_replay *r, iex_byte_t side,
+                                 const void *payload) {
   PTR_CHECK(payload, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   const struct iex_price_level_update_message *payload_data =
       (const struct iex_price_level_update_message *)(payload);
 
-  char *st = NULL;
-  TRACE(symbol_sanitize(payload_data->symbol, 8, &st));
-
   struct security *cur_sec = NULL;
-
-reget_security:
-  TRACE(exchange_get(iex_exchange, st, &cur_sec));
-
-  if (cur_sec == NULL) {
-    TRACE(exchange_put(iex_exchange, st, SECURITY_INTERVAL_MINUTE_NANOSECONDS,
-                       4));
-    goto reget_security;
+  TRACE(iex_get_security(r->exchange, payload_data->symbol, &cur_sec));
+
+  if (r->pipeline) {
+    struct iex_pipeline_message msg;
+    msg.sec = cur_sec;
+    msg.type = side;
+    msg.body.price_level_update = *payload_data;
+    TRACE(iex_pipeline_push(r->pipeline, &msg));
+  } else {
+    TRACE(apply_price_level_update_message(cur_sec, side, payload_data));
   }
 
-  TRACE(security_book_update(cur_sec, side, payload_data->price,
-                             payload_data->size));
-
-  free(st);
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -343,30 +813,26 @@ reget_security:
  * The trade report message tells us when a trade has happened,
  * this will also be the latest price
  */
-static enum RISKI_ERROR_CODE parse_trade_report_message(const void *payload) {
+static enum RISKI_ERROR_CODE parse_trade_report_message(struct iex_replay *r,
+                                                        const void *payload) {
   PTR_CHECK(payload, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   const struct iex_trade_report_message *payload_data =
       (const struct iex_trade_report_message *)(payload);
 
-  char *st = NULL;
-  TRACE(symbol_sanitize(payload_data->symbol, 8, &st));
-
   struct security *cur_sec = NULL;
-
-reget_security:
-  TRACE(exchange_get(iex_exchange, st, &cur_sec));
-
-  if (cur_sec == NULL) {
-    TRACE(exchange_put(iex_exchange, st, SECURITY_INTERVAL_MINUTE_NANOSECONDS,
-                       4));
-    goto reget_security;
+  TRACE(iex_get_security(r->exchange, payload_data->symbol, &cur_sec));
+
+  if (r->pipeline) {
+    struct iex_pipeline_message msg;
+    msg.sec = cur_sec;
+    msg.type = TRADE_REPORT_MESSAGE;
+    msg.body.trade_report = *payload_data;
+    TRACE(iex_pipeline_push(r->pipeline, &msg));
+  } else {
+    TRACE(apply_trade_report_message(cur_sec, payload_data));
   }
 
-  TRACE(security_chart_update(cur_sec, payload_data->price, payload_data->price,
-                              payload_data->price, payload_data->timestamp));
-
-  free(st);
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -422,13 +888,52 @@ parse_auction_information_message(const void *payload) {
   return RISKI_ERROR_CODE_NONE;
 }
 
+/**
+ * The length of the body of a message of the given type, 0 for a type
+ * that is not known
+ */
+static size_t iex_message_len(iex_byte_t message_type) {
+  switch (message_type) {
+  case SYSTEM_EVENT_MESSAGE:
+    return sizeof(struct iex_system_event_message);
+  case SECURITY_DIRECTORY_MESSAGE:
+    return sizeof(struct iex_security_directory_message);
+  case TRADING_STATUS_MESSAGE:
+    return sizeof(struct iex_trading_status_message);
+  case OPERATIONAL_HAULT_STATUS_MESSAGE:
+    return sizeof(struct iex_operational_halt_status_message);
+  case SHORT_SALE_PRICE_TEST_STATUS_MESSAGE:
+    return sizeof(struct iex_short_sale_price_test_message);
+  case SECURITY_EVENT_MESSAGE:
+    return sizeof(struct iex_security_event_message);
+  case PRICE_LEVEL_UPDATE_BUY_MESSAGE:
+  case PRICE_LEVEL_UPDATE_SELL_MESSAGE:
+    return sizeof(struct iex_price_level_update_message);
+  case TRADE_REPORT_MESSAGE:
+    return sizeof(struct iex_trade_report_message);
+  case OFFICIAL_PRICE_MESSAGE:
+    return sizeof(struct iex_official_price_message);
+  case TRADE_BREAK_MESSAGE:
+    return sizeof(struct iex_trade_break_message);
+  case AUCTION_INFORMATION_MESSAGE:
+    return sizeof(struct iex_auction_information_message);
+  default:
+    return 0;
+  }
+}
+
 /**
  * Parses the header data of the packet making sure it is
  * actually an iex packet and sending it of to a parse_*
- * function to do a task
+ * function to do a task. Nothing past len bytes of data is read, the
+ * packet may come straight out of a memory mapped capture.
  */
-enum RISKI_ERROR_CODE iex_tp_handler(const unsigned char *data) {
+enum RISKI_ERROR_CODE iex_tp_handler(struct iex_replay *r,
+                                     const unsigned char *data, size_t len) {
+  PTR_CHECK(r, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(data, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(len, sizeof(struct iex_tp_header), >=,
+                   RISKI_ERROR_CODE_INVALID_MESSAGE, RISKI_ERROR_TEXT);
 
   // the header starts at position 0 of the data
   const struct iex_tp_header *header = (const struct iex_tp_header *)&data[0];
@@ -445,18 +950,37 @@ enum RISKI_ERROR_CODE iex_tp_handler(const unsigned char *data) {
   }
 
   data = &data[sizeof(struct iex_tp_header)];
+  r->messages += header->message_count;
 
-  // to do bug, this only reads the first message of the message block
-  // add loop to read all messages
+  // the blocks must fit in both the payload and what was captured of it
+  size_t left = len - sizeof(struct iex_tp_header);
+  if (header->payload_length < left)
+    left = header->payload_length;
 
   for (iex_short_t i = 0; i < header->message_count; ++i) {
     // read the message block to figure out what kind of message this is
     const struct iex_tp_message_block_header *message_header =
         (const struct iex_tp_message_block_header *)&data[0];
 
-    data = &data[sizeof(struct iex_tp_message_block_header)];
+    // message_length counts the type and the body but not itself, a block
+    // too short for the body of its type is as broken as one that does
+    // not fit
+    size_t block_len = 0;
+    if (left >= sizeof(struct iex_tp_message_block_header))
+      block_len = sizeof(message_header->message_length) +
+                  message_header->message_length;
+    if (block_len == 0 || block_len > left ||
+        block_len < sizeof(struct iex_tp_message_block_header) +
+                        iex_message_len(message_header->message_type)) {
+      TRACE(logger_error(RISKI_ERROR_CODE_INVALID_MESSAGE, __func__,
+                         FILENAME_SHORT, __LINE__,
+                         "message %u of %u does not fit in the packet", i,
+                         header->message_count));
+      return RISKI_ERROR_CODE_INVALID_MESSAGE;
+    }
 
-    const void *payload_body = &data[0];
+    const void *payload_body =
+        &data[sizeof(struct iex_tp_message_block_header)];
 
     // switch through the different message types
     switch (message_header->message_type) {
@@ -464,54 +988,46 @@ enum RISKI_ERROR_CODE iex_tp_handler(const unsigned char *data) {
     // we are
     case SYSTEM_EVENT_MESSAGE:
       TRACE(parse_system_event_message(payload_body));
-      data = &data[sizeof(struct iex_system_event_message)];
       break;
     case SECURITY_DIRECTORY_MESSAGE:
       TRACE(parse_security_directory_message(payload_body));
-      data = &data[sizeof(struct iex_security_directory_message)];
       break;
     case TRADING_STATUS_MESSAGE:
       TRACE(parse_trading_status_message(payload_body));
-      data = &data[sizeof(struct iex_trading_status_message)];
       break;
     case OPERATIONAL_HAULT_STATUS_MESSAGE:
       TRACE(parse_operational_hault_status_message(payload_body));
-      data = &data[sizeof(struct iex_operational_halt_status_message)];
       break;
     case SHORT_SALE_PRICE_TEST_STATUS_MESSAGE:
       TRACE(parse_short_sale_price_test_status_message(payload_body));
-      data = &data[sizeof(struct iex_short_sale_price_test_message)];
       break;
     case SECURITY_EVENT_MESSAGE:
       TRACE(parse_security_event_message(payload_body));
-      data = &data[sizeof(struct iex_security_event_message)];
       break;
     case PRICE_LEVEL_UPDATE_BUY_MESSAGE:
     case PRICE_LEVEL_UPDATE_SELL_MESSAGE:
-      TRACE(parse_price_level_update_message(message_header->message_type,
+      TRACE(parse_price_level_update_message(r, message_header->message_type,
                                              payload_body));
-      data = &data[sizeof(struct iex_price_level_update_message)];
       break;
     case TRADE_REPORT_MESSAGE:
-      TRACE(parse_trade_report_message(payload_body));
-      data = &data[sizeof(struct iex_trade_report_message)];
+      TRACE(parse_trade_report_message(r, payload_body));
       break;
     case OFFICIAL_PRICE_MESSAGE:
       TRACE(parse_official_price_message(payload_body));
-      data = &data[sizeof(struct iex_official_price_message)];
       break;
     case TRADE_BREAK_MESSAGE:
       TRACE(parse_trade_break_message(payload_body));
-      data = &data[sizeof(struct iex_trade_break_message)];
       break;
     case AUCTION_INFORMATION_MESSAGE:
       TRACE(parse_auction_information_message(payload_body));
-      data = &data[sizeof(struct iex_auction_information_message)];
       break;
     default:
       print_iex_tp_header(header);
       return RISKI_ERROR_CODE_INVALID_MESSAGE;
     }
+
+    data = &data[block_len];
+    left -= block_len;
   }
   return RISKI_ERROR_CODE_NONE;
 }
@@ -0,0 +1,391 @@
+#include <iex/pcap_mmap.h>
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// classic pcap magic numbers, microsecond and nanosecond resolution
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+#define PCAP_GLOBAL_HEADER_LEN 24
+#define PCAP_RECORD_HEADER_LEN 16
+
+// pcapng block types
+#define PCAPNG_SECTION_HEADER_BLOCK 0x0a0d0d0a
+#define PCAPNG_INTERFACE_DESCRIPTION_BLOCK 0x00000001
+#define PCAPNG_SIMPLE_PACKET_BLOCK 0x00000003
+#define PCAPNG_ENHANCED_PACKET_BLOCK 0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC 0x1a2b3c4d
+
+// the only link type that is decoded
+#define LINKTYPE_ETHERNET 1
+
+// ethernet, vlan and ip constants used while walking the headers
+#define ETHER_HEADER_LEN 14
+#define ETHER_TYPE_IPV4 0x0800
+#define ETHER_TYPE_VLAN 0x8100
+#define VLAN_TAG_LEN 4
+#define IPV4_PROTOCOL_UDP 17
+#define UDP_HEADER_LEN 8
+
+// how far ahead of the cursor the kernel is asked to read
+#define READ_AHEAD_WINDOW (64UL * 1024UL * 1024UL)
+
+/*
+ * Holds a memory mapped capture file
+ * @param {const unsigned char*} data The start of the mapping
+ * @param {size_t} len The length of the mapping
+ * @param {bool} ng True if the file is pcapng instead of pcap
+ * @param {bool} swapped True if the file was written in the other byte order
+ * @param {uint32_t} linktype The link type of a classic pcap file
+ * @param {uint32_t*} ng_linktypes The link type of each pcapng interface
+ * @param {size_t} ng_num_interfaces The number of pcapng interfaces
+ * @param {uint32_t} ng_snaplen The snap length of the first pcapng interface
+ * @param {size_t} packets The number of packets walked
+ * @param {size_t} next_advice The cursor position of the next madvise
+ * @param {size_t} dropped Everything before this offset has been released
+ * @param {atomic_bool} stop Set to stop the walk
+ */
+struct pcap_mmap {
+  const unsigned char *data;
+  size_t len;
+  bool ng;
+  bool swapped;
+  uint32_t linktype;
+  uint32_t *ng_linktypes;
+  size_t ng_num_interfaces;
+  uint32_t ng_snaplen;
+  size_t packets;
+  size_t next_advice;
+  size_t dropped;
+  atomic_bool stop;
+};
+
+static inline uint32_t load_u32(const struct pcap_mmap *pm,
+                                const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return pm->swapped ? __builtin_bswap32(v) : v;
+}
+
+static inline uint16_t load_u16(const struct pcap_mmap *pm,
+                                const unsigned char *p) {
+  uint16_t v;
+  memcpy(&v, p, sizeof(v));
+  return pm->swapped ? __builtin_bswap16(v) : v;
+}
+
+// network headers are always big endian
+static inline uint16_t load_be16(const unsigned char *p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+enum RISKI_ERROR_CODE pcap_mmap_open(char *file, struct pcap_mmap **pm) {
+  PTR_CHECK(file, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    return logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__,
+                        FILENAME_SHORT, __LINE__, "can not open %s", file);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < PCAP_GLOBAL_HEADER_LEN) {
+    close(fd);
+    return logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__,
+                        FILENAME_SHORT, __LINE__, "%s is not a capture file",
+                        file);
+  }
+
+  size_t len = (size_t)st.st_size;
+  void *data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  // the mapping keeps its own reference to the file
+  close(fd);
+
+  if (data == MAP_FAILED) {
+    return logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__,
+                        FILENAME_SHORT, __LINE__, "can not mmap %s", file);
+  }
+
+  // the file is read front to back exactly once
+  madvise(data, len, MADV_SEQUENTIAL);
+  madvise(data, len < READ_AHEAD_WINDOW ? len : READ_AHEAD_WINDOW,
+          MADV_WILLNEED);
+
+  struct pcap_mmap *p = (struct pcap_mmap *)calloc(1, sizeof(struct pcap_mmap));
+  if (!p) {
+    munmap(data, len);
+    PTR_CHECK(p, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  }
+
+  p->data = (const unsigned char *)data;
+  p->len = len;
+  p->next_advice = READ_AHEAD_WINDOW;
+  atomic_init(&p->stop, false);
+
+  uint32_t magic;
+  memcpy(&magic, p->data, sizeof(magic));
+
+  if (magic == PCAP_MAGIC_USEC || magic == PCAP_MAGIC_NSEC) {
+    p->ng = false;
+  } else if (__builtin_bswap32(magic) == PCAP_MAGIC_USEC ||
+             __builtin_bswap32(magic) == PCAP_MAGIC_NSEC) {
+    p->ng = false;
+    p->swapped = true;
+  } else if (magic == PCAPNG_SECTION_HEADER_BLOCK) {
+    uint32_t bom;
+    memcpy(&bom, p->data + 8, sizeof(bom));
+    p->ng = true;
+    p->swapped = bom != PCAPNG_BYTE_ORDER_MAGIC;
+  } else {
+    munmap(data, len);
+    free(p);
+    return logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__,
+                        FILENAME_SHORT, __LINE__,
+                        "%s has unknown capture magic 0x%x", file, magic);
+  }
+
+  if (!p->ng) {
+    p->linktype = load_u32(p, p->data + 20);
+  }
+
+  *pm = p;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Decodes ethernet -> ipv4 -> udp in place and calls the handler with
+ * the udp payload, anything else is silently skipped
+ */
+static inline enum RISKI_ERROR_CODE
+dispatch_frame(const unsigned char *frame, size_t caplen,
+               pcap_mmap_handler handler, void *usr) {
+  if (caplen < ETHER_HEADER_LEN)
+    return RISKI_ERROR_CODE_NONE;
+
+  size_t off = ETHER_HEADER_LEN;
+  uint16_t ether_type = load_be16(frame + 12);
+  if (ether_type == ETHER_TYPE_VLAN) {
+    if (caplen < ETHER_HEADER_LEN + VLAN_TAG_LEN)
+      return RISKI_ERROR_CODE_NONE;
+    ether_type = load_be16(frame + 16);
+    off += VLAN_TAG_LEN;
+  }
+
+  if (ether_type != ETHER_TYPE_IPV4 || caplen < off + 20)
+    return RISKI_ERROR_CODE_NONE;
+
+  const unsigned char *ip = frame + off;
+  size_t ip_header_len = (size_t)(ip[0] & 0x0f) * 4;
+  if ((ip[0] >> 4) != 4 || ip[9] != IPV4_PROTOCOL_UDP || ip_header_len < 20)
+    return RISKI_ERROR_CODE_NONE;
+
+  off += ip_header_len;
+  if (caplen < off + UDP_HEADER_LEN)
+    return RISKI_ERROR_CODE_NONE;
+
+  size_t udp_len = load_be16(frame + off + 4);
+  off += UDP_HEADER_LEN;
+  if (udp_len < UDP_HEADER_LEN)
+    return RISKI_ERROR_CODE_NONE;
+
+  // trust the udp length but never read past what was captured
+  size_t payload_len = udp_len - UDP_HEADER_LEN;
+  if (payload_len > caplen - off)
+    payload_len = caplen - off;
+
+  struct pcap_mmap_datagram dg;
+  dg.payload = frame + off;
+  dg.len = payload_len;
+  memcpy(&dg.ip_src, ip + 12, sizeof(dg.ip_src));
+  memcpy(&dg.ip_dst, ip + 16, sizeof(dg.ip_dst));
+
+  return handler(&dg, usr);
+}
+
+/*
+ * Keeps the kernel reading ahead of the cursor and drops the pages
+ * behind it so a multi gigabyte file does not pin the whole mapping
+ */
+static inline void advise_window(struct pcap_mmap *pm, size_t cursor) {
+  if (cursor < pm->next_advice)
+    return;
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  size_t behind = (cursor / page) * page;
+  if (behind > pm->dropped + READ_AHEAD_WINDOW) {
+    size_t drop_to = behind - READ_AHEAD_WINDOW;
+    madvise((void *)(uintptr_t)(pm->data + pm->dropped), drop_to - pm->dropped,
+            MADV_DONTNEED);
+    pm->dropped = drop_to;
+  }
+
+  size_t ahead = behind + READ_AHEAD_WINDOW;
+  if (ahead < pm->len) {
+    size_t ahead_len = pm->len - ahead;
+    if (ahead_len > READ_AHEAD_WINDOW)
+      ahead_len = READ_AHEAD_WINDOW;
+    madvise((void *)(uintptr_t)(pm->data + ahead), ahead_len, MADV_WILLNEED);
+  }
+
+  pm->next_advice = cursor + READ_AHEAD_WINDOW;
+}
+
+static enum RISKI_ERROR_CODE walk_pcap(struct pcap_mmap *pm,
+                                       pcap_mmap_handler handler, void *usr) {
+  if (pm->linktype != LINKTYPE_ETHERNET) {
+    return logger_error(RISKI_ERROR_CODE_INVALID_FILE, __func__,
+                        FILENAME_SHORT, __LINE__,
+                        "unsupported pcap link type %u", pm->linktype);
+  }
+
+  size_t cursor = PCAP_GLOBAL_HEADER_LEN;
+
+  while (cursor + PCAP_RECORD_HEADER_LEN <= pm->len &&
+         !atomic_load_explicit(&pm->stop, memory_order_relaxed)) {
+    size_t caplen = load_u32(pm, pm->data + cursor + 8);
+    cursor += PCAP_RECORD_HEADER_LEN;
+
+    // a truncated final record ends the capture
+    if (caplen > pm->len - cursor)
+      break;
+
+    pm->packets += 1;
+    TRACE(dispatch_frame(pm->data + cursor, caplen, handler, usr));
+
+    cursor += caplen;
+    advise_window(pm, cursor);
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE ng_add_interface(struct pcap_mmap *pm,
+                                              const unsigned char *body) {
+  uint32_t *linktypes = (uint32_t *)realloc(
+      pm->ng_linktypes, (pm->ng_num_interfaces + 1) * sizeof(uint32_t));
+  PTR_CHECK(linktypes, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  linktypes[pm->ng_num_interfaces] = load_u16(pm, body);
+  if (pm->ng_num_interfaces == 0)
+    pm->ng_snaplen = load_u32(pm, body + 4);
+
+  pm->ng_linktypes = linktypes;
+  pm->ng_num_interfaces += 1;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE walk_pcapng(struct pcap_mmap *pm,
+                                         pcap_mmap_handler handler,
+                                         void *usr) {
+  size_t cursor = 0;
+
+  while (cursor + 12 <= pm->len &&
+         !atomic_load_explicit(&pm->stop, memory_order_relaxed)) {
+    const unsigned char *block = pm->data + cursor;
+    uint32_t type = load_u32(pm, block);
+
+    // a new section may switch the byte order
+    if (type == PCAPNG_SECTION_HEADER_BLOCK ||
+        __builtin_bswap32(type) == PCAPNG_SECTION_HEADER_BLOCK) {
+      uint32_t bom;
+      memcpy(&bom, block + 8, sizeof(bom));
+      pm->swapped = bom != PCAPNG_BYTE_ORDER_MAGIC;
+      pm->ng_num_interfaces = 0;
+    }
+
+    size_t block_len = load_u32(pm, block + 4);
+    if (block_len < 12 || block_len > pm->len - cursor)
+      break;
+
+    const unsigned char *body = block + 8;
+    size_t body_len = block_len - 12;
+
+    switch (type) {
+    case PCAPNG_INTERFACE_DESCRIPTION_BLOCK:
+      if (body_len >= 8)
+        TRACE(ng_add_interface(pm, body));
+      break;
+    case PCAPNG_ENHANCED_PACKET_BLOCK:
+      if (body_len >= 20) {
+        uint32_t interface_id = load_u32(pm, body);
+        size_t caplen = load_u32(pm, body + 12);
+        if (interface_id < pm->ng_num_interfaces &&
+            pm->ng_linktypes[interface_id] == LINKTYPE_ETHERNET &&
+            caplen <= body_len - 20) {
+          pm->packets += 1;
+          TRACE(dispatch_frame(body + 20, caplen, handler, usr));
+        }
+      }
+      break;
+    case PCAPNG_SIMPLE_PACKET_BLOCK:
+      if (body_len >= 4 && pm->ng_num_interfaces > 0 &&
+          pm->ng_linktypes[0] == LINKTYPE_ETHERNET) {
+        size_t caplen = load_u32(pm, body);
+        if (pm->ng_snaplen != 0 && caplen > pm->ng_snaplen)
+          caplen = pm->ng_snaplen;
+        if (caplen > body_len - 4)
+          caplen = body_len - 4;
+        pm->packets += 1;
+        TRACE(dispatch_frame(body + 4, caplen, handler, usr));
+      }
+      break;
+    default:
+      // statistics, name resolution and custom blocks are skipped
+      break;
+    }
+
+    cursor += block_len;
+    advise_window(pm, cursor);
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE pcap_mmap_for_each_udp(struct pcap_mmap *pm,
+                                             pcap_mmap_handler handler,
+                                             void *usr) {
+  PTR_CHECK(pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(handler, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (pm->ng) {
+    TRACE(walk_pcapng(pm, handler, usr));
+  } else {
+    TRACE(walk_pcap(pm, handler, usr));
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE pcap_mmap_stop(struct pcap_mmap *pm) {
+  PTR_CHECK(pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  atomic_store_explicit(&pm->stop, true, memory_order_relaxed);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE pcap_mmap_stats(struct pcap_mmap *pm, size_t *bytes,
+                                      size_t *packets) {
+  PTR_CHECK(pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bytes, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(packets, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *bytes = pm->len;
+  *packets = pm->packets;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE pcap_mmap_close(struct pcap_mmap **pm) {
+  PTR_CHECK(pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(*pm, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  munmap((void *)(uintptr_t)(*pm)->data, (*pm)->len);
+  free((*pm)->ng_linktypes);
+  free(*pm);
+  *pm = NULL;
+  return RISKI_ERROR_CODE_NONE;
+}
@@ -0,0 +1,255 @@
+#include <iex/pipeline.h>
+
+/*
+ * A single producer single consumer ring. head is only written by the
+ * worker and tail only by the decoder, they are kept on separate cache
+ * lines so the two threads do not fight over them. A side that has
+ * waited IEX_PIPELINE_SPINS rounds parks on lock until the other side
+ * moves its end.
+ * @param {atomic_size_t} head The next slot the worker reads
+ * @param {atomic_size_t} tail The next slot the decoder writes
+ * @param {struct iex_pipeline_message*} slots The ring storage
+ * @param {atomic_bool} worker_parked Set while the worker waits on can_read
+ * @param {atomic_bool} decoder_parked Set while the decoder waits on
+ * can_write
+ * @param {pthread_mutex_t} lock Guards the waits on can_read and can_write
+ * @param {pthread_cond_t} can_read Signaled when tail moves
+ * @param {pthread_cond_t} can_write Signaled when head moves
+ */
+struct iex_pipeline_ring {
+  atomic_size_t head;
+  char _p1[56];
+  atomic_size_t tail;
+  char _p2[56];
+  struct iex_pipeline_message *slots;
+  char _p3[56];
+  atomic_bool worker_parked;
+  atomic_bool decoder_parked;
+
+  // 6 unused bytes in this structure
+  char _p4[6];
+  pthread_mutex_t lock;
+  pthread_cond_t can_read;
+  pthread_cond_t can_write;
+};
+
+/*
+ * A worker thread and the ring it reads from
+ * @param {struct iex_pipeline*} p The owning pipeline
+ * @param {struct iex_pipeline_ring} ring The messages routed to the worker
+ * @param {pthread_t} thread The worker thread
+ */
+struct iex_pipeline_worker {
+  struct iex_pipeline_ring ring;
+  struct iex_pipeline *p;
+  pthread_t thread;
+};
+
+/*
+ * Holds the pipeline information
+ * @param {size_t} num_workers The number of workers
+ * @param {struct iex_pipeline_worker*} workers The workers
+ * @param {iex_pipeline_handler} handler Applies a message
+ * @param {atomic_bool} closing Set once the decoder has pushed everything
+ * @param {atomic_int} status The first error a worker hit
+ */
+struct iex_pipeline {
+  size_t num_workers;
+  struct iex_pipeline_worker *workers;
+  iex_pipeline_handler handler;
+  atomic_bool closing;
+  atomic_int status;
+};
+
+/*
+ * Waits until the decoder pushes past head or the pipeline closes
+ */
+static void iex_pipeline_park_worker(struct iex_pipeline_ring *ring,
+                                     struct iex_pipeline *p, size_t head) {
+  pthread_mutex_lock(&ring->lock);
+  // the decoder publishes tail before it looks for a parked worker, so
+  // either it sees this worker parked or this worker sees the message
+  atomic_store(&ring->worker_parked, true);
+  while (head == atomic_load(&ring->tail) && !atomic_load(&p->closing))
+    pthread_cond_wait(&ring->can_read, &ring->lock);
+  atomic_store(&ring->worker_parked, false);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+/*
+ * Waits until the worker frees a slot of a full ring
+ */
+static void iex_pipeline_park_decoder(struct iex_pipeline_ring *ring,
+                                      size_t tail) {
+  pthread_mutex_lock(&ring->lock);
+  atomic_store(&ring->decoder_parked, true);
+  while (tail - atomic_load(&ring->head) >= IEX_PIPELINE_RING_SIZE)
+    pthread_cond_wait(&ring->can_write, &ring->lock);
+  atomic_store(&ring->decoder_parked, false);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+/*
+ * Wakes the other side of a ring if it is parked
+ */
+static void iex_pipeline_wake(struct iex_pipeline_ring *ring,
+                              atomic_bool *parked, pthread_cond_t *cond) {
+  if (!atomic_load(parked))
+    return;
+  pthread_mutex_lock(&ring->lock);
+  pthread_cond_signal(cond);
+  pthread_mutex_unlock(&ring->lock);
+}
+
+static void *iex_pipeline_worker_func(void *usr) {
+  struct iex_pipeline_worker *w = (struct iex_pipeline_worker *)usr;
+  struct iex_pipeline_ring *ring = &w->ring;
+  struct iex_pipeline *p = w->p;
+
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t spins = 0;
+  while (true) {
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if (head == tail) {
+      // only stop once everything pushed before closing was handled
+      if (atomic_load_explicit(&p->closing, memory_order_acquire) &&
+          head == atomic_load_explicit(&ring->tail, memory_order_acquire))
+        break;
+      if (++spins < IEX_PIPELINE_SPINS) {
+        sched_yield();
+      } else {
+        iex_pipeline_park_worker(ring, p, head);
+        spins = 0;
+      }
+      continue;
+    }
+    spins = 0;
+
+    // handle every message that is ready before publishing the new head
+    for (; head != tail; ++head) {
+      const struct iex_pipeline_message *msg =
+          &ring->slots[head & (IEX_PIPELINE_RING_SIZE - 1)];
+
+      enum RISKI_ERROR_CODE err = p->handler(msg);
+      if (err != RISKI_ERROR_CODE_NONE) {
+        int expected = RISKI_ERROR_CODE_NONE;
+        atomic_compare_exchange_strong(&p->status, &expected, (int)err);
+      }
+    }
+    atomic_store(&ring->head, head);
+    iex_pipeline_wake(ring, &ring->decoder_parked, &ring->can_write);
+  }
+  return NULL;
+}
+
+enum RISKI_ERROR_CODE iex_pipeline_new(size_t num_workers,
+                                       iex_pipeline_handler handler,
+                                       struct iex_pipeline **pipeline) {
+  PTR_CHECK(handler, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(pipeline, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  RANGE_CHECK(num_workers, 1, 1024, RISKI_ERROR_CODE_INVALID_RANGE,
+              RISKI_ERROR_TEXT);
+
+  struct iex_pipeline *p =
+      (struct iex_pipeline *)calloc(1, sizeof(struct iex_pipeline));
+  PTR_CHECK(p, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  p->num_workers = num_workers;
+  p->handler = handler;
+  atomic_init(&p->closing, false);
+  atomic_init(&p->status, RISKI_ERROR_CODE_NONE);
+
+  p->workers = (struct iex_pipeline_worker *)calloc(
+      num_workers, sizeof(struct iex_pipeline_worker));
+  PTR_CHECK(p->workers, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    struct iex_pipeline_worker *w = &p->workers[i];
+    w->p = p;
+    atomic_init(&w->ring.head, 0);
+    atomic_init(&w->ring.tail, 0);
+    atomic_init(&w->ring.worker_parked, false);
+    atomic_init(&w->ring.decoder_parked, false);
+    pthread_mutex_init(&w->ring.lock, NULL);
+    pthread_cond_init(&w->ring.can_read, NULL);
+    pthread_cond_init(&w->ring.can_write, NULL);
+    w->ring.slots = (struct iex_pipeline_message *)malloc(
+        IEX_PIPELINE_RING_SIZE * sizeof(struct iex_pipeline_message));
+    PTR_CHECK(w->ring.slots, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  }
+
+  for (size_t i = 0; i < num_workers; ++i) {
+    pthread_create(&p->workers[i].thread, NULL, iex_pipeline_worker_func,
+                   &p->workers[i]);
+  }
+
+  TRACE(logger_info(__func__, FILENAME_SHORT, __LINE__,
+                    "started %lu iex pipeline workers", num_workers));
+
+  *pipeline = p;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE
+iex_pipeline_push(struct iex_pipeline *p,
+                  const struct iex_pipeline_message *msg) {
+  PTR_CHECK(p, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t hash = 0;
+  TRACE(security_get_hash(msg->sec, &hash));
+
+  struct iex_pipeline_ring *ring = &p->workers[hash % p->num_workers].ring;
+
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t spins = 0;
+  while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) >=
+         IEX_PIPELINE_RING_SIZE) {
+    // the worker has fallen behind, wait for it to free a slot
+    if (++spins < IEX_PIPELINE_SPINS)
+      sched_yield();
+    else
+      iex_pipeline_park_decoder(ring, tail);
+  }
+
+  ring->slots[tail & (IEX_PIPELINE_RING_SIZE - 1)] = *msg;
+  atomic_store(&ring->tail, tail + 1);
+  iex_pipeline_wake(ring, &ring->worker_parked, &ring->can_read);
+
+  return (enum RISKI_ERROR_CODE)atomic_load_explicit(&p->status,
+                                                     memory_order_relaxed);
+}
+
+enum RISKI_ERROR_CODE iex_pipeline_free(struct iex_pipeline **p) {
+  PTR_CHECK(p, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(*p, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  atomic_store(&(*p)->closing, true);
+
+  for (size_t i = 0; i < (*p)->num_workers; ++i) {
+    // a parked worker checks closing under the lock, so it either sees
+    // it or is waiting already
+    struct iex_pipeline_ring *ring = &(*p)->workers[i].ring;
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_broadcast(&ring->can_read);
+    pthread_mutex_unlock(&ring->lock);
+  }
+
+  for (size_t i = 0; i < (*p)->num_workers; ++i) {
+    struct iex_pipeline_ring *ring = &(*p)->workers[i].ring;
+    pthread_join((*p)->workers[i].thread, NULL);
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->can_read);
+    pthread_cond_destroy(&ring->can_write);
+    free(ring->slots);
+  }
+
+  enum RISKI_ERROR_CODE status = (enum RISKI_ERROR_CODE)atomic_load(
+      &(*p)->status);
+
+  free((*p)->workers);
+  free(*p);
+  *p = NULL;
+  return status;
+}
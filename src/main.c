@@ -23,14 +23,16 @@
  */
 typedef struct {
   bool pcap_feed;
+  bool pcap_batch;
   bool oanda_feed;
   bool dev_web;
   bool compile;
 
-  // 4 unused bytes here for padding
-  char _p1[4];
+  // 3 unused bytes here for padding
+  char _p1[3];
 
   char *pcap_feed_file;
+  char *pcap_batch_location;
   char *fxpig_ini_file;
   char *oanda_key;
   char *locaion;
@@ -44,6 +46,8 @@ static cli *cli_parse(int argc, char **argv) {
   cli *options = (cli *)malloc(1 * sizeof(cli));
   options->pcap_feed = false;
   options->pcap_feed_file = NULL;
+  options->pcap_batch = false;
+  options->pcap_batch_location = NULL;
   options->fxpig_ini_file = NULL;
   options->dev_web = false;
   options->oanda_feed = false;
@@ -67,6 +71,50 @@ static cli *cli_parse(int argc, char **argv) {
       } else {
         printf("%s", "-oanda_feed must be followd by an api key\n");
       }
+    } else if (strcmp("-pcap_batch", argv[i]) == 0) {
+      if (i + 1 < argc) {
+        options->pcap_batch = true;
+        options->pcap_batch_location = argv[i + 1];
+      } else {
+        printf("%s", "-pcap_batch must be followed "
+                     "by a directory or glob");
+        exit(1);
+      }
+    } else if (strcmp("-pcap_jobs", argv[i]) == 0) {
+      if (i + 1 < argc) {
+        IEX_BATCH_JOBS = strtol(argv[i + 1], NULL, 10);
+      } else {
+        printf("%s", "-pcap_jobs must be followed "
+                     "by a number of threads\n");
+        exit(1);
+      }
+    } else if (strcmp("-pcap_workers", argv[i]) == 0) {
+      if (i + 1 < argc) {
+        IEX_PARSE_WORKERS = strtol(argv[i + 1], NULL, 10);
+      } else {
+        printf("%s", "-pcap_workers must be followed "
+                     "by a number of threads\n");
+        exit(1);
+      }
+    } else if (strcmp("-store", argv[i]) == 0) {
+      if (i + 1 < argc) {
+        EXCHANGE_STORE_DIR = argv[i + 1];
+      } else {
+        printf("%s", "-store must be followed "
+                     "by a directory");
+        exit(1);
+      }
+    } else if (strcmp("-intervals", argv[i]) == 0) {
+      if (i + 1 < argc) {
+        if (security_set_intervals(argv[i + 1]) != RISKI_ERROR_CODE_NONE)
+          exit(1);
+      } else {
+        printf("%s", "-intervals must be followed "
+                     "by a list such as 5s,1m,5m,1h");
+        exit(1);
+      }
+    } else if (strcmp("-pcap_libpcap", argv[i]) == 0) {
+      IEX_USE_LIBPCAP = true;
     } else if (strcmp("-dev-web", argv[i]) == 0) {
       options->dev_web = true;
     } else if (strcmp("-c", argv[i]) == 0) {
@@ -93,7 +141,10 @@ static void valid_working_directory() {
 }
 
 static void __attribute__((noreturn)) usage(char *path) {
-  printf("%s [-pcap_feed FILE][-fxpig FILE]\n", path);
+  printf("%s [-pcap_feed FILE][-pcap_workers N][-pcap_batch DIR|GLOB]"
+         "[-pcap_jobs N][-pcap_libpcap][-fxpig FILE][-store DIR]"
+         "[-intervals LIST]\n",
+         path);
   exit(1);
 }
 
@@ -114,12 +165,17 @@ int main(int argc, char **argv) {
     analysis_init();
     if (options->pcap_feed) {
       iex_parse_deep(options->pcap_feed_file);
+    } else if (options->pcap_batch) {
+      iex_parse_deep_batch(options->pcap_batch_location);
     } else if (options->oanda_feed) {
       TRACE_HAULT(oanda_live(options->oanda_key));
     }
     analysis_cleanup();
     SERVER_INTERRUPTED = 1;
     pthread_join(id, NULL);
+
+    // the server reads the exchange until it has stopped
+    TRACE_HAULT(iex_cleanup());
   }
 
   TRACE_HAULT(search_free());
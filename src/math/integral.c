@@ -8,28 +8,34 @@ enum RISKI_ERROR_CODE integral_chart(struct chart *cht, size_t a, size_t b,
   COMPARISON_CHECK(a, b, <, RISKI_ERROR_CODE_COMPARISON_FAIL, RISKI_ERROR_TEXT);
 
   int64_t summation = 0;
-
-  struct candle *c = NULL;
-  int64_t close = 0;
-
-  TRACE(chart_get_candle(cht, a, &c));
-  TRACE(candle_close(c, &close));
-  summation += close;
-
-  for (size_t i = a + 1; i <= b - 1; ++i) {
-    TRACE(chart_get_candle(cht, i, &c));
-    TRACE(candle_close(c, &close));
-    summation += 2 * close;
-    if (summation <= 0) {
-      printf(".....");
-      COMPARISON_CHECK(summation, 0, <=, RISKI_ERROR_CODE_COMPARISON_FAIL,
-                       RISKI_ERROR_TEXT);
+  int64_t close_a = 0;
+  int64_t close_b = 0;
+
+  // trapezoids, every close counts twice except the two end points
+  struct chart_span span;
+  for (size_t i = a; i <= b; i += span.len) {
+    TRACE(chart_span(cht, i, b, &span));
+    if (span.flat) {
+      summation += 2 * span.price * (int64_t)span.len;
+      close_b = span.price;
+    } else {
+      for (size_t k = 0; k < span.len; ++k) {
+        summation += 2 * span.close[k];
+      }
+      close_b = span.close[span.len - 1];
     }
+    if (i == a)
+      close_a = span.flat ? span.price : span.close[0];
+  }
+
+  if (summation <= 0) {
+    printf(".....");
+    COMPARISON_CHECK(summation, 0, <=, RISKI_ERROR_CODE_COMPARISON_FAIL,
+                     RISKI_ERROR_TEXT);
   }
 
-  TRACE(chart_get_candle(cht, b, &c));
-  TRACE(candle_close(c, &close));
-  summation += close;
+  summation -= close_a;
+  summation -= close_b;
 
   // TODO: check for overflow maybe?
 
@@ -0,0 +1,66 @@
+#include <number_format.h>
+
+#include <string.h>
+
+/*
+ * The two digits of every number below 100, numbers are written two
+ * digits at a time so there is one division for every two digits
+ */
+static const char number_format_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+size_t number_format_u64(uint64_t v, char *dst) {
+  // the digits are made from the back so they are built in a scratch
+  // buffer and copied over in one go
+  char tmp[NUMBER_FORMAT_MAX_LEN];
+  char *p = tmp + NUMBER_FORMAT_MAX_LEN;
+
+  while (v >= 100) {
+    size_t pair = (size_t)(v % 100) * 2;
+    v /= 100;
+    p -= 2;
+    p[0] = number_format_pairs[pair];
+    p[1] = number_format_pairs[pair + 1];
+  }
+
+  if (v >= 10) {
+    size_t pair = (size_t)v * 2;
+    p -= 2;
+    p[0] = number_format_pairs[pair];
+    p[1] = number_format_pairs[pair + 1];
+  } else {
+    *--p = (char)('0' + v);
+  }
+
+  size_t len = (size_t)(tmp + NUMBER_FORMAT_MAX_LEN - p);
+  memcpy(dst, p, len);
+  return len;
+}
+
+size_t number_format_i64(int64_t v, char *dst) {
+  if (v >= 0)
+    return number_format_u64((uint64_t)v, dst);
+
+  // negating INT64_MIN overflows, going through unsigned does not
+  dst[0] = '-';
+  return 1 + number_format_u64(0 - (uint64_t)v, dst + 1);
+}
+
+size_t number_format_varint(uint64_t v, unsigned char *dst) {
+  size_t len = 0;
+  while (v >= 0x80) {
+    dst[len++] = (unsigned char)(v | 0x80);
+    v >>= 7;
+  }
+  dst[len++] = (unsigned char)v;
+  return len;
+}
@@ -194,6 +194,9 @@ static enum RISKI_ERROR_CODE oanda_main_loop(SSL *conn,
     if (time(NULL) - start_time >= 1) {
       requests_per_second = 0;
       start_time = time(NULL);
+
+      // the session is never shut down, the stores are written as it goes
+      TRACE(exchange_flush_store(exchange_oanda));
     } else {
       requests_per_second += 1;
     }
@@ -202,6 +205,8 @@ static enum RISKI_ERROR_CODE oanda_main_loop(SSL *conn,
 
 enum RISKI_ERROR_CODE oanda_live(char *token) {
   TRACE(exchange_new("OANDA", &exchange_oanda));
+  if (EXCHANGE_STORE_DIR)
+    TRACE(exchange_open_store(exchange_oanda, EXCHANGE_STORE_DIR));
 
   logger_info(__func__, FILENAME_SHORT, __LINE__, "using oanda api token %s",
               token);
@@ -311,8 +316,19 @@ enum RISKI_ERROR_CODE oanda_live(char *token) {
     oanda_tradeble_instruments[i] = strdup(cJSON_GetStringValue(displayName));
     cJSON *precision_json = cJSON_GetObjectItem(instrument, "displayPrecision");
     int precision = (int)(cJSON_GetNumberValue(precision_json));
-    TRACE(exchange_put(exchange_oanda, oanda_tradeble_instruments[i],
-                       SECURITY_INTERVAL_MINUTE_NANOSECONDS, precision));
+
+    // the instruments of the store were already put by exchange_open_store
+    struct security *sec = NULL;
+    TRACE(exchange_get(exchange_oanda, oanda_tradeble_instruments[i], &sec));
+    if (!sec) {
+      TRACE(exchange_put(exchange_oanda, oanda_tradeble_instruments[i],
+                         SECURITY_INTERVAL_MINUTE_NANOSECONDS, precision));
+      TRACE(exchange_get(exchange_oanda, oanda_tradeble_instruments[i], &sec));
+    }
+
+    // a live session runs for days, only the recent candles stay in memory
+    if (sec)
+      TRACE(security_set_retention(sec, OANDA_RESIDENT_CANDLES));
     // get the candles we have missed
   }
   cJSON_Delete(instruments_json);
@@ -21,7 +21,7 @@ enum RISKI_ERROR_CODE oanda_v20_v3_accounts(char *host, char *api_key,
   TRACE(string_builder_append(sb, api_key));
   TRACE(string_builder_append(sb, "\r\n\r\n"));
 
-  TRACE(string_builder_str(sb, res));
+  TRACE(string_builder_take(sb, res));
   TRACE(string_builder_free(&sb));
 
   return RISKI_ERROR_CODE_NONE;
@@ -53,7 +53,7 @@ enum RISKI_ERROR_CODE oanda_v20_v3_accounts_instruments(char *host,
   TRACE(string_builder_append(sb, api_key));
   TRACE(string_builder_append(sb, "\r\n\r\n"));
 
-  TRACE(string_builder_str(sb, res));
+  TRACE(string_builder_take(sb, res));
   TRACE(string_builder_free(&sb));
 
   return RISKI_ERROR_CODE_NONE;
@@ -76,7 +76,7 @@ enum RISKI_ERROR_CODE oanda_v20_v3_accounts_pricing(char *host, char *api_key,
   for (int i = 0; i < num_instruments; ++i) {
     TRACE(string_builder_append(sb, instrument_name[i]));
     if (i != num_instruments - 1)
-      TRACE(string_builder_append(sb, ","));
+      TRACE(string_builder_append_char(sb, ','));
   }
 
   TRACE(string_builder_append(sb, " HTTP/1.1\r\n"));
@@ -93,7 +93,7 @@ enum RISKI_ERROR_CODE oanda_v20_v3_accounts_pricing(char *host, char *api_key,
   TRACE(string_builder_append(sb, api_key));
   TRACE(string_builder_append(sb, "\r\n\r\n"));
 
-  TRACE(string_builder_str(sb, res));
+  TRACE(string_builder_take(sb, res));
   TRACE(string_builder_free(&sb));
 
   return RISKI_ERROR_CODE_NONE;
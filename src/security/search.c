@@ -77,7 +77,7 @@ enum RISKI_ERROR_CODE search_search(char *seq, char **json) {
   TRACE(string_builder_append(sb, "]"));
 
   char *dat = NULL;
-  TRACE(string_builder_str(sb, &dat));
+  TRACE(string_builder_take(sb, &dat));
   TRACE(string_builder_free(&sb));
 
   size_t len = strlen(dat);
@@ -5,39 +5,84 @@
  * @param {char*} name The name of the security
  * @param {size_t} hash The hash of the security name
  * @param {struct book*} b The order book
- * @param {struct chart*} cht The chart
+ * @param {struct chart_set*} charts The charts at each interval
  * @param {pthread_mutex_t} m_chart_update Lock mutex for getting chart info
+ * @param {pthread_mutex_t} m_book_update Lock mutex for getting book info
+ * @param {int64_t} bid The last best bid of the book, kept while the buy
+ * side is empty, -1 until the book has had a buy
+ * @param {int64_t} ask The last best ask of the book, kept while the sell
+ * side is empty, -1 until the book has had a sell
  */
 struct security {
   char *name;
   size_t hash;
   struct book *b;
-  struct chart *cht;
+  struct chart_set *charts;
   pthread_mutex_t m_chart_update;
+  pthread_mutex_t m_book_update;
+  int64_t bid;
+  int64_t ask;
 };
 
+uint64_t SECURITY_INTERVALS[CHART_STORE_MAX_CHARTS];
+size_t SECURITY_NUM_INTERVALS = 0;
+
 static size_t hash(unsigned char *str) {
   size_t hash = 5381;
   unsigned long c;
   while ((c = *str++))
     hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
 
-  hash = hash % SECURITY_HASH_MODULE_VAL;
   return hash;
 }
 
-enum RISKI_ERROR_CODE security_get_analysis(struct security *sec, char **json) {
+/*
+ * Gets the chart of the security with the given interval, logs an error
+ * if there is none
+ */
+static enum RISKI_ERROR_CODE security_chart(struct security *sec,
+                                            uint64_t interval,
+                                            struct chart **cht) {
+  TRACE(chart_set_get(sec->charts, interval, cht));
+  if (*cht == NULL) {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                       FILENAME_SHORT, __LINE__, "%s has no %lu chart",
+                       sec->name, interval));
+    return RISKI_ERROR_CODE_INVALID_RANGE;
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_get_analysis(struct security *sec,
+                                            uint64_t interval, char **json) {
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
   char *dat = NULL;
-  TRACE(chart_analysis_json(sec->cht, &dat));
+  TRACE(chart_analysis_json_cached(cht, &dat));
 
   *json = dat;
 
   return RISKI_ERROR_CODE_NONE;
 }
 
+enum RISKI_ERROR_CODE security_get_versions(struct security *sec,
+                                            uint64_t interval,
+                                            uint64_t *version,
+                                            uint64_t *analysis_version) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
+  // the versions are atomic, there is no need to hold m_chart_update
+  TRACE(chart_get_versions(cht, version, analysis_version));
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE security_get_hash(struct security *s, size_t *hash) {
   PTR_CHECK(s, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(hash, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -54,33 +99,81 @@ enum RISKI_ERROR_CODE security_hash(char *name, size_t *index) {
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE security_get_chart(struct security *sec, char **json) {
+enum RISKI_ERROR_CODE security_get_chart(struct security *sec,
+                                         uint64_t interval, char **json) {
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  pthread_mutex_lock(&(sec->m_chart_update));
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
+  // served from the cache of the chart, the feed is not held up while
+  // the chart is written out
   char *dat = NULL;
-  chart_json(sec->cht, &dat);
-  pthread_mutex_unlock(&(sec->m_chart_update));
+  TRACE(chart_json_cached(cht, &dat));
 
   *json = dat;
   return RISKI_ERROR_CODE_NONE;
 }
 
 enum RISKI_ERROR_CODE security_get_latest_candle(struct security *sec,
+                                                 uint64_t interval,
                                                  char **json) {
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
   pthread_mutex_lock(&(sec->m_chart_update));
 
   char *dat = NULL;
-  chart_latest_candle(sec->cht, &dat);
+  chart_latest_candle(cht, &dat);
   pthread_mutex_unlock(&(sec->m_chart_update));
   *json = dat;
   return RISKI_ERROR_CODE_NONE;
 }
 
+enum RISKI_ERROR_CODE security_get_chart_bin(struct security *sec,
+                                             uint64_t interval, char **bin,
+                                             size_t *len) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
+  char *dat = NULL;
+  size_t dat_len = 0;
+  TRACE(chart_bin_cached(cht, &dat, &dat_len));
+
+  *bin = dat;
+  *len = dat_len;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_get_latest_candle_bin(struct security *sec,
+                                                     uint64_t interval,
+                                                     char **bin, size_t *len) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(bin, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct chart *cht = NULL;
+  TRACE(security_chart(sec, interval, &cht));
+
+  pthread_mutex_lock(&(sec->m_chart_update));
+  char *dat = NULL;
+  size_t dat_len = 0;
+  chart_latest_candle_bin(cht, &dat, &dat_len);
+  pthread_mutex_unlock(&(sec->m_chart_update));
+
+  *bin = dat;
+  *len = dat_len;
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE security_cmp(char *n1, struct security *s, bool *res) {
   PTR_CHECK(n1, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(s, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -92,6 +185,53 @@ enum RISKI_ERROR_CODE security_cmp(char *n1, struct security *s, bool *res) {
 }
 
 // creates a new security
+enum RISKI_ERROR_CODE security_set_intervals(const char *list) {
+  PTR_CHECK(list, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  uint64_t intervals[CHART_STORE_MAX_CHARTS];
+  size_t num_intervals = 0;
+  const char *p = list;
+  while (*p) {
+    char *end = NULL;
+    uint64_t len = strtoull(p, &end, 10);
+    uint64_t unit = 0;
+    if (*end == 's')
+      unit = SECURITY_INTERVAL_5SECOND_NANOSECONDS / 5;
+    else if (*end == 'm')
+      unit = SECURITY_INTERVAL_5MINUTE_NANOSECONDS / 5;
+    else if (*end == 'h')
+      unit = SECURITY_INTERVAL_HOUR_NANOSECONDS;
+
+    if (end == p || unit == 0 || len == 0 ||
+        num_intervals == CHART_STORE_MAX_CHARTS ||
+        (num_intervals > 0 && (len * unit <= intervals[num_intervals - 1] ||
+                               len * unit % intervals[0] != 0))) {
+      TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                         FILENAME_SHORT, __LINE__,
+                         "%s is not a list of at most %d ascending intervals "
+                         "that are multiples of the first",
+                         list, CHART_STORE_MAX_CHARTS));
+      return RISKI_ERROR_CODE_INVALID_RANGE;
+    }
+    intervals[num_intervals++] = len * unit;
+
+    p = end + 1;
+    if (*p == ',')
+      ++p;
+    else if (*p) {
+      TRACE(logger_error(RISKI_ERROR_CODE_INVALID_RANGE, __func__,
+                         FILENAME_SHORT, __LINE__,
+                         "intervals in %s must be separated by a comma",
+                         list));
+      return RISKI_ERROR_CODE_INVALID_RANGE;
+    }
+  }
+
+  memcpy(SECURITY_INTERVALS, intervals, num_intervals * sizeof(uint64_t));
+  SECURITY_NUM_INTERVALS = num_intervals;
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE security_new(char *name, uint64_t interval, int precision,
                                    struct security **sec) {
   PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
@@ -109,9 +249,32 @@ enum RISKI_ERROR_CODE security_new(char *name, uint64_t interval, int precision,
 
   sec_->name = n;
   sec_->b = book_new();
-  TRACE(chart_new(interval, n, precision, &(sec_->cht)));
+
+  if (SECURITY_NUM_INTERVALS > 0) {
+    TRACE(chart_set_new(n, precision, SECURITY_INTERVALS,
+                        SECURITY_NUM_INTERVALS, &(sec_->charts)));
+  } else {
+    // the base interval and every default interval that is a larger
+    // multiple of it
+    uint64_t defaults[] = {SECURITY_INTERVAL_5MINUTE_NANOSECONDS,
+                           SECURITY_INTERVAL_HOUR_NANOSECONDS};
+    uint64_t intervals[1 + sizeof(defaults) / sizeof(defaults[0])];
+    size_t num_intervals = 0;
+    intervals[num_intervals++] = interval;
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+      if (interval != 0 && defaults[i] > interval &&
+          defaults[i] % interval == 0)
+        intervals[num_intervals++] = defaults[i];
+    }
+    TRACE(chart_set_new(n, precision, intervals, num_intervals,
+                        &(sec_->charts)));
+  }
+
   sec_->hash = hash((unsigned char *)n);
   pthread_mutex_init(&(sec_->m_chart_update), NULL);
+  pthread_mutex_init(&(sec_->m_book_update), NULL);
+  sec_->bid = -1;
+  sec_->ask = -1;
 
   *sec = sec_;
 
@@ -120,10 +283,147 @@ enum RISKI_ERROR_CODE security_new(char *name, uint64_t interval, int precision,
 
 // this is just an abstraction on the book update function
 enum RISKI_ERROR_CODE security_book_update(struct security *sec, bool side,
-                                           int64_t price, int64_t quantity) {
+                                           int64_t price, int64_t quantity,
+                                           uint64_t ts) {
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
+  // an empty side leaves the last quote of that side alone
+  int64_t bid = sec->bid;
+  int64_t ask = sec->ask;
+
+  pthread_mutex_lock(&(sec->m_book_update));
   book_update(side, sec->b, price, quantity);
+  book_best_bid(sec->b, &bid, NULL);
+  book_best_ask(sec->b, &ask, NULL);
+  pthread_mutex_unlock(&(sec->m_book_update));
+
+  // most updates are below the top of the book and leave the chart alone
+  if (bid == sec->bid && ask == sec->ask)
+    return RISKI_ERROR_CODE_NONE;
+
+  sec->bid = bid;
+  sec->ask = ask;
+
+  // -1 is not a price, the candles keep the trade price until both sides
+  // have been quoted
+  if (bid < 0 || ask < 0)
+    return RISKI_ERROR_CODE_NONE;
+
+  pthread_mutex_lock(&(sec->m_chart_update));
+  enum RISKI_ERROR_CODE err = chart_set_quote(sec->charts, bid, ask, ts);
+  pthread_mutex_unlock(&(sec->m_chart_update));
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+// appends [price,quantity] for every level
+static enum RISKI_ERROR_CODE depth_levels_json(struct string_builder *sb,
+                                               struct book_level *lvls,
+                                               size_t n) {
+  TRACE(string_builder_append_char(sb, '['));
+  for (size_t i = 0; i < n; ++i) {
+    if (i != 0)
+      TRACE(string_builder_append_char(sb, ','));
+
+    TRACE(string_builder_append_char(sb, '['));
+    TRACE(string_builder_append_i64(sb, lvls[i].price));
+    TRACE(string_builder_append_char(sb, ','));
+    TRACE(string_builder_append_i64(sb, lvls[i].quantity));
+    TRACE(string_builder_append_char(sb, ']'));
+  }
+  TRACE(string_builder_append_char(sb, ']'));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+// appends [side,price,quantity] for every change
+static enum RISKI_ERROR_CODE depth_changes_json(struct string_builder *sb,
+                                                struct book_change *changes,
+                                                size_t n) {
+  TRACE(string_builder_append_char(sb, '['));
+  for (size_t i = 0; i < n; ++i) {
+    if (i != 0)
+      TRACE(string_builder_append_char(sb, ','));
+
+    TRACE(string_builder_append(sb, changes[i].side ? "[1," : "[0,"));
+    TRACE(string_builder_append_i64(sb, changes[i].price));
+    TRACE(string_builder_append_char(sb, ','));
+    TRACE(string_builder_append_i64(sb, changes[i].quantity));
+    TRACE(string_builder_append_char(sb, ']'));
+  }
+  TRACE(string_builder_append_char(sb, ']'));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_get_depth(struct security *sec, size_t depth,
+                                         uint64_t seq, char **json,
+                                         uint64_t *next_seq) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(json, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  RANGE_CHECK((int)depth, 1, SECURITY_DEPTH_MAX_LEVELS,
+              RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+
+  /**
+   * {"depth":{"seq":N,"snapshot":true,"bids":[[p,q],..],"asks":[[p,q],..]}}
+   * {"depth":{"seq":N,"snapshot":false,"changes":[[side,p,q],..]}}
+   */
+
+  struct book_level bids[SECURITY_DEPTH_MAX_LEVELS];
+  struct book_level asks[SECURITY_DEPTH_MAX_LEVELS];
+  struct book_change changes[BOOK_CHANGE_LOG_SIZE];
+  size_t num_bids = 0;
+  size_t num_asks = 0;
+  size_t num_changes = 0;
+
+  // copy everything out under the lock and format after releasing it
+  pthread_mutex_lock(&(sec->m_book_update));
+  bool snapshot = seq == 0 || !book_changes_since(sec->b, seq, changes,
+                                                  BOOK_CHANGE_LOG_SIZE,
+                                                  &num_changes);
+  if (snapshot)
+    book_snapshot(sec->b, depth, bids, &num_bids, asks, &num_asks, &seq);
+  else if (num_changes != 0)
+    seq = changes[num_changes - 1].seq;
+  pthread_mutex_unlock(&(sec->m_book_update));
+
+  struct string_builder *sb = NULL;
+  TRACE(string_builder_new(&sb));
+
+  TRACE(string_builder_append(sb, "{\"depth\":{\"seq\":"));
+  TRACE(string_builder_append_u64(sb, seq));
+
+  if (snapshot) {
+    TRACE(string_builder_append(sb, ",\"snapshot\":true,\"bids\":"));
+    TRACE(depth_levels_json(sb, bids, num_bids));
+    TRACE(string_builder_append(sb, ",\"asks\":"));
+    TRACE(depth_levels_json(sb, asks, num_asks));
+  } else {
+    TRACE(string_builder_append(sb, ",\"snapshot\":false,\"changes\":"));
+    TRACE(depth_changes_json(sb, changes, num_changes));
+  }
+  TRACE(string_builder_append(sb, "}}"));
+
+  char *ret = NULL;
+  TRACE(string_builder_take(sb, &ret));
+  TRACE(string_builder_free(&sb));
+
+  *json = ret;
+  if (next_seq)
+    *next_seq = seq;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_get_depth_seq(struct security *sec,
+                                             uint64_t *seq) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(seq, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  pthread_mutex_lock(&(sec->m_book_update));
+  *seq = book_seq(sec->b);
+  pthread_mutex_unlock(&(sec->m_book_update));
+
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -134,18 +434,120 @@ enum RISKI_ERROR_CODE security_chart_update(struct security *sec, int64_t price,
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
   pthread_mutex_lock(&(sec->m_chart_update));
-  chart_update(sec->cht, price, bid, ask, ts);
+  chart_set_update(sec->charts, price, bid, ask, ts);
+  pthread_mutex_unlock(&(sec->m_chart_update));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_trade_update(struct security *sec,
+                                            int64_t price, uint64_t ts) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // a side that has never been quoted takes the trade price
+  int64_t bid = sec->bid < 0 ? price : sec->bid;
+  int64_t ask = sec->ask < 0 ? price : sec->ask;
+
+  pthread_mutex_lock(&(sec->m_chart_update));
+  enum RISKI_ERROR_CODE err = chart_set_update(sec->charts, price, bid, ask, ts);
+  pthread_mutex_unlock(&(sec->m_chart_update));
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_get_name(struct security *sec, char **name) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(name, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *name = sec->name;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_set_analysis(struct security *sec,
+                                            bool enabled) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(chart_set_set_analysis(sec->charts, enabled));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_set_retention(struct security *sec,
+                                             size_t max_candles) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  pthread_mutex_lock(&(sec->m_chart_update));
+  enum RISKI_ERROR_CODE err =
+      chart_set_set_retention(sec->charts, max_candles);
+  pthread_mutex_unlock(&(sec->m_chart_update));
+
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_open_store(struct security *sec,
+                                          const char *dir) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(dir, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t n = strlen(dir) + strlen(sec->name) + strlen(SECURITY_STORE_SUFFIX) +
+             2;
+  char *path = (char *)malloc(n * sizeof(char));
+  PTR_CHECK(path, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  snprintf(path, n, "%s/%s%s", dir, sec->name, SECURITY_STORE_SUFFIX);
+
+  // a name must not reach into another directory
+  for (char *c = path + strlen(dir) + 1; *c; ++c) {
+    if (*c == '/')
+      *c = '_';
+  }
+
+  pthread_mutex_lock(&(sec->m_chart_update));
+  enum RISKI_ERROR_CODE err = chart_set_open_store(sec->charts, path);
   pthread_mutex_unlock(&(sec->m_chart_update));
 
+  free(path);
+  TRACE(err);
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_flush_store(struct security *sec) {
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(chart_set_flush_store(sec->charts));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE security_merge(struct security *dst,
+                                     struct security *src) {
+  PTR_CHECK(dst, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(src, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  pthread_mutex_lock(&(dst->m_chart_update));
+  enum RISKI_ERROR_CODE err = chart_set_append(dst->charts, src->charts);
+  pthread_mutex_unlock(&(dst->m_chart_update));
+
+  // the newer book replaces the old one, src will free the old book
+  pthread_mutex_lock(&(dst->m_book_update));
+  struct book *b = dst->b;
+  dst->b = src->b;
+  src->b = b;
+  pthread_mutex_unlock(&(dst->m_book_update));
+  dst->bid = src->bid;
+  dst->ask = src->ask;
+
+  TRACE(err);
   return RISKI_ERROR_CODE_NONE;
 }
 
 enum RISKI_ERROR_CODE security_free(struct security **sec) {
   PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   book_free(&((*sec)->b));
-  TRACE(chart_free(&(*sec)->cht));
+  TRACE(chart_set_free(&(*sec)->charts));
   free((*sec)->name);
   (*sec)->name = NULL;
+  pthread_mutex_destroy(&(*sec)->m_chart_update);
+  pthread_mutex_destroy(&(*sec)->m_book_update);
   free(*sec);
   *sec = NULL;
 
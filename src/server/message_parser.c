@@ -1,92 +1,181 @@
 #include <server/message_parser.h>
 
+/*
+ * Chart intervals are sent in seconds, both feeds keep time in nanoseconds
+ */
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+/*
+ * Converts the optional interval token of a request into the interval of
+ * the chart, 0 for the default chart
+ */
+static uint64_t request_interval(char *interval) {
+  if (!interval)
+    return 0;
+  return strtoull(interval, NULL, 10) * NANOSECONDS_PER_SECOND;
+}
+
 static enum RISKI_ERROR_CODE
 extract_request_query(char *query, struct exchange **sec, char **security) {
   char *exchange = NULL;
   exchange = strtok(query, ":");
+  PTR_CHECK(exchange, RISKI_ERROR_CODE_INVALID_REQUEST, RISKI_ERROR_TEXT);
 
   if (strcmp(exchange, "IEX") == 0) {
     *sec = iex_exchange;
   } else if (strcmp(exchange, "OANDA") == 0) {
     *sec = exchange_oanda;
+  } else {
+    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_REQUEST, __func__,
+                       FILENAME_SHORT, __LINE__,
+                       "%s is not a known exchange", exchange));
+    return RISKI_ERROR_CODE_INVALID_REQUEST;
   }
+  // the exchange of a feed that is not running is NULL
+  PTR_CHECK(*sec, RISKI_ERROR_CODE_INVALID_REQUEST, RISKI_ERROR_TEXT);
 
   *security = strtok(NULL, ":");
+  PTR_CHECK(*security, RISKI_ERROR_CODE_INVALID_REQUEST, RISKI_ERROR_TEXT);
 
   return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE init_response(char *security, char **resp) {
-  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+/*
+ * Finds the security of a EXCHANGE:SYMBOL query
+ */
+static enum RISKI_ERROR_CODE request_security(char *query,
+                                              struct security **sec) {
+  PTR_CHECK(query, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
+  char *security = NULL;
   struct exchange *working_exchange = NULL;
-  TRACE(extract_request_query(security, &working_exchange, &security));
+  TRACE(extract_request_query(query, &working_exchange, &security));
 
-  struct security *sec = NULL;
-  TRACE(exchange_get(working_exchange, security, &sec));
+  struct security *found = NULL;
+  TRACE(exchange_get(working_exchange, security, &found));
 
-  if (!sec) {
+  if (!found) {
     TRACE(logger_error(RISKI_ERROR_CODE_INVALID_SYMBOL, __func__,
                        FILENAME_SHORT, __LINE__,
                        "%s is not a valid security traded on IEX", security));
     return RISKI_ERROR_CODE_UNKNOWN;
   }
+
+  *sec = found;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE init_response(char *security, uint64_t interval,
+                                           char **resp) {
+  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct security *sec = NULL;
+  TRACE(request_security(security, &sec));
+
   char *cht = NULL;
-  TRACE(security_get_chart(sec, &cht));
+  TRACE(security_get_chart(sec, interval, &cht));
   *resp = cht;
   return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE latest_response(char *security, char **resp) {
+static enum RISKI_ERROR_CODE latest_response(char *security, uint64_t interval,
+                                             char **resp) {
   PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  struct exchange *working_exchange = NULL;
-  TRACE(extract_request_query(security, &working_exchange, &security));
-
   struct security *sec = NULL;
-  TRACE(exchange_get(working_exchange, security, &sec));
-
-  if (!sec) {
-    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_SYMBOL, __func__,
-                       FILENAME_SHORT, __LINE__,
-                       "%s is not a valid security traded on IEX", security));
-    return RISKI_ERROR_CODE_UNKNOWN;
-  }
+  TRACE(request_security(security, &sec));
 
   char *cht = NULL;
 
-  TRACE(security_get_latest_candle(sec, &cht));
+  TRACE(security_get_latest_candle(sec, interval, &cht));
   *resp = cht;
 
   return RISKI_ERROR_CODE_NONE;
 }
 
-static enum RISKI_ERROR_CODE analysis_response(char *security, char **resp) {
+static enum RISKI_ERROR_CODE analysis_response(char *security,
+                                               uint64_t interval,
+                                               char **resp) {
   PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  struct exchange *working_exchange = NULL;
-  TRACE(extract_request_query(security, &working_exchange, &security));
-
   struct security *sec = NULL;
-  TRACE(exchange_get(working_exchange, security, &sec));
-
-  if (!sec) {
-    TRACE(logger_error(RISKI_ERROR_CODE_INVALID_SYMBOL, __func__,
-                       FILENAME_SHORT, __LINE__,
-                       "%s is not a valid security traded on IEX", security));
-    return RISKI_ERROR_CODE_UNKNOWN;
-  }
+  TRACE(request_security(security, &sec));
 
   char *analysis_json = NULL;
-  TRACE(security_get_analysis(sec, &analysis_json));
+  TRACE(security_get_analysis(sec, interval, &analysis_json));
 
   *resp = analysis_json;
   return RISKI_ERROR_CODE_NONE;
 }
 
+static enum RISKI_ERROR_CODE depth_response(char *security, char *seq,
+                                            char **resp) {
+  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // no seq means the client has no book yet
+  uint64_t last_seq = 0;
+  if (seq)
+    last_seq = strtoull(seq, NULL, 10);
+
+  struct security *sec = NULL;
+  TRACE(request_security(security, &sec));
+
+  char *depth_json = NULL;
+  TRACE(security_get_depth(sec, SECURITY_DEPTH_LEVELS, last_seq, &depth_json,
+                           NULL));
+
+  *resp = depth_json;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE init_response_bin(char *security,
+                                               uint64_t interval, char **resp,
+                                               size_t *resp_len) {
+  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct security *sec = NULL;
+  TRACE(request_security(security, &sec));
+
+  TRACE(security_get_chart_bin(sec, interval, resp, resp_len));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE latest_response_bin(char *security,
+                                                 uint64_t interval,
+                                                 char **resp,
+                                                 size_t *resp_len) {
+  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct security *sec = NULL;
+  TRACE(request_security(security, &sec));
+
+  TRACE(security_get_latest_candle_bin(sec, interval, resp, resp_len));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+static enum RISKI_ERROR_CODE subscribe_response(char *security,
+                                                uint64_t interval,
+                                                struct subscription_set *subs,
+                                                bool subscribe, bool depth) {
+  PTR_CHECK(security, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(subs, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  struct security *sec = NULL;
+  TRACE(request_security(security, &sec));
+
+  if (subscribe)
+    TRACE(subscription_add(subs, sec, interval, depth));
+  else
+    TRACE(subscription_remove(subs, sec, interval, depth));
+  return RISKI_ERROR_CODE_NONE;
+}
+
 static enum RISKI_ERROR_CODE search_response(char *query, char **resp) {
   char *dat = NULL;
   TRACE(search_search(query, &dat));
@@ -96,9 +185,13 @@ static enum RISKI_ERROR_CODE search_response(char *query, char **resp) {
   return RISKI_ERROR_CODE_NONE;
 }
 
-enum RISKI_ERROR_CODE parse_message(char *msg, size_t len, char **resp) {
-  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+enum RISKI_ERROR_CODE parse_message(char *msg, size_t len,
+                                    struct subscription_set *subs,
+                                    char **resp) {
   PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *resp = NULL;
 
   // there is some garbage after msg from the websocket
   // so we cut it off in a new array
@@ -114,29 +207,123 @@ enum RISKI_ERROR_CODE parse_message(char *msg, size_t len, char **resp) {
 
   // log_debug("received event type: %s", tokened);
 
+  // an empty frame has no type and no response
+  if (!tokened) {
+    free(sanitized_msg);
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  // the tokens point into sanitized_msg, it is freed once the request is
+  // answered, failed or not
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
   char *response = NULL;
   if (strcmp("init", tokened) == 0) {
     tokened = strtok(NULL, "|");
 
-    TRACE(init_response(tokened, &response));
-    free(sanitized_msg);
+    // read the interval before extract_request_query restarts strtok
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    err = init_response(tokened, interval, &response);
   } else if (strcmp("latest", tokened) == 0) {
     tokened = strtok(NULL, "|");
 
-    TRACE(latest_response(tokened, &response));
-    free(sanitized_msg);
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    err = latest_response(tokened, interval, &response);
   } else if (strcmp("analysis", tokened) == 0) {
     tokened = strtok(NULL, "|");
 
-    TRACE(analysis_response(tokened, &response));
-    free(sanitized_msg);
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    err = analysis_response(tokened, interval, &response);
+  } else if (strcmp("depth", tokened) == 0) {
+    tokened = strtok(NULL, "|");
+
+    // read the seq before extract_request_query restarts strtok
+    char *seq = strtok(NULL, "|");
+
+    err = depth_response(tokened, seq, &response);
+  } else if (strcmp("subscribe", tokened) == 0 ||
+             strcmp("unsubscribe", tokened) == 0) {
+    bool subscribe = tokened[0] == 's';
+    tokened = strtok(NULL, "|");
+
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    // changes are pushed later, there is no response
+    err = subscribe_response(tokened, interval, subs, subscribe, false);
+  } else if (strcmp("subscribe_depth", tokened) == 0 ||
+             strcmp("unsubscribe_depth", tokened) == 0) {
+    bool subscribe = tokened[0] == 's';
+    tokened = strtok(NULL, "|");
+
+    // a snapshot and then the changes are pushed later
+    err = subscribe_response(tokened, 0, subs, subscribe, true);
   } else if (strcmp("search", tokened) == 0) {
     tokened = strtok(NULL, "|");
 
-    TRACE(search_response(tokened, &response));
+    err = search_response(tokened, &response);
+  }
+  free(sanitized_msg);
+  TRACE(err);
+
+  *resp = response;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE parse_message_bin(char *msg, size_t len,
+                                        struct subscription_set *subs,
+                                        char **resp, size_t *resp_len,
+                                        bool *binary) {
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(resp_len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(binary, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *resp = NULL;
+  *resp_len = 0;
+  *binary = false;
+
+  char *sanitized_msg = (char *)malloc((len + 1) * sizeof(char));
+  PTR_CHECK(sanitized_msg, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  strncpy(sanitized_msg, msg, len);
+  sanitized_msg[len] = '\x0';
+
+  char *tokened = NULL;
+  tokened = strtok(sanitized_msg, "|");
+
+  enum RISKI_ERROR_CODE err = RISKI_ERROR_CODE_NONE;
+  char *response = NULL;
+  size_t response_len = 0;
+  if (tokened && strcmp("init", tokened) == 0) {
+    tokened = strtok(NULL, "|");
+
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    err = init_response_bin(tokened, interval, &response, &response_len);
+    free(sanitized_msg);
+    TRACE(err);
+    *binary = true;
+  } else if (tokened && strcmp("latest", tokened) == 0) {
+    tokened = strtok(NULL, "|");
+
+    uint64_t interval = request_interval(strtok(NULL, "|"));
+
+    err = latest_response_bin(tokened, interval, &response, &response_len);
+    free(sanitized_msg);
+    TRACE(err);
+    *binary = true;
+  } else {
+    // everything else has no binary form and is answered with json
     free(sanitized_msg);
+    TRACE(parse_message(msg, len, subs, &response));
+    if (response)
+      response_len = strlen(response);
+    *binary = false;
   }
 
   *resp = response;
+  *resp_len = response_len;
   return RISKI_ERROR_CODE_NONE;
 }
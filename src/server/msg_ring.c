@@ -0,0 +1,83 @@
+#include <server/msg_ring.h>
+
+enum RISKI_ERROR_CODE msg_new(const char *data, size_t len, bool binary,
+                              struct msg **msg) {
+  PTR_CHECK(data, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // one allocation holds the message, the space lws_write needs and the
+  // payload
+  struct msg *m = malloc(sizeof(struct msg) + LWS_PRE + len);
+  PTR_CHECK(m, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  m->payload = (unsigned char *)(m + 1) + LWS_PRE;
+  m->len = len;
+  m->refs = 1;
+  m->binary = binary;
+  memcpy(m->payload, data, len);
+
+  *msg = m;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_ref(struct msg *msg) {
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  ++msg->refs;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_unref(struct msg **msg) {
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(*msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (--(*msg)->refs == 0)
+    free(*msg);
+  *msg = NULL;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_ring_push(struct msg_ring *ring, struct msg *msg,
+                                    enum MSG_RING_POLICY policy) {
+  PTR_CHECK(ring, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (msg_ring_full(ring)) {
+    COMPARISON_CHECK(policy, MSG_RING_DROP_OLDEST, ==,
+                     RISKI_ERROR_CODE_INSUFFITIENT_SPACE, RISKI_ERROR_TEXT);
+    TRACE(msg_ring_pop(ring));
+    ++ring->dropped;
+  }
+
+  TRACE(msg_ref(msg));
+  ring->msgs[(ring->head + ring->count) % MSG_RING_LEN] = msg;
+  ++ring->count;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_ring_peek(struct msg_ring *ring, struct msg **msg) {
+  PTR_CHECK(ring, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *msg = ring->count ? ring->msgs[ring->head] : NULL;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_ring_pop(struct msg_ring *ring) {
+  PTR_CHECK(ring, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  COMPARISON_CHECK(ring->count, 0, >, RISKI_ERROR_CODE_INVALID_RANGE,
+                   RISKI_ERROR_TEXT);
+
+  TRACE(msg_unref(&ring->msgs[ring->head]));
+  ring->head = (ring->head + 1) % MSG_RING_LEN;
+  --ring->count;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE msg_ring_clear(struct msg_ring *ring) {
+  PTR_CHECK(ring, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  while (ring->count > 0)
+    TRACE(msg_ring_pop(ring));
+  ring->head = 0;
+  return RISKI_ERROR_CODE_NONE;
+}
@@ -0,0 +1,24 @@
+/*
+ * ws protocol handler for "riski-bin"
+ *
+ * Clients send the same text requests as with "lws-minimal". Charts and
+ * latest candles are answered with the binary frames of chart_bin and
+ * chart_latest_candle_bin, everything else with json text. The sessions
+ * are the ones of "lws-minimal", callback_minimal tells the two protocols
+ * apart by their id.
+ */
+
+#if !defined(LWS_PLUGIN_STATIC)
+#define LWS_DLL
+#define LWS_INTERNAL
+#include <libwebsockets.h>
+#endif
+
+/* the id of "riski-bin", "lws-minimal" has 0 */
+#define PROTOCOL_BIN_ID 1
+
+#define LWS_PLUGIN_PROTOCOL_BIN                                                \
+  {                                                                            \
+    "riski-bin", callback_minimal, sizeof(struct per_session_data__minimal),   \
+        128, PROTOCOL_BIN_ID, NULL, 0                                          \
+  }
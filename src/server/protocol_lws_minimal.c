@@ -6,9 +6,8 @@
  * This file is made available under the Creative Commons CC0 1.0
  * Universal Public Domain Dedication.
  *
- * This version holds a single message at a time, which may be lost if a new
- * message comes.  See the minimal-ws-server-ring sample for the same thing
- * but using an lws_ring ringbuffer to hold up to 8 messages at a time.
+ * Each session queues up to MSG_RING_LEN messages, a client sending more
+ * requests than that is not read from until the queue drains.
  */
 
 #if !defined(LWS_PLUGIN_STATIC)
@@ -17,23 +16,22 @@
 #include <libwebsockets.h>
 #endif
 
+#include <stdbool.h>
 #include <string.h>
 
-/* one of these created for each message */
-
-struct msg {
-  void *payload; /* is malloc'd */
-  size_t len;
-};
-
 /* one of these is created for each client connecting to us */
 
 struct per_session_data__minimal {
   struct per_session_data__minimal *pss_list;
   struct lws *wsi;
-  int last; /* the last message number we sent */
-  int current;
-  struct msg amsg;
+  struct msg_ring ring;         /* the messages waiting to be sent */
+  struct subscription_set subs; /* the charts pushed to this client */
+  bool push_due;                /* a round of pushes is still being sent */
+  bool push_timer;              /* the push timer is armed */
+  bool rx_paused;               /* not read from until the ring drains */
+
+  /* There are 5 unused bytes in this struct */
+  char _p1[5];
 };
 
 /* one of these is created for each vhost our protocol is used with */
@@ -44,11 +42,7 @@ struct per_vhost_data__minimal {
 
   struct per_session_data__minimal *pss_list; /* linked-list of live pss*/
 
-  struct msg amsg; /* the one pending message... */
-  int current;     /* the current message number we are caching */
-
-  /* There are 4 unused bytes in this struct */
-  char _p1[4];
+  struct subscription_cache pushes; /* pushes shared between the pss */
 };
 
 /* destroys the message when everyone has had a copy of it */
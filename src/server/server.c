@@ -3,6 +3,8 @@
 #define LWS_PLUGIN_STATIC
 #include "protocol_lws_minimal.c"
 
+#include "protocol_bin.c"
+
 int SERVER_INTERRUPTED = 0;
 
 static int callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
@@ -14,6 +16,7 @@ static int callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
 static struct lws_protocols protocols[] = {
     {"http", lws_callback_http_dummy, 0, 0},
     LWS_PLUGIN_PROTOCOL_MINIMAL,
+    LWS_PLUGIN_PROTOCOL_BIN,
     {NULL, NULL, 0, 0} /* terminator */
 };
 
@@ -72,6 +75,10 @@ static int callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
   struct per_vhost_data__minimal *vhd =
       (struct per_vhost_data__minimal *)lws_protocol_vh_priv_get(
           lws_get_vhost(wsi), lws_get_protocol(wsi));
+  struct msg *msg = NULL;
+  char *response = NULL;
+  size_t response_len = 0;
+  bool binary = false;
   int m;
 
 #pragma clang diagnostic push
@@ -85,83 +92,110 @@ static int callback_minimal(struct lws *wsi, enum lws_callback_reasons reason,
     vhd->vhost = lws_get_vhost(wsi);
     break;
 
+  case LWS_CALLBACK_PROTOCOL_DESTROY:
+    if (vhd)
+      subscription_cache_clear(&vhd->pushes);
+    break;
+
   case LWS_CALLBACK_ESTABLISHED:
     /* add ourselves to the list of live pss held in the vhd */
     lws_ll_fwd_insert(pss, pss_list, vhd->pss_list) pss->wsi = wsi;
-    pss->last = vhd->current;
-    pss->current = pss->last;
     break;
 
   case LWS_CALLBACK_CLOSED:
     /* remove our closing pss from the list of live pss */
-    if (pss->amsg.payload) {
-      struct msg *msg = &pss->amsg;
-      free(msg->payload);
-      msg->payload = NULL;
-      msg->len = 0;
-    }
+    msg_ring_clear(&pss->ring);
 
     lws_ll_fwd_remove(struct per_session_data__minimal, pss_list, pss,
                       vhd->pss_list) break;
 
   case LWS_CALLBACK_SERVER_WRITEABLE:
 
-    if (!pss->amsg.payload)
-      break;
-
-    if (pss->last == pss->current)
+    /* replies go out before any push, a push is only built once the ring
+     * is empty so a slow client is sent fewer and newer pushes */
+    msg_ring_peek(&pss->ring, &msg);
+    if (!msg && pss->push_due) {
+      subscription_next(&pss->subs, &vhd->pushes,
+                        vhd->protocol->id == PROTOCOL_BIN_ID, &msg);
+      if (!msg) {
+        pss->push_due = false;
+        break;
+      }
+      msg_ring_push(&pss->ring, msg, MSG_RING_BACKPRESSURE);
+      msg_unref(&msg);
+      msg_ring_peek(&pss->ring, &msg);
+    }
+    if (!msg)
       break;
 
-    /* notice we allowed for LWS_PRE in the payload already */
-    m = lws_write(pss->wsi, ((unsigned char *)pss->amsg.payload) + LWS_PRE,
-                  pss->amsg.len, LWS_WRITE_TEXT);
-    if (m < (int)vhd->amsg.len) {
+    /* lws_write puts the frame header in the LWS_PRE bytes in front of
+     * the payload, it is the same for every session a message is shared
+     * with */
+    m = lws_write(pss->wsi, msg->payload, msg->len,
+                  msg->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+    if (m < (int)msg->len) {
       lwsl_err("ERROR %d writing to ws\n", m);
       return -1;
     }
+    msg_ring_pop(&pss->ring);
 
-    free(pss->amsg.payload);
-    pss->amsg.payload = NULL;
-    pss->amsg.len = 0;
+    if (pss->rx_paused && !msg_ring_full(&pss->ring)) {
+      pss->rx_paused = false;
+      lws_rx_flow_control(pss->wsi, 1);
+    }
 
-    pss->current = pss->last;
+    /* only one write is allowed per callback */
+    if (pss->ring.count > 0 || pss->push_due)
+      lws_callback_on_writable(pss->wsi);
     break;
 
-  case LWS_CALLBACK_RECEIVE:
-    if (vhd->amsg.payload) {
-      struct msg *msg = &vhd->amsg;
-      free(msg->payload);
-      msg->payload = NULL;
-      msg->len = 0;
+  case LWS_CALLBACK_TIMER:
+    if (pss->subs.num_subs == 0) {
+      pss->push_timer = false;
+      break;
     }
 
-    if (pss->amsg.payload) {
-      struct msg *msg = &pss->amsg;
-      free(msg->payload);
-      msg->payload = NULL;
-      msg->len = 0;
+    subscription_round(&pss->subs);
+    pss->push_due = true;
+    lws_callback_on_writable(pss->wsi);
+    lws_set_timer_usecs(wsi, SERVER_PUSH_INTERVAL_US);
+    break;
+
+  case LWS_CALLBACK_RECEIVE:
+    if (vhd->protocol->id == PROTOCOL_BIN_ID) {
+      parse_message_bin(in, len, &pss->subs, &response, &response_len,
+                        &binary);
+    } else {
+      parse_message(in, len, &pss->subs, &response);
+      if (response)
+        response_len = strlen(response);
     }
 
-    char *response = NULL;
-    parse_message(in, len, &response);
+    /* the timer stops itself once there is nothing left to push */
+    if (pss->subs.num_subs > 0 && !pss->push_timer) {
+      pss->push_timer = true;
+      lws_set_timer_usecs(wsi, SERVER_PUSH_INTERVAL_US);
+    }
     if (!response)
       break;
-    size_t response_len = strlen(response);
 
-    pss->amsg.len = response_len;
-    /* notice we over-allocate by LWS_PRE */
-    pss->amsg.payload = malloc(LWS_PRE + response_len);
-    if (!pss->amsg.payload) {
+    if (msg_new(response, response_len, binary, &msg) !=
+        RISKI_ERROR_CODE_NONE) {
       lwsl_user("OOM: dropping\n");
+      free(response);
       break;
     }
-
-    memcpy((char *)pss->amsg.payload + LWS_PRE, response, response_len);
-    pss->last++;
-    vhd->current++;
-
     free(response);
 
+    /* reading stops before the ring is full, so the oldest reply is only
+     * dropped if lws hands over a request it had already read */
+    msg_ring_push(&pss->ring, msg, MSG_RING_DROP_OLDEST);
+    msg_unref(&msg);
+    if (msg_ring_full(&pss->ring) && !pss->rx_paused) {
+      pss->rx_paused = true;
+      lws_rx_flow_control(pss->wsi, 0);
+    }
+
     lws_callback_on_writable(pss->wsi);
     break;
   default:
@@ -0,0 +1,217 @@
+#include <server/subscription.h>
+
+/*
+ * The index of the subscription to sec and interval, or to the order book
+ * of sec, num_subs if there is none
+ */
+static size_t subscription_find(struct subscription_set *set,
+                                struct security *sec, uint64_t interval,
+                                bool depth) {
+  for (size_t i = 0; i < set->num_subs; ++i) {
+    if (set->subs[i].sec == sec && set->subs[i].depth == depth &&
+        (depth || set->subs[i].interval == interval))
+      return i;
+  }
+  return set->num_subs;
+}
+
+enum RISKI_ERROR_CODE subscription_add(struct subscription_set *set,
+                                       struct security *sec,
+                                       uint64_t interval, bool depth) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(sec, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  if (subscription_find(set, sec, interval, depth) != set->num_subs)
+    return RISKI_ERROR_CODE_NONE;
+
+  RANGE_CHECK(set->num_subs, 0, SUBSCRIPTION_MAX,
+              RISKI_ERROR_CODE_INVALID_RANGE, RISKI_ERROR_TEXT);
+
+  // makes sure the chart exists, the versions of a chart only start at 0
+  // so nothing is pushed until it is first updated
+  if (!depth) {
+    uint64_t version = 0;
+    uint64_t analysis_version = 0;
+    TRACE(security_get_versions(sec, interval, &version, &analysis_version));
+  }
+
+  struct subscription *sub = &set->subs[set->num_subs++];
+  sub->sec = sec;
+  sub->interval = depth ? 0 : interval;
+  sub->version = 0;
+  sub->analysis_version = 0;
+  sub->depth_seq = 0;
+  sub->depth = depth;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE subscription_remove(struct subscription_set *set,
+                                          struct security *sec,
+                                          uint64_t interval, bool depth) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  size_t i = subscription_find(set, sec, interval, depth);
+  if (i == set->num_subs)
+    return RISKI_ERROR_CODE_NONE;
+
+  // the last subscription takes the place of the removed one, the round
+  // may miss it this time around and picks it up in the next
+  set->subs[i] = set->subs[--set->num_subs];
+  if (i == set->next)
+    set->candle_sent = false;
+  if (set->next >= set->num_subs)
+    set->next = 0;
+  if (set->left > set->num_subs)
+    set->left = set->num_subs;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE subscription_round(struct subscription_set *set) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  set->left = set->num_subs;
+  set->candle_sent = false;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Takes a reference to the push of a chart from the cache, building it if
+ * the cache has no push of that version
+ */
+static enum RISKI_ERROR_CODE
+subscription_push(struct subscription_cache *cache, struct subscription *sub,
+                  bool analysis, uint64_t version, bool binary,
+                  struct msg **msg) {
+  size_t slot = ((uintptr_t)sub->sec / sizeof(void *) ^ sub->interval ^
+                 (uint64_t)analysis) %
+                SUBSCRIPTION_CACHE_LEN;
+  struct subscription_cached *cached = &cache->entries[slot];
+
+  if (cached->msg && cached->sec == sub->sec &&
+      cached->interval == sub->interval && cached->analysis == analysis &&
+      cached->version == version) {
+    TRACE(msg_ref(cached->msg));
+    *msg = cached->msg;
+    return RISKI_ERROR_CODE_NONE;
+  }
+
+  char *data = NULL;
+  size_t len = 0;
+  bool is_binary = false;
+  if (analysis) {
+    TRACE(security_get_analysis(sub->sec, sub->interval, &data));
+  } else if (binary) {
+    TRACE(security_get_latest_candle_bin(sub->sec, sub->interval, &data,
+                                         &len));
+    is_binary = true;
+  } else {
+    TRACE(security_get_latest_candle(sub->sec, sub->interval, &data));
+  }
+  if (!data)
+    return RISKI_ERROR_CODE_NONE;
+  if (!is_binary)
+    len = strlen(data);
+
+  enum RISKI_ERROR_CODE status = msg_new(data, len, is_binary, msg);
+  free(data);
+  TRACE(status);
+
+  if (cached->msg)
+    TRACE(msg_unref(&cached->msg));
+  cached->sec = sub->sec;
+  cached->interval = sub->interval;
+  cached->version = version;
+  cached->analysis = analysis;
+  cached->msg = *msg;
+  TRACE(msg_ref(cached->msg));
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+/*
+ * Builds the depth push of an order book subscription, the changes since
+ * the seq last pushed or a snapshot if they are no longer kept
+ */
+static enum RISKI_ERROR_CODE subscription_push_depth(struct subscription *sub,
+                                                     struct msg **msg) {
+  char *data = NULL;
+  uint64_t seq = 0;
+  TRACE(security_get_depth(sub->sec, SECURITY_DEPTH_LEVELS, sub->depth_seq,
+                           &data, &seq));
+
+  enum RISKI_ERROR_CODE status = msg_new(data, strlen(data), false, msg);
+  free(data);
+  TRACE(status);
+
+  sub->depth_seq = seq;
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE subscription_next(struct subscription_set *set,
+                                        struct subscription_cache *cache,
+                                        bool binary, struct msg **msg) {
+  PTR_CHECK(set, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(cache, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(msg, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *msg = NULL;
+
+  while (set->left > 0) {
+    struct subscription *sub = &set->subs[set->next];
+
+    // an order book is pushed at most once a round like a chart
+    if (sub->depth) {
+      set->candle_sent = false;
+      set->next = (set->next + 1) % set->num_subs;
+      --set->left;
+
+      uint64_t seq = 0;
+      TRACE(security_get_depth_seq(sub->sec, &seq));
+      if (seq != sub->depth_seq) {
+        TRACE(subscription_push_depth(sub, msg));
+        return RISKI_ERROR_CODE_NONE;
+      }
+      continue;
+    }
+
+    uint64_t version = 0;
+    uint64_t analysis_version = 0;
+    TRACE(security_get_versions(sub->sec, sub->interval, &version,
+                                &analysis_version));
+
+    // the candle goes first, the analysis of a subscription is sent on
+    // the next call without looking at the candle again
+    if (!set->candle_sent && version != sub->version) {
+      TRACE(subscription_push(cache, sub, false, version, binary, msg));
+      sub->version = version;
+      set->candle_sent = true;
+      return RISKI_ERROR_CODE_NONE;
+    }
+
+    set->candle_sent = false;
+    set->next = (set->next + 1) % set->num_subs;
+    --set->left;
+
+    if (analysis_version != sub->analysis_version) {
+      TRACE(subscription_push(cache, sub, true, analysis_version, binary,
+                              msg));
+      sub->analysis_version = analysis_version;
+      return RISKI_ERROR_CODE_NONE;
+    }
+  }
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE
+subscription_cache_clear(struct subscription_cache *cache) {
+  PTR_CHECK(cache, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  for (size_t i = 0; i < SUBSCRIPTION_CACHE_LEN; ++i) {
+    if (cache->entries[i].msg)
+      TRACE(msg_unref(&cache->entries[i].msg));
+  }
+  return RISKI_ERROR_CODE_NONE;
+}
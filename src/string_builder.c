@@ -1,5 +1,8 @@
 #include <string_builder.h>
 
+// The size of the first buffer of a string builder
+#define STRING_BUILDER_MIN_SIZE 64
+
 struct string_builder {
   // The allocated size of the buffer "c"
   size_t allocated_size;
@@ -7,15 +10,42 @@ struct string_builder {
   // The length of the current string
   size_t len;
 
-  // The character buffer
+  // The character buffer, always NULL terminated once allocated
   char *c;
 };
 
+/*
+ * Makes sure there is room for n more characters and the terminator,
+ * the buffer doubles in size so appending is amortised O(1)
+ */
+static enum RISKI_ERROR_CODE string_builder_reserve(struct string_builder *sb,
+                                                    size_t n) {
+  if (sb->len + n + 1 <= sb->allocated_size)
+    return RISKI_ERROR_CODE_NONE;
+
+  size_t allocated_size = sb->allocated_size == 0 ? STRING_BUILDER_MIN_SIZE
+                                                  : sb->allocated_size;
+  while (allocated_size < sb->len + n + 1)
+    allocated_size *= 2;
+
+  char *c = (char *)realloc(sb->c, allocated_size * sizeof(char));
+  PTR_CHECK(c, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  if (sb->c == NULL)
+    c[0] = '\0';
+
+  sb->c = c;
+  sb->allocated_size = allocated_size;
+  return RISKI_ERROR_CODE_NONE;
+}
+
 enum RISKI_ERROR_CODE string_builder_new(struct string_builder **sb) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
   struct string_builder *sb_ =
       (struct string_builder *)malloc(1 * sizeof(struct string_builder));
 
-  PTR_CHECK(sb, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+  PTR_CHECK(sb_, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
 
   sb_->allocated_size = 0;
   sb_->len = 0;
@@ -28,19 +58,65 @@ enum RISKI_ERROR_CODE string_builder_new(struct string_builder **sb) {
 
 enum RISKI_ERROR_CODE string_builder_append(struct string_builder *sb,
                                             char *c) {
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  TRACE(string_builder_append_n(sb, c, strlen(c)));
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_append_n(struct string_builder *sb,
+                                              const char *c, size_t n) {
   // Make sure sb is a valid pointer
   PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
   PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
-  // Reallocate if needed
-  if (sb->allocated_size == 0) {
-    sb->allocated_size = strlen(c) + 1;
-    sb->c = strdup(c);
-    return RISKI_ERROR_CODE_NONE;
-  }
-  sb->allocated_size += strlen(c) + 2;
-  sb->c = (char *)realloc(sb->c, sb->allocated_size * sizeof(char));
-  PTR_CHECK(sb->c, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
-  strcat(sb->c, c);
+
+  TRACE(string_builder_reserve(sb, n));
+  memcpy(sb->c + sb->len, c, n);
+  sb->len += n;
+  sb->c[sb->len] = '\0';
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_append_char(struct string_builder *sb,
+                                                 char c) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(string_builder_reserve(sb, 1));
+  sb->c[sb->len++] = c;
+  sb->c[sb->len] = '\0';
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_append_i64(struct string_builder *sb,
+                                                int64_t v) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(string_builder_reserve(sb, NUMBER_FORMAT_MAX_LEN));
+  sb->len += number_format_i64(v, sb->c + sb->len);
+  sb->c[sb->len] = '\0';
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_append_u64(struct string_builder *sb,
+                                                uint64_t v) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  TRACE(string_builder_reserve(sb, NUMBER_FORMAT_MAX_LEN));
+  sb->len += number_format_u64(v, sb->c + sb->len);
+  sb->c[sb->len] = '\0';
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_len(struct string_builder *sb,
+                                         size_t *len) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(len, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  *len = sb->len;
+
   return RISKI_ERROR_CODE_NONE;
 }
 
@@ -51,7 +127,31 @@ enum RISKI_ERROR_CODE string_builder_str(struct string_builder *sb, char **c) {
   // Make sure c is a valid pointer
   PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
 
-  *c = strdup(sb->c);
+  char *str = (char *)malloc((sb->len + 1) * sizeof(char));
+  PTR_CHECK(str, RISKI_ERROR_CODE_MALLOC_ERROR, RISKI_ERROR_TEXT);
+
+  if (sb->len)
+    memcpy(str, sb->c, sb->len);
+  str[sb->len] = '\0';
+
+  *c = str;
+
+  return RISKI_ERROR_CODE_NONE;
+}
+
+enum RISKI_ERROR_CODE string_builder_take(struct string_builder *sb,
+                                          char **c) {
+  PTR_CHECK(sb, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+  PTR_CHECK(c, RISKI_ERROR_CODE_NULL_PTR, RISKI_ERROR_TEXT);
+
+  // an empty builder still hands over an empty string
+  TRACE(string_builder_reserve(sb, 0));
+
+  *c = sb->c;
+
+  sb->allocated_size = 0;
+  sb->len = 0;
+  sb->c = NULL;
 
   return RISKI_ERROR_CODE_NONE;
 }
@@ -67,3 +167,5 @@ enum RISKI_ERROR_CODE string_builder_free(struct string_builder **sb) {
 
   return RISKI_ERROR_CODE_NONE;
 }
+
+#undef STRING_BUILDER_MIN_SIZE
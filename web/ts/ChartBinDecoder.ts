@@ -0,0 +1,129 @@
+/**
+  The kinds of binary frames the server sends
+ */
+enum CHART_BIN_FRAME {// eslint-disable-line no-unused-vars
+  CHART = 1, // eslint-disable-line no-unused-vars
+  LATEST_CANDLE = 2// eslint-disable-line no-unused-vars
+}
+
+/**
+  Reads the binary frames of the riski-bin protocol into the same objects
+  the json of lws-minimal is parsed into. A frame is a 24 byte little
+  endian header followed by the candles, each candle is nine varints that
+  hold the difference of a field to a field it is usually close to.
+ */
+class ChartBinDecoder { // eslint-disable-line no-unused-vars
+  /**
+    The version of the frames this decoder reads
+   */
+  public static readonly VERSION: number = 1;
+
+  /**
+    The length of the header of a frame
+   */
+  private static readonly HEADER_LEN: number = 24;
+
+  private view: DataView;
+  private bytes: Uint8Array;
+
+  /**
+    The offset of the next byte to read
+   */
+  private pos: number = 0;
+
+  /**
+    @param {ArrayBuffer} buffer The frame
+   */
+  constructor(buffer: ArrayBuffer) {
+    this.view = new DataView(buffer);
+    this.bytes = new Uint8Array(buffer);
+  }
+
+  /**
+    Decodes the frame
+    @return {IChart | ILatestCandle | null} The chart or latest candle in
+      the frame, null if the frame has a version this decoder can't read
+   */
+  public decode(): IChart | ILatestCandle | null {
+    if (this.bytes.length < ChartBinDecoder.HEADER_LEN ||
+        this.view.getUint8(0) != ChartBinDecoder.VERSION) {
+      return null;
+    }
+
+    const type: number = this.view.getUint8(1);
+    const precision: number = this.view.getUint16(2, true);
+    const count: number = this.view.getUint32(4, true);
+    const interval: number = this.getUint64(8);
+    const start: number = this.getUint64(16);
+    this.pos = ChartBinDecoder.HEADER_LEN;
+
+    // times are nanoseconds, past 2^53 a number can't hold every one so
+    // they are added up relative to the start and only made absolute at
+    // the end, the same rounding as parsing them from json
+    let close: number = 0;
+    let relStart: number = -interval;
+
+    const candles: ICandle[] = [];
+    for (let i = 0; i < count; ++i) {
+      const o: number = close + this.readSigned();
+      const h: number = o + this.readSigned();
+      const l: number = o + this.readSigned();
+      const c: number = o + this.readSigned();
+      relStart += interval + this.readSigned();
+      const relEnd: number = relStart + this.readSigned();
+      const v: number = this.readVarint();
+      const b: number = c + this.readSigned();
+      const a: number = c + this.readSigned();
+
+      candles.push({candle: {
+        o: o, h: h, l: l, c: c,
+        s: start + relStart, e: start + relEnd,
+        v: v, b: b, a: a,
+      }});
+      close = c;
+    }
+
+    if (type == CHART_BIN_FRAME.CHART) {
+      return {chart: {precision: precision, candles: candles}};
+    } else if (type == CHART_BIN_FRAME.LATEST_CANDLE && count == 1) {
+      return {latestCandle: candles[0]};
+    }
+    return null;
+  }
+
+  /**
+    Reads a little endian 64 bit number, rounded past 2^53
+    @param {number} offset The offset of the number
+    @return {number} The number
+   */
+  private getUint64(offset: number): number {
+    return this.view.getUint32(offset + 4, true) * 4294967296 +
+        this.view.getUint32(offset, true);
+  }
+
+  /**
+    Reads a varint, the low 7 bits of each byte are the next 7 bits of the
+    number and the high bit is set on every byte but the last
+    @return {number} The number
+   */
+  private readVarint(): number {
+    let value: number = 0;
+    let scale: number = 1;
+    let byte: number = 0;
+    do {
+      byte = this.bytes[this.pos++];
+      value += (byte & 0x7f) * scale;
+      scale *= 128;
+    } while (byte & 0x80);
+    return value;
+  }
+
+  /**
+    Reads a zigzag encoded varint, 0, 1, 2, 3, 4 are 0, -1, 1, -2, 2
+    @return {number} The number
+   */
+  private readSigned(): number {
+    const n: number = this.readVarint();
+    return (n % 2) ? -(n + 1) / 2 : n / 2;
+  }
+}
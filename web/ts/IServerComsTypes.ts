@@ -57,3 +57,26 @@ interface Analysis {
 interface IAnalysis {
   analysisFull: Array<Array<Analysis> | null>;
 }
+
+/**
+  A price level as [price, quantity]
+ */
+type DepthLevel = [number, number];
+
+/**
+  A level change as [side, price, quantity], side is 1 for bids and 0 for
+  asks. A quantity of 0 deletes the level.
+ */
+type DepthChange = [number, number, number];
+
+interface Depth {
+  seq: number;
+  snapshot: boolean;
+  bids?: DepthLevel[];
+  asks?: DepthLevel[];
+  changes?: DepthChange[];
+}
+
+interface IDepth {
+  depth: Depth;
+}
@@ -2,6 +2,7 @@ type SocketReadyFunc = () => any;
 type FullChartReceivedFunc = (cht: IChart) => any;
 type LatestCandleReceivedFunc = (cnd: ILatestCandle) => any;
 type AnalysisReceivedFunc = (anl: IAnalysis) => any;
+type DepthReceivedFunc = (dpt: IDepth) => any;
 
 /**
   An abstraction to websocket that allows for callback based server
@@ -27,6 +28,11 @@ class ServerComs { // eslint-disable-line no-unused-vars
 
   private onanalysisreceived: AnalysisReceivedFunc;
 
+  /**
+    Function to call when the server sends order book depth
+   */
+  private ondepthreceived: DepthReceivedFunc | null;
+
   /**
     Creates a new connection and sets up the bindings.
     @param {string} ip The servers ip address
@@ -37,17 +43,24 @@ class ServerComs { // eslint-disable-line no-unused-vars
     server sends latest candle information
     @param {AnalysisReceivedFunc} onanalysisreceived Function to call when
     the full analysis is sent from the server
+    @param {DepthReceivedFunc} ondepthreceived Function to call when order
+    book depth is sent from the server
    */
   constructor(ip: string, onsocketready: SocketReadyFunc,
       onfullchartreceived: FullChartReceivedFunc,
       onlatestcandlereceived: LatestCandleReceivedFunc,
-      onanalysisreceived: AnalysisReceivedFunc) {
-    this.socket = new WebSocket(ip, 'lws-minimal');
+      onanalysisreceived: AnalysisReceivedFunc,
+      ondepthreceived: DepthReceivedFunc | null = null) {
+    // riski-bin sends charts and candles as binary frames, lws-minimal is
+    // kept for servers without it
+    this.socket = new WebSocket(ip, ['riski-bin', 'lws-minimal']);
+    this.socket.binaryType = 'arraybuffer';
 
     this.onsocketready = onsocketready;
     this.onfullchartreceived = onfullchartreceived;
     this.onlatestcandlereceived = onlatestcandlereceived;
     this.onanalysisreceived = onanalysisreceived;
+    this.ondepthreceived = ondepthreceived;
 
     this.socket.onmessage = this.onmessage.bind(this);
     this.socket.onopen = this.onopen.bind(this);
@@ -55,17 +68,30 @@ class ServerComs { // eslint-disable-line no-unused-vars
     this.socket.onerror = this.onerror.bind(this);
   }
 
+  /**
+    The optional interval part of a chart request
+    @param {number} interval The candle length in seconds, 0 for the default
+    @return {string} The token to append to the request
+   */
+  private static intervalToken(interval: number): string {
+    return interval ? '|' + interval : '';
+  }
+
   /**
     Asks the server for the latest chart.
     @param {string} exchange The exchange to pull from
     @param {string} security The ticker/security symbol
+    @param {number} interval The candle length in seconds, 0 for the
+      default chart
     @return {boolean} Returns false if socket isn't open otherwize returns true.
    */
-  public getFullChart(exchange: string, security: string): boolean {
+  public getFullChart(exchange: string, security: string,
+      interval: number = 0): boolean {
     if (this.socket.readyState != this.socket.OPEN) {
       return false;
     } else {
-      this.socket.send('init|' + exchange + ':' + security);
+      this.socket.send('init|' + exchange + ':' + security +
+          ServerComs.intervalToken(interval));
       return true;
     }
   }
@@ -74,13 +100,17 @@ class ServerComs { // eslint-disable-line no-unused-vars
     Asks the server for the full analysis data
     @param {string} exchange The excahge to pull from
     @param {string} security The ticker/security symbol
+    @param {number} interval The candle length in seconds, 0 for the
+      default chart
     @return {boolean} Returns false if socket isn't open otherwize returns true.
    */
-  public getAnalysisData(exchange: string, security: string): boolean {
+  public getAnalysisData(exchange: string, security: string,
+      interval: number = 0): boolean {
     if (this.socket.readyState != this.socket.OPEN) {
       return false;
     } else {
-      this.socket.send('analysis|' + exchange + ':' + security);
+      this.socket.send('analysis|' + exchange + ':' + security +
+          ServerComs.intervalToken(interval));
       return true;
     }
   }
@@ -89,13 +119,106 @@ class ServerComs { // eslint-disable-line no-unused-vars
     Asks the server for the latest candle.
     @param {string} exchange The exchange to pull from
     @param {string} security The ticker/security symbol
+    @param {number} interval The candle length in seconds, 0 for the
+      default chart
     @return {boolean} Returns false if socket isn't open otherwize returns true.
    */
-  public getLatestCandle(exchange: string, security: string): boolean {
+  public getLatestCandle(exchange: string, security: string,
+      interval: number = 0): boolean {
     if (this.socket.readyState != this.socket.OPEN) {
       return false;
     } else {
-      this.socket.send('latest|' + exchange + ':' + security);
+      this.socket.send('latest|' + exchange + ':' + security +
+          ServerComs.intervalToken(interval));
+      return true;
+    }
+  }
+
+  /**
+    Asks the server to push the latest candle and the analysis of a chart
+    whenever they change. They arrive through the same callbacks as the
+    replies to getLatestCandle and getAnalysisData.
+    @param {string} exchange The exchange to pull from
+    @param {string} security The ticker/security symbol
+    @param {number} interval The candle length in seconds, 0 for the
+      default chart
+    @return {boolean} Returns false if socket isn't open otherwize returns true.
+   */
+  public subscribe(exchange: string, security: string,
+      interval: number = 0): boolean {
+    if (this.socket.readyState != this.socket.OPEN) {
+      return false;
+    } else {
+      this.socket.send('subscribe|' + exchange + ':' + security +
+          ServerComs.intervalToken(interval));
+      return true;
+    }
+  }
+
+  /**
+    Stops the pushes of a chart subscribed to
+    @param {string} exchange The exchange to pull from
+    @param {string} security The ticker/security symbol
+    @param {number} interval The candle length in seconds, 0 for the
+      default chart
+    @return {boolean} Returns false if socket isn't open otherwize returns true.
+   */
+  public unsubscribe(exchange: string, security: string,
+      interval: number = 0): boolean {
+    if (this.socket.readyState != this.socket.OPEN) {
+      return false;
+    } else {
+      this.socket.send('unsubscribe|' + exchange + ':' + security +
+          ServerComs.intervalToken(interval));
+      return true;
+    }
+  }
+
+  /**
+    Asks the server for the order book. With a seq of 0 the server sends a
+    snapshot of the top levels, otherwise only the levels that changed
+    after seq (or a snapshot if seq is too old).
+    @param {string} exchange The exchange to pull from
+    @param {string} security The ticker/security symbol
+    @param {number} seq The seq of the last depth applied
+    @return {boolean} Returns false if socket isn't open otherwize returns true.
+   */
+  public getDepth(exchange: string, security: string, seq: number): boolean {
+    if (this.socket.readyState != this.socket.OPEN) {
+      return false;
+    } else {
+      this.socket.send('depth|' + exchange + ':' + security + '|' + seq);
+      return true;
+    }
+  }
+
+  /**
+    Asks the server to push the order book whenever it changes, a snapshot
+    first and then the levels that changed since the last push
+    @param {string} exchange The exchange to pull from
+    @param {string} security The ticker/security symbol
+    @return {boolean} Returns false if socket isn't open otherwize returns true.
+   */
+  public subscribeDepth(exchange: string, security: string): boolean {
+    if (this.socket.readyState != this.socket.OPEN) {
+      return false;
+    } else {
+      this.socket.send('subscribe_depth|' + exchange + ':' + security);
+      return true;
+    }
+  }
+
+  /**
+    Stops the pushes of an order book subscribed to
+    @param {string} exchange The exchange to pull from
+    @param {string} security The ticker/security symbol
+    @return {boolean} Returns false if socket isn't open otherwize returns true.
+   */
+  public unsubscribeDepth(exchange: string, security: string): boolean {
+    if (this.socket.readyState != this.socket.OPEN) {
+      return false;
+    } else {
+      this.socket.send('unsubscribe_depth|' + exchange + ':' + security);
       return true;
     }
   }
@@ -103,9 +226,23 @@ class ServerComs { // eslint-disable-line no-unused-vars
   /**
     When a message is received this will get called and the function will
     dispatch the message to the callback designated with the json response.
+    Binary frames are decoded into the same objects as their json.
     @param {MessageEvent} evt The message event
    */
   private onmessage(evt: MessageEvent) {
+    if (evt.data instanceof ArrayBuffer) {
+      const frame: IChart | ILatestCandle | null =
+          new ChartBinDecoder(evt.data).decode();
+      if (!frame) {
+        console.error('Unknown binary frame from the server');
+      } else if ((<IChart>frame).chart !== undefined) {
+        this.onfullchartreceived(<IChart>frame);
+      } else {
+        this.onlatestcandlereceived(<ILatestCandle>frame);
+      }
+      return;
+    }
+
     /*
       When the message is received, identify the type of message and disburse
       invoke the callback function
@@ -117,6 +254,8 @@ class ServerComs { // eslint-disable-line no-unused-vars
       this.onlatestcandlereceived(<ILatestCandle>response);
     } else if (response['analysisFull']) {
       this.onanalysisreceived(<IAnalysis>response);
+    } else if (response['depth'] && this.ondepthreceived) {
+      this.ondepthreceived(<IDepth>response);
     }
   }
 
@@ -0,0 +1,102 @@
+/**
+  A local copy of a securities order book kept up to date from the depth
+  messages the server sends
+ */
+class OrderBook { // eslint-disable-line no-unused-vars
+  /**
+    Quantity by price for each side
+   */
+  private bids: {[price: string]: number} = {};
+  private asks: {[price: string]: number} = {};
+
+  /**
+    The number of levels per side in the last snapshot. Deltas only carry
+    levels that changed, once a side has fewer levels than the snapshot
+    the levels below it are unknown and a new snapshot is needed.
+   */
+  private snapshotDepth: number = 0;
+
+  /**
+    The seq of the last depth message applied, 0 if there is none
+   */
+  public seq: number = 0;
+
+  /**
+    Applies a depth message from the server
+    @param {IDepth} dpt The depth message
+   */
+  public apply(dpt: IDepth): void {
+    const depth: Depth = dpt.depth;
+
+    if (depth.snapshot) {
+      this.bids = {};
+      this.asks = {};
+      const bids: DepthLevel[] = depth.bids || [];
+      const asks: DepthLevel[] = depth.asks || [];
+      for (let i = 0; i < bids.length; ++i) {
+        this.bids[bids[i][0]] = bids[i][1];
+      }
+      for (let i = 0; i < asks.length; ++i) {
+        this.asks[asks[i][0]] = asks[i][1];
+      }
+      this.snapshotDepth = Math.max(bids.length, asks.length);
+    } else {
+      const changes: DepthChange[] = depth.changes || [];
+      for (let i = 0; i < changes.length; ++i) {
+        const side = (changes[i][0] == 1) ? this.bids : this.asks;
+        if (changes[i][2] == 0) {
+          delete side[changes[i][1]];
+        } else {
+          side[changes[i][1]] = changes[i][2];
+        }
+      }
+    }
+
+    this.seq = depth.seq;
+  }
+
+  /**
+    The seq to ask the server for next, 0 when a new snapshot is needed
+    @return {number} The seq
+   */
+  public nextSeq(): number {
+    if (Object.keys(this.bids).length < this.snapshotDepth ||
+        Object.keys(this.asks).length < this.snapshotDepth) {
+      return 0;
+    }
+    return this.seq;
+  }
+
+  /**
+    Gets the best bids, highest price first
+    @param {number} n The number of levels
+    @return {DepthLevel[]} The levels
+   */
+  public topBids(n: number): DepthLevel[] {
+    return OrderBook.top(this.bids, n, -1);
+  }
+
+  /**
+    Gets the best asks, lowest price first
+    @param {number} n The number of levels
+    @return {DepthLevel[]} The levels
+   */
+  public topAsks(n: number): DepthLevel[] {
+    return OrderBook.top(this.asks, n, 1);
+  }
+
+  /**
+    Sorts the levels of a side and returns the first n
+    @param {Object} side Quantity by price
+    @param {number} n The number of levels
+    @param {number} order 1 for ascending and -1 for descending prices
+    @return {DepthLevel[]} The levels
+   */
+  private static top(side: {[price: string]: number}, n: number,
+      order: number): DepthLevel[] {
+    const levels: DepthLevel[] = Object.keys(side).map(
+        (p: string): DepthLevel => [Number(p), side[p]]);
+    levels.sort((a: DepthLevel, b: DepthLevel) => order * (a[0] - b[0]));
+    return levels.slice(0, n);
+  }
+}
@@ -15,6 +15,7 @@ class Chart {// eslint-disable-line no-unused-vars
   private ChartOptions: HTMLDivElement;
   private ChartOptionsSearchIcon: HTMLObjectElement;
   private ChartOptionsSearchInput: HTMLInputElement;
+  private ChartOptionsInterval: HTMLSelectElement;
   private ChartCandleView: ChartCandleView | null = null;
 
   /**
@@ -22,7 +23,29 @@ class Chart {// eslint-disable-line no-unused-vars
    */
   private Exchange: string = 'IEX';
   private Symbol: string = 'SPY';
-  private ExchangeSymbolChange: boolean = false;
+
+  /**
+    The chart the server is pushing changes of, null before the first
+    subscription
+   */
+  private Subscribed: [string, string, number] | null = null;
+
+  /**
+    True from asking for a new chart until it arrives, pushes that come in
+    between are for the chart before it
+   */
+  private WaitingForChart: boolean = false;
+
+  /**
+    True from asking for the chart again after a new candle started until
+    it arrives, the candles pushed in between are newer than the chart
+   */
+  private RefreshingChart: boolean = false;
+
+  /**
+    The candle length in seconds, 0 for the default chart of the server
+   */
+  private Interval: number = 0;
 
   private Server: string = 'ws://riski.sh:7681';
 
@@ -85,7 +108,7 @@ class Chart {// eslint-disable-line no-unused-vars
       if (evt.keyCode == 13) { // enter
         this.Exchange = this.ChartOptionsSearchInput.value.split(':')[0];
         this.Symbol = this.ChartOptionsSearchInput.value.split(':')[1];
-        this.ExchangeSymbolChange = true;
+        this.resubscribe();
       }
     });
 
@@ -109,6 +132,30 @@ class Chart {// eslint-disable-line no-unused-vars
 
     this.ChartOptions.appendChild(this.ChartOptionsSearchIcon);
 
+    this.ChartOptionsInterval =
+      document.createElement('select') as HTMLSelectElement;
+    this.ChartOptionsInterval.style.backgroundColor = this.Theme.bg;
+    this.ChartOptionsInterval.style.color = this.Theme.fg;
+    this.ChartOptionsInterval.style.border = 'none';
+
+    // 0 is the base chart of the symbol, the others are only kept by the
+    // server when riski was started with them, see -intervals
+    const intervals: [string, number][] = [['base', 0], ['5s', 5],
+      ['1m', 60], ['5m', 300], ['1h', 3600]];
+    for (let i = 0; i < intervals.length; ++i) {
+      const option: HTMLOptionElement =
+        document.createElement('option') as HTMLOptionElement;
+      option.text = intervals[i][0];
+      option.value = intervals[i][1].toString();
+      this.ChartOptionsInterval.appendChild(option);
+    }
+
+    this.ChartOptionsInterval.onchange = ((evt: Event) => {
+      this.Interval = Number(this.ChartOptionsInterval.value);
+      this.resubscribe();
+    });
+
+    this.ChartOptions.appendChild(this.ChartOptionsInterval);
 
     // Create the two canvas
     this.CandleChart =
@@ -127,6 +174,21 @@ class Chart {// eslint-disable-line no-unused-vars
         this.analysisreceivedfunc.bind(this));
   }
 
+  /**
+    Moves the subscription to the current exchange, symbol and interval and
+    asks for its full chart, the server pushes the changes after it
+   */
+  private resubscribe(): void {
+    if (this.Subscribed) {
+      this.Socket.unsubscribe(this.Subscribed[0], this.Subscribed[1],
+          this.Subscribed[2]);
+    }
+    this.WaitingForChart = true;
+    this.Socket.getFullChart(this.Exchange, this.Symbol, this.Interval);
+    this.Socket.subscribe(this.Exchange, this.Symbol, this.Interval);
+    this.Subscribed = [this.Exchange, this.Symbol, this.Interval];
+  }
+
   /**
     Callback for when the socket has opened up and connected
     successfully.
@@ -135,7 +197,7 @@ class Chart {// eslint-disable-line no-unused-vars
     console.log('Connected to ws://localhost:7681');
 
     // start up the chart candle view
-    this.Socket.getFullChart(this.Exchange, this.Symbol);
+    this.resubscribe();
   }
 
   /**
@@ -148,42 +210,34 @@ class Chart {// eslint-disable-line no-unused-vars
     } else {
       this.ChartCandleView = new ChartCandleView(this.CandleChart, cht);
     }
-    this.Socket.getLatestCandle(this.Exchange, this.Symbol);
+    this.WaitingForChart = false;
+    this.RefreshingChart = false;
   }
 
   /**
-    Callback when the server sends the latest candle data
+    Callback when the server pushes the latest candle data
     @param {ILatestCandle} cnd The latest candle
    */
   private onlatestcandlereceived(cnd: ILatestCandle): void {
-    if (this.ExchangeSymbolChange) {
-      this.ExchangeSymbolChange = false;
-      this.Socket.getFullChart(this.Exchange, this.Symbol);
+    if (this.WaitingForChart || this.RefreshingChart ||
+        !this.ChartCandleView) {
       return;
     }
-    if (this.ChartCandleView) {
-      if (!this.ChartCandleView.chartPartialUpdate(cnd)) {
-        this.Socket.getAnalysisData(this.Exchange, this.Symbol);
-        // this.Socket.getFullChart(this.Exchange, this.Symbol);
-      } else {
-        this.Socket.getLatestCandle(this.Exchange, this.Symbol);
-      }
+    if (!this.ChartCandleView.chartPartialUpdate(cnd)) {
+      // a new candle started, the chart only has the ones before it
+      this.RefreshingChart = true;
+      this.Socket.getFullChart(this.Exchange, this.Symbol, this.Interval);
     }
   }
 
   /**
-    Callback when the server sends analysis data back.
+    Callback when the server pushes analysis data.
     @param {IAnalysis} anl The analysis data
    */
   private analysisreceivedfunc(anl: IAnalysis): void {
-    if (this.ExchangeSymbolChange) {
-      this.ExchangeSymbolChange = false;
-      this.Socket.getFullChart(this.Exchange, this.Symbol);
+    if (this.WaitingForChart || !this.ChartCandleView) {
       return;
     }
-    if (this.ChartCandleView) {
-      this.ChartCandleView.fullAnalysisUpdate(anl);
-    }
-    this.Socket.getFullChart(this.Exchange, this.Symbol);
+    this.ChartCandleView.fullAnalysisUpdate(anl);
   }
 }